@@ -27,6 +27,9 @@ impl PhysicalMemory for NullMem {
         PhysicalMemoryMetadata {
             size: 0,
             readonly: true,
+            preferred_batch_size: 0,
+            max_in_flight: 0,
+            coalesce_size: 0,
         }
     }
 }
@@ -0,0 +1,96 @@
+use criterion::*;
+
+use memflow::iter::FnExtend;
+use memflow::prelude::v1::*;
+
+use rand::prelude::*;
+use rand::{Rng, SeedableRng};
+use rand_xorshift::XorShiftRng as CurRng;
+
+const RANGE_SIZE: usize = size::kb(64);
+
+/// Creates a map of `range_count` ranges, every range is followed by a hole of the same size.
+fn fragmented_map(range_count: usize) -> MemoryMap<(Address, usize)> {
+    let mut map = MemoryMap::new();
+    for i in 0..range_count {
+        map.push_remap(
+            Address::from(i * RANGE_SIZE * 2),
+            RANGE_SIZE,
+            Address::from(i * RANGE_SIZE),
+        );
+    }
+    map
+}
+
+fn map_test(map: &MemoryMap<(Address, usize)>, addrs: &[(PhysicalAddress, usize)]) {
+    let mut void = FnExtend::void();
+    black_box(map.map_iter(addrs.iter().copied(), &mut void).count());
+}
+
+fn map_params(
+    group: &mut BenchmarkGroup<'_, measurement::WallTime>,
+    func_name: String,
+    range_count: usize,
+    sequential: bool,
+) {
+    let map = fragmented_map(range_count);
+    let map_size = range_count * RANGE_SIZE * 2;
+
+    for &chunk_size in [1, 4, 16, 64, 256, 1024, 4096].iter() {
+        let mut rng = CurRng::from_rng(thread_rng()).unwrap();
+
+        let mut addrs = vec![(PhysicalAddress::INVALID, 8); chunk_size];
+        let base_addr = rng.gen_range(0, map_size);
+        for (i, (addr, _)) in addrs.iter_mut().enumerate() {
+            *addr = if sequential {
+                Address::from((base_addr + i * 0x100) % map_size).into()
+            } else {
+                Address::from(rng.gen_range(0, map_size)).into()
+            };
+        }
+
+        group.throughput(Throughput::Elements(chunk_size as u64));
+        group.bench_with_input(
+            BenchmarkId::new(func_name.clone(), chunk_size),
+            &chunk_size,
+            |b, _| b.iter(|| map_test(&map, &addrs)),
+        );
+    }
+}
+
+fn map_lookup(c: &mut Criterion, range_count: usize) {
+    let plot_config = PlotConfiguration::default().summary_scale(AxisScale::Logarithmic);
+
+    let group_name = format!("mem_map_{}_ranges", range_count);
+
+    let mut group = c.benchmark_group(group_name.clone());
+    group.plot_config(plot_config);
+
+    map_params(
+        &mut group,
+        format!("{}_sequential", group_name),
+        range_count,
+        true,
+    );
+    map_params(
+        &mut group,
+        format!("{}_random", group_name),
+        range_count,
+        false,
+    );
+}
+
+fn mem_map_group(c: &mut Criterion) {
+    map_lookup(c, 4);
+    map_lookup(c, 1000);
+}
+
+criterion_group! {
+    name = mem_map;
+    config = Criterion::default()
+        .warm_up_time(std::time::Duration::from_millis(300))
+        .measurement_time(std::time::Duration::from_millis(2700));
+    targets = mem_map_group
+}
+
+criterion_main!(mem_map);
@@ -6,6 +6,9 @@ use criterion::*;
 use memflow::mem::dummy::{DummyMemory as Memory, DummyModule, DummyProcess};
 use memflow::prelude::v1::*;
 
+#[global_allocator]
+static ALLOCATOR: virt::CountingAllocator = virt::CountingAllocator;
+
 fn initialize_virt_ctx() -> Result<(
     Memory,
     DirectTranslate,
@@ -23,12 +26,33 @@ fn initialize_virt_ctx() -> Result<(
     Ok((mem, vat, proc, translator, module))
 }
 
+fn initialize_virt_ctx_generic() -> Result<(
+    Memory,
+    DirectTranslate,
+    DummyProcess,
+    impl ScopedVirtualTranslate,
+    DummyModule,
+)> {
+    let mut mem = Memory::new(size::mb(64));
+
+    let vat = DirectTranslate::new();
+
+    let proc = mem.alloc_process(size::mb(60), &[]);
+    let module = proc.get_module(size::mb(4));
+    let translator = proc.translator_generic();
+    Ok((mem, vat, proc, translator, module))
+}
+
 fn dummy_read_group(c: &mut Criterion) {
     virt::seq_read(c, "dummy", &initialize_virt_ctx);
     virt::chunk_read(c, "dummy", &initialize_virt_ctx);
+    virt::alloc_read(c, "dummy", &initialize_virt_ctx);
+    virt::coalesce_read(c, "dummy", &initialize_virt_ctx);
     phys::seq_read(c, "dummy", &|| Ok(Memory::new(size::mb(64))));
     phys::chunk_read(c, "dummy", &|| Ok(Memory::new(size::mb(64))));
+    phys::batch_size_sweep(c, "dummy", &|| Ok(Memory::new(size::mb(64))));
     vat::chunk_vat(c, "dummy", &initialize_virt_ctx);
+    vat::chunk_vat(c, "dummy_generic_walk", &initialize_virt_ctx_generic);
 }
 
 criterion_group! {
@@ -72,6 +72,7 @@ fn win32_read_group(c: &mut Criterion) {
     virt::chunk_read(c, "win32", &initialize_virt_ctx);
     phys::seq_read(c, "win32", &|| create_connector(&ConnectorArgs::new()));
     phys::chunk_read(c, "win32", &|| create_connector(&ConnectorArgs::new()));
+    phys::batch_size_sweep(c, "win32", &|| create_connector(&ConnectorArgs::new()));
     vat::chunk_vat(c, "win32", &initialize_virt_ctx);
 }
 
@@ -1,6 +1,6 @@
 use criterion::*;
 
-use memflow::mem::{CachedMemoryAccess, PhysicalMemory};
+use memflow::mem::{CachedMemoryAccess, PhysicalMemory, PhysicalMemoryMetadata, PhysicalWriteData};
 
 use memflow::architecture;
 use memflow::error::Result;
@@ -11,6 +11,29 @@ use rand::prelude::*;
 use rand::{Rng, SeedableRng};
 use rand_xorshift::XorShiftRng as CurRng;
 
+/// Wraps a memory backend and overrides the batching it advertises to the cache.
+struct BatchedMem<T> {
+    mem: T,
+    preferred_batch_size: usize,
+}
+
+impl<T: PhysicalMemory> PhysicalMemory for BatchedMem<T> {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.mem.phys_read_raw_list(data)
+    }
+
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.mem.phys_write_raw_list(data)
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        PhysicalMemoryMetadata {
+            preferred_batch_size: self.preferred_batch_size,
+            ..self.mem.metadata()
+        }
+    }
+}
+
 fn rwtest<T: PhysicalMemory>(
     bench: &mut Bencher,
     mem: &mut T,
@@ -204,3 +227,47 @@ pub fn chunk_read<T: PhysicalMemory>(
         initialize_ctx,
     );
 }
+
+fn batch_size_params<T: PhysicalMemory>(
+    group: &mut BenchmarkGroup<'_, measurement::WallTime>,
+    func_name: String,
+    initialize_ctx: &dyn Fn() -> Result<T>,
+) {
+    let size = 0x100;
+    let chunk_size = 1024;
+
+    for &batch_size in [1, 16, 64, 256, 1024].iter() {
+        group.throughput(Throughput::Bytes(size * chunk_size));
+        group.bench_with_input(
+            BenchmarkId::new(func_name.clone(), batch_size),
+            &batch_size,
+            |b, &batch_size| {
+                read_test_with_ctx(
+                    b,
+                    black_box(2),
+                    black_box(size as usize),
+                    black_box(chunk_size as usize),
+                    BatchedMem {
+                        mem: initialize_ctx().unwrap(),
+                        preferred_batch_size: batch_size,
+                    },
+                )
+            },
+        );
+    }
+}
+
+pub fn batch_size_sweep<T: PhysicalMemory>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<T>,
+) {
+    let plot_config = PlotConfiguration::default().summary_scale(AxisScale::Logarithmic);
+
+    let group_name = format!("{}_phys_batch_sweep", backend_name);
+
+    let mut group = c.benchmark_group(group_name.clone());
+    group.plot_config(plot_config);
+
+    batch_size_params(&mut group, format!("{}_cache", group_name), initialize_ctx);
+}
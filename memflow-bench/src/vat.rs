@@ -73,19 +73,20 @@ fn vat_test_with_ctx<
     cache_size: u64,
     chunks: usize,
     translations: usize,
-    use_tlb: bool,
+    tlb_ways: usize,
     (mut mem, mut vat, prc, translator, tmod): (T, V, P, S, M),
-) {
+) -> (usize, usize) {
     if cache_size > 0 {
         let cache = CachedMemoryAccess::builder(&mut mem)
             .arch(prc.sys_arch())
             .cache_size(size::mb(cache_size as usize))
             .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE);
 
-        if use_tlb {
+        if tlb_ways > 0 {
             let mut mem = cache.build().unwrap();
             let mut vat = CachedVirtualTranslate::builder(vat)
                 .arch(prc.sys_arch())
+                .ways(tlb_ways)
                 .build()
                 .unwrap();
             vat_test_with_mem(
@@ -97,6 +98,7 @@ fn vat_test_with_ctx<
                 translator,
                 tmod,
             );
+            (vat.hitc, vat.misc)
         } else {
             let mut mem = cache.build().unwrap();
             vat_test_with_mem(
@@ -108,10 +110,12 @@ fn vat_test_with_ctx<
                 translator,
                 tmod,
             );
+            (0, 0)
         }
-    } else if use_tlb {
+    } else if tlb_ways > 0 {
         let mut vat = CachedVirtualTranslate::builder(vat)
             .arch(prc.sys_arch())
+            .ways(tlb_ways)
             .build()
             .unwrap();
         vat_test_with_mem(
@@ -123,6 +127,7 @@ fn vat_test_with_ctx<
             translator,
             tmod,
         );
+        (vat.hitc, vat.misc)
     } else {
         vat_test_with_mem(
             bench,
@@ -133,6 +138,7 @@ fn vat_test_with_ctx<
             translator,
             tmod,
         );
+        (0, 0)
     }
 }
 
@@ -146,26 +152,40 @@ fn chunk_vat_params<
     group: &mut BenchmarkGroup<'_, measurement::WallTime>,
     func_name: String,
     cache_size: u64,
-    use_tlb: bool,
+    tlb_ways: usize,
     initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
 ) {
     let size = 0x10;
     for &chunk_size in [1, 4, 16, 64].iter() {
+        let mut hitc = 0;
+        let mut misc = 0;
+
         group.throughput(Throughput::Elements(chunk_size * size));
         group.bench_with_input(
             BenchmarkId::new(func_name.clone(), chunk_size),
             &size,
             |b, &size| {
-                vat_test_with_ctx(
+                let (hits, misses) = vat_test_with_ctx(
                     b,
                     black_box(cache_size),
                     black_box(chunk_size as usize),
                     black_box((size * chunk_size) as usize),
-                    black_box(use_tlb),
+                    black_box(tlb_ways),
                     initialize_ctx().unwrap(),
-                )
+                );
+                hitc += hits;
+                misc += misses;
             },
         );
+
+        if hitc + misc > 0 {
+            println!(
+                "{}/{}: tlb hit rate {:.2}%",
+                func_name,
+                chunk_size,
+                hitc as f64 * 100.0 / (hitc + misc) as f64
+            );
+        }
     }
 }
 
@@ -191,28 +211,42 @@ pub fn chunk_vat<
         &mut group,
         format!("{}_nocache", group_name),
         0,
-        false,
+        0,
         initialize_ctx,
     );
     chunk_vat_params(
         &mut group,
         format!("{}_tlb_nocache", group_name),
         0,
-        true,
+        1,
+        initialize_ctx,
+    );
+    chunk_vat_params(
+        &mut group,
+        format!("{}_tlb4way_nocache", group_name),
+        0,
+        4,
         initialize_ctx,
     );
     chunk_vat_params(
         &mut group,
         format!("{}_cache", group_name),
         2,
-        false,
+        0,
         initialize_ctx,
     );
     chunk_vat_params(
         &mut group,
         format!("{}_tlb_cache", group_name),
         2,
-        true,
+        1,
+        initialize_ctx,
+    );
+    chunk_vat_params(
+        &mut group,
+        format!("{}_tlb4way_cache", group_name),
+        2,
+        4,
         initialize_ctx,
     );
 }
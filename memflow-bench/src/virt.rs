@@ -1,8 +1,9 @@
 use criterion::*;
 
 use memflow::mem::{
-    CachedMemoryAccess, CachedVirtualTranslate, PhysicalMemory, VirtualDMA, VirtualMemory,
-    VirtualReadData, VirtualTranslate,
+    CachedMemoryAccess, CachedVirtualTranslate, PhysicalMemory, PhysicalMemoryMetadata,
+    PhysicalReadData, PhysicalWriteData, VirtualDMA, VirtualMemory, VirtualReadData,
+    VirtualTranslate,
 };
 
 use memflow::architecture::ScopedVirtualTranslate;
@@ -14,6 +15,38 @@ use rand::prelude::*;
 use rand::{Rng, SeedableRng};
 use rand_xorshift::XorShiftRng as CurRng;
 
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+static ALLOCATIONS: AtomicUsize = AtomicUsize::new(0);
+
+/// Allocator that counts all allocations of the process.
+///
+/// Benchmark binaries have to register it as their `#[global_allocator]`,
+/// otherwise `alloc_read` can not observe any allocations.
+pub struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
 fn rwtest<T: VirtualMemory, M: OsProcessModuleInfo>(
     bench: &mut Bencher,
     virt_mem: &mut T,
@@ -287,3 +320,196 @@ pub fn chunk_read<
         initialize_ctx,
     );
 }
+
+/// Wraps a memory backend and overrides the read coalescing it advertises to `VirtualDMA`.
+struct CoalescedMem<T> {
+    mem: T,
+    coalesce_size: usize,
+}
+
+impl<T: PhysicalMemory> PhysicalMemory for CoalescedMem<T> {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.mem.phys_read_raw_list(data)
+    }
+
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.mem.phys_write_raw_list(data)
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        PhysicalMemoryMetadata {
+            coalesce_size: self.coalesce_size,
+            ..self.mem.metadata()
+        }
+    }
+}
+
+fn coalesce_read_params<
+    T: PhysicalMemory,
+    V: VirtualTranslate,
+    P: OsProcessInfo,
+    S: ScopedVirtualTranslate,
+    M: OsProcessModuleInfo,
+>(
+    group: &mut BenchmarkGroup<'_, measurement::WallTime>,
+    func_name: String,
+    coalesce_size: usize,
+    initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
+) {
+    for &size in [0x2000, 0x10000, 0x100000].iter() {
+        group.throughput(Throughput::Bytes(size));
+        group.bench_with_input(
+            BenchmarkId::new(func_name.clone(), size),
+            &size,
+            |b, &size| {
+                let (mem, vat, proc, translator, tmod) = initialize_ctx().unwrap();
+                let mem = CoalescedMem { mem, coalesce_size };
+                let mut virt_mem = VirtualDMA::with_vat(mem, proc.proc_arch(), translator, vat);
+                read_test_with_mem(b, &mut virt_mem, black_box(size as usize), 1, tmod);
+            },
+        );
+    }
+}
+
+/// Benchmarks multi page reads with and without coalescing of physically contiguous chunks.
+///
+/// The gain depends on the cost of a single request of the backend,
+/// for memory mapped backends merging mostly adds the cost of the bounce buffer.
+pub fn coalesce_read<
+    T: PhysicalMemory,
+    V: VirtualTranslate,
+    P: OsProcessInfo,
+    S: ScopedVirtualTranslate,
+    M: OsProcessModuleInfo,
+>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
+) {
+    let plot_config = PlotConfiguration::default().summary_scale(AxisScale::Logarithmic);
+
+    let group_name = format!("{}_virt_coalesce_read", backend_name);
+
+    let mut group = c.benchmark_group(group_name.clone());
+    group.plot_config(plot_config);
+
+    coalesce_read_params(
+        &mut group,
+        format!("{}_without", group_name),
+        0,
+        initialize_ctx,
+    );
+    coalesce_read_params(
+        &mut group,
+        format!("{}_with", group_name),
+        size::mb(1),
+        initialize_ctx,
+    );
+}
+
+/// Returns the amount of allocations `f` performs per call once it has been warmed up.
+fn allocations_per_call<F: FnMut()>(calls: usize, mut f: F) -> f64 {
+    f();
+    let start = ALLOCATIONS.load(Ordering::Relaxed);
+    for _ in 0..calls {
+        f();
+    }
+    (ALLOCATIONS.load(Ordering::Relaxed) - start) as f64 / calls as f64
+}
+
+fn alloc_read_with_mem<T: VirtualMemory, M: OsProcessModuleInfo>(
+    group: &mut BenchmarkGroup<'_, measurement::WallTime>,
+    func_name: &str,
+    virt_mem: &mut T,
+    module: &M,
+    alloc_free: bool,
+) {
+    // aligned so that no read crosses a page boundary
+    let mut rng = CurRng::from_rng(thread_rng()).unwrap();
+    let addrs = (0..0x400)
+        .map(|_| module.base() + (rng.gen_range(0, module.size() - 0x40) & !0x3f))
+        .collect::<Vec<Address>>();
+
+    let mut idx = 0;
+    let mut next_addr = move || {
+        idx = (idx + 1) % addrs.len();
+        addrs[idx]
+    };
+
+    let mut buf = [0u8; 0x40];
+    let reads: [(&str, &mut dyn FnMut(&mut T, Address)); 2] = [
+        ("read_u64", &mut |virt_mem: &mut T, addr| {
+            let mut out = 0u64;
+            let _ = black_box(virt_mem.virt_read_into(addr, &mut out));
+        }),
+        ("read_cstr_into", &mut |virt_mem: &mut T, addr| {
+            let _ = black_box(virt_mem.virt_read_cstr_into(addr, &mut buf));
+        }),
+    ];
+
+    for (name, read) in reads.iter_mut() {
+        let allocs = allocations_per_call(0x1000, || read(virt_mem, next_addr()));
+        println!("{}_{}: {} allocations per read", func_name, name, allocs);
+        if alloc_free {
+            assert_eq!(
+                allocs, 0.0,
+                "{}_{} is expected to not allocate",
+                func_name, name
+            );
+        }
+
+        group.throughput(Throughput::Elements(1));
+        group.bench_function(BenchmarkId::new(func_name, name), |b| {
+            b.iter(|| read(virt_mem, next_addr()))
+        });
+    }
+}
+
+/// Benchmarks small reads and reports the amount of allocations they perform.
+///
+/// Reads through an uncached `VirtualDMA` are required to be allocation free,
+/// the benchmark panics if one of them allocates.
+pub fn alloc_read<
+    T: PhysicalMemory,
+    V: VirtualTranslate,
+    P: OsProcessInfo,
+    S: ScopedVirtualTranslate,
+    M: OsProcessModuleInfo,
+>(
+    c: &mut Criterion,
+    backend_name: &str,
+    initialize_ctx: &dyn Fn() -> Result<(T, V, P, S, M)>,
+) {
+    let group_name = format!("{}_virt_alloc_read", backend_name);
+    let mut group = c.benchmark_group(group_name.clone());
+
+    let (mem, vat, proc, translator, tmod) = initialize_ctx().unwrap();
+    let mut virt_mem = VirtualDMA::with_vat(mem, proc.proc_arch(), translator, vat);
+    alloc_read_with_mem(
+        &mut group,
+        &format!("{}_nocache", group_name),
+        &mut virt_mem,
+        &tmod,
+        true,
+    );
+
+    let (mem, vat, proc, translator, tmod) = initialize_ctx().unwrap();
+    let mem = CachedMemoryAccess::builder(mem)
+        .arch(proc.sys_arch())
+        .cache_size(size::mb(2))
+        .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE)
+        .build()
+        .unwrap();
+    let vat = CachedVirtualTranslate::builder(vat)
+        .arch(proc.sys_arch())
+        .build()
+        .unwrap();
+    let mut virt_mem = VirtualDMA::with_vat(mem, proc.proc_arch(), translator, vat);
+    alloc_read_with_mem(
+        &mut group,
+        &format!("{}_tlb_cache", group_name),
+        &mut virt_mem,
+        &tmod,
+        false,
+    );
+}
@@ -0,0 +1,486 @@
+// End-to-end benchmarks of the C++ bindings against the dummy connector.
+//
+// The scenarios, benchmark names and timings mirror the criterion benchmarks of `memflow-bench`
+// (`read_dummy.rs` and `batcher.rs`), so the results of both suites can be compared directly,
+// the difference between them is the overhead of the FFI layer and the C++ wrappers.
+//
+// The suite uses a minimal built-in harness with a Google Benchmark compatible interface.
+// Build it with `GOOGLE_BENCHMARK=1` to run the same benchmarks on Google Benchmark instead.
+//
+// The static library has to be built with the dummy connector:
+// cargo build --release -p memflow-ffi --features dummy_mem
+
+#include "memflow_cpp.h"
+
+#include <array>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef USE_GOOGLE_BENCHMARK
+#include <benchmark/benchmark.h>
+#else
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <regex>
+
+namespace benchmark {
+
+// Subset of `benchmark::State` that is used by this suite, timing starts on the first
+// iteration of the `for (auto _ : state)` loop and stops once the loop is done.
+class State
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct __attribute__((unused)) Value {};
+
+    struct Iterator {
+        State *state;
+        uint64_t remaining;
+
+        Value operator*() const {
+            return Value {};
+        }
+
+        Iterator &operator++() {
+            this->remaining--;
+            return *this;
+        }
+
+        bool operator!=(const Iterator &) {
+            if (this->remaining) {
+                return true;
+            }
+            this->state->stop = clock::now();
+            this->state->finished = true;
+            return false;
+        }
+    };
+
+    explicit State(uint64_t iterations)
+        : max_iterations(iterations), bytes(0), finished(false) {}
+
+    Iterator begin() {
+        this->start = clock::now();
+        return Iterator { this, this->max_iterations };
+    }
+
+    Iterator end() {
+        return Iterator { this, 0 };
+    }
+
+    uint64_t iterations() const {
+        return this->max_iterations;
+    }
+
+    void SetBytesProcessed(int64_t bytes) {
+        this->bytes = bytes;
+    }
+
+    double elapsed() const {
+        return std::chrono::duration<double>(this->stop - this->start).count();
+    }
+
+    int64_t bytes_processed() const {
+        return this->bytes;
+    }
+
+    // Returns false if the benchmark returned before running its loop, e.g. on a setup error
+    bool done() const {
+        return this->finished;
+    }
+
+private:
+    uint64_t max_iterations;
+    int64_t bytes;
+    bool finished;
+    clock::time_point start;
+    clock::time_point stop;
+};
+
+template<typename T>
+inline void DoNotOptimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+namespace internal {
+
+// Same warm-up time as the criterion configuration of `memflow-bench`
+static const double WARM_UP_TIME = 0.3;
+
+struct Benchmark
+{
+    std::string name;
+    std::function<void(State &)> fn;
+    double min_time;
+
+    Benchmark *MinTime(double time) {
+        this->min_time = time;
+        return this;
+    }
+
+    void run() {
+        // grow the iterations until the warm-up time is reached to estimate the iteration time,
+        // short runs grow faster so the setup of the benchmark is not repeated too often
+        uint64_t iterations = 1;
+        double warm_up = 0, per_iteration = 0;
+        while (warm_up < WARM_UP_TIME) {
+            State state(iterations);
+            this->fn(state);
+            if (!state.done()) {
+                printf("%-64s failed\n", this->name.c_str());
+                return;
+            }
+            warm_up += state.elapsed();
+            per_iteration = state.elapsed() / iterations;
+            iterations *= state.elapsed() < WARM_UP_TIME / 100 ? 10 : 2;
+        }
+
+        iterations = per_iteration > 0 ? (uint64_t)(this->min_time / per_iteration) : iterations;
+        State state(iterations ? iterations : 1);
+        this->fn(state);
+
+        double ns = state.elapsed() * 1e9 / state.iterations();
+        double mib = state.bytes_processed() / state.elapsed() / (1024.0 * 1024.0);
+        printf("%-64s %12.1f ns %12llu %12.2f MiB/s\n",
+            this->name.c_str(), ns, (unsigned long long)state.iterations(), mib);
+        fflush(stdout);
+    }
+};
+
+static std::vector<std::unique_ptr<Benchmark>> &registry() {
+    static std::vector<std::unique_ptr<Benchmark>> benchmarks;
+    return benchmarks;
+}
+
+static std::string &filter() {
+    static std::string filter = ".";
+    return filter;
+}
+
+}
+
+template<typename F>
+internal::Benchmark *RegisterBenchmark(const char *name, F fn) {
+    internal::registry().emplace_back(new internal::Benchmark { name, fn, 1.0 });
+    return internal::registry().back().get();
+}
+
+// Accepts `--benchmark_filter=<regex>`
+inline void Initialize(int *argc, char **argv) {
+    const std::string prefix = "--benchmark_filter=";
+    for (int i = 1; i < *argc; i++) {
+        std::string arg = argv[i];
+        if (!arg.compare(0, prefix.size(), prefix)) {
+            internal::filter() = arg.substr(prefix.size());
+        }
+    }
+}
+
+inline size_t RunSpecifiedBenchmarks() {
+    std::regex filter(internal::filter());
+    size_t ran = 0;
+    for (auto &bench : internal::registry()) {
+        if (std::regex_search(bench->name, filter)) {
+            bench->run();
+            ran++;
+        }
+    }
+    return ran;
+}
+
+}
+#endif
+
+// Same measurement time as the criterion configuration of `memflow-bench`
+static const double MEASUREMENT_TIME = 2.7;
+
+static const uintptr_t MB = 1024 * 1024;
+
+struct VirtConfig {
+    const char *name;
+    uintptr_t cache_size;
+    bool use_tlb;
+};
+
+static const VirtConfig VIRT_CONFIGS[] = {
+    { "nocache", 0, false },
+    { "tlb_nocache", 0, true },
+    { "cache", 2 * MB, false },
+    { "tlb_cache", 2 * MB, true },
+};
+
+struct PhysConfig {
+    const char *name;
+    uintptr_t cache_size;
+};
+
+static const PhysConfig PHYS_CONFIGS[] = {
+    { "nocache", 0 },
+    { "cache", 2 * MB },
+};
+
+static const uint64_t SEQ_SIZES[] = { 0x8, 0x10, 0x100, 0x1000, 0x10000 };
+static const uint64_t CHUNK_SIZES[] = { 0x8, 0x10, 0x100, 0x1000 };
+static const uint64_t CHUNK_COUNTS[] = { 1, 4, 16, 64 };
+static const uint64_t BATCH_COUNTS[] = { 1, 4, 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+// The process layout of `initialize_virt_ctx` in `read_dummy.rs`
+struct DummyProcess
+{
+    Address module_base;
+    uintptr_t module_len;
+    CVirtualMemory mem;
+
+    DummyProcess(const VirtConfig &config)
+        : module_base(0), module_len(0),
+        mem(::dummy_virt_new(64 * MB, 60 * MB, 4 * MB, config.cache_size, config.use_tlb,
+            &module_base, &module_len)) {}
+
+    ~DummyProcess() {
+        if (this->mem.inner) {
+            ::dummy_virt_free(this->mem.invalidate());
+        }
+    }
+};
+
+static uint64_t gen_range(std::mt19937_64 &rng, uint64_t low, uint64_t high) {
+    return std::uniform_int_distribution<uint64_t>(low, high - 1)(rng);
+}
+
+// Same encoding as `PhysicalAddress::with_page`
+static PhysicalAddress paddr_with_page(Address address, PageType page_type, uint64_t page_size) {
+    uint8_t bits = 0;
+    while (page_size >> bits) {
+        bits++;
+    }
+    return PhysicalAddress { address, page_type, (uint8_t)(bits - 2) };
+}
+
+static std::string bench_name(const std::string &group, const std::string &func, uint64_t param) {
+    return group + "/" + func + "/" + std::to_string(param);
+}
+
+static std::string hex(uint64_t value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%llx", (unsigned long long)value);
+    return buf;
+}
+
+// `virt::seq_read` and `virt::chunk_read`, a single list read of `chunks` random entries
+static void virt_read(benchmark::State &state, const VirtConfig &config, uint64_t size, uint64_t chunks) {
+    DummyProcess proc(config);
+    if (!proc.mem.inner) {
+        return;
+    }
+
+    std::mt19937_64 rng(std::random_device {}());
+    Address base = gen_range(rng, proc.module_base, proc.module_base + proc.module_len);
+
+    std::vector<std::vector<uint8_t>> bufs(chunks, std::vector<uint8_t>(size));
+    std::vector<VirtualReadEntry> read_list;
+    for (std::vector<uint8_t> &buf : bufs) {
+        read_list.push_back(VirtualReadEntry { base + gen_range(rng, 0, 0x2000), buf.data(), buf.size() });
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            proc.mem.virt_read_raw_list(read_list.data(), read_list.size()));
+    }
+
+    state.SetBytesProcessed(state.iterations() * size * chunks);
+}
+
+// Same reads as `virt_read`, but queued into a `CVirtualBatcher` on every iteration
+static void virt_batcher_read(benchmark::State &state, const VirtConfig &config, uint64_t size, uint64_t chunks) {
+    DummyProcess proc(config);
+    if (!proc.mem.inner) {
+        return;
+    }
+
+    std::mt19937_64 rng(std::random_device {}());
+    Address base = gen_range(rng, proc.module_base, proc.module_base + proc.module_len);
+
+    std::vector<std::vector<uint8_t>> bufs(chunks, std::vector<uint8_t>(size));
+    std::vector<Address> addrs;
+    for (size_t i = 0; i < chunks; i++) {
+        addrs.push_back(base + gen_range(rng, 0, 0x2000));
+    }
+
+    CVirtualBatcher batcher = proc.mem.virt_batcher();
+    batcher.read_prealloc(chunks);
+
+    for (auto _ : state) {
+        for (size_t i = 0; i < chunks; i++) {
+            batcher.read_raw_into(addrs[i], bufs[i].data(), size);
+        }
+        benchmark::DoNotOptimize(batcher.commit_rw());
+    }
+
+    state.SetBytesProcessed(state.iterations() * size * chunks);
+}
+
+// `phys::seq_read` and `phys::chunk_read`
+static void phys_read(benchmark::State &state, const PhysConfig &config, uint64_t size, uint64_t chunks) {
+    CCloneablePhysicalMemory conn(::dummy_connector_new(64 * MB, config.cache_size));
+    if (!conn.inner) {
+        return;
+    }
+    CPhysicalMemory mem = conn.downcast_cloneable();
+
+    std::mt19937_64 rng(std::random_device {}());
+    Address start = gen_range(rng, 0, 50 * MB);
+    Address base = gen_range(rng, start, start + MB);
+
+    std::vector<std::vector<uint8_t>> bufs(chunks, std::vector<uint8_t>(size));
+    std::vector<PhysicalReadEntry> read_list;
+    for (std::vector<uint8_t> &buf : bufs) {
+        PhysicalAddress addr = paddr_with_page(base + gen_range(rng, 0, 0x2000), PageType_WRITEABLE, 0x1000);
+        read_list.push_back(PhysicalReadEntry { addr, buf.data(), buf.size() });
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            mem.phys_read_raw_list(read_list.data(), read_list.size()));
+    }
+
+    state.SetBytesProcessed(state.iterations() * size * chunks);
+}
+
+// `batcher.rs`, the addresses are regenerated from the same seed on every iteration.
+//
+// Unlike `batcher.rs` the reads are performed on the dummy connector instead of a null connector,
+// the base address is kept in bounds so that every read succeeds.
+static void batched_read(benchmark::State &state, bool use_batcher, uint64_t chunks) {
+    CCloneablePhysicalMemory conn(::dummy_connector_new(64 * MB, 0));
+    if (!conn.inner) {
+        return;
+    }
+    CPhysicalMemory mem = conn.downcast_cloneable();
+
+    std::vector<std::array<uint8_t, 16>> bufs(chunks);
+    std::vector<PhysicalReadEntry> read_list(chunks);
+    for (size_t i = 0; i < chunks; i++) {
+        read_list[i].buf = bufs[i].data();
+        read_list[i].len = bufs[i].size();
+    }
+
+    const std::mt19937_64 seed(std::random_device {}());
+
+    if (!use_batcher) {
+        for (auto _ : state) {
+            std::mt19937_64 rng = seed;
+            Address base = gen_range(rng, 0, 64 * MB - 0x2000 - 16);
+            for (PhysicalReadEntry &data : read_list) {
+                data.address = addr_to_paddr(base + gen_range(rng, 0, 0x2000));
+            }
+            benchmark::DoNotOptimize(
+                mem.phys_read_raw_list(read_list.data(), read_list.size()));
+        }
+    } else {
+        for (auto _ : state) {
+            std::mt19937_64 rng = seed;
+            Address base = gen_range(rng, 0, 64 * MB - 0x2000 - 16);
+            CPhysicalBatcher batcher = mem.phys_batcher();
+            batcher.read_prealloc(chunks);
+            for (std::array<uint8_t, 16> &buf : bufs) {
+                batcher.read_into(addr_to_paddr(base + gen_range(rng, 0, 0x2000)), &buf);
+            }
+            benchmark::DoNotOptimize(batcher.commit_rw());
+        }
+    }
+
+    // `batcher.rs` reports the amount of entries as the throughput
+    state.SetBytesProcessed(state.iterations() * chunks);
+}
+
+static void register_virt(const char *backend) {
+    std::string seq_group = std::string(backend) + "_virt_seq_read";
+    std::string chunk_group = std::string(backend) + "_virt_chunk_read";
+    std::string batcher_group = std::string(backend) + "_virt_batcher_read";
+
+    for (const VirtConfig &config : VIRT_CONFIGS) {
+        for (uint64_t size : SEQ_SIZES) {
+            std::string func = seq_group + "_" + config.name;
+            benchmark::RegisterBenchmark(bench_name(seq_group, func, size).c_str(),
+                [=](benchmark::State &state) { virt_read(state, config, size, 1); })
+                ->MinTime(MEASUREMENT_TIME);
+        }
+    }
+
+    for (const VirtConfig &config : VIRT_CONFIGS) {
+        for (uint64_t size : CHUNK_SIZES) {
+            for (uint64_t chunks : CHUNK_COUNTS) {
+                std::string func = chunk_group + "_" + config.name + "_s" + hex(size);
+                benchmark::RegisterBenchmark(bench_name(chunk_group, func, size * chunks).c_str(),
+                    [=](benchmark::State &state) { virt_read(state, config, size, chunks); })
+                    ->MinTime(MEASUREMENT_TIME);
+            }
+        }
+    }
+
+    for (const VirtConfig &config : VIRT_CONFIGS) {
+        for (uint64_t size : CHUNK_SIZES) {
+            for (uint64_t chunks : CHUNK_COUNTS) {
+                std::string func = batcher_group + "_" + config.name + "_s" + hex(size);
+                benchmark::RegisterBenchmark(bench_name(batcher_group, func, size * chunks).c_str(),
+                    [=](benchmark::State &state) { virt_batcher_read(state, config, size, chunks); })
+                    ->MinTime(MEASUREMENT_TIME);
+            }
+        }
+    }
+}
+
+static void register_phys(const char *backend) {
+    std::string seq_group = std::string(backend) + "_phys_seq_read";
+    std::string chunk_group = std::string(backend) + "_phys_chunk_read";
+
+    for (const PhysConfig &config : PHYS_CONFIGS) {
+        for (uint64_t size : SEQ_SIZES) {
+            std::string func = seq_group + "_" + config.name;
+            benchmark::RegisterBenchmark(bench_name(seq_group, func, size).c_str(),
+                [=](benchmark::State &state) { phys_read(state, config, size, 1); })
+                ->MinTime(MEASUREMENT_TIME);
+        }
+    }
+
+    for (const PhysConfig &config : PHYS_CONFIGS) {
+        for (uint64_t size : CHUNK_SIZES) {
+            for (uint64_t chunks : CHUNK_COUNTS) {
+                std::string func = chunk_group + "_" + config.name + "_s" + hex(size);
+                benchmark::RegisterBenchmark(bench_name(chunk_group, func, size * chunks).c_str(),
+                    [=](benchmark::State &state) { phys_read(state, config, size, chunks); })
+                    ->MinTime(MEASUREMENT_TIME);
+            }
+        }
+    }
+}
+
+static void register_batched(const char *backend) {
+    std::string group = std::string(backend) + "_batched_read";
+
+    for (int use_batcher = 0; use_batcher < 2; use_batcher++) {
+        for (uint64_t chunks : BATCH_COUNTS) {
+            std::string func = group + (use_batcher ? "_with" : "_without");
+            benchmark::RegisterBenchmark(bench_name(group, func, chunks).c_str(),
+                [=](benchmark::State &state) { batched_read(state, use_batcher, chunks); })
+                ->MinTime(MEASUREMENT_TIME);
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    log_init(0);
+
+    register_virt("dummy");
+    register_phys("dummy");
+    register_batched("dummy");
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
@@ -45,17 +45,44 @@ typedef struct OsProcessInfoObj OsProcessInfoObj;
 
 typedef struct OsProcessModuleInfoObj OsProcessModuleInfoObj;
 
-typedef struct PhysicalMemoryObj PhysicalMemoryObj;
+/**
+ * Scans virtual memory for multiple byte patterns at once.
+ */
+typedef struct PatternScanner PatternScanner;
 
-typedef struct PhysicalReadData PhysicalReadData;
+typedef struct PhysicalMemoryObj PhysicalMemoryObj;
 
-typedef struct PhysicalWriteData PhysicalWriteData;
+/**
+ * Performs reads on a worker thread and reports their completion through tickets or callbacks.
+ *
+ * All reads that are submitted while the worker is busy are performed in a single list call
+ * once it becomes idle, this allows connectors to keep many requests in flight.
+ * Should the combined call fail the jobs are retried one by one to report accurate results.
+ */
+typedef struct ReadQueue_PhysicalMemoryObj ReadQueue_PhysicalMemoryObj;
 
-typedef struct VirtualMemoryObj VirtualMemoryObj;
+/**
+ * Performs reads on a worker thread and reports their completion through tickets or callbacks.
+ *
+ * All reads that are submitted while the worker is busy are performed in a single list call
+ * once it becomes idle, this allows connectors to keep many requests in flight.
+ * Should the combined call fail the jobs are retried one by one to report accurate results.
+ */
+typedef struct ReadQueue_VirtualMemoryObj ReadQueue_VirtualMemoryObj;
 
-typedef struct VirtualReadData VirtualReadData;
+/**
+ * A thread-safe handle to a connector.
+ *
+ * The handle is `Send + Sync`, it can be shared by reference or cloned cheaply.
+ * All clones share the same connector and submission queue.
+ *
+ * All entries that are dispatched together share the result of the merged read,
+ * an error of the connector is reported to every request of that dispatch.
+ * Writes are not queued, they are directly forwarded to the connector.
+ */
+typedef struct SharedConnector_PhysicalMemoryBox SharedConnector_PhysicalMemoryBox;
 
-typedef struct VirtualWriteData VirtualWriteData;
+typedef struct VirtualMemoryObj VirtualMemoryObj;
 
 /**
  * This type represents a address on the target system.
@@ -124,11 +151,151 @@ typedef struct PhysicalAddress {
     uint8_t page_size_log2;
 } PhysicalAddress;
 
+/**
+ * A single read of a physical read list
+ *
+ * `len` bytes are read from `address` into `buf`. `buf` may be null if `len` is 0.
+ */
+typedef struct PhysicalReadEntry {
+    PhysicalAddress address;
+    uint8_t * buf;
+    uintptr_t len;
+} PhysicalReadEntry;
+
+/**
+ * A single write of a physical write list
+ *
+ * `len` bytes are written from `buf` to `address`. `buf` may be null if `len` is 0.
+ */
+typedef struct PhysicalWriteEntry {
+    PhysicalAddress address;
+    const uint8_t * buf;
+    uintptr_t len;
+} PhysicalWriteEntry;
+
+/**
+ * A single read of a virtual read list
+ *
+ * `len` bytes are read from `address` into `buf`. `buf` may be null if `len` is 0.
+ */
+typedef struct VirtualReadEntry {
+    Address address;
+    uint8_t * buf;
+    uintptr_t len;
+} VirtualReadEntry;
+
+/**
+ * A single write of a virtual write list
+ *
+ * `len` bytes are written from `buf` to `address`. `buf` may be null if `len` is 0.
+ */
+typedef struct VirtualWriteEntry {
+    Address address;
+    const uint8_t * buf;
+    uintptr_t len;
+} VirtualWriteEntry;
+
 typedef struct PhysicalMemoryMetadata {
     uintptr_t size;
     bool readonly;
+    /**
+     * The amount of entries the connector prefers to receive in a single `phys_read_raw_list` call.
+     *
+     * A value of 0 means the connector has no preference.
+     */
+    uintptr_t preferred_batch_size;
+    /**
+     * The maximum amount of requests the connector can have in flight at once.
+     *
+     * A value of 0 means the amount of requests is unlimited.
+     */
+    uintptr_t max_in_flight;
+    /**
+     * The maximum size of a read that physically contiguous entries may be merged into.
+     *
+     * Connectors with a high cost per request can set this to have `VirtualDMA`
+     * sort the translated reads by their physical address and merge adjacent ones.
+     * A value of 0 means the connector does not benefit from merged reads.
+     */
+    uintptr_t coalesce_size;
 } PhysicalMemoryMetadata;
 
+typedef SharedConnector_PhysicalMemoryBox SharedPhysicalMemoryObj;
+
+typedef ReadQueue_PhysicalMemoryObj PhysicalReadQueue;
+
+/**
+ * Identifies a read that was submitted to a read queue
+ *
+ * Valid tickets are never 0.
+ */
+typedef uint64_t ReadTicket;
+
+/**
+ * Receives the result of a queued read on the worker thread of the queue
+ */
+typedef void (*ReadCallback)(void *ctx, ReadTicket ticket, int32_t result);
+
+typedef ReadQueue_VirtualMemoryObj VirtualReadQueue;
+
+/**
+ * A single range that should be dumped.
+ *
+ * `address` is the address the data is reported at to the sink
+ * (e.g. the virtual address for process dumps), `phys_address` is where the data is read from.
+ */
+typedef struct DumpRange {
+    Address address;
+    PhysicalAddress phys_address;
+    uintptr_t size;
+} DumpRange;
+
+/**
+ * Statistics of a finished dump.
+ */
+typedef struct DumpStats {
+    /**
+     * Total amount of bytes handed to the sink
+     */
+    uintptr_t bytes;
+    /**
+     * Amount of bytes that could not be read and were zero filled
+     */
+    uintptr_t failed_bytes;
+    /**
+     * Wall clock time of the dump in nanoseconds
+     */
+    uint64_t elapsed_ns;
+} DumpStats;
+
+/**
+ * Receives the dumped ranges in ascending order
+ *
+ * Returning a non-zero value aborts the dump.
+ */
+typedef int32_t (*DumpCallback)(void *ctx, Address address, const uint8_t *data, uintptr_t len);
+
+/**
+ * A match reported by the scanner.
+ */
+typedef struct ScanMatch {
+    /**
+     * Index of the matching pattern in the order they were added to the scanner
+     */
+    uintptr_t pattern;
+    /**
+     * Address of the first byte of the match
+     */
+    Address address;
+} ScanMatch;
+
+/**
+ * Receives the matches of a scan in ascending address order
+ *
+ * Returning a non-zero value stops the scan.
+ */
+typedef int32_t (*ScanCallback)(void *ctx, ScanMatch found);
+
 /**
  * Type alias for a PID.
  */
@@ -247,6 +414,48 @@ void connector_free(CloneablePhysicalMemoryObj *conn);
  */
 void inventory_free(ConnectorInventory *inv);
 
+/**
+ * Create a new dummy connector
+ *
+ * The connector is backed by `size` bytes of zeroed heap memory. If `cache_size` is non-zero,
+ * the connector is wrapped in a page cache with a size of `cache_size` bytes.
+ *
+ * The instance needs to be freed using `connector_free`.
+ */
+CloneablePhysicalMemoryObj *dummy_connector_new(uintptr_t size, uintptr_t cache_size);
+
+/**
+ * Create the virtual memory of a new process on a dummy connector
+ *
+ * This allocates a `size` bytes dummy connector and maps a process of `map_size` bytes into it.
+ * The base and size of a random module inside of that process, picked by
+ * `DummyProcess::get_module` with a minimum size of `module_size`, are written to
+ * `module_base` and `module_len`.
+ *
+ * If `cache_size` is non-zero, the physical memory is wrapped in a page cache with a size of
+ * `cache_size` bytes. If `use_tlb` is set, virtual address translations are cached.
+ *
+ * The instance needs to be freed using `dummy_virt_free`.
+ */
+VirtualMemoryObj *dummy_virt_new(uintptr_t size,
+                                 uintptr_t map_size,
+                                 uintptr_t module_size,
+                                 uintptr_t cache_size,
+                                 bool use_tlb,
+                                 Address *module_base,
+                                 uintptr_t *module_len);
+
+/**
+ * Free a virtual memory object created by `dummy_virt_new`
+ *
+ * Unlike `virt_free`, this also frees the underlying dummy connector.
+ *
+ * # Safety
+ *
+ * `mem` has to point to a valid `VirtualMemoryObj` created by `dummy_virt_new`.
+ */
+void dummy_virt_free(VirtualMemoryObj *mem);
+
 /**
  * Downcast a cloneable physical memory into a physical memory object.
  *
@@ -279,9 +488,10 @@ void phys_free(PhysicalMemoryObj *mem);
  *
  * # Safety
  *
- * `data` must be a valid array of `PhysicalReadData` with the length of at least `len`
+ * `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+ * the buffers of the entries must not overlap.
  */
-int32_t phys_read_raw_list(PhysicalMemoryObj *mem, PhysicalReadData *data, uintptr_t len);
+int32_t phys_read_raw_list(PhysicalMemoryObj *mem, const PhysicalReadEntry *data, uintptr_t len);
 
 /**
  * Write a list of values
@@ -291,15 +501,24 @@ int32_t phys_read_raw_list(PhysicalMemoryObj *mem, PhysicalReadData *data, uintp
  *
  * # Safety
  *
- * `data` must be a valid array of `PhysicalWriteData` with the length of at least `len`
+ * `data` must be a valid array of `PhysicalWriteEntry` with the length of at least `len`
  */
-int32_t phys_write_raw_list(PhysicalMemoryObj *mem, const PhysicalWriteData *data, uintptr_t len);
+int32_t phys_write_raw_list(PhysicalMemoryObj *mem, const PhysicalWriteEntry *data, uintptr_t len);
 
 /**
  * Retrieve metadata about the physical memory object
  */
 PhysicalMemoryMetadata phys_metadata(const PhysicalMemoryObj *mem);
 
+/**
+ * Prefetch a range of physical memory
+ *
+ * This hints the physical memory object that `len` bytes starting at `addr` will be read soon.
+ * Caching memory objects will fill their page cache for the range in a single batched read,
+ * other objects ignore the hint.
+ */
+int32_t phys_prefetch(PhysicalMemoryObj *mem, PhysicalAddress addr, uintptr_t len);
+
 /**
  * Read a single value into `out` from a provided `PhysicalAddress`
  *
@@ -344,6 +563,102 @@ int32_t phys_write_u32(PhysicalMemoryObj *mem, PhysicalAddress addr, uint32_t va
  */
 int32_t phys_write_u64(PhysicalMemoryObj *mem, PhysicalAddress addr, uint64_t val);
 
+/**
+ * Create a thread-safe shared handle of a connector
+ *
+ * This consumes `conn`, which must not be used or freed afterwards. All functions taking a
+ * `SharedPhysicalMemoryObj` can be called from multiple threads at once, concurrent reads are
+ * merged into larger batches before they reach the connector.
+ *
+ * The handle has to be freed using `shared_phys_free`.
+ *
+ * # Safety
+ *
+ * `conn` has to point to a valid `CloneablePhysicalMemoryObj` created by one of the provided
+ * functions.
+ */
+SharedPhysicalMemoryObj *connector_shared(CloneablePhysicalMemoryObj *conn);
+
+/**
+ * Create a connector that refers to a shared handle
+ *
+ * The returned connector can be used like any other connector, e.g. to build a kernel on another
+ * thread, all its reads go through the queue of `mem`. It has to be freed using `connector_free`.
+ */
+CloneablePhysicalMemoryObj *shared_phys_clone(const SharedPhysicalMemoryObj *mem);
+
+/**
+ * Free a shared handle
+ *
+ * Connectors created with `shared_phys_clone` stay valid.
+ *
+ * # Safety
+ *
+ * `mem` must point to a valid `SharedPhysicalMemoryObj` that was created using `connector_shared`.
+ */
+void shared_phys_free(SharedPhysicalMemoryObj *mem);
+
+/**
+ * Read a list of values through a shared handle
+ *
+ * This function is thread-safe. The reads are queued together with the reads of other threads
+ * and the function blocks until they were performed.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+ * the buffers of the entries must not overlap.
+ */
+int32_t shared_phys_read_raw_list(const SharedPhysicalMemoryObj *mem,
+                                  const PhysicalReadEntry *data,
+                                  uintptr_t len);
+
+/**
+ * Write a list of values through a shared handle
+ *
+ * This function is thread-safe.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `PhysicalWriteEntry` with the length of at least `len`
+ */
+int32_t shared_phys_write_raw_list(const SharedPhysicalMemoryObj *mem,
+                                   const PhysicalWriteEntry *data,
+                                   uintptr_t len);
+
+/**
+ * Retrieve metadata about the connector of a shared handle
+ */
+PhysicalMemoryMetadata shared_phys_metadata(const SharedPhysicalMemoryObj *mem);
+
+/**
+ * Read a single value into `out` from a provided `PhysicalAddress` through a shared handle
+ *
+ * This function is thread-safe.
+ *
+ * # Safety
+ *
+ * `out` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t shared_phys_read_raw_into(const SharedPhysicalMemoryObj *mem,
+                                  PhysicalAddress addr,
+                                  uint8_t *out,
+                                  uintptr_t len);
+
+/**
+ * Write a single value from `input` into a provided `PhysicalAddress` through a shared handle
+ *
+ * This function is thread-safe.
+ *
+ * # Safety
+ *
+ * `input` must be a valid pointer to a data buffer of at least `len` size.
+ */
+int32_t shared_phys_write_raw(const SharedPhysicalMemoryObj *mem,
+                              PhysicalAddress addr,
+                              const uint8_t *input,
+                              uintptr_t len);
+
 /**
  * Free a virtual memory object reference
  *
@@ -364,9 +679,30 @@ void virt_free(VirtualMemoryObj *mem);
  *
  * # Safety
  *
- * `data` must be a valid array of `VirtualReadData` with the length of at least `len`
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+ * the buffers of the entries must not overlap.
  */
-int32_t virt_read_raw_list(VirtualMemoryObj *mem, VirtualReadData *data, uintptr_t len);
+int32_t virt_read_raw_list(VirtualMemoryObj *mem, const VirtualReadEntry *data, uintptr_t len);
+
+/**
+ * Read a list of values and report the outcome of every entry
+ *
+ * This behaves like `virt_read_raw_list`, but instead of failing the whole batch on a partial
+ * read, `status[i]` is set to `true` if `data[i]` was fully read, and to `false` if any part of it
+ * could not be translated. Failed regions are zeroed out, successful reads are kept intact.
+ *
+ * The function only returns an error if the underlying physical read failed.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+ * the buffers of the entries must not overlap,
+ * and `status` must be a valid array of `bool` with the length of at least `len`
+ */
+int32_t virt_read_raw_list_status(VirtualMemoryObj *mem,
+                                  const VirtualReadEntry *data,
+                                  bool *status,
+                                  uintptr_t len);
 
 /**
  * Write a list of values
@@ -377,9 +713,19 @@ int32_t virt_read_raw_list(VirtualMemoryObj *mem, VirtualReadData *data, uintptr
  *
  * # Safety
  *
- * `data` must be a valid array of `VirtualWriteData` with the length of at least `len`
+ * `data` must be a valid array of `VirtualWriteEntry` with the length of at least `len`
  */
-int32_t virt_write_raw_list(VirtualMemoryObj *mem, const VirtualWriteData *data, uintptr_t len);
+int32_t virt_write_raw_list(VirtualMemoryObj *mem, const VirtualWriteEntry *data, uintptr_t len);
+
+/**
+ * Prefetch a range of virtual memory
+ *
+ * This hints the virtual memory object that `len` bytes starting at `addr` will be read soon.
+ * The range is translated and, if the underlying physical memory is cached, the page cache
+ * is filled for the entire range in a single batched read. This is useful before scanning
+ * a whole module.
+ */
+int32_t virt_prefetch(VirtualMemoryObj *mem, Address addr, uintptr_t len);
 
 /**
  * Read a single value into `out` from a provided `Address`
@@ -390,6 +736,30 @@ int32_t virt_write_raw_list(VirtualMemoryObj *mem, const VirtualWriteData *data,
  */
 int32_t virt_read_raw_into(VirtualMemoryObj *mem, Address addr, uint8_t *out, uintptr_t len);
 
+/**
+ * Resolve a list of pointer chains
+ *
+ * Chain `i` starts at `bases[i]` and uses the next `counts[i]` entries of `offsets`,
+ * the offsets of all chains are stored back to back. Each offset is added to the current address
+ * before the pointer at that location is read with the pointer width of `arch`.
+ *
+ * All chains are resolved level by level with one batched read per depth.
+ * After the call `out[i]` contains the final address of chain `i`, or an invalid address
+ * if one of its pointers could not be read or was null.
+ *
+ * # Safety
+ *
+ * `bases`, `counts` and `out` must be valid arrays with the length of at least `len`,
+ * and `offsets` must be a valid array with the length of at least the sum of all `counts`
+ */
+int32_t virt_read_ptr_chains(VirtualMemoryObj *mem,
+                             const ArchitectureObj *arch,
+                             const Address *bases,
+                             const uintptr_t *offsets,
+                             const uintptr_t *counts,
+                             Address *out,
+                             uintptr_t len);
+
 /**
  * Read a single 32-bit value from a provided `Address`
  */
@@ -419,6 +789,268 @@ int32_t virt_write_u32(VirtualMemoryObj *mem, Address addr, uint32_t val);
  */
 int32_t virt_write_u64(VirtualMemoryObj *mem, Address addr, uint64_t val);
 
+/**
+ * Dump physical memory ranges in parallel
+ *
+ * Reads all `ranges` with `threads` worker threads, each using a clone of `mem`, and passes them
+ * in order to `callback`. If `ranges_len` is 0 the entire physical memory is dumped.
+ * At most `max_in_flight` chunks of `chunk_size` bytes are buffered at any time.
+ * Passing 0 for `threads`, `chunk_size` or `max_in_flight` selects the default value.
+ *
+ * If `stats` is not null it is filled with the statistics of the dump.
+ *
+ * # Safety
+ *
+ * `ranges` must be a valid array of `DumpRange` with the length of at least `ranges_len`,
+ * `stats` must be either null or a valid pointer to `DumpStats`.
+ */
+int32_t phys_dump(const CloneablePhysicalMemoryObj *mem,
+                  const DumpRange *ranges,
+                  uintptr_t ranges_len,
+                  uintptr_t threads,
+                  uintptr_t chunk_size,
+                  uintptr_t max_in_flight,
+                  DumpCallback callback,
+                  void *ctx,
+                  DumpStats *stats);
+
+/**
+ * Dump the entire physical memory into a raw image file
+ *
+ * See `phys_dump` for a description of the parameters.
+ *
+ * # Safety
+ *
+ * `path` must be a valid null terminated string,
+ * `stats` must be either null or a valid pointer to `DumpStats`.
+ */
+int32_t phys_dump_file(const CloneablePhysicalMemoryObj *mem,
+                       const char *path,
+                       uintptr_t threads,
+                       uintptr_t chunk_size,
+                       uintptr_t max_in_flight,
+                       DumpStats *stats);
+
+/**
+ * Dump all mapped pages of a virtual address space in parallel
+ *
+ * The translation map of `virt_mem` is read once, the pages are then read from clones of `mem`
+ * and passed to `callback` at their virtual addresses in ascending order.
+ * See `phys_dump` for a description of the remaining parameters.
+ *
+ * `mem` has to be the physical memory object `virt_mem` reads from.
+ *
+ * # Safety
+ *
+ * `stats` must be either null or a valid pointer to `DumpStats`.
+ */
+int32_t virt_dump(VirtualMemoryObj *virt_mem,
+                  const CloneablePhysicalMemoryObj *mem,
+                  uintptr_t threads,
+                  uintptr_t chunk_size,
+                  uintptr_t max_in_flight,
+                  DumpCallback callback,
+                  void *ctx,
+                  DumpStats *stats);
+
+/**
+ * Create a read queue that performs physical reads on a worker thread
+ *
+ * This takes over `mem`, which must not be used or freed afterwards. The connector `mem` was
+ * created from has to outlive the queue. The queue has to be freed using `phys_read_queue_free`.
+ *
+ * # Safety
+ *
+ * `mem` must point to a valid `PhysicalMemoryObj` that was created using one of the provided
+ * functions.
+ */
+PhysicalReadQueue *phys_read_queue_new(PhysicalMemoryObj *mem);
+
+/**
+ * Submit a list of physical reads to the queue
+ *
+ * This function is thread-safe and returns immediately. If `callback` is set it is called with
+ * the result on the worker thread, otherwise the result has to be retrieved with `phys_read_poll`
+ * or `phys_read_wait`. Returns 0 if the read could not be queued.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+ * both the array and its buffers have to stay valid until the read has been completed.
+ */
+ReadTicket phys_read_submit(const PhysicalReadQueue *queue,
+                            const PhysicalReadEntry *data,
+                            uintptr_t len,
+                            ReadCallback callback,
+                            void *ctx);
+
+/**
+ * Check whether a submitted physical read has been completed
+ *
+ * Returns `true` and writes the result into `result` once the read has been completed.
+ * Afterwards the ticket becomes invalid. Tickets with a callback can not be polled.
+ *
+ * # Safety
+ *
+ * `result` must be a valid pointer to an `i32`
+ */
+bool phys_read_poll(const PhysicalReadQueue *queue, ReadTicket ticket, int32_t *result);
+
+/**
+ * Wait for a submitted physical read and return its result
+ *
+ * Afterwards the ticket becomes invalid.
+ */
+int32_t phys_read_wait(const PhysicalReadQueue *queue, ReadTicket ticket);
+
+/**
+ * Free a physical read queue
+ *
+ * All submitted reads are completed before the function returns.
+ *
+ * # Safety
+ *
+ * `queue` must point to a valid `PhysicalReadQueue` that was created using `phys_read_queue_new`.
+ */
+void phys_read_queue_free(PhysicalReadQueue *queue);
+
+/**
+ * Create a read queue that performs virtual reads on a worker thread
+ *
+ * This takes over `mem`, which must not be used or freed afterwards. The object `mem` was
+ * created from has to outlive the queue. The queue has to be freed using `virt_read_queue_free`.
+ *
+ * # Safety
+ *
+ * `mem` must point to a valid `VirtualMemoryObj` that was created using one of the provided
+ * functions.
+ */
+VirtualReadQueue *virt_read_queue_new(VirtualMemoryObj *mem);
+
+/**
+ * Submit a list of virtual reads to the queue
+ *
+ * This function is thread-safe and returns immediately. If `callback` is set it is called with
+ * the result on the worker thread, otherwise the result has to be retrieved with `virt_read_poll`
+ * or `virt_read_wait`. Returns 0 if the read could not be queued.
+ *
+ * Like `virt_read_raw_list`, partially unmapped reads are not reported as an error.
+ *
+ * # Safety
+ *
+ * `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+ * both the array and its buffers have to stay valid until the read has been completed.
+ */
+ReadTicket virt_read_submit(const VirtualReadQueue *queue,
+                            const VirtualReadEntry *data,
+                            uintptr_t len,
+                            ReadCallback callback,
+                            void *ctx);
+
+/**
+ * Check whether a submitted virtual read has been completed
+ *
+ * Returns `true` and writes the result into `result` once the read has been completed.
+ * Afterwards the ticket becomes invalid. Tickets with a callback can not be polled.
+ *
+ * # Safety
+ *
+ * `result` must be a valid pointer to an `i32`
+ */
+bool virt_read_poll(const VirtualReadQueue *queue, ReadTicket ticket, int32_t *result);
+
+/**
+ * Wait for a submitted virtual read and return its result
+ *
+ * Afterwards the ticket becomes invalid.
+ */
+int32_t virt_read_wait(const VirtualReadQueue *queue, ReadTicket ticket);
+
+/**
+ * Free a virtual read queue
+ *
+ * All submitted reads are completed before the function returns.
+ *
+ * # Safety
+ *
+ * `queue` must point to a valid `VirtualReadQueue` that was created using `virt_read_queue_new`.
+ */
+void virt_read_queue_free(VirtualReadQueue *queue);
+
+/**
+ * Create a new pattern scanner without any patterns
+ *
+ * Chunk and batch sizes may be 0 to select the default values.
+ */
+PatternScanner *pattern_scanner_new(uintptr_t chunk_size, uintptr_t batch_size);
+
+/**
+ * Add a pattern in the `"48 8B 05 ? ? ? ?"` notation to the scanner
+ *
+ * Patterns are numbered in the order they are added, starting with 0.
+ *
+ * # Safety
+ *
+ * `pattern` must be a valid null terminated string
+ */
+int32_t pattern_scanner_add(PatternScanner *scanner, const char *pattern);
+
+/**
+ * Add a masked byte pattern to the scanner
+ *
+ * Every byte of the target memory is compared with `bytes[i]` under `mask[i]`,
+ * a mask of `0x00` marks a wildcard.
+ *
+ * # Safety
+ *
+ * `bytes` and `mask` must be valid arrays of bytes with the length of at least `len`
+ */
+int32_t pattern_scanner_add_masked(PatternScanner *scanner,
+                                   const uint8_t *bytes,
+                                   const uint8_t *mask,
+                                   uintptr_t len);
+
+/**
+ * Free a pattern scanner
+ *
+ * # Safety
+ *
+ * `scanner` must be a valid reference to a pattern scanner created with `pattern_scanner_new`.
+ */
+void pattern_scanner_free(PatternScanner *scanner);
+
+/**
+ * Scan all mapped pages between `start` and `end` for the patterns of `scanner`
+ *
+ * Every match is passed to `callback` in ascending address order.
+ * Returns the number of matches the callback accepted, the match on which the callback
+ * stopped the scan is not counted.
+ */
+uintptr_t virt_scan(VirtualMemoryObj *mem,
+                    const PatternScanner *scanner,
+                    Address start,
+                    Address end,
+                    ScanCallback callback,
+                    void *ctx);
+
+/**
+ * Scan a local buffer for the patterns of `scanner`
+ *
+ * The buffer is assumed to be located at `base`, matches are written into `out`.
+ * Returns the total number of matches, which may be larger than `max_matches`.
+ *
+ * # Safety
+ *
+ * `buf` must be a valid array of bytes with the length of at least `len`,
+ * `out` must be a valid array of `ScanMatch` with the length of at least `max_matches`
+ */
+uintptr_t scan_buffer(const PatternScanner *scanner,
+                      Address base,
+                      const uint8_t *buf,
+                      uintptr_t len,
+                      ScanMatch *out,
+                      uintptr_t max_matches);
+
 uint8_t arch_bits(const ArchitectureObj *arch);
 
 Endianess arch_endianess(const ArchitectureObj *arch);
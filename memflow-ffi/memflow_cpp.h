@@ -5,12 +5,206 @@
 #include "binddestr.h"
 
 #ifndef NO_STL_CONTAINERS
+#include <future>
 #include <string>
+#include <vector>
 #ifndef AUTO_STRING_SIZE
 #define AUTO_STRING_SIZE 128
 #endif
 #endif
 
+#ifndef NO_STL_CONTAINERS
+// Queues up reads and writes and commits them in a single list call.
+//
+// This mirrors `PhysicalMemoryBatcher` and `VirtualMemoryBatcher` of the Rust library.
+// Read outputs are kept by reference and have to stay valid until the batcher is committed,
+// write inputs are copied into an internal arena, so temporaries can be passed to `write_into`.
+//
+// All buffers retain their capacity between commits, thus reusing a batcher does
+// not allocate once it has been warmed up.
+template<typename M, typename A, typename R, typename W,
+    int32_t (*READ_LIST)(M *, const R *, uintptr_t),
+    int32_t (*WRITE_LIST)(M *, const W *, uintptr_t)>
+struct CMemoryBatcher
+{
+    M *mem;
+    std::vector<R> read_list;
+    std::vector<W> write_list;
+    std::vector<uint8_t> write_arena;
+
+    CMemoryBatcher(M *mem)
+        : mem(mem) {}
+
+    CMemoryBatcher(CMemoryBatcher &other) = delete;
+
+    CMemoryBatcher(CMemoryBatcher &&other)
+        : mem(other.mem),
+        read_list(std::move(other.read_list)),
+        write_list(std::move(other.write_list)),
+        write_arena(std::move(other.write_arena)) {
+        other.mem = NULL;
+    }
+
+    ~CMemoryBatcher() {
+        this->commit_rw();
+    }
+
+    CMemoryBatcher &read_prealloc(size_t capacity) {
+        this->read_list.reserve(capacity);
+        return *this;
+    }
+
+    CMemoryBatcher &write_prealloc(size_t capacity, size_t arena_size) {
+        this->write_list.reserve(capacity);
+        this->write_arena.reserve(arena_size);
+        return *this;
+    }
+
+    // Performs all queued reads, and then all queued writes.
+    //
+    // If the read list fails, writes are not performed and the error value is returned.
+    int32_t commit_rw() {
+        int32_t ret = 0;
+
+        if (!this->mem) {
+            return ret;
+        }
+
+        if (!this->read_list.empty()) {
+            ret = READ_LIST(this->mem, this->read_list.data(), this->read_list.size());
+            this->read_list.clear();
+        }
+
+        if (!this->write_list.empty()) {
+            if (!ret) {
+                // the arena may have grown while queueing, so buffers are stored as offsets
+                const uint8_t *base = this->write_arena.data();
+                for (W &data : this->write_list) {
+                    data.buf = base + (uintptr_t)data.buf;
+                }
+
+                ret = WRITE_LIST(this->mem, this->write_list.data(), this->write_list.size());
+            }
+
+            this->write_list.clear();
+            this->write_arena.clear();
+        }
+
+        return ret;
+    }
+
+    // read helpers
+    CMemoryBatcher &read_raw_into(A address, uint8_t *out, size_t len) {
+        R data = { address, out, len };
+        this->read_list.push_back(data);
+        return *this;
+    }
+
+    template<typename T>
+    CMemoryBatcher &read_into(A address, T *out) {
+        return this->read_raw_into(address, (uint8_t *)out, sizeof(T));
+    }
+
+    // write helpers
+    CMemoryBatcher &write_raw_into(A address, const uint8_t *data, size_t len) {
+        size_t offset = this->write_arena.size();
+        this->write_arena.insert(this->write_arena.end(), data, data + len);
+        W entry = { address, (const uint8_t *)offset, len };
+        this->write_list.push_back(entry);
+        return *this;
+    }
+
+    template<typename T>
+    CMemoryBatcher &write_into(A address, const T &data) {
+        return this->write_raw_into(address, (const uint8_t *)&data, sizeof(T));
+    }
+};
+
+typedef CMemoryBatcher<PhysicalMemoryObj, PhysicalAddress, PhysicalReadEntry, PhysicalWriteEntry,
+    phys_read_raw_list, phys_write_raw_list> CPhysicalBatcher;
+
+typedef CMemoryBatcher<VirtualMemoryObj, Address, VirtualReadEntry, VirtualWriteEntry,
+    virt_read_raw_list, virt_write_raw_list> CVirtualBatcher;
+#endif
+
+// Performs reads on the worker thread of a read queue.
+//
+// `submit` returns immediately with a ticket that can be polled or waited on, or calls
+// `callback(ctx, ticket, result)` on the worker thread once the read is done.
+// Reads submitted while the worker is busy are combined into a single list call.
+//
+// All buffers passed to the queue have to stay valid until the read has been completed.
+template<typename Q, typename A, typename R,
+    ReadTicket (*SUBMIT)(const Q *, const R *, uintptr_t, ReadCallback, void *),
+    bool (*POLL)(const Q *, ReadTicket, int32_t *),
+    int32_t (*WAIT)(const Q *, ReadTicket),
+    void (*FREE)(Q *)>
+struct CReadQueue
+    : BindDestr<Q, FREE>
+{
+    CReadQueue(Q *queue)
+        : BindDestr<Q, FREE>(queue) {}
+
+    ReadTicket submit(const R *data, uintptr_t len, ReadCallback callback = nullptr, void *ctx = nullptr) const {
+        return SUBMIT(this->inner, data, len, callback, ctx);
+    }
+
+    bool poll(ReadTicket ticket, int32_t *result) const {
+        return POLL(this->inner, ticket, result);
+    }
+
+    int32_t wait(ReadTicket ticket) const {
+        return WAIT(this->inner, ticket);
+    }
+
+#ifndef NO_STL_CONTAINERS
+    // Submits the reads and returns a future that is fulfilled on the worker thread.
+    std::future<int32_t> read_raw_list(const R *data, uintptr_t len) const {
+        return submit_pending(new CPendingRead(), data, len);
+    }
+
+    std::future<int32_t> read_raw_into(A address, uint8_t *out, uintptr_t len) const {
+        CPendingRead *pending = new CPendingRead();
+        R data = { address, out, len };
+        pending->data = data;
+        return submit_pending(pending, &pending->data, 1);
+    }
+
+    template<typename T>
+    std::future<int32_t> read_into(A address, T *out) const {
+        return this->read_raw_into(address, (uint8_t *)out, sizeof(T));
+    }
+
+private:
+    // the single entry of `read_raw_into` has to live until the read has been completed
+    struct CPendingRead {
+        std::promise<int32_t> promise;
+        R data;
+    };
+
+    std::future<int32_t> submit_pending(CPendingRead *pending, const R *data, uintptr_t len) const {
+        std::future<int32_t> future = pending->promise.get_future();
+        if (!SUBMIT(this->inner, data, len, &pending_trampoline, (void *)pending)) {
+            pending->promise.set_value(-1);
+            delete pending;
+        }
+        return future;
+    }
+
+    static void pending_trampoline(void *ctx, ReadTicket ticket, int32_t result) {
+        CPendingRead *pending = (CPendingRead *)ctx;
+        pending->promise.set_value(result);
+        delete pending;
+    }
+#endif
+};
+
+typedef CReadQueue<PhysicalReadQueue, PhysicalAddress, PhysicalReadEntry,
+    phys_read_submit, phys_read_poll, phys_read_wait, phys_read_queue_free> CPhysicalReadQueue;
+
+typedef CReadQueue<VirtualReadQueue, Address, VirtualReadEntry,
+    virt_read_submit, virt_read_poll, virt_read_wait, virt_read_queue_free> CVirtualReadQueue;
+
 struct CConnectorInventory
     : BindDestr<ConnectorInventory, inventory_free>
 {
@@ -36,6 +230,7 @@ struct CPhysicalMemory
     WRAP_FN_RAW(phys_read_raw_list);
     WRAP_FN_RAW(phys_write_raw_list);
     WRAP_FN_RAW(phys_metadata);
+    WRAP_FN_RAW(phys_prefetch);
     WRAP_FN_RAW(phys_read_raw_into);
     WRAP_FN_RAW(phys_read_u32);
     WRAP_FN_RAW(phys_read_u64);
@@ -54,6 +249,65 @@ struct CPhysicalMemory
     int32_t phys_write(PhysicalAddress address, const T &data) {
         return this->phys_write_raw(address, (const uint8_t *)&data, sizeof(T));
     }
+
+#ifndef NO_STL_CONTAINERS
+    CPhysicalBatcher phys_batcher() {
+        return CPhysicalBatcher(this->inner);
+    }
+#endif
+
+    // Moves this object onto the worker thread of a new read queue
+    CPhysicalReadQueue read_queue() {
+        return CPhysicalReadQueue(::phys_read_queue_new(this->invalidate()));
+    }
+};
+
+struct CCloneablePhysicalMemory;
+
+// Thread-safe counterpart of `CPhysicalMemory`.
+//
+// All methods can be called on the same instance from multiple threads at once,
+// concurrent reads are merged into larger batches before they reach the connector.
+struct CSharedPhysicalMemory
+    : BindDestr<SharedPhysicalMemoryObj, shared_phys_free>
+{
+    CSharedPhysicalMemory(SharedPhysicalMemoryObj *mem)
+        : BindDestr(mem) {}
+
+    int32_t phys_read_raw_list(const PhysicalReadEntry *data, uintptr_t len) const {
+        return ::shared_phys_read_raw_list(this->inner, data, len);
+    }
+
+    int32_t phys_write_raw_list(const PhysicalWriteEntry *data, uintptr_t len) const {
+        return ::shared_phys_write_raw_list(this->inner, data, len);
+    }
+
+    PhysicalMemoryMetadata phys_metadata() const {
+        return ::shared_phys_metadata(this->inner);
+    }
+
+    int32_t phys_read_raw_into(PhysicalAddress address, uint8_t *out, uintptr_t len) const {
+        return ::shared_phys_read_raw_into(this->inner, address, out, len);
+    }
+
+    int32_t phys_write_raw(PhysicalAddress address, const uint8_t *input, uintptr_t len) const {
+        return ::shared_phys_write_raw(this->inner, address, input, len);
+    }
+
+    template<typename T>
+    T phys_read(PhysicalAddress address) const {
+        T data;
+        this->phys_read_raw_into(address, (uint8_t *)&data, sizeof(T));
+        return data;
+    }
+
+    template<typename T>
+    int32_t phys_write(PhysicalAddress address, const T &data) const {
+        return this->phys_write_raw(address, (const uint8_t *)&data, sizeof(T));
+    }
+
+    // Creates a connector whose reads go through this handle, e.g. to build a kernel on another thread
+    CCloneablePhysicalMemory connector() const;
 };
 
 struct CCloneablePhysicalMemory
@@ -63,9 +317,46 @@ struct CCloneablePhysicalMemory
         : BindDestr(mem) {}
 
     WRAP_FN(connector, clone);
+    WRAP_FN_TYPE_INVALIDATE(CSharedPhysicalMemory, connector, shared);
     WRAP_FN_RAW_TYPE(CPhysicalMemory, downcast_cloneable);
+    WRAP_FN_RAW(phys_dump);
+    WRAP_FN_RAW(phys_dump_file);
+
+    // Dumps `ranges` (or the entire memory if empty) in parallel, `sink(address, data, len)`
+    // is called in order and aborts the dump by returning a non-zero value
+    template<typename F>
+    int32_t dump(
+        F &sink,
+        const DumpRange *ranges = nullptr,
+        size_t ranges_len = 0,
+        size_t threads = 0,
+        size_t chunk_size = 0,
+        size_t max_in_flight = 0,
+        DumpStats *stats = nullptr
+    ) {
+        return ::phys_dump(
+            this->inner,
+            ranges,
+            ranges_len,
+            threads,
+            chunk_size,
+            max_in_flight,
+            &dump_trampoline<F>,
+            (void *)&sink,
+            stats
+        );
+    }
+
+    template<typename F>
+    static int32_t dump_trampoline(void *ctx, Address address, const uint8_t *data, uintptr_t len) {
+        return (*(F *)ctx)(address, data, len);
+    }
 };
 
+inline CCloneablePhysicalMemory CSharedPhysicalMemory::connector() const {
+    return CCloneablePhysicalMemory(::shared_phys_clone(this->inner));
+}
+
 struct CVirtualMemory
     : BindDestr<VirtualMemoryObj, virt_free>
 {
@@ -73,8 +364,12 @@ struct CVirtualMemory
         : BindDestr(virt_mem) {}
 
     WRAP_FN_RAW(virt_read_raw_list);
+    WRAP_FN_RAW(virt_read_raw_list_status);
     WRAP_FN_RAW(virt_write_raw_list);
+    WRAP_FN_RAW(virt_prefetch);
+    WRAP_FN_RAW(virt_dump);
     WRAP_FN_RAW(virt_read_raw_into);
+    WRAP_FN_RAW(virt_read_ptr_chains);
     WRAP_FN_RAW(virt_read_u32);
     WRAP_FN_RAW(virt_read_u64);
     WRAP_FN_RAW(virt_write_raw);
@@ -92,6 +387,105 @@ struct CVirtualMemory
     int32_t virt_write(Address address, const T &data) {
         return this->virt_write_raw(address, (const uint8_t *)&data, sizeof(T));
     }
+
+#ifndef NO_STL_CONTAINERS
+    CVirtualBatcher virt_batcher() {
+        return CVirtualBatcher(this->inner);
+    }
+
+    // Resolves the chain `[[base + offsets[0]] + offsets[1]]...` for every base with one batched
+    // read per level, chains that hit an unreadable or null pointer resolve to an invalid address
+    template<size_t DEPTH>
+    std::vector<Address> read_ptr_chains(
+        const ArchitectureObj *arch,
+        const std::vector<Address> &bases,
+        const uintptr_t (&offsets)[DEPTH]
+    ) {
+        std::vector<uintptr_t> chain_offsets;
+        chain_offsets.reserve(bases.size() * DEPTH);
+        for (size_t i = 0; i < bases.size(); i++) {
+            chain_offsets.insert(chain_offsets.end(), offsets, offsets + DEPTH);
+        }
+        std::vector<uintptr_t> counts(bases.size(), DEPTH);
+
+        std::vector<Address> out(bases.size());
+        this->virt_read_ptr_chains(
+            arch,
+            bases.data(),
+            chain_offsets.data(),
+            counts.data(),
+            out.data(),
+            bases.size()
+        );
+        return out;
+    }
+
+    // Resolves the pointer chains and reads a `T` at the final address of every chain,
+    // the values of failed chains are value initialized
+    template<typename T, size_t DEPTH>
+    std::vector<T> read_ptr_chains(
+        const ArchitectureObj *arch,
+        const std::vector<Address> &bases,
+        const uintptr_t (&offsets)[DEPTH]
+    ) {
+        std::vector<Address> addrs = this->read_ptr_chains(arch, bases, offsets);
+        std::vector<T> out(addrs.size());
+        CVirtualBatcher batcher = this->virt_batcher();
+        for (size_t i = 0; i < addrs.size(); i++) {
+            if (addrs[i] != ~(Address)0) {
+                batcher.read_into(addrs[i], &out[i]);
+            }
+        }
+        batcher.commit_rw();
+        return out;
+    }
+#endif
+
+    // Moves this object onto the worker thread of a new read queue
+    CVirtualReadQueue read_queue() {
+        return CVirtualReadQueue(::virt_read_queue_new(this->invalidate()));
+    }
+};
+
+struct CPatternScanner
+    : BindDestr<PatternScanner, pattern_scanner_free>
+{
+    CPatternScanner(PatternScanner *scanner)
+        : BindDestr(scanner) {}
+
+    CPatternScanner()
+        : CPatternScanner(::pattern_scanner_new(0, 0)) {}
+
+    CPatternScanner(size_t chunk_size, size_t batch_size)
+        : CPatternScanner(::pattern_scanner_new(chunk_size, batch_size)) {}
+
+    WRAP_FN(pattern_scanner, add);
+    WRAP_FN(pattern_scanner, add_masked);
+    WRAP_FN_RAW(scan_buffer);
+
+    // Scans all mapped pages between `start` and `end`, `callback(match)` is called
+    // in ascending address order and stops the scan by returning a non-zero value
+    template<typename F>
+    size_t scan(CVirtualMemory &mem, Address start, Address end, F &callback) {
+        return ::virt_scan(mem.inner, this->inner, start, end, &scan_trampoline<F>, (void *)&callback);
+    }
+
+    template<typename F>
+    static int32_t scan_trampoline(void *ctx, ScanMatch found) {
+        return (*(F *)ctx)(found);
+    }
+
+#ifndef NO_STL_CONTAINERS
+    std::vector<ScanMatch> scan(CVirtualMemory &mem, Address start, Address end) {
+        std::vector<ScanMatch> matches;
+        auto push = [&matches](ScanMatch found) -> int32_t {
+            matches.push_back(found);
+            return 0;
+        };
+        this->scan(mem, start, end, push);
+        return matches;
+    }
+#endif
 };
 
 struct CArchitecture
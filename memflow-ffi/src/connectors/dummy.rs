@@ -0,0 +1,141 @@
+/*!
+In-memory dummy connector for tests and benchmarks of the C/C++ bindings.
+
+The memory stacks are assembled exactly like in the `memflow-bench` suite,
+so the results of both suites can be compared directly.
+*/
+
+use memflow::architecture::x86::x64;
+use memflow::error::Result;
+use memflow::mem::dummy::{DummyMemory, DummyProcess};
+use memflow::mem::{
+    CachedMemoryAccess, CachedVirtualTranslate, DefaultCacheValidator, DirectTranslate,
+    PhysicalMemory, VirtualDMA, VirtualTranslate,
+};
+use memflow::process::{OsProcessInfo, OsProcessModuleInfo};
+use memflow::types::{Address, PageType};
+
+use crate::mem::phys_mem::CloneablePhysicalMemoryObj;
+use crate::mem::virt_mem::VirtualMemoryObj;
+use crate::util::*;
+
+use log::trace;
+
+/// Create a new dummy connector
+///
+/// The connector is backed by `size` bytes of zeroed heap memory. If `cache_size` is non-zero,
+/// the connector is wrapped in a page cache with a size of `cache_size` bytes.
+///
+/// The instance needs to be freed using `connector_free`.
+#[no_mangle]
+pub extern "C" fn dummy_connector_new(
+    size: usize,
+    cache_size: usize,
+) -> Option<&'static mut CloneablePhysicalMemoryObj> {
+    let mem = DummyMemory::new(size);
+
+    let conn = if cache_size > 0 {
+        let cache = cached(mem, cache_size).map_err(inspect_err).ok()?;
+        to_heap(cache) as CloneablePhysicalMemoryObj
+    } else {
+        to_heap(mem) as CloneablePhysicalMemoryObj
+    };
+
+    trace!("dummy_connector_new: {:?}", conn as *const _);
+    Some(to_heap(conn))
+}
+
+/// Create the virtual memory of a new process on a dummy connector
+///
+/// This allocates a `size` bytes dummy connector and maps a process of `map_size` bytes into it.
+/// The base and size of a random module inside of that process, picked by
+/// `DummyProcess::get_module` with a minimum size of `module_size`, are written to
+/// `module_base` and `module_len`.
+///
+/// If `cache_size` is non-zero, the physical memory is wrapped in a page cache with a size of
+/// `cache_size` bytes. If `use_tlb` is set, virtual address translations are cached.
+///
+/// The instance needs to be freed using `dummy_virt_free`.
+#[no_mangle]
+pub extern "C" fn dummy_virt_new(
+    size: usize,
+    map_size: usize,
+    module_size: usize,
+    cache_size: usize,
+    use_tlb: bool,
+    module_base: &mut Address,
+    module_len: &mut usize,
+) -> Option<&'static mut VirtualMemoryObj> {
+    let mut mem = DummyMemory::new(size);
+    let proc = mem.alloc_process(map_size, &[]);
+
+    let module = proc.get_module(module_size);
+    *module_base = module.base();
+    *module_len = module.size();
+
+    let virt_mem = if cache_size > 0 {
+        let cache = cached(mem, cache_size).map_err(inspect_err).ok()?;
+        virt_with_mem(cache, &proc, use_tlb)
+    } else {
+        virt_with_mem(mem, &proc, use_tlb)
+    }?;
+
+    trace!("dummy_virt_new: {:?}", virt_mem as *const _);
+    Some(to_heap(virt_mem))
+}
+
+/// Free a virtual memory object created by `dummy_virt_new`
+///
+/// Unlike `virt_free`, this also frees the underlying dummy connector.
+///
+/// # Safety
+///
+/// `mem` has to point to a valid `VirtualMemoryObj` created by `dummy_virt_new`.
+#[no_mangle]
+pub unsafe extern "C" fn dummy_virt_free(mem: &'static mut VirtualMemoryObj) {
+    trace!("dummy_virt_free: {:?}", mem as *mut _);
+    let _ = Box::from_raw(*Box::from_raw(mem));
+}
+
+fn cached<T: PhysicalMemory>(
+    mem: T,
+    cache_size: usize,
+) -> Result<CachedMemoryAccess<'static, T, DefaultCacheValidator>> {
+    CachedMemoryAccess::builder(mem)
+        .arch(x64::ARCH)
+        .cache_size(cache_size)
+        .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE)
+        .build()
+}
+
+fn virt_with_mem<T: PhysicalMemory + 'static>(
+    mem: T,
+    proc: &DummyProcess,
+    use_tlb: bool,
+) -> Option<VirtualMemoryObj> {
+    let vat = DirectTranslate::new();
+
+    if use_tlb {
+        let vat = CachedVirtualTranslate::builder(vat)
+            .arch(proc.sys_arch())
+            .build()
+            .map_err(inspect_err)
+            .ok()?;
+        Some(virt_with_vat(mem, proc, vat))
+    } else {
+        Some(virt_with_vat(mem, proc, vat))
+    }
+}
+
+fn virt_with_vat<T: PhysicalMemory + 'static, V: VirtualTranslate + 'static>(
+    mem: T,
+    proc: &DummyProcess,
+    vat: V,
+) -> VirtualMemoryObj {
+    to_heap(VirtualDMA::with_vat(
+        mem,
+        proc.proc_arch(),
+        proc.translator(),
+        vat,
+    ))
+}
@@ -10,6 +10,9 @@ use crate::mem::phys_mem::CloneablePhysicalMemoryObj;
 
 use log::trace;
 
+#[cfg(feature = "dummy_mem")]
+pub mod dummy;
+
 /// Create a new connector inventory
 ///
 /// This function will try to find connectors using PATH environment variable
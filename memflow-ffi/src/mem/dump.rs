@@ -0,0 +1,150 @@
+use memflow::mem::dump::{DumpRange, DumpStats, MemoryDumper, WriteSink};
+use memflow::mem::{PhysicalMemory, VirtualMemory};
+use memflow::types::Address;
+
+use super::phys_mem::CloneablePhysicalMemoryObj;
+use super::virt_mem::VirtualMemoryObj;
+use crate::util::*;
+
+use std::ffi::{c_void, CStr};
+use std::fs::File;
+use std::io::BufWriter;
+use std::os::raw::c_char;
+use std::slice::from_raw_parts;
+
+use memflow::error::{Error, Result};
+
+/// Receives the dumped ranges in ascending order
+///
+/// Returning a non-zero value aborts the dump.
+pub type DumpCallback =
+    extern "C" fn(ctx: *mut c_void, address: Address, data: *const u8, len: usize) -> i32;
+
+/// Dump physical memory ranges in parallel
+///
+/// Reads all `ranges` with `threads` worker threads, each using a clone of `mem`, and passes them
+/// in order to `callback`. If `ranges_len` is 0 the entire physical memory is dumped.
+/// At most `max_in_flight` chunks of `chunk_size` bytes are buffered at any time.
+/// Passing 0 for `threads`, `chunk_size` or `max_in_flight` selects the default value.
+///
+/// If `stats` is not null it is filled with the statistics of the dump.
+///
+/// # Safety
+///
+/// `ranges` must be a valid array of `DumpRange` with the length of at least `ranges_len`,
+/// `stats` must be either null or a valid pointer to `DumpStats`.
+#[no_mangle]
+pub unsafe extern "C" fn phys_dump(
+    mem: &CloneablePhysicalMemoryObj,
+    ranges: *const DumpRange,
+    ranges_len: usize,
+    threads: usize,
+    chunk_size: usize,
+    max_in_flight: usize,
+    callback: DumpCallback,
+    ctx: *mut c_void,
+    stats: *mut DumpStats,
+) -> i32 {
+    let ranges = if ranges_len == 0 {
+        vec![DumpRange::physical(Address::NULL, mem.metadata().size)]
+    } else {
+        from_raw_parts(ranges, ranges_len).to_vec()
+    };
+
+    dumper(threads, chunk_size, max_in_flight)
+        .dump(&**mem, &ranges, &mut callback_sink(callback, ctx))
+        .map(|s| write_stats(stats, s))
+        .int_result()
+}
+
+/// Dump the entire physical memory into a raw image file
+///
+/// See `phys_dump` for a description of the parameters.
+///
+/// # Safety
+///
+/// `path` must be a valid null terminated string,
+/// `stats` must be either null or a valid pointer to `DumpStats`.
+#[no_mangle]
+pub unsafe extern "C" fn phys_dump_file(
+    mem: &CloneablePhysicalMemoryObj,
+    path: *const c_char,
+    threads: usize,
+    chunk_size: usize,
+    max_in_flight: usize,
+    stats: *mut DumpStats,
+) -> i32 {
+    let path = CStr::from_ptr(path).to_string_lossy();
+
+    File::create(&*path)
+        .map_err(|_| Error::IO("unable to create dump file"))
+        .and_then(|file| {
+            dumper(threads, chunk_size, max_in_flight).dump(
+                &**mem,
+                &[DumpRange::physical(Address::NULL, mem.metadata().size)],
+                &mut WriteSink(BufWriter::new(file)),
+            )
+        })
+        .map(|s| write_stats(stats, s))
+        .int_result()
+}
+
+/// Dump all mapped pages of a virtual address space in parallel
+///
+/// The translation map of `virt_mem` is read once, the pages are then read from clones of `mem`
+/// and passed to `callback` at their virtual addresses in ascending order.
+/// See `phys_dump` for a description of the remaining parameters.
+///
+/// `mem` has to be the physical memory object `virt_mem` reads from.
+///
+/// # Safety
+///
+/// `stats` must be either null or a valid pointer to `DumpStats`.
+#[no_mangle]
+pub unsafe extern "C" fn virt_dump(
+    virt_mem: &mut VirtualMemoryObj,
+    mem: &CloneablePhysicalMemoryObj,
+    threads: usize,
+    chunk_size: usize,
+    max_in_flight: usize,
+    callback: DumpCallback,
+    ctx: *mut c_void,
+    stats: *mut DumpStats,
+) -> i32 {
+    let ranges = DumpRange::from_translation_map(&virt_mem.virt_translation_map());
+
+    dumper(threads, chunk_size, max_in_flight)
+        .dump(&**mem, &ranges, &mut callback_sink(callback, ctx))
+        .map(|s| write_stats(stats, s))
+        .int_result()
+}
+
+fn dumper(threads: usize, chunk_size: usize, max_in_flight: usize) -> MemoryDumper {
+    let mut dumper = MemoryDumper::new();
+    if threads != 0 {
+        dumper = dumper.threads(threads);
+    }
+    if chunk_size != 0 {
+        dumper = dumper.chunk_size(chunk_size);
+    }
+    if max_in_flight != 0 {
+        dumper = dumper.max_in_flight(max_in_flight);
+    }
+    dumper
+}
+
+fn callback_sink(
+    callback: DumpCallback,
+    ctx: *mut c_void,
+) -> impl FnMut(Address, &[u8]) -> Result<()> {
+    move |address, data: &[u8]| match callback(ctx, address, data.as_ptr(), data.len()) {
+        0 => Ok(()),
+        _ => Err(Error::Other("dump aborted by callback")),
+    }
+}
+
+unsafe fn write_stats(out: *mut DumpStats, stats: DumpStats) {
+    if let Some(out) = out.as_mut() {
+        *out = stats;
+    }
+}
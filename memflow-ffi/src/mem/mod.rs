@@ -1,2 +1,5 @@
+pub mod dump;
 pub mod phys_mem;
+pub mod read_queue;
+pub mod scan;
 pub mod virt_mem;
@@ -1,3 +1,4 @@
+use memflow::connector::SharedConnector;
 use memflow::mem::phys_mem::*;
 use memflow::types::PhysicalAddress;
 
@@ -10,6 +11,64 @@ use log::trace;
 pub type CloneablePhysicalMemoryObj = &'static mut dyn CloneablePhysicalMemory;
 pub type PhysicalMemoryObj = &'static mut dyn PhysicalMemory;
 
+/// A single read of a physical read list
+///
+/// `len` bytes are read from `address` into `buf`. `buf` may be null if `len` is 0.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct PhysicalReadEntry {
+    pub address: PhysicalAddress,
+    pub buf: *mut u8,
+    pub len: usize,
+}
+
+impl PhysicalReadEntry {
+    /// Converts a caller provided list into the `PhysicalReadData` of the Rust library.
+    ///
+    /// # Safety
+    ///
+    /// `entries` must be a valid array of `len` entries (or null), the buffers of all entries
+    /// have to be valid for writes of their length and must not overlap.
+    pub(crate) unsafe fn data_list<'a>(
+        entries: *const Self,
+        len: usize,
+    ) -> Vec<PhysicalReadData<'a>> {
+        slice_from_raw(entries, len)
+            .iter()
+            .map(|e| PhysicalReadData(e.address, slice_from_raw_mut(e.buf, e.len)))
+            .collect()
+    }
+}
+
+/// A single write of a physical write list
+///
+/// `len` bytes are written from `buf` to `address`. `buf` may be null if `len` is 0.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct PhysicalWriteEntry {
+    pub address: PhysicalAddress,
+    pub buf: *const u8,
+    pub len: usize,
+}
+
+impl PhysicalWriteEntry {
+    /// Converts a caller provided list into the `PhysicalWriteData` of the Rust library.
+    ///
+    /// # Safety
+    ///
+    /// `entries` must be a valid array of `len` entries (or null), the buffers of all entries
+    /// have to be valid for reads of their length.
+    pub(crate) unsafe fn data_list<'a>(
+        entries: *const Self,
+        len: usize,
+    ) -> Vec<PhysicalWriteData<'a>> {
+        slice_from_raw(entries, len)
+            .iter()
+            .map(|e| PhysicalWriteData(e.address, slice_from_raw(e.buf, e.len)))
+            .collect()
+    }
+}
+
 /// Downcast a cloneable physical memory into a physical memory object.
 ///
 /// This function will take a `cloneable` and turn it into a `PhysicalMemoryObj`, which then can be
@@ -46,15 +105,16 @@ pub unsafe extern "C" fn phys_free(mem: &'static mut PhysicalMemoryObj) {
 ///
 /// # Safety
 ///
-/// `data` must be a valid array of `PhysicalReadData` with the length of at least `len`
+/// `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+/// the buffers of the entries must not overlap.
 #[no_mangle]
 pub unsafe extern "C" fn phys_read_raw_list(
     mem: &mut PhysicalMemoryObj,
-    data: *mut PhysicalReadData,
+    data: *const PhysicalReadEntry,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts_mut(data, len);
-    mem.phys_read_raw_list(data).int_result()
+    let mut data = PhysicalReadEntry::data_list(data, len);
+    mem.phys_read_raw_list(&mut data).int_result()
 }
 
 /// Write a list of values
@@ -64,15 +124,15 @@ pub unsafe extern "C" fn phys_read_raw_list(
 ///
 /// # Safety
 ///
-/// `data` must be a valid array of `PhysicalWriteData` with the length of at least `len`
+/// `data` must be a valid array of `PhysicalWriteEntry` with the length of at least `len`
 #[no_mangle]
 pub unsafe extern "C" fn phys_write_raw_list(
     mem: &mut PhysicalMemoryObj,
-    data: *const PhysicalWriteData,
+    data: *const PhysicalWriteEntry,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts(data, len);
-    mem.phys_write_raw_list(data).int_result()
+    let data = PhysicalWriteEntry::data_list(data, len);
+    mem.phys_write_raw_list(&data).int_result()
 }
 
 /// Retrieve metadata about the physical memory object
@@ -81,6 +141,20 @@ pub extern "C" fn phys_metadata(mem: &PhysicalMemoryObj) -> PhysicalMemoryMetada
     mem.metadata()
 }
 
+/// Prefetch a range of physical memory
+///
+/// This hints the physical memory object that `len` bytes starting at `addr` will be read soon.
+/// Caching memory objects will fill their page cache for the range in a single batched read,
+/// other objects ignore the hint.
+#[no_mangle]
+pub extern "C" fn phys_prefetch(
+    mem: &mut PhysicalMemoryObj,
+    addr: PhysicalAddress,
+    len: usize,
+) -> i32 {
+    mem.phys_prefetch(addr, len).int_result()
+}
+
 /// Read a single value into `out` from a provided `PhysicalAddress`
 ///
 /// # Safety
@@ -144,3 +218,129 @@ pub extern "C" fn phys_write_u64(
 ) -> i32 {
     mem.phys_write(addr, &val).int_result()
 }
+
+pub type SharedPhysicalMemoryObj = SharedConnector<PhysicalMemoryBox>;
+
+/// Create a thread-safe shared handle of a connector
+///
+/// This consumes `conn`, which must not be used or freed afterwards. All functions taking a
+/// `SharedPhysicalMemoryObj` can be called from multiple threads at once, concurrent reads are
+/// merged into larger batches before they reach the connector.
+///
+/// The handle has to be freed using `shared_phys_free`.
+///
+/// # Safety
+///
+/// `conn` has to point to a valid `CloneablePhysicalMemoryObj` created by one of the provided
+/// functions.
+#[no_mangle]
+pub unsafe extern "C" fn connector_shared(
+    conn: &'static mut CloneablePhysicalMemoryObj,
+) -> &'static mut SharedPhysicalMemoryObj {
+    trace!("connector_shared: {:?}", conn as *mut _);
+    let conn: PhysicalMemoryBox = Box::from_raw(*Box::from_raw(conn));
+    to_heap(SharedConnector::new(conn))
+}
+
+/// Create a connector that refers to a shared handle
+///
+/// The returned connector can be used like any other connector, e.g. to build a kernel on another
+/// thread, all its reads go through the queue of `mem`. It has to be freed using `connector_free`.
+#[no_mangle]
+pub extern "C" fn shared_phys_clone(
+    mem: &SharedPhysicalMemoryObj,
+) -> &'static mut CloneablePhysicalMemoryObj {
+    let conn: PhysicalMemoryBox = Box::new(mem.clone());
+    Box::leak(Box::new(Box::leak(conn)))
+}
+
+/// Free a shared handle
+///
+/// Connectors created with `shared_phys_clone` stay valid.
+///
+/// # Safety
+///
+/// `mem` must point to a valid `SharedPhysicalMemoryObj` that was created using `connector_shared`.
+#[no_mangle]
+pub unsafe extern "C" fn shared_phys_free(mem: &'static mut SharedPhysicalMemoryObj) {
+    trace!("shared_phys_free: {:?}", mem as *mut _);
+    let _ = Box::from_raw(mem);
+}
+
+/// Read a list of values through a shared handle
+///
+/// This function is thread-safe. The reads are queued together with the reads of other threads
+/// and the function blocks until they were performed.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+/// the buffers of the entries must not overlap.
+#[no_mangle]
+pub unsafe extern "C" fn shared_phys_read_raw_list(
+    mem: &SharedPhysicalMemoryObj,
+    data: *const PhysicalReadEntry,
+    len: usize,
+) -> i32 {
+    let mut data = PhysicalReadEntry::data_list(data, len);
+    mem.read_raw_list(&mut data).int_result()
+}
+
+/// Write a list of values through a shared handle
+///
+/// This function is thread-safe.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `PhysicalWriteEntry` with the length of at least `len`
+#[no_mangle]
+pub unsafe extern "C" fn shared_phys_write_raw_list(
+    mem: &SharedPhysicalMemoryObj,
+    data: *const PhysicalWriteEntry,
+    len: usize,
+) -> i32 {
+    let data = PhysicalWriteEntry::data_list(data, len);
+    mem.write_raw_list(&data).int_result()
+}
+
+/// Retrieve metadata about the connector of a shared handle
+#[no_mangle]
+pub extern "C" fn shared_phys_metadata(mem: &SharedPhysicalMemoryObj) -> PhysicalMemoryMetadata {
+    mem.metadata()
+}
+
+/// Read a single value into `out` from a provided `PhysicalAddress` through a shared handle
+///
+/// This function is thread-safe.
+///
+/// # Safety
+///
+/// `out` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn shared_phys_read_raw_into(
+    mem: &SharedPhysicalMemoryObj,
+    addr: PhysicalAddress,
+    out: *mut u8,
+    len: usize,
+) -> i32 {
+    mem.read_raw_list(&mut [PhysicalReadData(addr, from_raw_parts_mut(out, len))])
+        .int_result()
+}
+
+/// Write a single value from `input` into a provided `PhysicalAddress` through a shared handle
+///
+/// This function is thread-safe.
+///
+/// # Safety
+///
+/// `input` must be a valid pointer to a data buffer of at least `len` size.
+#[no_mangle]
+pub unsafe extern "C" fn shared_phys_write_raw(
+    mem: &SharedPhysicalMemoryObj,
+    addr: PhysicalAddress,
+    input: *const u8,
+    len: usize,
+) -> i32 {
+    mem.write_raw_list(&[PhysicalWriteData(addr, from_raw_parts(input, len))])
+        .int_result()
+}
@@ -0,0 +1,376 @@
+use memflow::error::PartialResultExt;
+
+use super::phys_mem::{PhysicalMemoryObj, PhysicalReadEntry};
+use super::virt_mem::{VirtualMemoryObj, VirtualReadEntry};
+use crate::util::*;
+
+use std::collections::HashMap;
+use std::ffi::c_void;
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread::{self, JoinHandle};
+
+use log::trace;
+
+/// Identifies a read that was submitted to a read queue
+///
+/// Valid tickets are never 0.
+pub type ReadTicket = u64;
+
+/// Receives the result of a queued read on the worker thread of the queue
+pub type ReadCallback = Option<extern "C" fn(ctx: *mut c_void, ticket: ReadTicket, result: i32)>;
+
+pub type PhysicalReadQueue = ReadQueue<PhysicalMemoryObj>;
+pub type VirtualReadQueue = ReadQueue<VirtualMemoryObj>;
+
+/// A memory object that can be driven by the worker of a `ReadQueue`.
+pub trait QueuedMemory: Send + 'static {
+    type Entry: Copy + 'static;
+
+    /// # Safety
+    ///
+    /// The buffers of all entries have to be valid for writes of their length and must not overlap.
+    unsafe fn read_list(&mut self, data: &[Self::Entry]) -> i32;
+}
+
+impl QueuedMemory for PhysicalMemoryObj {
+    type Entry = PhysicalReadEntry;
+
+    unsafe fn read_list(&mut self, data: &[Self::Entry]) -> i32 {
+        let mut data = PhysicalReadEntry::data_list(data.as_ptr(), data.len());
+        self.phys_read_raw_list(&mut data).int_result()
+    }
+}
+
+impl QueuedMemory for VirtualMemoryObj {
+    type Entry = VirtualReadEntry;
+
+    unsafe fn read_list(&mut self, data: &[Self::Entry]) -> i32 {
+        let mut data = VirtualReadEntry::data_list(data.as_ptr(), data.len());
+        self.virt_read_raw_list(&mut data).data_part().int_result()
+    }
+}
+
+struct Job<D> {
+    ticket: ReadTicket,
+    data: *const D,
+    len: usize,
+    callback: ReadCallback,
+    ctx: *mut c_void,
+}
+
+// the buffers of a job are owned by the submitter until the job has been completed
+unsafe impl<D> Send for Job<D> {}
+
+struct QueueState<D> {
+    pending: Vec<Job<D>>,
+    // results of the tickets without a callback, `None` while they are in flight
+    tickets: HashMap<ReadTicket, Option<i32>>,
+    next_ticket: ReadTicket,
+    shutdown: bool,
+}
+
+struct QueueShared<D> {
+    state: Mutex<QueueState<D>>,
+    submitted: Condvar,
+    completed: Condvar,
+}
+
+/// Performs reads on a worker thread and reports their completion through tickets or callbacks.
+///
+/// All reads that are submitted while the worker is busy are performed in a single list call
+/// once it becomes idle, this allows connectors to keep many requests in flight.
+/// Should the combined call fail the jobs are retried one by one to report accurate results.
+pub struct ReadQueue<M: QueuedMemory> {
+    shared: Arc<QueueShared<M::Entry>>,
+    worker: Option<JoinHandle<()>>,
+}
+
+impl<M: QueuedMemory> ReadQueue<M> {
+    pub fn new(mem: M) -> Self {
+        let shared = Arc::new(QueueShared {
+            state: Mutex::new(QueueState {
+                pending: Vec::new(),
+                tickets: HashMap::new(),
+                next_ticket: 1,
+                shutdown: false,
+            }),
+            submitted: Condvar::new(),
+            completed: Condvar::new(),
+        });
+
+        let worker_shared = shared.clone();
+        let worker = thread::Builder::new()
+            .name("memflow-read-queue".to_string())
+            .spawn(move || run_worker(mem, &worker_shared))
+            .map_err(inspect_err)
+            .ok();
+
+        Self { shared, worker }
+    }
+
+    /// Queues a read list, returns 0 if the queue has no worker.
+    ///
+    /// # Safety
+    ///
+    /// `data` and all its buffers have to stay valid until the read has been completed.
+    pub unsafe fn submit(
+        &self,
+        data: *const M::Entry,
+        len: usize,
+        callback: ReadCallback,
+        ctx: *mut c_void,
+    ) -> ReadTicket {
+        if self.worker.is_none() {
+            return 0;
+        }
+
+        let mut state = self.shared.state.lock().unwrap();
+        let ticket = state.next_ticket;
+        state.next_ticket += 1;
+        if callback.is_none() {
+            state.tickets.insert(ticket, None);
+        }
+        state.pending.push(Job {
+            ticket,
+            data,
+            len,
+            callback,
+            ctx,
+        });
+        self.shared.submitted.notify_one();
+        ticket
+    }
+
+    /// Returns the result of a completed ticket and forgets the ticket.
+    ///
+    /// Unknown tickets complete with an error.
+    pub fn poll(&self, ticket: ReadTicket) -> Option<i32> {
+        let mut state = self.shared.state.lock().unwrap();
+        match state.tickets.get(&ticket) {
+            Some(None) => None,
+            Some(Some(_)) => state.tickets.remove(&ticket).unwrap(),
+            None => Some(-1),
+        }
+    }
+
+    /// Blocks until the ticket has been completed and returns its result.
+    pub fn wait(&self, ticket: ReadTicket) -> i32 {
+        let mut state = self.shared.state.lock().unwrap();
+        loop {
+            match state.tickets.get(&ticket) {
+                Some(None) => state = self.shared.completed.wait(state).unwrap(),
+                Some(Some(_)) => return state.tickets.remove(&ticket).unwrap().unwrap(),
+                None => return -1,
+            }
+        }
+    }
+}
+
+impl<M: QueuedMemory> Drop for ReadQueue<M> {
+    fn drop(&mut self) {
+        self.shared.state.lock().unwrap().shutdown = true;
+        self.shared.submitted.notify_one();
+        if let Some(worker) = self.worker.take() {
+            worker.join().ok();
+        }
+    }
+}
+
+fn run_worker<M: QueuedMemory>(mut mem: M, shared: &QueueShared<M::Entry>) {
+    let mut data = Vec::new();
+    let mut results = Vec::new();
+
+    loop {
+        let jobs = {
+            let mut state = shared.state.lock().unwrap();
+            while state.pending.is_empty() && !state.shutdown {
+                state = shared.submitted.wait(state).unwrap();
+            }
+            if state.pending.is_empty() {
+                return;
+            }
+            std::mem::replace(&mut state.pending, Vec::new())
+        };
+
+        for job in jobs.iter() {
+            data.extend_from_slice(unsafe { slice_from_raw(job.data, job.len) });
+        }
+        let ret = unsafe { mem.read_list(&data) };
+        data.clear();
+
+        results.clear();
+        for job in jobs.iter() {
+            let result = if ret == 0 || jobs.len() == 1 {
+                ret
+            } else {
+                unsafe { mem.read_list(slice_from_raw(job.data, job.len)) }
+            };
+            match job.callback {
+                Some(callback) => callback(job.ctx, job.ticket, result),
+                None => results.push((job.ticket, result)),
+            }
+        }
+
+        if !results.is_empty() {
+            let mut state = shared.state.lock().unwrap();
+            for &(ticket, result) in results.iter() {
+                state.tickets.insert(ticket, Some(result));
+            }
+            shared.completed.notify_all();
+        }
+    }
+}
+
+/// Create a read queue that performs physical reads on a worker thread
+///
+/// This takes over `mem`, which must not be used or freed afterwards. The connector `mem` was
+/// created from has to outlive the queue. The queue has to be freed using `phys_read_queue_free`.
+///
+/// # Safety
+///
+/// `mem` must point to a valid `PhysicalMemoryObj` that was created using one of the provided
+/// functions.
+#[no_mangle]
+pub unsafe extern "C" fn phys_read_queue_new(
+    mem: &'static mut PhysicalMemoryObj,
+) -> &'static mut PhysicalReadQueue {
+    trace!("phys_read_queue_new: {:?}", mem as *mut _);
+    to_heap(ReadQueue::new(*Box::from_raw(mem)))
+}
+
+/// Submit a list of physical reads to the queue
+///
+/// This function is thread-safe and returns immediately. If `callback` is set it is called with
+/// the result on the worker thread, otherwise the result has to be retrieved with `phys_read_poll`
+/// or `phys_read_wait`. Returns 0 if the read could not be queued.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `PhysicalReadEntry` with the length of at least `len`,
+/// both the array and its buffers have to stay valid until the read has been completed.
+#[no_mangle]
+pub unsafe extern "C" fn phys_read_submit(
+    queue: &PhysicalReadQueue,
+    data: *const PhysicalReadEntry,
+    len: usize,
+    callback: ReadCallback,
+    ctx: *mut c_void,
+) -> ReadTicket {
+    queue.submit(data, len, callback, ctx)
+}
+
+/// Check whether a submitted physical read has been completed
+///
+/// Returns `true` and writes the result into `result` once the read has been completed.
+/// Afterwards the ticket becomes invalid. Tickets with a callback can not be polled.
+///
+/// # Safety
+///
+/// `result` must be a valid pointer to an `i32`
+#[no_mangle]
+pub unsafe extern "C" fn phys_read_poll(
+    queue: &PhysicalReadQueue,
+    ticket: ReadTicket,
+    result: *mut i32,
+) -> bool {
+    queue.poll(ticket).map(|r| *result = r).is_some()
+}
+
+/// Wait for a submitted physical read and return its result
+///
+/// Afterwards the ticket becomes invalid.
+#[no_mangle]
+pub extern "C" fn phys_read_wait(queue: &PhysicalReadQueue, ticket: ReadTicket) -> i32 {
+    queue.wait(ticket)
+}
+
+/// Free a physical read queue
+///
+/// All submitted reads are completed before the function returns.
+///
+/// # Safety
+///
+/// `queue` must point to a valid `PhysicalReadQueue` that was created using `phys_read_queue_new`.
+#[no_mangle]
+pub unsafe extern "C" fn phys_read_queue_free(queue: &'static mut PhysicalReadQueue) {
+    trace!("phys_read_queue_free: {:?}", queue as *mut _);
+    let _ = Box::from_raw(queue);
+}
+
+/// Create a read queue that performs virtual reads on a worker thread
+///
+/// This takes over `mem`, which must not be used or freed afterwards. The object `mem` was
+/// created from has to outlive the queue. The queue has to be freed using `virt_read_queue_free`.
+///
+/// # Safety
+///
+/// `mem` must point to a valid `VirtualMemoryObj` that was created using one of the provided
+/// functions.
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_queue_new(
+    mem: &'static mut VirtualMemoryObj,
+) -> &'static mut VirtualReadQueue {
+    trace!("virt_read_queue_new: {:?}", mem as *mut _);
+    to_heap(ReadQueue::new(*Box::from_raw(mem)))
+}
+
+/// Submit a list of virtual reads to the queue
+///
+/// This function is thread-safe and returns immediately. If `callback` is set it is called with
+/// the result on the worker thread, otherwise the result has to be retrieved with `virt_read_poll`
+/// or `virt_read_wait`. Returns 0 if the read could not be queued.
+///
+/// Like `virt_read_raw_list`, partially unmapped reads are not reported as an error.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+/// both the array and its buffers have to stay valid until the read has been completed.
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_submit(
+    queue: &VirtualReadQueue,
+    data: *const VirtualReadEntry,
+    len: usize,
+    callback: ReadCallback,
+    ctx: *mut c_void,
+) -> ReadTicket {
+    queue.submit(data, len, callback, ctx)
+}
+
+/// Check whether a submitted virtual read has been completed
+///
+/// Returns `true` and writes the result into `result` once the read has been completed.
+/// Afterwards the ticket becomes invalid. Tickets with a callback can not be polled.
+///
+/// # Safety
+///
+/// `result` must be a valid pointer to an `i32`
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_poll(
+    queue: &VirtualReadQueue,
+    ticket: ReadTicket,
+    result: *mut i32,
+) -> bool {
+    queue.poll(ticket).map(|r| *result = r).is_some()
+}
+
+/// Wait for a submitted virtual read and return its result
+///
+/// Afterwards the ticket becomes invalid.
+#[no_mangle]
+pub extern "C" fn virt_read_wait(queue: &VirtualReadQueue, ticket: ReadTicket) -> i32 {
+    queue.wait(ticket)
+}
+
+/// Free a virtual read queue
+///
+/// All submitted reads are completed before the function returns.
+///
+/// # Safety
+///
+/// `queue` must point to a valid `VirtualReadQueue` that was created using `virt_read_queue_new`.
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_queue_free(queue: &'static mut VirtualReadQueue) {
+    trace!("virt_read_queue_free: {:?}", queue as *mut _);
+    let _ = Box::from_raw(queue);
+}
@@ -0,0 +1,132 @@
+use memflow::mem::scan::{Pattern, PatternScanner, ScanMatch};
+use memflow::types::Address;
+
+use super::virt_mem::VirtualMemoryObj;
+use crate::util::*;
+
+use std::ffi::{c_void, CStr};
+use std::os::raw::c_char;
+use std::slice::from_raw_parts;
+
+/// Receives the matches of a scan in ascending address order
+///
+/// Returning a non-zero value stops the scan.
+pub type ScanCallback = extern "C" fn(ctx: *mut c_void, found: ScanMatch) -> i32;
+
+/// Create a new pattern scanner without any patterns
+///
+/// Chunk and batch sizes may be 0 to select the default values.
+#[no_mangle]
+pub extern "C" fn pattern_scanner_new(
+    chunk_size: usize,
+    batch_size: usize,
+) -> &'static mut PatternScanner {
+    let mut scanner = PatternScanner::new();
+    if chunk_size != 0 {
+        scanner = scanner.chunk_size(chunk_size);
+    }
+    if batch_size != 0 {
+        scanner = scanner.batch_size(batch_size);
+    }
+    to_heap(scanner)
+}
+
+/// Add a pattern in the `"48 8B 05 ? ? ? ?"` notation to the scanner
+///
+/// Patterns are numbered in the order they are added, starting with 0.
+///
+/// # Safety
+///
+/// `pattern` must be a valid null terminated string
+#[no_mangle]
+pub unsafe extern "C" fn pattern_scanner_add(
+    scanner: &mut PatternScanner,
+    pattern: *const c_char,
+) -> i32 {
+    let pattern = CStr::from_ptr(pattern).to_string_lossy();
+    Pattern::from_ida(&pattern)
+        .map(|p| scanner.add_pattern(p))
+        .int_result_logged()
+}
+
+/// Add a masked byte pattern to the scanner
+///
+/// Every byte of the target memory is compared with `bytes[i]` under `mask[i]`,
+/// a mask of `0x00` marks a wildcard.
+///
+/// # Safety
+///
+/// `bytes` and `mask` must be valid arrays of bytes with the length of at least `len`
+#[no_mangle]
+pub unsafe extern "C" fn pattern_scanner_add_masked(
+    scanner: &mut PatternScanner,
+    bytes: *const u8,
+    mask: *const u8,
+    len: usize,
+) -> i32 {
+    Pattern::new(from_raw_parts(bytes, len), from_raw_parts(mask, len))
+        .map(|p| scanner.add_pattern(p))
+        .int_result_logged()
+}
+
+/// Free a pattern scanner
+///
+/// # Safety
+///
+/// `scanner` must be a valid reference to a pattern scanner created with `pattern_scanner_new`.
+#[no_mangle]
+pub unsafe extern "C" fn pattern_scanner_free(scanner: &'static mut PatternScanner) {
+    let _ = Box::from_raw(scanner);
+}
+
+/// Scan all mapped pages between `start` and `end` for the patterns of `scanner`
+///
+/// Every match is passed to `callback` in ascending address order.
+/// Returns the number of matches the callback accepted, the match on which the callback
+/// stopped the scan is not counted.
+#[no_mangle]
+pub extern "C" fn virt_scan(
+    mem: &mut VirtualMemoryObj,
+    scanner: &PatternScanner,
+    start: Address,
+    end: Address,
+    callback: ScanCallback,
+    ctx: *mut c_void,
+) -> usize {
+    let mut count = 0;
+    scanner.scan_with(mem, start, end, |found| {
+        let accepted = callback(ctx, found) == 0;
+        if accepted {
+            count += 1;
+        }
+        accepted
+    });
+    count
+}
+
+/// Scan a local buffer for the patterns of `scanner`
+///
+/// The buffer is assumed to be located at `base`, matches are written into `out`.
+/// Returns the total number of matches, which may be larger than `max_matches`.
+///
+/// # Safety
+///
+/// `buf` must be a valid array of bytes with the length of at least `len`,
+/// `out` must be a valid array of `ScanMatch` with the length of at least `max_matches`
+#[no_mangle]
+pub unsafe extern "C" fn scan_buffer(
+    scanner: &PatternScanner,
+    base: Address,
+    buf: *const u8,
+    len: usize,
+    out: *mut ScanMatch,
+    max_matches: usize,
+) -> usize {
+    let mut matches = Vec::new();
+    scanner.scan_buffer(base, from_raw_parts(buf, len), &mut matches);
+    if max_matches != 0 {
+        let len = std::cmp::min(matches.len(), max_matches);
+        std::ptr::copy_nonoverlapping(matches.as_ptr(), out, len);
+    }
+    matches.len()
+}
@@ -1,3 +1,4 @@
+use memflow::architecture::ArchitectureObj;
 use memflow::error::PartialResultExt;
 use memflow::mem::virt_mem::*;
 use memflow::types::Address;
@@ -8,6 +9,64 @@ use std::slice::{from_raw_parts, from_raw_parts_mut};
 
 pub type VirtualMemoryObj = &'static mut dyn VirtualMemory;
 
+/// A single read of a virtual read list
+///
+/// `len` bytes are read from `address` into `buf`. `buf` may be null if `len` is 0.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct VirtualReadEntry {
+    pub address: Address,
+    pub buf: *mut u8,
+    pub len: usize,
+}
+
+impl VirtualReadEntry {
+    /// Converts a caller provided list into the `VirtualReadData` of the Rust library.
+    ///
+    /// # Safety
+    ///
+    /// `entries` must be a valid array of `len` entries (or null), the buffers of all entries
+    /// have to be valid for writes of their length and must not overlap.
+    pub(crate) unsafe fn data_list<'a>(
+        entries: *const Self,
+        len: usize,
+    ) -> Vec<VirtualReadData<'a>> {
+        slice_from_raw(entries, len)
+            .iter()
+            .map(|e| VirtualReadData(e.address, slice_from_raw_mut(e.buf, e.len)))
+            .collect()
+    }
+}
+
+/// A single write of a virtual write list
+///
+/// `len` bytes are written from `buf` to `address`. `buf` may be null if `len` is 0.
+#[repr(C)]
+#[derive(Clone, Copy)]
+pub struct VirtualWriteEntry {
+    pub address: Address,
+    pub buf: *const u8,
+    pub len: usize,
+}
+
+impl VirtualWriteEntry {
+    /// Converts a caller provided list into the `VirtualWriteData` of the Rust library.
+    ///
+    /// # Safety
+    ///
+    /// `entries` must be a valid array of `len` entries (or null), the buffers of all entries
+    /// have to be valid for reads of their length.
+    pub(crate) unsafe fn data_list<'a>(
+        entries: *const Self,
+        len: usize,
+    ) -> Vec<VirtualWriteData<'a>> {
+        slice_from_raw(entries, len)
+            .iter()
+            .map(|e| VirtualWriteData(e.address, slice_from_raw(e.buf, e.len)))
+            .collect()
+    }
+}
+
 /// Free a virtual memory object reference
 ///
 /// This function frees the reference to a virtual memory object.
@@ -28,15 +87,45 @@ pub unsafe extern "C" fn virt_free(mem: &'static mut VirtualMemoryObj) {
 ///
 /// # Safety
 ///
-/// `data` must be a valid array of `VirtualReadData` with the length of at least `len`
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+/// the buffers of the entries must not overlap.
 #[no_mangle]
 pub unsafe extern "C" fn virt_read_raw_list(
     mem: &mut VirtualMemoryObj,
-    data: *mut VirtualReadData,
+    data: *const VirtualReadEntry,
+    len: usize,
+) -> i32 {
+    let mut data = VirtualReadEntry::data_list(data, len);
+    mem.virt_read_raw_list(&mut data).data_part().int_result()
+}
+
+/// Read a list of values and report the outcome of every entry
+///
+/// This behaves like `virt_read_raw_list`, but instead of failing the whole batch on a partial
+/// read, `status[i]` is set to `true` if `data[i]` was fully read, and to `false` if any part of it
+/// could not be translated. Failed regions are zeroed out, successful reads are kept intact.
+///
+/// The function only returns an error if the underlying physical read failed.
+///
+/// # Safety
+///
+/// `data` must be a valid array of `VirtualReadEntry` with the length of at least `len`,
+/// the buffers of the entries must not overlap,
+/// and `status` must be a valid array of `bool` with the length of at least `len`
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_raw_list_status(
+    mem: &mut VirtualMemoryObj,
+    data: *const VirtualReadEntry,
+    status: *mut bool,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts_mut(data, len);
-    mem.virt_read_raw_list(data).data_part().int_result()
+    let mut data = VirtualReadEntry::data_list(data, len);
+    if !status.is_null() {
+        std::ptr::write_bytes(status, 0, len);
+    }
+    let status = slice_from_raw_mut(status, len);
+    mem.virt_read_raw_list_status(&mut data, status)
+        .int_result()
 }
 
 /// Write a list of values
@@ -47,15 +136,26 @@ pub unsafe extern "C" fn virt_read_raw_list(
 ///
 /// # Safety
 ///
-/// `data` must be a valid array of `VirtualWriteData` with the length of at least `len`
+/// `data` must be a valid array of `VirtualWriteEntry` with the length of at least `len`
 #[no_mangle]
 pub unsafe extern "C" fn virt_write_raw_list(
     mem: &mut VirtualMemoryObj,
-    data: *const VirtualWriteData,
+    data: *const VirtualWriteEntry,
     len: usize,
 ) -> i32 {
-    let data = from_raw_parts(data, len);
-    mem.virt_write_raw_list(data).data_part().int_result()
+    let data = VirtualWriteEntry::data_list(data, len);
+    mem.virt_write_raw_list(&data).data_part().int_result()
+}
+
+/// Prefetch a range of virtual memory
+///
+/// This hints the virtual memory object that `len` bytes starting at `addr` will be read soon.
+/// The range is translated and, if the underlying physical memory is cached, the page cache
+/// is filled for the entire range in a single batched read. This is useful before scanning
+/// a whole module.
+#[no_mangle]
+pub extern "C" fn virt_prefetch(mem: &mut VirtualMemoryObj, addr: Address, len: usize) -> i32 {
+    mem.virt_prefetch(addr, len).int_result()
 }
 
 /// Read a single value into `out` from a provided `Address`
@@ -75,6 +175,49 @@ pub unsafe extern "C" fn virt_read_raw_into(
         .int_result()
 }
 
+/// Resolve a list of pointer chains
+///
+/// Chain `i` starts at `bases[i]` and uses the next `counts[i]` entries of `offsets`,
+/// the offsets of all chains are stored back to back. Each offset is added to the current address
+/// before the pointer at that location is read with the pointer width of `arch`.
+///
+/// All chains are resolved level by level with one batched read per depth.
+/// After the call `out[i]` contains the final address of chain `i`, or an invalid address
+/// if one of its pointers could not be read or was null.
+///
+/// # Safety
+///
+/// `bases`, `counts` and `out` must be valid arrays with the length of at least `len`,
+/// and `offsets` must be a valid array with the length of at least the sum of all `counts`
+#[no_mangle]
+pub unsafe extern "C" fn virt_read_ptr_chains(
+    mem: &mut VirtualMemoryObj,
+    arch: &ArchitectureObj,
+    bases: *const Address,
+    offsets: *const usize,
+    counts: *const usize,
+    out: *mut Address,
+    len: usize,
+) -> i32 {
+    let bases = from_raw_parts(bases, len);
+    let counts = from_raw_parts(counts, len);
+    let offsets = from_raw_parts(offsets, counts.iter().sum());
+
+    let mut start = 0;
+    let chains = bases
+        .iter()
+        .zip(counts.iter())
+        .map(|(&base, &count)| {
+            let chain = PointerChain::new(base, &offsets[start..start + count]);
+            start += count;
+            chain
+        })
+        .collect::<Vec<_>>();
+
+    mem.virt_read_ptr_chains(*arch, &chains, from_raw_parts_mut(out, len))
+        .int_result()
+}
+
 /// Read a single 32-bit value from a provided `Address`
 #[no_mangle]
 pub extern "C" fn virt_read_u32(mem: &mut VirtualMemoryObj, addr: Address) -> u32 {
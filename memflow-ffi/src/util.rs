@@ -42,3 +42,30 @@ impl<T, E: std::fmt::Display> ToIntResult for Result<T, E> {
         }
     }
 }
+
+/// Wraps a caller provided array, a null `ptr` is treated as an empty array.
+///
+/// # Safety
+///
+/// `ptr` has to be null or valid for reads of `len` elements for the lifetime `'a`.
+pub unsafe fn slice_from_raw<'a, T>(ptr: *const T, len: usize) -> &'a [T] {
+    if ptr.is_null() || len == 0 {
+        &[]
+    } else {
+        std::slice::from_raw_parts(ptr, len)
+    }
+}
+
+/// Wraps a caller provided mutable array, a null `ptr` is treated as an empty array.
+///
+/// # Safety
+///
+/// `ptr` has to be null or valid for writes of `len` elements for the lifetime `'a`,
+/// and must not be aliased during that lifetime.
+pub unsafe fn slice_from_raw_mut<'a, T>(ptr: *mut T, len: usize) -> &'a mut [T] {
+    if ptr.is_null() || len == 0 {
+        &mut []
+    } else {
+        std::slice::from_raw_parts_mut(ptr, len)
+    }
+}
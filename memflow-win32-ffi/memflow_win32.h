@@ -7,12 +7,31 @@
 #include <stdlib.h>
 #include "memflow.h"
 
+/**
+ * The amount of buckets of the batch size histogram of a connector.
+ */
+#define BATCH_SIZE_BUCKETS 16
+
+/**
+ * The amount of buckets of the translation latency histogram.
+ */
+#define LATENCY_BUCKETS 32
+
+/**
+ * Returned on failure by the list functions that fill a caller provided buffer.
+ */
+#define LIST_ERROR UINTPTR_MAX
+
 typedef struct Kernel_FFIMemory__FFIVirtualTranslate Kernel_FFIMemory__FFIVirtualTranslate;
 
 typedef struct Win32ModuleInfo Win32ModuleInfo;
 
+typedef struct Win32ProcessDiff Win32ProcessDiff;
+
 typedef struct Win32ProcessInfo Win32ProcessInfo;
 
+typedef struct Win32ProcessSnapshot Win32ProcessSnapshot;
+
 typedef struct Win32Process_FFIVirtualMemory Win32Process_FFIVirtualMemory;
 
 typedef Kernel_FFIMemory__FFIVirtualTranslate Kernel;
@@ -28,11 +47,89 @@ typedef struct Win32Version {
     uint32_t nt_build_number;
 } Win32Version;
 
+/**
+ * Statistics of a single page cache.
+ */
+typedef struct PageCacheStats {
+    /**
+     * Page chunks that were served from the cache.
+     */
+    uint64_t hits;
+    /**
+     * Page chunks that had to be read from the underlying memory.
+     */
+    uint64_t misses;
+    /**
+     * Pages that were (re)validated and stored in the cache.
+     */
+    uint64_t validations;
+} PageCacheStats;
+
+/**
+ * Statistics of the accesses that reached a connector.
+ */
+typedef struct ConnectorStats {
+    uint64_t read_calls;
+    uint64_t read_entries;
+    uint64_t read_bytes;
+    uint64_t write_calls;
+    uint64_t write_entries;
+    uint64_t write_bytes;
+    /**
+     * Histogram of the amount of entries per read and write call.
+     */
+    uint64_t batch_size_histogram[BATCH_SIZE_BUCKETS];
+} ConnectorStats;
+
+/**
+ * Statistics of a virtual address translation cache.
+ */
+typedef struct TranslateStats {
+    /**
+     * Page translations that were served from the TLB.
+     */
+    uint64_t tlb_hits;
+    /**
+     * Page translations that required a page walk.
+     */
+    uint64_t tlb_misses;
+    /**
+     * Valid TLB entries that were replaced by another translation.
+     */
+    uint64_t tlb_evictions;
+    /**
+     * Histogram of the duration of page walk batches in nanoseconds.
+     */
+    uint64_t latency_ns_histogram[LATENCY_BUCKETS];
+} TranslateStats;
+
+/**
+ * Statistics of an entire memory stack, from the translation down to the connector.
+ */
+typedef struct MemoryStats {
+    PageCacheStats page_cache;
+    PageCacheStats page_table_cache;
+    ConnectorStats connector;
+    TranslateStats translate;
+} MemoryStats;
+
 /**
  * Type alias for a PID.
  */
 typedef uint32_t PID;
 
+/**
+ * A pe section of a loaded module
+ */
+typedef struct PeSectionInfo {
+    /**
+     * Absolute address of the section
+     */
+    Address base;
+    uintptr_t size;
+    uint32_t characteristics;
+} PeSectionInfo;
+
 typedef Win32Process_FFIVirtualMemory Win32Process;
 
 typedef struct Win32ArchOffsets {
@@ -72,6 +169,9 @@ Kernel *kernel_build(CloneablePhysicalMemoryObj *mem);
  *
  * vat_cache_entries must be positive, or the program will panic upon memory reads or writes.
  *
+ * A non-zero page_table_cache_size_kb moves page table entries out of the page cache
+ * into a separate cache, so they are not evicted by large data reads.
+ *
  * # Safety
  *
  * `mem` must be a heap allocated memory reference, created by one of the API's functions.
@@ -82,7 +182,9 @@ Kernel *kernel_build_custom(CloneablePhysicalMemoryObj *mem,
                             PageType page_cache_flags,
                             uintptr_t page_cache_size_kb,
                             uint64_t vat_cache_time_ms,
-                            uintptr_t vat_cache_entries);
+                            uintptr_t vat_cache_entries,
+                            uint64_t page_table_cache_time_ms,
+                            uintptr_t page_table_cache_size_kb);
 
 Kernel *kernel_clone(const Kernel *kernel);
 
@@ -115,6 +217,19 @@ Win32Version kernel_winver(const Kernel *kernel);
 
 Win32Version kernel_winver_unmasked(const Kernel *kernel);
 
+/**
+ * Retrieve the statistics of the caches and the connector of a kernel
+ *
+ * Apart from the vat cache hits and misses all counters stay zero
+ * unless the library was built with the `stats` feature.
+ */
+MemoryStats kernel_stats(const Kernel *kernel);
+
+/**
+ * Reset all statistics of a kernel
+ */
+void kernel_reset_stats(Kernel *kernel);
+
 /**
  * Retrieve a list of peorcess addresses
  *
@@ -136,6 +251,50 @@ uintptr_t kernel_eprocess_list(Kernel *kernel, Address *buffer, uintptr_t max_si
  */
 uintptr_t kernel_process_info_list(Kernel *kernel, Win32ProcessInfo **buffer, uintptr_t max_size);
 
+/**
+ * Retrieve a list of eprocess addresses into a caller provided buffer
+ *
+ * Writes up to `max_size` addresses into `buffer` and returns the total amount of processes found,
+ * which may be larger than `max_size`. Calling this function with `max_size` 0 queries the
+ * required buffer size, `buffer` may be null in that case.
+ *
+ * Returns `LIST_ERROR` on failure.
+ *
+ * # Safety
+ *
+ * `buffer` must be null or a valid buffer of size at least `max_size`
+ */
+uintptr_t kernel_eprocess_list_into(Kernel *kernel, Address *buffer, uintptr_t max_size);
+
+/**
+ * Retrieve a list of processes into a caller provided buffer
+ *
+ * Fills `buffer` with up to `max_size` win32 process informations. If all processes fit into the
+ * buffer the amount of written processes is returned. Otherwise only the first `max_size` processes
+ * are resolved and the total amount of processes found is returned, which is larger than `max_size`.
+ * Calling this function with `max_size` 0 queries the required buffer size without resolving any
+ * process, `buffer` may be null in that case.
+ *
+ * The returned processes will need to be individually freed with `process_info_free`
+ *
+ * Returns `LIST_ERROR` on failure.
+ *
+ * # Safety
+ *
+ * `buffer` must be null or a valid buffer that can contain at least `max_size` references to `Win32ProcessInfo`.
+ */
+uintptr_t kernel_process_info_list_into(Kernel *kernel,
+                                        Win32ProcessInfo **buffer,
+                                        uintptr_t max_size);
+
+/**
+ * Update a process snapshot and retrieve the processes that changed since its last update
+ *
+ * Only the process list links are re-read, full process information is only resolved
+ * for newly found processes. The returned diff has to be freed with `process_diff_free`.
+ */
+Win32ProcessDiff *kernel_process_diff(Kernel *kernel, Win32ProcessSnapshot *snapshot);
+
 Win32ProcessInfo *kernel_kernel_process_info(Kernel *kernel);
 
 Win32ProcessInfo *kernel_process_info_from_eprocess(Kernel *kernel, Address eprocess);
@@ -239,6 +398,8 @@ void process_free(Win32Process *process);
  * Retrieve a process module list
  *
  * This will fill up to `max_len` elements into `out` with references to `Win32ModuleInfo` objects.
+ * The module entries and their names are read in two batches, regardless of the number of modules.
+ * If the return value equals `max_len` the list might have been truncated.
  *
  * These references then need to be freed with `module_info_free`
  *
@@ -248,6 +409,26 @@ void process_free(Win32Process *process);
  */
 uintptr_t process_module_list(Win32Process *process, Win32ModuleInfo **out, uintptr_t max_len);
 
+/**
+ * Retrieve a process module list into a caller provided buffer
+ *
+ * Writes up to `max_len` references to `Win32ModuleInfo` objects into `out` and returns the total
+ * amount of modules found, which may be larger than `max_len`. In that case the buffer was too
+ * small and the call can be retried with the exact size. `out` may be null if `max_len` is 0.
+ * The module entries and their names are read in two batches, regardless of the number of modules.
+ *
+ * Only the returned references that fit into `out` need to be freed with `module_info_free`.
+ *
+ * Returns `LIST_ERROR` on failure.
+ *
+ * # Safety
+ *
+ * `out` must be a valid buffer able to contain `max_len` references to `Win32ModuleInfo`.
+ */
+uintptr_t process_module_list_into(Win32Process *process,
+                                   Win32ModuleInfo **out,
+                                   uintptr_t max_len);
+
 /**
  * Retrieve the main module of the process
  *
@@ -279,6 +460,38 @@ Win32ModuleInfo *process_main_module_info(Win32Process *process);
  */
 Win32ModuleInfo *process_module_info(Win32Process *process, const char *name);
 
+/**
+ * Lookup the address of an export of `module`
+ *
+ * Only the pe header and export directory of the module are read,
+ * the result is cached for subsequent lookups in the same module.
+ * Returns a null address if the export does not exist or is forwarded.
+ *
+ * # Safety
+ *
+ * `process` must be a valid Win32Process pointer.
+ * `name` must be a valid null terminated string.
+ */
+Address process_module_export(Win32Process *process,
+                              const Win32ModuleInfo *module,
+                              const char *name);
+
+/**
+ * Lookup a pe section of `module`
+ *
+ * On success the section is written into `out` and 0 is returned.
+ * The result is cached for subsequent lookups in the same module.
+ *
+ * # Safety
+ *
+ * `process` must be a valid Win32Process pointer.
+ * `name` must be a valid null terminated string.
+ */
+int32_t process_module_section(Win32Process *process,
+                               const Win32ModuleInfo *module,
+                               const char *name,
+                               PeSectionInfo *out);
+
 OsProcessInfoObj *process_info_trait(Win32ProcessInfo *info);
 
 Address process_info_dtb(const Win32ProcessInfo *info);
@@ -314,6 +527,74 @@ Win32ModuleListInfo process_info_module_info_native(const Win32ProcessInfo *info
  */
 void process_info_free(Win32ProcessInfo *info);
 
+/**
+ * Create an empty process snapshot
+ *
+ * The first `kernel_process_diff` call on it will report all processes as added.
+ */
+Win32ProcessSnapshot *process_snapshot_new(void);
+
+/**
+ * Retrieve the number of processes that were found during the last update
+ */
+uintptr_t process_snapshot_len(const Win32ProcessSnapshot *snapshot);
+
+/**
+ * Free a process snapshot
+ *
+ * # Safety
+ *
+ * `snapshot` must be a valid heap allocated reference created by `process_snapshot_new`.
+ */
+void process_snapshot_free(Win32ProcessSnapshot *snapshot);
+
+/**
+ * Retrieve the number of processes that were added
+ */
+uintptr_t process_diff_added_len(const Win32ProcessDiff *diff);
+
+/**
+ * Retrieve the number of processes that were removed
+ */
+uintptr_t process_diff_removed_len(const Win32ProcessDiff *diff);
+
+/**
+ * Retrieve the list of added processes
+ *
+ * This will fill `buffer` with up to `max_size` added processes and return the amount written.
+ * These processes will need to be individually freed with `process_info_free`
+ *
+ * # Safety
+ *
+ * `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessInfo`.
+ */
+uintptr_t process_diff_added(const Win32ProcessDiff *diff,
+                             Win32ProcessInfo **buffer,
+                             uintptr_t max_size);
+
+/**
+ * Retrieve the list of removed processes
+ *
+ * This will fill `buffer` with up to `max_size` removed processes and return the amount written.
+ * These processes will need to be individually freed with `process_info_free`
+ *
+ * # Safety
+ *
+ * `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessInfo`.
+ */
+uintptr_t process_diff_removed(const Win32ProcessDiff *diff,
+                               Win32ProcessInfo **buffer,
+                               uintptr_t max_size);
+
+/**
+ * Free a process diff
+ *
+ * # Safety
+ *
+ * `diff` must be a valid heap allocated reference returned by `kernel_process_diff`.
+ */
+void process_diff_free(Win32ProcessDiff *diff);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif // __cplusplus
@@ -7,7 +7,7 @@
 
 #ifndef NO_STL_CONTAINERS
 #include <vector>
-// Maximum number of entries allowed in the returned lists
+// Initial capacity of the lists returned by value, they grow as needed
 #ifndef AUTO_VEC_SIZE
 #define AUTO_VEC_SIZE 2048
 #endif
@@ -34,6 +34,55 @@ struct CWin32Process
 
     WRAP_FN_TYPE(CWin32ModuleInfo, process, module_info);
     WRAP_FN_TYPE(CVirtualMemory, process, virt_mem);
+
+    // Resolves an export of `module`, returns a null address if it does not exist
+    Address module_export(const CWin32ModuleInfo &module, const char *name) {
+        return process_module_export(this->inner, module.inner, name);
+    }
+
+    // Resolves a section of `module`, returns false if it does not exist
+    bool module_section(const CWin32ModuleInfo &module, const char *name, PeSectionInfo &out) {
+        return process_module_section(this->inner, module.inner, name, &out) == 0;
+    }
+
+#ifndef NO_STL_CONTAINERS
+    // Manual module_list impl
+    //
+    // Retrieves all modules of the process. If more than `capacity` modules are found,
+    // the list is retrieved again with the exact size.
+    std::vector<CWin32ModuleInfo> module_vec(size_t capacity = 256) {
+        static_assert(sizeof(CWin32ModuleInfo) == sizeof(Win32ModuleInfo *),
+            "CWin32ModuleInfo has to be layout compatible with Win32ModuleInfo *");
+
+        std::vector<CWin32ModuleInfo> ret;
+        size_t size = capacity;
+
+        while (size != LIST_ERROR) {
+            ret.clear();
+            ret.reserve(size);
+            while (ret.size() < size)
+                ret.emplace_back(nullptr);
+
+            // the wrappers are written to directly, they take ownership of the returned modules
+            size = process_module_list_into(
+                this->inner,
+                reinterpret_cast<Win32ModuleInfo **>(ret.data()),
+                ret.size()
+            );
+
+            if (size <= ret.size()) {
+                while (ret.size() > size)
+                    ret.pop_back();
+                return ret;
+            }
+
+            // modules were loaded in between or the buffer was too small, retry with the exact size
+        }
+
+        ret.clear();
+        return ret;
+    }
+#endif
 };
 
 struct CWin32ProcessInfo
@@ -59,6 +108,61 @@ struct CWin32ProcessInfo
     }
 };
 
+struct CWin32ProcessSnapshot
+    : BindDestr<Win32ProcessSnapshot, process_snapshot_free>
+{
+    CWin32ProcessSnapshot()
+        : BindDestr(process_snapshot_new()) {}
+
+    CWin32ProcessSnapshot(Win32ProcessSnapshot *snapshot)
+        : BindDestr(snapshot) {}
+
+    WRAP_FN(process_snapshot, len);
+};
+
+struct CWin32ProcessDiff
+    : BindDestr<Win32ProcessDiff, process_diff_free>
+{
+    CWin32ProcessDiff(Win32ProcessDiff *diff)
+        : BindDestr(diff) {}
+
+    WRAP_FN(process_diff, added_len);
+    WRAP_FN(process_diff, removed_len);
+
+#ifndef NO_STL_CONTAINERS
+    std::vector<CWin32ProcessInfo> added() {
+        return this->collect(process_diff_added, process_diff_added_len(this->inner));
+    }
+
+    std::vector<CWin32ProcessInfo> removed() {
+        return this->collect(process_diff_removed, process_diff_removed_len(this->inner));
+    }
+
+private:
+    template<typename F>
+    std::vector<CWin32ProcessInfo> collect(F fill, size_t len) {
+        std::vector<CWin32ProcessInfo> ret;
+
+        if (!this->inner || !len)
+            return ret;
+
+        Win32ProcessInfo **buf = (Win32ProcessInfo **)malloc(sizeof(Win32ProcessInfo *) * len);
+
+        if (buf) {
+            size_t size = fill(this->inner, buf, len);
+
+            ret.reserve(size);
+            for (size_t i = 0; i < size; i++)
+                ret.push_back(CWin32ProcessInfo(buf[i]));
+
+            free(buf);
+        }
+
+        return ret;
+    }
+#endif
+};
+
 struct CKernel
     : BindDestr<Kernel, kernel_free>
 {
@@ -74,14 +178,18 @@ struct CKernel
         PageType page_cache_flags,
         uintptr_t page_cache_size_kb,
         uint64_t vat_cache_time_ms,
-        uintptr_t vat_cache_entries
+        uintptr_t vat_cache_entries,
+        uint64_t page_table_cache_time_ms = 0,
+        uintptr_t page_table_cache_size_kb = 0
     ) : BindDestr(kernel_build_custom(
             mem.invalidate(),
             page_cache_time_ms,
             page_cache_flags,
             page_cache_size_kb,
             vat_cache_time_ms,
-            vat_cache_entries
+            vat_cache_entries,
+            page_table_cache_time_ms,
+            page_table_cache_size_kb
         )) {}
 
     WRAP_FN_TYPE(CKernel, kernel, clone);
@@ -89,6 +197,8 @@ struct CKernel
     WRAP_FN(kernel, start_block);
     WRAP_FN(kernel, winver);
     WRAP_FN(kernel, winver_unmasked);
+    WRAP_FN(kernel, stats);
+    WRAP_FN(kernel, reset_stats);
     WRAP_FN(kernel, eprocess_list);
     WRAP_FN(kernel, process_info_list);
     WRAP_FN_TYPE(CWin32ProcessInfo, kernel, kernel_process_info);
@@ -99,47 +209,116 @@ struct CKernel
     WRAP_FN_TYPE_INVALIDATE(CWin32Process, kernel, into_process_pid);
     WRAP_FN_TYPE_INVALIDATE(CWin32Process, kernel, into_kernel_process);
 
+    // Updates the snapshot and returns the processes that changed since its last update
+    CWin32ProcessDiff process_diff(CWin32ProcessSnapshot &snapshot) {
+        return CWin32ProcessDiff(kernel_process_diff(this->inner, snapshot.inner));
+    }
+
 #ifndef NO_STL_CONTAINERS
     // Manual eprocess_list impl
-    std::vector<Address> eprocess_vec(size_t max_size) {
-        Address *buf = (Address *)malloc(sizeof(Address *) * max_size);
-        std::vector<Address> ret;
+    //
+    // Fills `out` with all eprocess addresses. The storage of `out` is reused,
+    // so passing the same vector on every poll avoids any allocation.
+    void eprocess_vec(std::vector<Address> &out) {
+        out.resize(out.capacity());
 
-        if (buf) {
-            size_t size = kernel_eprocess_list(this->inner, buf, max_size);
+        for (;;) {
+            size_t size = kernel_eprocess_list_into(this->inner, out.data(), out.size());
 
-            for (size_t i = 0; i < size; i++)
-                ret.push_back(buf[i]);
+            if (size == LIST_ERROR) {
+                out.clear();
+                return;
+            }
 
-            free(buf);
+            if (size <= out.size()) {
+                out.resize(size);
+                return;
+            }
+
+            // the list was larger than the buffer, retry with the exact size
+            out.resize(size);
         }
+    }
 
+    // Retrieves at most `max_size` eprocess addresses
+    std::vector<Address> eprocess_vec(size_t max_size) {
+        std::vector<Address> ret(max_size);
+        size_t size = kernel_eprocess_list_into(this->inner, ret.data(), ret.size());
+        ret.resize(size == LIST_ERROR ? 0 : size < max_size ? size : max_size);
         return ret;
     }
 
     std::vector<Address> eprocess_vec() {
-        return this->eprocess_vec(AUTO_VEC_SIZE);
+        std::vector<Address> ret;
+        ret.reserve(AUTO_VEC_SIZE);
+        this->eprocess_vec(ret);
+        return ret;
     }
 
     // Manual process_info_list impl
-    std::vector<CWin32ProcessInfo> process_info_vec(size_t max_size) {
-        Win32ProcessInfo **buf = (Win32ProcessInfo **)malloc(sizeof(Win32ProcessInfo *) * max_size);
-        std::vector<CWin32ProcessInfo> ret;
+    //
+    // Fills `out` with all processes. Previous entries of `out` are freed and its storage is reused.
+    void process_info_vec(std::vector<CWin32ProcessInfo> &out) {
+        static_assert(sizeof(CWin32ProcessInfo) == sizeof(Win32ProcessInfo *),
+            "CWin32ProcessInfo has to be layout compatible with Win32ProcessInfo *");
 
-        if (buf) {
-            size_t size = kernel_process_info_list(this->inner, buf, max_size);
+        out.clear();
 
-            for (size_t i = 0; i < size; i++)
-                ret.push_back(CWin32ProcessInfo(buf[i]));
+        // only query the size first, so no process is resolved into a buffer that is too small
+        size_t size = kernel_process_info_list_into(this->inner, nullptr, 0);
 
-            free(buf);
+        while (size != LIST_ERROR) {
+            out.clear();
+            out.reserve(size);
+            while (out.size() < size)
+                out.emplace_back(nullptr);
+
+            // the wrappers are written to directly, they take ownership of the returned processes
+            size = kernel_process_info_list_into(
+                this->inner,
+                reinterpret_cast<Win32ProcessInfo **>(out.data()),
+                out.size()
+            );
+
+            if (size <= out.size()) {
+                while (out.size() > size)
+                    out.pop_back();
+                return;
+            }
+
+            // processes were started in between, retry with the new size
         }
 
+        out.clear();
+    }
+
+    // Retrieves at most `max_size` processes
+    std::vector<CWin32ProcessInfo> process_info_vec(size_t max_size) {
+        std::vector<CWin32ProcessInfo> ret;
+        ret.reserve(max_size);
+        while (ret.size() < max_size)
+            ret.emplace_back(nullptr);
+
+        size_t size = kernel_process_info_list_into(
+            this->inner,
+            reinterpret_cast<Win32ProcessInfo **>(ret.data()),
+            ret.size()
+        );
+
+        if (size == LIST_ERROR)
+            size = 0;
+
+        // processes that could not be resolved leave their entries empty
+        while (ret.size() > size || (!ret.empty() && !ret.back().inner))
+            ret.pop_back();
         return ret;
     }
 
     std::vector<CWin32ProcessInfo> process_info_vec() {
-        return this->process_info_vec(AUTO_VEC_SIZE);
+        std::vector<CWin32ProcessInfo> ret;
+        ret.reserve(AUTO_VEC_SIZE);
+        this->process_info_vec(ret);
+        return ret;
     }
 #endif
 };
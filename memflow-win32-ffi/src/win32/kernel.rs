@@ -1,11 +1,13 @@
 use memflow_ffi::mem::phys_mem::CloneablePhysicalMemoryObj;
 use memflow_ffi::util::*;
 use memflow_win32::kernel::Win32Version;
-use memflow_win32::win32::{kernel, Win32ProcessInfo, Win32VirtualTranslate};
+use memflow_win32::win32::{
+    kernel, Win32ProcessDiff, Win32ProcessInfo, Win32ProcessSnapshot, Win32VirtualTranslate,
+};
 
 use memflow::mem::{
     cache::{CachedMemoryAccess, CachedVirtualTranslate, TimedCacheValidator},
-    CloneablePhysicalMemory, DirectTranslate, VirtualDMA,
+    CloneablePhysicalMemory, DirectTranslate, MemoryStats, VirtualDMA,
 };
 
 use memflow::iter::FnExtend;
@@ -26,6 +28,9 @@ pub(crate) type FFIVirtualTranslate = CachedVirtualTranslate<DirectTranslate, Ti
 pub(crate) type FFIVirtualMemory =
     VirtualDMA<FFIMemory, FFIVirtualTranslate, Win32VirtualTranslate>;
 
+/// Returned on failure by the list functions that fill a caller provided buffer.
+pub const LIST_ERROR: usize = usize::MAX;
+
 pub type Kernel = kernel::Kernel<FFIMemory, FFIVirtualTranslate>;
 
 /// Build a cloneable kernel object with default caching parameters
@@ -55,6 +60,9 @@ pub unsafe extern "C" fn kernel_build(
 ///
 /// vat_cache_entries must be positive, or the program will panic upon memory reads or writes.
 ///
+/// A non-zero page_table_cache_size_kb moves page table entries out of the page cache
+/// into a separate cache, so they are not evicted by large data reads.
+///
 /// # Safety
 ///
 /// `mem` must be a heap allocated memory reference, created by one of the API's functions.
@@ -67,6 +75,8 @@ pub unsafe extern "C" fn kernel_build_custom(
     page_cache_size_kb: usize,
     vat_cache_time_ms: u64,
     vat_cache_entries: usize,
+    page_table_cache_time_ms: u64,
+    page_table_cache_size_kb: usize,
 ) -> Option<&'static mut Kernel> {
     let mem: Box<dyn CloneablePhysicalMemory> = Box::from_raw(*Box::from_raw(mem));
     kernel::Kernel::builder(mem)
@@ -78,6 +88,12 @@ pub unsafe extern "C" fn kernel_build_custom(
                 ))
                 .page_type_mask(page_cache_flags)
                 .cache_size(size::kb(page_cache_size_kb))
+                .page_table_cache(
+                    size::kb(page_table_cache_size_kb),
+                    TimedCacheValidator::new(
+                        Duration::from_millis(page_table_cache_time_ms).into(),
+                    ),
+                )
                 .build()
                 .unwrap()
         })
@@ -145,6 +161,21 @@ pub extern "C" fn kernel_winver_unmasked(kernel: &Kernel) -> Win32Version {
     kernel.kernel_info.kernel_winver
 }
 
+/// Retrieve the statistics of the caches and the connector of a kernel
+///
+/// Apart from the vat cache hits and misses all counters stay zero
+/// unless the library was built with the `stats` feature.
+#[no_mangle]
+pub extern "C" fn kernel_stats(kernel: &Kernel) -> MemoryStats {
+    kernel.stats()
+}
+
+/// Reset all statistics of a kernel
+#[no_mangle]
+pub extern "C" fn kernel_reset_stats(kernel: &mut Kernel) {
+    kernel.reset_stats()
+}
+
 /// Retrieve a list of peorcess addresses
 ///
 /// # Safety
@@ -208,6 +239,97 @@ pub unsafe extern "C" fn kernel_process_info_list(
         .unwrap_or_default()
 }
 
+/// Retrieve a list of eprocess addresses into a caller provided buffer
+///
+/// Writes up to `max_size` addresses into `buffer` and returns the total amount of processes found,
+/// which may be larger than `max_size`. Calling this function with `max_size` 0 queries the
+/// required buffer size, `buffer` may be null in that case.
+///
+/// Returns `LIST_ERROR` on failure.
+///
+/// # Safety
+///
+/// `buffer` must be null or a valid buffer of size at least `max_size`
+#[no_mangle]
+pub unsafe extern "C" fn kernel_eprocess_list_into(
+    kernel: &'static mut Kernel,
+    buffer: *mut Address,
+    max_size: usize,
+) -> usize {
+    let mut ret = 0;
+
+    let max_size = if buffer.is_null() { 0 } else { max_size };
+
+    let mut extend_fn = FnExtend::new(|addr| {
+        if ret < max_size {
+            buffer.add(ret).write(addr);
+        }
+        ret += 1;
+    });
+
+    kernel
+        .eprocess_list_extend(&mut extend_fn)
+        .map_err(inspect_err)
+        .ok()
+        .map(|_| ret)
+        .unwrap_or(LIST_ERROR)
+}
+
+/// Retrieve a list of processes into a caller provided buffer
+///
+/// Fills `buffer` with up to `max_size` win32 process informations. If all processes fit into the
+/// buffer the amount of written processes is returned. Otherwise only the first `max_size` processes
+/// are resolved and the total amount of processes found is returned, which is larger than `max_size`.
+/// Calling this function with `max_size` 0 queries the required buffer size without resolving any
+/// process, `buffer` may be null in that case.
+///
+/// The returned processes will need to be individually freed with `process_info_free`
+///
+/// Returns `LIST_ERROR` on failure.
+///
+/// # Safety
+///
+/// `buffer` must be null or a valid buffer that can contain at least `max_size` references to `Win32ProcessInfo`.
+#[no_mangle]
+pub unsafe extern "C" fn kernel_process_info_list_into(
+    kernel: &'static mut Kernel,
+    buffer: *mut *mut Win32ProcessInfo,
+    max_size: usize,
+) -> usize {
+    let mut written = 0;
+
+    // the buffer is uninitialized, it is only ever written through raw pointers
+    let max_size = if buffer.is_null() { 0 } else { max_size };
+
+    let mut extend_fn = FnExtend::new(|info| {
+        buffer.add(written).write(to_heap(info));
+        written += 1;
+    });
+
+    kernel
+        .process_info_list_extend_max(&mut extend_fn, max_size)
+        .map_err(inspect_err)
+        .ok()
+        .map(|total| if total <= max_size { written } else { total })
+        .unwrap_or(LIST_ERROR)
+}
+
+/// Update a process snapshot and retrieve the processes that changed since its last update
+///
+/// Only the process list links are re-read, full process information is only resolved
+/// for newly found processes. The returned diff has to be freed with `process_diff_free`.
+#[no_mangle]
+pub extern "C" fn kernel_process_diff(
+    kernel: &'static mut Kernel,
+    snapshot: &mut Win32ProcessSnapshot,
+) -> Option<&'static mut Win32ProcessDiff> {
+    snapshot
+        .update(kernel)
+        .map_err(inspect_err)
+        .ok()
+        .map(to_heap)
+}
+
 // Process info
 
 #[no_mangle]
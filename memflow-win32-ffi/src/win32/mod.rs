@@ -2,3 +2,4 @@ pub mod kernel;
 pub mod module;
 pub mod process;
 pub mod process_info;
+pub mod process_snapshot;
@@ -1,6 +1,27 @@
 use memflow_ffi::process::OsProcessModuleInfoObj;
 use memflow_ffi::util::to_heap;
-use memflow_win32::win32::Win32ModuleInfo;
+use memflow_win32::win32::{PeSection, Win32ModuleInfo};
+
+use memflow::types::Address;
+
+/// A pe section of a loaded module
+#[repr(C)]
+pub struct PeSectionInfo {
+    /// Absolute address of the section
+    pub base: Address,
+    pub size: usize,
+    pub characteristics: u32,
+}
+
+impl PeSectionInfo {
+    pub(crate) fn new(module_base: Address, section: &PeSection) -> Self {
+        Self {
+            base: module_base + section.rva,
+            size: section.size,
+            characteristics: section.characteristics,
+        }
+    }
+}
 
 #[no_mangle]
 pub extern "C" fn module_info_trait(
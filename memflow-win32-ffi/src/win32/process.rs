@@ -1,8 +1,11 @@
-use super::kernel::{FFIVirtualMemory, Kernel};
+use super::kernel::{FFIVirtualMemory, Kernel, LIST_ERROR};
+use super::module::PeSectionInfo;
 
 use memflow::iter::FnExtend;
+use memflow::types::Address;
 use memflow_ffi::mem::virt_mem::VirtualMemoryObj;
 use memflow_ffi::util::*;
+use memflow_win32::error::Error;
 use memflow_win32::win32::{self, Win32ModuleInfo, Win32ProcessInfo};
 
 use std::ffi::CStr;
@@ -56,6 +59,8 @@ pub unsafe extern "C" fn process_free(process: &'static mut Win32Process) {
 /// Retrieve a process module list
 ///
 /// This will fill up to `max_len` elements into `out` with references to `Win32ModuleInfo` objects.
+/// The module entries and their names are read in two batches, regardless of the number of modules.
+/// If the return value equals `max_len` the list might have been truncated.
 ///
 /// These references then need to be freed with `module_info_free`
 ///
@@ -87,6 +92,44 @@ pub unsafe extern "C" fn process_module_list(
         .unwrap_or_default()
 }
 
+/// Retrieve a process module list into a caller provided buffer
+///
+/// Writes up to `max_len` references to `Win32ModuleInfo` objects into `out` and returns the total
+/// amount of modules found, which may be larger than `max_len`. In that case the buffer was too
+/// small and the call can be retried with the exact size. `out` may be null if `max_len` is 0.
+/// The module entries and their names are read in two batches, regardless of the number of modules.
+///
+/// Only the returned references that fit into `out` need to be freed with `module_info_free`.
+///
+/// Returns `LIST_ERROR` on failure.
+///
+/// # Safety
+///
+/// `out` must be a valid buffer able to contain `max_len` references to `Win32ModuleInfo`.
+#[no_mangle]
+pub unsafe extern "C" fn process_module_list_into(
+    process: &mut Win32Process,
+    out: *mut *mut Win32ModuleInfo,
+    max_len: usize,
+) -> usize {
+    let mut ret = 0;
+
+    // modules that do not fit into the buffer are only counted
+    let mut extend_fn = FnExtend::new(|info| {
+        if ret < max_len && !out.is_null() {
+            out.add(ret).write(to_heap(info));
+        }
+        ret += 1;
+    });
+
+    process
+        .module_list_extend(&mut extend_fn)
+        .map_err(inspect_err)
+        .ok()
+        .map(|_| ret)
+        .unwrap_or(LIST_ERROR)
+}
+
 /// Retrieve the main module of the process
 ///
 /// This function searches for a module with a base address
@@ -134,3 +177,58 @@ pub unsafe extern "C" fn process_module_info(
         .map_err(inspect_err)
         .ok()
 }
+
+/// Lookup the address of an export of `module`
+///
+/// Only the pe header and export directory of the module are read,
+/// the result is cached for subsequent lookups in the same module.
+/// Returns a null address if the export does not exist or is forwarded.
+///
+/// # Safety
+///
+/// `process` must be a valid Win32Process pointer.
+/// `name` must be a valid null terminated string.
+#[no_mangle]
+pub unsafe extern "C" fn process_module_export(
+    process: &mut Win32Process,
+    module: &Win32ModuleInfo,
+    name: *const c_char,
+) -> Address {
+    let name = CStr::from_ptr(name).to_string_lossy();
+
+    process
+        .module_pe_index(module)
+        .and_then(|index| index.export(&name))
+        .map_err(inspect_err)
+        .unwrap_or_default()
+}
+
+/// Lookup a pe section of `module`
+///
+/// On success the section is written into `out` and 0 is returned.
+/// The result is cached for subsequent lookups in the same module.
+///
+/// # Safety
+///
+/// `process` must be a valid Win32Process pointer.
+/// `name` must be a valid null terminated string.
+#[no_mangle]
+pub unsafe extern "C" fn process_module_section(
+    process: &mut Win32Process,
+    module: &Win32ModuleInfo,
+    name: *const c_char,
+    out: &mut PeSectionInfo,
+) -> i32 {
+    let name = CStr::from_ptr(name).to_string_lossy();
+
+    process
+        .module_pe_index(module)
+        .and_then(|index| {
+            index
+                .section(&name)
+                .map(|section| PeSectionInfo::new(index.base, section))
+                .ok_or(Error::Other("section not found"))
+        })
+        .map(|section| *out = section)
+        .int_result_logged()
+}
@@ -0,0 +1,96 @@
+use memflow_ffi::util::to_heap;
+use memflow_win32::win32::{Win32ProcessDiff, Win32ProcessInfo, Win32ProcessSnapshot};
+
+/// Create an empty process snapshot
+///
+/// The first `kernel_process_diff` call on it will report all processes as added.
+#[no_mangle]
+pub extern "C" fn process_snapshot_new() -> &'static mut Win32ProcessSnapshot {
+    to_heap(Win32ProcessSnapshot::new())
+}
+
+/// Retrieve the number of processes that were found during the last update
+#[no_mangle]
+pub extern "C" fn process_snapshot_len(snapshot: &Win32ProcessSnapshot) -> usize {
+    snapshot.len()
+}
+
+/// Free a process snapshot
+///
+/// # Safety
+///
+/// `snapshot` must be a valid heap allocated reference created by `process_snapshot_new`.
+#[no_mangle]
+pub unsafe extern "C" fn process_snapshot_free(snapshot: &'static mut Win32ProcessSnapshot) {
+    let _ = Box::from_raw(snapshot);
+}
+
+/// Retrieve the number of processes that were added
+#[no_mangle]
+pub extern "C" fn process_diff_added_len(diff: &Win32ProcessDiff) -> usize {
+    diff.added.len()
+}
+
+/// Retrieve the number of processes that were removed
+#[no_mangle]
+pub extern "C" fn process_diff_removed_len(diff: &Win32ProcessDiff) -> usize {
+    diff.removed.len()
+}
+
+/// Retrieve the list of added processes
+///
+/// This will fill `buffer` with up to `max_size` added processes and return the amount written.
+/// These processes will need to be individually freed with `process_info_free`
+///
+/// # Safety
+///
+/// `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessInfo`.
+#[no_mangle]
+pub unsafe extern "C" fn process_diff_added(
+    diff: &Win32ProcessDiff,
+    buffer: *mut *mut Win32ProcessInfo,
+    max_size: usize,
+) -> usize {
+    copy_process_infos(&diff.added, buffer, max_size)
+}
+
+/// Retrieve the list of removed processes
+///
+/// This will fill `buffer` with up to `max_size` removed processes and return the amount written.
+/// These processes will need to be individually freed with `process_info_free`
+///
+/// # Safety
+///
+/// `buffer` must be a valid that can contain at least `max_size` references to `Win32ProcessInfo`.
+#[no_mangle]
+pub unsafe extern "C" fn process_diff_removed(
+    diff: &Win32ProcessDiff,
+    buffer: *mut *mut Win32ProcessInfo,
+    max_size: usize,
+) -> usize {
+    copy_process_infos(&diff.removed, buffer, max_size)
+}
+
+/// Free a process diff
+///
+/// # Safety
+///
+/// `diff` must be a valid heap allocated reference returned by `kernel_process_diff`.
+#[no_mangle]
+pub unsafe extern "C" fn process_diff_free(diff: &'static mut Win32ProcessDiff) {
+    let _ = Box::from_raw(diff);
+}
+
+unsafe fn copy_process_infos(
+    infos: &[Win32ProcessInfo],
+    buffer: *mut *mut Win32ProcessInfo,
+    max_size: usize,
+) -> usize {
+    // the buffer is uninitialized, it is only ever written through raw pointers
+    infos
+        .iter()
+        .take(max_size)
+        .enumerate()
+        .map(|(i, info)| buffer.add(i).write(to_heap(info.clone())))
+        .count()
+}
@@ -1,5 +1,5 @@
-use dataview::Pod;
 use std::{
+    convert::TryFrom,
     env,
     error::Error,
     fs::{self, File},
@@ -9,18 +9,21 @@ use std::{
 
 #[path = "src/offsets/offset_table.rs"]
 #[cfg(feature = "embed_offsets")]
+#[allow(dead_code)]
 mod offset_table;
 
 #[cfg(feature = "embed_offsets")]
-use offset_table::Win32OffsetFile;
+use offset_table::{write_offset_table, Win32OffsetEntry, Win32OffsetFile, Win32OffsetTableView};
 
+/// Merges all TOML offset files and binary offset tables (`*.bin`, as emitted by the
+/// `generate_offsets` example) of the offsets folder into a single sorted offset table.
 #[cfg(feature = "embed_offsets")]
 fn embed_offsets() -> Result<(), Box<dyn Error>> {
     let out_dir = env::var("OUT_DIR")?;
     let dest_path = Path::new(&out_dir).join("win32_offsets.bin");
-    let mut all_the_files = File::create(&dest_path)?;
 
-    // iterate offsets folder
+    // iterate offsets folder, TOML files come first so they take precedence over binary tables
+    let mut paths = vec![];
     for f in fs::read_dir("./offsets")? {
         let f = f?;
 
@@ -28,14 +31,36 @@ fn embed_offsets() -> Result<(), Box<dyn Error>> {
             continue;
         }
 
-        let mut file = File::open(f.path())?;
-        let mut tomlstr = String::new();
-        file.read_to_string(&mut tomlstr)?;
+        let path = f.path();
+        match path.extension().and_then(|ext| ext.to_str()) {
+            Some("toml") => paths.push((false, path)),
+            Some("bin") => paths.push((true, path)),
+            _ => {}
+        }
+    }
+    paths.sort();
+
+    let mut entries = vec![];
+    for (is_table, path) in paths.iter() {
+        if *is_table {
+            let buf = fs::read(path)?;
+            let table = Win32OffsetTableView::new(&buf)?;
+            entries.extend(table.iter());
+        } else {
+            let mut file = File::open(path)?;
+            let mut tomlstr = String::new();
+            file.read_to_string(&mut tomlstr)?;
 
-        let offsets: Win32OffsetFile = toml::from_str(&tomlstr)?;
-        all_the_files.write_all(offsets.as_bytes())?;
+            let offsets: Win32OffsetFile = toml::from_str(&tomlstr)?;
+            entries.push(Win32OffsetEntry::try_from(&offsets)?);
+        }
     }
 
+    let mut file = File::create(&dest_path)?;
+    file.write_all(&write_offset_table(&mut entries))?;
+
+    println!("cargo:rerun-if-changed=offsets");
+
     Ok(())
 }
 
@@ -1,42 +1,21 @@
 use clap::*;
-use log::{error, Level};
-use std::fs::{create_dir_all, File};
+use log::{error, info, Level};
+use std::collections::{HashSet, VecDeque};
+use std::convert::TryFrom;
+use std::fs::{self, create_dir_all, File};
 use std::io::Write;
 use std::path::PathBuf;
+use std::sync::{mpsc, Arc, Mutex};
 
 use memflow_win32::prelude::{
-    SymbolStore, Win32GUID, Win32OffsetFile, Win32Offsets, Win32OffsetsArchitecture, Win32Version,
+    write_offset_table, SymbolStore, Win32GUID, Win32OffsetEntry, Win32OffsetFile,
+    Win32OffsetTableView, Win32OffsetsArchitecture, Win32Version,
 };
 
-pub fn main() {
-    let matches = App::new("generate offsets example")
-        .version(crate_version!())
-        .author(crate_authors!())
-        .arg(Arg::with_name("verbose").short("v").multiple(true))
-        .arg(
-            Arg::with_name("output")
-                .long("output")
-                .short("o")
-                .takes_value(true)
-                .required(true),
-        )
-        .get_matches();
+type WinId = (Win32Version, Win32OffsetsArchitecture, Win32GUID);
 
-    // set log level
-    let level = match matches.occurrences_of("verbose") {
-        0 => Level::Error,
-        1 => Level::Warn,
-        2 => Level::Info,
-        3 => Level::Debug,
-        4 => Level::Trace,
-        _ => Level::Trace,
-    };
-    simple_logger::SimpleLogger::new()
-        .with_level(level.to_level_filter())
-        .init()
-        .unwrap();
-
-    let win_ids = vec![
+fn default_win_ids() -> Vec<WinId> {
+    vec![
         /*
         (
             Win32Version::new(5, 2, 3790),
@@ -73,49 +52,239 @@ pub fn main() {
             Win32OffsetsArchitecture::X86,
             Win32GUID::new("ntkrpamp.pdb", "1B1D6AA205E1C87DC63A314ACAA50B491"),
         ),
-    ];
-
-    let out_dir = matches.value_of("output").unwrap();
-    create_dir_all(out_dir).unwrap();
-
-    for win_id in win_ids.into_iter() {
-        if let Ok(offsets) = Win32Offsets::builder()
-            .symbol_store(SymbolStore::new())
-            .guid(win_id.2.clone())
-            .build()
-        {
-            let offset_file = Win32OffsetFile {
-                pdb_file_name: win_id.2.file_name.as_str().into(),
-                pdb_guid: win_id.2.guid.as_str().into(),
-
-                nt_major_version: win_id.0.major_version(),
-                nt_minor_version: win_id.0.minor_version(),
-                nt_build_number: win_id.0.build_number(),
-
-                arch: win_id.1,
-
-                offsets: offsets.0,
-            };
-
-            let offsetstr = toml::to_string_pretty(&offset_file).unwrap();
-
-            let file_name = format!(
-                "{}_{}_{}_{}_{}.toml",
-                win_id.0.major_version(),
-                win_id.0.minor_version(),
-                win_id.0.build_number(),
-                win_id.1.to_string(),
-                win_id.2.guid,
-            );
-
-            let mut file =
-                File::create([out_dir, &file_name].iter().collect::<PathBuf>().as_path()).unwrap();
-            file.write_all(offsetstr.as_bytes()).unwrap();
-        } else {
-            error!(
-                "unable to find offsets for {} {:?} {:?}",
-                win_id.0, win_id.1, win_id.2
-            )
+    ]
+}
+
+/// Parses a list of kernels, one per line in the format `<major>.<minor>.<build> <arch> <pdb file name> <pdb guid>`.
+/// Empty lines and lines starting with `#` are ignored.
+fn parse_win_ids(list: &str) -> Vec<WinId> {
+    list.lines()
+        .map(str::trim)
+        .filter(|line| !line.is_empty() && !line.starts_with('#'))
+        .filter_map(|line| {
+            let parsed = parse_win_id(line);
+            if parsed.is_none() {
+                error!("skipping invalid line: {}", line);
+            }
+            parsed
+        })
+        .collect()
+}
+
+fn parse_win_id(line: &str) -> Option<WinId> {
+    let mut parts = line.split_whitespace();
+
+    let mut version = parts.next()?.split('.').map(|v| v.parse::<u32>().ok());
+    let winver = Win32Version::new(version.next()??, version.next()??, version.next()??);
+
+    let arch = match parts.next()? {
+        "X86" | "x86" => Win32OffsetsArchitecture::X86,
+        "X64" | "x64" => Win32OffsetsArchitecture::X64,
+        _ => return None,
+    };
+
+    let guid = Win32GUID::new(parts.next()?, parts.next()?);
+    Some((winver, arch, guid))
+}
+
+/// Collects the pdbs that already have offsets in the output folder or the offset table.
+fn existing_guids(out_dir: &str, table: &[Win32OffsetEntry]) -> HashSet<(String, String)> {
+    let mut guids = HashSet::new();
+
+    for entry in table.iter() {
+        if let (Ok(file_name), Ok(guid)) = (entry.pdb_file_name(), entry.pdb_guid()) {
+            guids.insert((file_name.to_string(), guid.to_string()));
+        }
+    }
+
+    for path in fs::read_dir(out_dir)
+        .into_iter()
+        .flatten()
+        .filter_map(|f| f.ok())
+        .map(|f| f.path())
+        .filter(|p| p.extension().and_then(|ext| ext.to_str()) == Some("toml"))
+    {
+        let offsets = fs::read_to_string(&path)
+            .ok()
+            .and_then(|s| toml::from_str::<Win32OffsetFile>(&s).ok());
+        if let Some(offsets) = offsets {
+            if let (Ok(file_name), Ok(guid)) = (
+                <&str>::try_from(&offsets.pdb_file_name),
+                <&str>::try_from(&offsets.pdb_guid),
+            ) {
+                guids.insert((file_name.to_string(), guid.to_string()));
+            }
+        }
+    }
+
+    guids
+}
+
+pub fn main() {
+    let matches = App::new("generate offsets example")
+        .version(crate_version!())
+        .author(crate_authors!())
+        .arg(Arg::with_name("verbose").short("v").multiple(true))
+        .arg(
+            Arg::with_name("output")
+                .long("output")
+                .short("o")
+                .takes_value(true)
+                .required(true),
+        )
+        .arg(
+            Arg::with_name("input")
+                .long("input")
+                .short("i")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("table")
+                .long("table")
+                .short("t")
+                .takes_value(true),
+        )
+        .arg(
+            Arg::with_name("jobs")
+                .long("jobs")
+                .short("j")
+                .takes_value(true)
+                .default_value("4"),
+        )
+        .get_matches();
+
+    // set log level
+    let level = match matches.occurrences_of("verbose") {
+        0 => Level::Error,
+        1 => Level::Warn,
+        2 => Level::Info,
+        3 => Level::Debug,
+        4 => Level::Trace,
+        _ => Level::Trace,
+    };
+    simple_logger::SimpleLogger::new()
+        .with_level(level.to_level_filter())
+        .init()
+        .unwrap();
+
+    let win_ids = if let Some(input) = matches.value_of("input") {
+        parse_win_ids(&fs::read_to_string(input).unwrap())
+    } else {
+        default_win_ids()
+    };
+
+    let out_dir = matches.value_of("output").unwrap().to_string();
+    create_dir_all(&out_dir).unwrap();
+
+    // an existing table is extended instead of being replaced
+    let table_path = matches.value_of("table");
+    let mut table = table_path
+        .and_then(|path| fs::read(path).ok())
+        .map(|buf| {
+            Win32OffsetTableView::new(&buf)
+                .expect("the existing offset table is invalid")
+                .iter()
+                .collect::<Vec<_>>()
+        })
+        .unwrap_or_default();
+
+    let existing = existing_guids(&out_dir, &table);
+    let queue = win_ids
+        .into_iter()
+        .filter(|win_id| {
+            let known = existing.contains(&(win_id.2.file_name.clone(), win_id.2.guid.clone()));
+            if known {
+                info!(
+                    "skipping {} {:?}, offsets already exist",
+                    win_id.0, win_id.2
+                );
+            }
+            !known
+        })
+        .collect::<VecDeque<_>>();
+    let queue = Arc::new(Mutex::new(queue));
+
+    // every worker downloads and parses one pdb at a time
+    let jobs = matches.value_of("jobs").unwrap().parse::<usize>().unwrap();
+    let (sender, receiver) = mpsc::channel();
+    let workers = (0..std::cmp::max(jobs, 1))
+        .map(|_| {
+            let queue = queue.clone();
+            let sender = sender.clone();
+            let store = SymbolStore::new();
+
+            std::thread::spawn(move || loop {
+                let win_id = match queue.lock().unwrap().pop_front() {
+                    Some(win_id) => win_id,
+                    None => break,
+                };
+
+                let offsets = store.load_offsets(&win_id.2);
+                if sender.send((win_id, offsets)).is_err() {
+                    break;
+                }
+            })
+        })
+        .collect::<Vec<_>>();
+    std::mem::drop(sender);
+
+    for (win_id, offsets) in receiver.iter() {
+        let offsets = match offsets {
+            Ok(offsets) => offsets,
+            Err(err) => {
+                error!(
+                    "unable to find offsets for {} {:?} {:?}: {}",
+                    win_id.0, win_id.1, win_id.2, err
+                );
+                continue;
+            }
+        };
+
+        let offset_file = Win32OffsetFile {
+            pdb_file_name: win_id.2.file_name.as_str().into(),
+            pdb_guid: win_id.2.guid.as_str().into(),
+
+            nt_major_version: win_id.0.major_version(),
+            nt_minor_version: win_id.0.minor_version(),
+            nt_build_number: win_id.0.build_number(),
+
+            arch: win_id.1,
+
+            offsets: offsets.0,
+        };
+
+        if table_path.is_some() {
+            match Win32OffsetEntry::try_from(&offset_file) {
+                Ok(entry) => table.push(entry),
+                Err(err) => error!("unable to add {:?} to the offset table: {}", win_id.2, err),
+            }
         }
+
+        let offsetstr = toml::to_string_pretty(&offset_file).unwrap();
+
+        let file_name = format!(
+            "{}_{}_{}_{}_{}.toml",
+            win_id.0.major_version(),
+            win_id.0.minor_version(),
+            win_id.0.build_number(),
+            win_id.1.to_string(),
+            win_id.2.guid,
+        );
+
+        let mut file = File::create(
+            [out_dir.as_str(), &file_name]
+                .iter()
+                .collect::<PathBuf>()
+                .as_path(),
+        )
+        .unwrap();
+        file.write_all(offsetstr.as_bytes()).unwrap();
+    }
+
+    workers.into_iter().for_each(|w| w.join().unwrap());
+
+    // the table contains all offsets of the previous runs and of this run in a single file
+    if let Some(table_path) = table_path {
+        fs::write(table_path, write_offset_table(&mut table)).unwrap();
     }
 }
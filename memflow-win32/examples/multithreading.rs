@@ -1,4 +1,5 @@
 use std::thread;
+use std::time::Duration;
 
 use clap::*;
 use log::{info, Level};
@@ -56,6 +57,31 @@ pub fn parallel_kernels_cached<T: PhysicalMemory + Clone + 'static>(connector: T
         .for_each(|t| t.join().unwrap());
 }
 
+pub fn parallel_kernels_shared_cache<T: PhysicalMemory + Clone + 'static>(connector: T) {
+    // all kernel clones share the same page cache
+    let kernel = Kernel::builder(connector)
+        .build_page_cache(|connector, arch| {
+            CachedMemoryAccess::builder(connector)
+                .arch(arch)
+                .shared(Duration::from_millis(1000).into())
+                .build()
+                .unwrap()
+        })
+        .build()
+        .unwrap();
+
+    (0..8)
+        .map(|_| kernel.clone())
+        .into_iter()
+        .map(|mut k| {
+            thread::spawn(move || {
+                let eprocesses = k.eprocess_list().unwrap();
+                info!("eprocesses list fetched: {}", eprocesses.len());
+            })
+        })
+        .for_each(|t| t.join().unwrap());
+}
+
 pub fn parallel_processes<T: PhysicalMemory + Clone + 'static>(connector: T) {
     let kernel = Kernel::builder(connector)
         .build_default_caches()
@@ -130,5 +156,7 @@ pub fn main() {
 
     parallel_kernels_cached(connector.clone());
 
+    parallel_kernels_shared_cache(connector.clone());
+
     parallel_processes(connector);
 }
@@ -14,7 +14,17 @@ use log::{info, warn};
 use memflow::mem::VirtualMemory;
 use memflow::types::Address;
 
-use pelite::{self, pe64::debug::CodeView, pe64::exports::Export, PeView};
+#[cfg(feature = "std")]
+use {
+    crate::win32::Win32VirtualTranslate,
+    memflow::mem::{DirectTranslate, PhysicalMemory, VirtualDMA},
+    std::sync::atomic::{AtomicUsize, Ordering},
+    std::sync::Arc,
+};
+
+use crate::win32::PeIndex;
+
+use pelite::{self, pe64::debug::CodeView, PeView};
 
 pub fn find<T: VirtualMemory>(
     virt_mem: &mut T,
@@ -42,6 +52,76 @@ pub fn find<T: VirtualMemory>(
     Err(Error::Initialization("unable to find ntoskrnl.exe"))
 }
 
+/// Finds ntoskrnl.exe like `find` but probes the candidate regions on `threads` clones of `mem`.
+///
+/// Only the x64 page map scan is parallelized, the result is identical to the one of `find`.
+#[cfg(feature = "std")]
+pub fn find_parallel<T: PhysicalMemory + Clone + 'static>(
+    mem: &T,
+    start_block: &StartBlock,
+    threads: usize,
+) -> Result<(Address, usize)> {
+    let virt_mem = |mem: T, start_block: &StartBlock| {
+        VirtualDMA::with_vat(
+            mem,
+            start_block.arch,
+            Win32VirtualTranslate::new(start_block.arch, start_block.dtb),
+            DirectTranslate::new(),
+        )
+    };
+    let mut main_mem = virt_mem(mem.clone(), start_block);
+
+    if start_block.arch.bits() != 64 || threads <= 1 {
+        return find(&mut main_mem, start_block);
+    }
+
+    if !start_block.kernel_hint.is_null() {
+        match x64::find_with_va_hint(&mut main_mem, start_block) {
+            Ok(b) => return Ok(b),
+            Err(e) => warn!("x64::find_with_va_hint() error: {}", e),
+        }
+    }
+
+    let candidates = Arc::new(x64::find_candidates(&mut main_mem, start_block));
+    // index of the first candidate that contained ntoskrnl.exe
+    let found = Arc::new(AtomicUsize::new(usize::MAX));
+
+    let handles = (0..threads)
+        .map(|thread| {
+            let mut thread_mem = virt_mem(mem.clone(), start_block);
+            let candidates = candidates.clone();
+            let found = found.clone();
+
+            std::thread::spawn(move || {
+                for idx in (thread..candidates.len()).step_by(threads) {
+                    // an earlier candidate already matched
+                    if idx > found.load(Ordering::SeqCst) {
+                        break;
+                    }
+
+                    if let Ok(addr) = x64::find_in_candidate(&mut thread_mem, candidates[idx]) {
+                        found.fetch_min(idx, Ordering::SeqCst);
+                        return Some((idx, addr));
+                    }
+                }
+                None
+            })
+        })
+        .collect::<Vec<_>>();
+
+    let kernel_base = handles
+        .into_iter()
+        .filter_map(|handle| handle.join().ok().flatten())
+        .min_by_key(|&(idx, _)| idx)
+        .map(|(_, addr)| addr)
+        .ok_or(Error::Initialization(
+            "x64::find_parallel: unable to locate ntoskrnl.exe with a page map",
+        ))?;
+
+    let size_of_image = pehelper::try_get_pe_size(&mut main_mem, kernel_base)?;
+    Ok((kernel_base, size_of_image))
+}
+
 // TODO: move to pe::...
 pub fn find_guid<T: VirtualMemory>(virt_mem: &mut T, kernel_base: Address) -> Result<Win32GUID> {
     let image = pehelper::try_get_pe_image(virt_mem, kernel_base)?;
@@ -79,14 +159,11 @@ pub fn find_guid<T: VirtualMemory>(virt_mem: &mut T, kernel_base: Address) -> Re
     Ok(Win32GUID::new(file_name, &guid))
 }
 
-fn get_export(pe: &PeView, name: &str) -> Result<usize> {
+fn get_export(pe: &PeIndex, name: &str) -> Result<usize> {
     info!("trying to find {} export", name);
-    let export = match pe.get_export_by_name(name).map_err(Error::PE)? {
-        Export::Symbol(s) => *s as usize,
-        Export::Forward(_) => {
-            return Err(Error::Other("Export found but it was a forwarded export"))
-        }
-    };
+    let export = pe.export_offset(name).ok_or(Error::Other(
+        "Export not found or it was a forwarded export",
+    ))?;
     info!("{} found at 0x{:x}", name, export);
     Ok(export)
 }
@@ -95,8 +172,8 @@ pub fn find_winver<T: VirtualMemory>(
     virt_mem: &mut T,
     kernel_base: Address,
 ) -> Result<Win32Version> {
-    let image = pehelper::try_get_pe_image(virt_mem, kernel_base)?;
-    let pe = PeView::from_bytes(&image).map_err(Error::PE)?;
+    // only the pe header and the export directory are required here
+    let pe = PeIndex::new(virt_mem, kernel_base)?;
 
     // NtBuildNumber
     let nt_build_number_ref = get_export(&pe, "NtBuildNumber")?;
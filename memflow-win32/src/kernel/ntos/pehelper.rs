@@ -1,6 +1,7 @@
 use std::prelude::v1::*;
 
 use crate::error::{Error, Result};
+use crate::win32::PeIndex;
 
 use log::{debug, info};
 
@@ -32,6 +33,23 @@ pub fn try_get_pe_size<T: VirtualMemory>(virt_mem: &mut T, probe_addr: Address)
     }
 }
 
+/// Returns the size of image and the timestamp of the pe header at `probe_addr`.
+pub fn try_get_pe_header_info<T: VirtualMemory>(
+    virt_mem: &mut T,
+    probe_addr: Address,
+) -> Result<(usize, u32)> {
+    let mut probe_buf = vec![0; size::kb(4)];
+    virt_mem.virt_read_raw_into(probe_addr, &mut probe_buf)?;
+
+    let pe_probe = PeView::from_bytes(&probe_buf).map_err(Error::PE)?;
+
+    let size_of_image = match pe_probe.optional_header() {
+        pelite::Wrap::T32(opt32) => opt32.SizeOfImage,
+        pelite::Wrap::T64(opt64) => opt64.SizeOfImage,
+    };
+    Ok((size_of_image as usize, pe_probe.file_header().TimeDateStamp))
+}
+
 pub fn try_get_pe_image<T: VirtualMemory>(
     virt_mem: &mut T,
     probe_addr: Address,
@@ -44,14 +62,9 @@ pub fn try_get_pe_image<T: VirtualMemory>(
 }
 
 pub fn try_get_pe_name<T: VirtualMemory>(virt_mem: &mut T, probe_addr: Address) -> Result<String> {
-    let image = try_get_pe_image(virt_mem, probe_addr)?;
-    let pe = PeView::from_bytes(&image).map_err(Error::PE)?;
-    let name = pe
-        .exports()
-        .map_err(|_| Error::Initialization("unable to get exports"))?
-        .dll_name()
-        .map_err(|_| Error::Initialization("unable to get dll name"))?
-        .to_str()?;
+    let name = PeIndex::new(virt_mem, probe_addr)?
+        .dll_name
+        .ok_or(Error::Initialization("unable to get dll name"))?;
     info!("try_get_pe_name: found pe header for {}", name);
-    Ok(name.to_string())
+    Ok(name)
 }
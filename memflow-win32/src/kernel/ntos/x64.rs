@@ -75,27 +75,41 @@ fn find_with_va<T: VirtualMemory>(virt_mem: &mut T, va_base: u64) -> Result<u64>
         .ok_or_else(|| Error::Initialization("unable to locate ntoskrnl.exe"))
 }
 
+/// Returns all 2mb regions in the kernel half of the address space that may contain ntoskrnl.exe.
+pub fn find_candidates<T: VirtualMemory>(
+    virt_mem: &mut T,
+    start_block: &StartBlock,
+) -> Vec<Address> {
+    virt_mem
+        .virt_page_map_range(
+            size::mb(2),
+            (!0u64 - (1u64 << (start_block.arch.address_space_bits() - 1))).into(),
+            (!0u64).into(),
+        )
+        .into_iter()
+        .flat_map(|(va, size)| size.page_chunks(va, size::mb(2)))
+        .filter(|&(_, size)| size == size::mb(2))
+        .map(|(va, _)| va)
+        .collect()
+}
+
+/// Probes a single candidate region returned by `find_candidates`.
+pub fn find_in_candidate<T: VirtualMemory>(virt_mem: &mut T, va: Address) -> Result<Address> {
+    find_with_va(virt_mem, va.as_u64()).map(Address::from)
+}
+
 pub fn find<T: VirtualMemory>(
     virt_mem: &mut T,
     start_block: &StartBlock,
 ) -> Result<(Address, usize)> {
     debug!("x64::find: trying to find ntoskrnl.exe with page map",);
 
-    let page_map = virt_mem.virt_page_map_range(
-        size::mb(2),
-        (!0u64 - (1u64 << (start_block.arch.address_space_bits() - 1))).into(),
-        (!0u64).into(),
-    );
-
-    match page_map
+    match find_candidates(virt_mem, start_block)
         .into_iter()
-        .flat_map(|(va, size)| size.page_chunks(va, size::mb(2)))
-        .filter(|&(_, size)| size == size::mb(2))
-        .filter_map(|(va, _)| find_with_va(virt_mem, va.as_u64()).ok())
+        .filter_map(|va| find_in_candidate(virt_mem, va).ok())
         .next()
     {
-        Some(a) => {
-            let addr = Address::from(a);
+        Some(addr) => {
             let size_of_image = pehelper::try_get_pe_size(virt_mem, addr)?;
             Ok((addr, size_of_image))
         }
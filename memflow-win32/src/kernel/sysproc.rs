@@ -1,17 +1,15 @@
 use std::prelude::v1::*;
 
-use super::ntos::pehelper;
 use super::StartBlock;
 use crate::error::{Error, Result};
+use crate::win32::PeIndex;
 
 use std::convert::TryInto;
 
 use log::{debug, info, warn};
 
 use memflow::mem::VirtualMemory;
-use memflow::types::{size, Address};
-
-use pelite::{self, pe64::exports::Export, PeView};
+use memflow::types::Address;
 
 pub fn find<T: VirtualMemory>(
     virt_mem: &mut T,
@@ -40,20 +38,7 @@ pub fn find_exported<T: VirtualMemory>(
     kernel_base: Address,
 ) -> Result<Address> {
     // PsInitialSystemProcess -> PsActiveProcessHead
-    let image = pehelper::try_get_pe_image(virt_mem, kernel_base)?;
-    let pe = PeView::from_bytes(&image).map_err(Error::PE)?;
-
-    let sys_proc = match pe
-        .get_export_by_name("PsInitialSystemProcess")
-        .map_err(Error::PE)?
-    {
-        Export::Symbol(s) => kernel_base + *s as usize,
-        Export::Forward(_) => {
-            return Err(Error::Other(
-                "PsInitialSystemProcess found but it was a forwarded export",
-            ))
-        }
-    };
+    let sys_proc = PeIndex::new(virt_mem, kernel_base)?.export("PsInitialSystemProcess")?;
     info!("PsInitialSystemProcess found at 0x{:x}", sys_proc);
 
     // read containing value
@@ -86,21 +71,10 @@ pub fn find_in_section<T: VirtualMemory>(
     // scan for va of system process (dtb.va)
     // ... check if its 32 or 64bit
 
-    let mut header_buf = vec![0; size::mb(32)];
-    virt_mem.virt_read_raw_into(ntos, &mut header_buf)?;
-
-    /*
-    let mut pe_opts = ParseOptions::default();
-    pe_opts.resolve_rva = false;
-
-    let header = PE::parse_with_opts(&header_buf, &pe_opts).unwrap(); // TODO: error
-    let _sect = header
-        .sections
-        .iter()
-        .filter(|s| String::from_utf8(s.name.to_vec()).unwrap_or_default() == "ALMOSTRO")
-        .nth(0)
-        .ok_or_else(|| Error::new("unable to find section ALMOSTRO"))?;
-    */
+    let _almostro = PeIndex::new(virt_mem, ntos)?
+        .section("ALMOSTRO")
+        .cloned()
+        .ok_or(Error::Other("unable to find section ALMOSTRO"))?;
 
     Err(Error::Other(
         "sysproc::find_in_section(): not implemented yet",
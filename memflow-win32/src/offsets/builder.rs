@@ -1,25 +1,17 @@
-use std::convert::TryFrom;
-
 #[cfg(feature = "symstore")]
 use super::symstore::SymbolStore;
 
-use super::offset_table::Win32OffsetFile;
+#[cfg(feature = "embed_offsets")]
+use super::offset_table::Win32OffsetTableView;
 use super::{Win32Offsets, Win32OffsetsArchitecture};
 
 use crate::error::{Error, Result};
 use crate::kernel::{Win32GUID, Win32Version};
 use crate::win32::KernelInfo;
 
-#[repr(align(16))]
-struct Align16<T>(pub T);
-
+/// Binary offset table of all offset files in the memflow-win32/offsets/ folder, see `build.rs`.
 #[cfg(feature = "embed_offsets")]
-const WIN32_OFFSETS: Align16<
-    [u8; include_bytes!(concat!(env!("OUT_DIR"), "/win32_offsets.bin")).len()],
-> = Align16(*include_bytes!(concat!(
-    env!("OUT_DIR"),
-    "/win32_offsets.bin"
-)));
+const WIN32_OFFSETS: &[u8] = include_bytes!(concat!(env!("OUT_DIR"), "/win32_offsets.bin"));
 
 pub struct Win32OffsetBuilder {
     #[cfg(feature = "symstore")]
@@ -70,25 +62,13 @@ impl Win32OffsetBuilder {
 
     #[cfg(feature = "embed_offsets")]
     fn build_with_offset_list(&self) -> Result<Win32Offsets> {
-        // # Safety
-        // Struct padding and alignment is compile-time guaranteed by the struct (see mod offset_table).
-        let offsets: [Win32OffsetFile;
-            WIN32_OFFSETS.0.len() / std::mem::size_of::<Win32OffsetFile>()] =
-            unsafe { std::mem::transmute(WIN32_OFFSETS.0) };
+        let offsets = Win32OffsetTableView::new(WIN32_OFFSETS)
+            .map_err(|_| Error::Other("the embedded offset table is invalid"))?;
 
         // Try matching exact guid
         if let Some(target_guid) = &self.guid {
-            for offset in offsets.iter() {
-                if let (Ok(file), Ok(guid)) = (
-                    <&str>::try_from(&offset.pdb_file_name),
-                    <&str>::try_from(&offset.pdb_guid),
-                ) {
-                    if target_guid.file_name == file && target_guid.guid == guid {
-                        return Ok(Win32Offsets {
-                            0: offset.offsets.clone(),
-                        });
-                    }
-                }
+            if let Some(offset) = offsets.find(&target_guid.file_name, &target_guid.guid) {
+                return Ok(Win32Offsets { 0: offset.offsets });
             }
         }
 
@@ -105,9 +85,7 @@ impl Win32OffsetBuilder {
                     && arch == offset.arch
                 {
                     prev_build_number = offset.nt_build_number;
-                    closest_match = Some(Win32Offsets {
-                        0: offset.offsets.clone(),
-                    });
+                    closest_match = Some(Win32Offsets { 0: offset.offsets });
                 }
             }
 
@@ -134,8 +112,7 @@ impl Win32OffsetBuilder {
     fn build_with_symbol_store(&self) -> Result<Win32Offsets> {
         if let Some(store) = &self.symbol_store {
             if self.guid.is_some() {
-                let pdb = store.load(self.guid.as_ref().unwrap())?;
-                Win32Offsets::from_pdb_slice(&pdb[..])
+                store.load_offsets(self.guid.as_ref().unwrap())
             } else {
                 Err(Error::Other("symbol store can only be used with a guid"))
             }
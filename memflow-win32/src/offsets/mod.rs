@@ -8,7 +8,10 @@ pub mod symstore;
 
 pub mod offset_table;
 #[doc(hidden)]
-pub use offset_table::{Win32OffsetFile, Win32OffsetTable, Win32OffsetsArchitecture};
+pub use offset_table::{
+    write_offset_table, Win32OffsetEntry, Win32OffsetFile, Win32OffsetTable, Win32OffsetTableView,
+    Win32OffsetsArchitecture,
+};
 
 #[cfg(feature = "symstore")]
 pub use {pdb_struct::PdbStruct, symstore::*};
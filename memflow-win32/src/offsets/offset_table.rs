@@ -9,8 +9,8 @@ use std::str;
 /// TOML files contained in the memflow-win32/offsets/ folder
 /// and merge the byte buffer directly into the build.
 ///
-/// This byte buffer is then transmuted back into a slice of
-/// Win32OffsetFile structs and parsed as a backup in case
+/// Every file is converted into a `Win32OffsetEntry` of a sorted binary
+/// offset table which is searched as a backup in case
 /// no symbol store is available.
 ///
 /// To get loaded properly this struct guarantees a certain alignment and no padding.
@@ -44,6 +44,217 @@ pub struct Win32OffsetFile {
 const _: [(); std::mem::size_of::<[Win32OffsetFile; 16]>()] =
     [(); 16 * std::mem::size_of::<Win32OffsetFile>()];
 
+/// Magic of a binary offset table, bump the version whenever `Win32OffsetEntry` changes.
+pub const OFFSET_TABLE_MAGIC: [u8; 8] = *b"MFOTAB01";
+
+/// Header of a binary offset table.
+///
+/// The header is followed by `entry_count` entries that are sorted by their pdb guid and file name,
+/// so the offsets of a guid can be found with a binary search instead of scanning all entries.
+#[repr(C, align(4))]
+#[derive(Clone, Pod)]
+pub struct Win32OffsetTableHeader {
+    pub magic: [u8; 8],
+    pub entry_size: u32,
+    pub entry_count: u32,
+}
+
+/// Compact counterpart of `Win32OffsetFile` that is stored in binary offset tables.
+///
+/// Strings are stored zero padded, which keeps the byte wise order of the padded strings
+/// equal to the order of the strings themselves.
+///
+// # Safety
+// This struct guarantees that it does not contain any padding.
+#[repr(C, align(4))]
+#[derive(Clone, Pod)]
+pub struct Win32OffsetEntry {
+    pub pdb_guid: [u8; 40],
+    pub pdb_file_name: [u8; 24],
+
+    pub nt_major_version: u32,
+    pub nt_minor_version: u32,
+    pub nt_build_number: u32,
+
+    pub arch: Win32OffsetsArchitecture,
+
+    pub offsets: Win32OffsetTable,
+}
+
+/// Byte offset of `Win32OffsetEntry::arch`, it is validated before an entry is read from a table.
+const ENTRY_ARCH_OFFSET: usize = 40 + 24 + 3 * 4;
+
+impl Win32OffsetEntry {
+    pub fn pdb_guid(&self) -> Result<&str, std::str::Utf8Error> {
+        padded_str(&self.pdb_guid)
+    }
+
+    pub fn pdb_file_name(&self) -> Result<&str, std::str::Utf8Error> {
+        padded_str(&self.pdb_file_name)
+    }
+
+    fn key(&self) -> (&[u8], &[u8]) {
+        (&self.pdb_guid, &self.pdb_file_name)
+    }
+}
+
+impl<'a> TryFrom<&'a Win32OffsetFile> for Win32OffsetEntry {
+    type Error = &'static str;
+
+    fn try_from(file: &'a Win32OffsetFile) -> Result<Self, Self::Error> {
+        let mut pdb_guid = [0; 40];
+        let mut pdb_file_name = [0; 24];
+        copy_padded(
+            &mut pdb_guid,
+            <&str>::try_from(&file.pdb_guid).map_err(|_| "invalid pdb guid")?,
+        )?;
+        copy_padded(
+            &mut pdb_file_name,
+            <&str>::try_from(&file.pdb_file_name).map_err(|_| "invalid pdb file name")?,
+        )?;
+
+        Ok(Self {
+            pdb_guid,
+            pdb_file_name,
+            nt_major_version: file.nt_major_version,
+            nt_minor_version: file.nt_minor_version,
+            nt_build_number: file.nt_build_number,
+            arch: file.arch,
+            offsets: file.offsets.clone(),
+        })
+    }
+}
+
+/// Read-only view of a binary offset table.
+///
+/// The buffer does not need to be aligned, entries are copied out on access.
+pub struct Win32OffsetTableView<'a> {
+    entries: &'a [u8],
+    len: usize,
+}
+
+impl<'a> Win32OffsetTableView<'a> {
+    pub fn new(buf: &'a [u8]) -> Result<Self, &'static str> {
+        let header_size = std::mem::size_of::<Win32OffsetTableHeader>();
+        let entry_size = std::mem::size_of::<Win32OffsetEntry>();
+
+        if buf.len() < header_size {
+            return Err("offset table is too small");
+        }
+
+        let header =
+            unsafe { std::ptr::read_unaligned(buf.as_ptr() as *const Win32OffsetTableHeader) };
+        if header.magic != OFFSET_TABLE_MAGIC || header.entry_size as usize != entry_size {
+            return Err("offset table has an invalid header");
+        }
+
+        let len = header.entry_count as usize;
+        let entries = &buf[header_size..];
+        if entries.len() != len * entry_size {
+            return Err("offset table has an invalid size");
+        }
+
+        // reject corrupted tables up front instead of skipping their entries on access
+        let table = Self { entries, len };
+        if (0..len).any(|i| table.entry_arch(i).is_err()) {
+            return Err("offset table has an entry with an invalid architecture");
+        }
+
+        Ok(table)
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    pub fn get(&self, idx: usize) -> Option<Win32OffsetEntry> {
+        if idx < self.len {
+            // the arch enum has to hold a valid discriminant before the entry can be constructed
+            self.entry_arch(idx).ok()?;
+            let ptr = self.entries[idx * std::mem::size_of::<Win32OffsetEntry>()..].as_ptr();
+            Some(unsafe { std::ptr::read_unaligned(ptr as *const Win32OffsetEntry) })
+        } else {
+            None
+        }
+    }
+
+    fn entry_arch(&self, idx: usize) -> Result<Win32OffsetsArchitecture, &'static str> {
+        let start = idx * std::mem::size_of::<Win32OffsetEntry>() + ENTRY_ARCH_OFFSET;
+        let mut arch = [0; 4];
+        arch.copy_from_slice(&self.entries[start..start + 4]);
+        Win32OffsetsArchitecture::try_from(u32::from_ne_bytes(arch))
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = Win32OffsetEntry> + '_ {
+        (0..self.len).filter_map(move |i| self.get(i))
+    }
+
+    /// Finds the entry of the given pdb with a binary search.
+    pub fn find(&self, pdb_file_name: &str, pdb_guid: &str) -> Option<Win32OffsetEntry> {
+        let mut guid = [0; 40];
+        let mut file_name = [0; 24];
+        copy_padded(&mut guid, pdb_guid).ok()?;
+        copy_padded(&mut file_name, pdb_file_name).ok()?;
+        let key: (&[u8], &[u8]) = (&guid, &file_name);
+
+        let (mut low, mut high) = (0, self.len);
+        while low < high {
+            let mid = low + (high - low) / 2;
+            let entry = self.get(mid)?;
+            match entry.key().cmp(&key) {
+                std::cmp::Ordering::Less => low = mid + 1,
+                std::cmp::Ordering::Greater => high = mid,
+                std::cmp::Ordering::Equal => return Some(entry),
+            }
+        }
+
+        None
+    }
+}
+
+/// Serializes `entries` into a binary offset table.
+///
+/// The entries are sorted in place, if multiple entries describe the same pdb
+/// only the first one of them is kept.
+pub fn write_offset_table(entries: &mut Vec<Win32OffsetEntry>) -> Vec<u8> {
+    entries.sort_by(|a, b| a.key().cmp(&b.key()));
+    entries.dedup_by(|a, b| a.key() == b.key());
+
+    let header = Win32OffsetTableHeader {
+        magic: OFFSET_TABLE_MAGIC,
+        entry_size: std::mem::size_of::<Win32OffsetEntry>() as u32,
+        entry_count: entries.len() as u32,
+    };
+
+    let mut buf = Vec::with_capacity(
+        std::mem::size_of::<Win32OffsetTableHeader>()
+            + entries.len() * std::mem::size_of::<Win32OffsetEntry>(),
+    );
+    buf.extend_from_slice(header.as_bytes());
+    for entry in entries.iter() {
+        buf.extend_from_slice(entry.as_bytes());
+    }
+    buf
+}
+
+fn copy_padded(dst: &mut [u8], src: &str) -> Result<(), &'static str> {
+    // the last byte always stays zero
+    if src.len() >= dst.len() {
+        return Err("string is too long for an offset table entry");
+    }
+    dst[..src.len()].copy_from_slice(src.as_bytes());
+    Ok(())
+}
+
+fn padded_str(buf: &[u8]) -> Result<&str, std::str::Utf8Error> {
+    let len = buf.iter().position(|&b| b == 0).unwrap_or(buf.len());
+    str::from_utf8(&buf[..len])
+}
+
 #[repr(u32)]
 #[derive(Clone, Copy, Debug, PartialEq, Eq)]
 #[cfg_attr(feature = "serde", derive(::serde::Serialize, ::serde::Deserialize))]
@@ -59,6 +270,19 @@ impl std::fmt::Display for Win32OffsetsArchitecture {
     }
 }
 
+impl TryFrom<u32> for Win32OffsetsArchitecture {
+    type Error = &'static str;
+
+    fn try_from(arch: u32) -> Result<Self, Self::Error> {
+        match arch {
+            0 => Ok(Win32OffsetsArchitecture::X86),
+            1 => Ok(Win32OffsetsArchitecture::X64),
+            2 => Ok(Win32OffsetsArchitecture::AArch64),
+            _ => Err("invalid offsets architecture"),
+        }
+    }
+}
+
 unsafe impl Pod for Win32OffsetsArchitecture {}
 
 // TODO: use const-generics here once they are fully stabilized
@@ -190,3 +414,115 @@ pub struct Win32OffsetTable {
     /// Since version x.x
     pub teb_peb_x86: u32,
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entry(file_name: &str, guid: &str, build_number: u32) -> Win32OffsetEntry {
+        let mut offsets: Win32OffsetTable = unsafe { std::mem::zeroed() };
+        offsets.eproc_pid = build_number;
+
+        Win32OffsetEntry::try_from(&Win32OffsetFile {
+            pdb_file_name: file_name.into(),
+            pdb_guid: guid.into(),
+            nt_major_version: 10,
+            nt_minor_version: 0,
+            nt_build_number: build_number,
+            arch: Win32OffsetsArchitecture::X64,
+            offsets,
+        })
+        .unwrap()
+    }
+
+    #[test]
+    fn offset_table_lookup() {
+        let mut entries = vec![
+            entry("ntkrnlmp.pdb", "BBED7C2955FBE4522AAA23F4B8677AD91", 19041),
+            entry("ntkrnlmp.pdb", "0AFB69F5FD264D54673570E37B38A3181", 18362),
+            entry("ntkrpamp.pdb", "1B1D6AA205E1C87DC63A314ACAA50B491", 19042),
+            entry("ntkrnlmp.pdb", "1C9875F76C8F0FBF3EB9A9D7C1C274061", 19043),
+            entry("ntkrnlmp.pdb", "0AFB69F5FD264D54673570E37B38A3181", 1),
+            entry("ntkrnlmp.pdb", "1B1D6AA205E1C87DC63A314ACAA50B491", 19044),
+        ];
+        let buf = write_offset_table(&mut entries);
+
+        // unaligned buffers are supported
+        let mut unaligned = vec![0u8];
+        unaligned.extend_from_slice(&buf);
+        let table = Win32OffsetTableView::new(&unaligned[1..]).unwrap();
+
+        // duplicates keep the first entry
+        assert_eq!(table.len(), 5);
+        assert!(table
+            .iter()
+            .zip(table.iter().skip(1))
+            .all(|(a, b)| a.key() < b.key()));
+
+        let found = table
+            .find("ntkrnlmp.pdb", "0AFB69F5FD264D54673570E37B38A3181")
+            .unwrap();
+        assert_eq!(found.nt_build_number, 18362);
+        assert_eq!(found.offsets.eproc_pid, 18362);
+        assert_eq!(found.pdb_file_name(), Ok("ntkrnlmp.pdb"));
+
+        let found = table
+            .find("ntkrpamp.pdb", "1B1D6AA205E1C87DC63A314ACAA50B491")
+            .unwrap();
+        assert_eq!(found.nt_build_number, 19042);
+        let found = table
+            .find("ntkrnlmp.pdb", "1B1D6AA205E1C87DC63A314ACAA50B491")
+            .unwrap();
+        assert_eq!(found.nt_build_number, 19044);
+
+        assert!(table
+            .find("ntkrnlmp.pdb", "00000000000000000000000000000000")
+            .is_none());
+        assert!(table
+            .find(
+                "ntkrnlmp.pdb",
+                "0AFB69F5FD264D54673570E37B38A3181_with_a_too_long_suffix"
+            )
+            .is_none());
+    }
+
+    #[test]
+    fn offset_table_invalid() {
+        let mut entries = vec![entry(
+            "ntkrnlmp.pdb",
+            "0AFB69F5FD264D54673570E37B38A3181",
+            1,
+        )];
+        let buf = write_offset_table(&mut entries);
+
+        assert!(Win32OffsetTableView::new(&buf[..8]).is_err());
+        assert!(Win32OffsetTableView::new(&buf[..buf.len() - 1]).is_err());
+
+        let mut invalid = buf.clone();
+        invalid[0] = 0;
+        assert!(Win32OffsetTableView::new(&invalid).is_err());
+
+        assert!(Win32OffsetTableView::new(&write_offset_table(&mut vec![]))
+            .unwrap()
+            .is_empty());
+    }
+
+    #[test]
+    fn offset_table_invalid_arch() {
+        let mut entries = vec![entry(
+            "ntkrnlmp.pdb",
+            "0AFB69F5FD264D54673570E37B38A3181",
+            1,
+        )];
+        let base = &entries[0] as *const _ as usize;
+        assert_eq!(
+            &entries[0].arch as *const _ as usize - base,
+            ENTRY_ARCH_OFFSET
+        );
+
+        let mut buf = write_offset_table(&mut entries);
+        let start = std::mem::size_of::<Win32OffsetTableHeader>() + ENTRY_ARCH_OFFSET;
+        buf[start..start + 4].copy_from_slice(&7u32.to_ne_bytes());
+        assert!(Win32OffsetTableView::new(&buf).is_err());
+    }
+}
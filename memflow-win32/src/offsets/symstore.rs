@@ -1,60 +1,111 @@
 use std::prelude::v1::*;
 
 use crate::error::{Error, Result};
-use crate::offsets::Win32GUID;
+use crate::offsets::{Win32GUID, Win32OffsetTable, Win32Offsets};
 
 use std::fs::{self, File};
 use std::io::{Read, Write};
 use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::Arc;
 
+use dataview::Pod;
 use dirs::home_dir;
-use log::info;
+use log::{info, warn};
 
 #[cfg(feature = "download_progress")]
-use {
-    pbr::ProgressBar,
-    progress_streams::ProgressReader,
-    std::sync::atomic::{AtomicBool, AtomicUsize, Ordering},
-    std::sync::Arc,
-};
+use {pbr::ProgressBar, progress_streams::ProgressReader};
+
+/// Magic of the binary offset cache files, bump the version whenever `Win32OffsetTable` changes.
+const OFFSETS_CACHE_MAGIC: [u8; 8] = *b"MFOFFS01";
+
+/// Files smaller than this are always downloaded in a single request.
+const MIN_RANGED_DOWNLOAD_SIZE: usize = 1024 * 1024;
+
+#[repr(C)]
+#[derive(Clone)]
+struct OffsetsCacheFile {
+    magic: [u8; 8],
+    table_size: u32,
+    _reserved: u32,
+    offsets: Win32OffsetTable,
+}
+unsafe impl Pod for OffsetsCacheFile {}
+
+/// Tracks the amount of downloaded bytes across all download threads.
+struct DownloadProgress {
+    total: Arc<AtomicUsize>,
+    finished: Arc<AtomicBool>,
+    thread: Option<std::thread::JoinHandle<()>>,
+}
+
+impl DownloadProgress {
+    #[cfg(feature = "download_progress")]
+    fn new(len: usize) -> Self {
+        let total = Arc::new(AtomicUsize::new(0));
+        let finished = Arc::new(AtomicBool::new(false));
+        let mut pb = ProgressBar::new(len as u64);
+
+        let thread = {
+            let finished_thread = finished.clone();
+            let total_thread = total.clone();
+
+            std::thread::spawn(move || {
+                while !finished_thread.load(Ordering::Relaxed) {
+                    pb.set(total_thread.load(Ordering::SeqCst) as u64);
+                    std::thread::sleep(std::time::Duration::from_millis(10));
+                }
+                pb.finish();
+            })
+        };
+
+        Self {
+            total,
+            finished,
+            thread: Some(thread),
+        }
+    }
+
+    #[cfg(not(feature = "download_progress"))]
+    fn new(_len: usize) -> Self {
+        Self {
+            total: Arc::new(AtomicUsize::new(0)),
+            finished: Arc::new(AtomicBool::new(false)),
+            thread: None,
+        }
+    }
+}
+
+impl Drop for DownloadProgress {
+    fn drop(&mut self) {
+        self.finished.store(true, Ordering::Relaxed);
+        if let Some(thread) = self.thread.take() {
+            thread.join().ok();
+        }
+    }
+}
 
 #[cfg(feature = "download_progress")]
-fn read_to_end<T: Read>(reader: &mut T, len: usize) -> Result<Vec<u8>> {
+fn read_to_end<T: Read>(reader: &mut T, total: &AtomicUsize) -> Result<Vec<u8>> {
     let mut buffer = vec![];
 
-    let total = Arc::new(AtomicUsize::new(0));
     let mut reader = ProgressReader::new(reader, |progress: usize| {
         total.fetch_add(progress, Ordering::SeqCst);
     });
-    let mut pb = ProgressBar::new(len as u64);
-
-    let finished = Arc::new(AtomicBool::new(false));
-    let thread = {
-        let finished_thread = finished.clone();
-        let total_thread = total.clone();
-
-        std::thread::spawn(move || {
-            while !finished_thread.load(Ordering::Relaxed) {
-                pb.set(total_thread.load(Ordering::SeqCst) as u64);
-                std::thread::sleep(std::time::Duration::from_millis(10));
-            }
-            pb.finish();
-        })
-    };
 
     reader
         .read_to_end(&mut buffer)
         .map_err(|_| Error::SymbolStore("unable to read from http request"))?;
-    finished.store(true, Ordering::Relaxed);
-    thread.join().unwrap();
 
     Ok(buffer)
 }
 
 #[cfg(not(feature = "download_progress"))]
-fn read_to_end<T: Read>(reader: &mut T, _len: usize) -> Result<Vec<u8>> {
+fn read_to_end<T: Read>(reader: &mut T, _total: &AtomicUsize) -> Result<Vec<u8>> {
     let mut buffer = vec![];
-    reader.read_to_end(&mut buffer)?;
+    reader
+        .read_to_end(&mut buffer)
+        .map_err(|_| Error::SymbolStore("unable to read from http request"))?;
     Ok(buffer)
 }
 
@@ -62,6 +113,7 @@ fn read_to_end<T: Read>(reader: &mut T, _len: usize) -> Result<Vec<u8>> {
 pub struct SymbolStore {
     base_url: String,
     cache_path: Option<PathBuf>,
+    download_threads: usize,
 }
 
 impl Default for SymbolStore {
@@ -70,6 +122,7 @@ impl Default for SymbolStore {
         Self {
             base_url: "https://msdl.microsoft.com/download/symbols".to_string(),
             cache_path: Some(home_dir.join(".memflow").join("cache")),
+            download_threads: 4,
         }
     }
 }
@@ -123,6 +176,49 @@ impl SymbolStore {
         }
     }
 
+    /// Loads the offsets for the given pdb.
+    ///
+    /// The parsed offsets are cached next to the pdb in a small binary file, so
+    /// subsequent calls (also from other processes sharing the same cache path)
+    /// neither have to download nor parse the pdb again.
+    pub fn load_offsets(&self, guid: &Win32GUID) -> Result<Win32Offsets> {
+        let cache_file = self.cache_path.as_ref().map(|cache_path| {
+            cache_path
+                .join(guid.file_name.clone())
+                .join(format!("{}.offsets", guid.guid))
+        });
+
+        if let Some(cache_file) = &cache_file {
+            if cache_file.exists() {
+                match read_offsets_cache(cache_file) {
+                    Ok(offsets) => {
+                        info!(
+                            "reading offsets from local cache: {}",
+                            cache_file.to_string_lossy()
+                        );
+                        return Ok(offsets);
+                    }
+                    Err(err) => warn!("ignoring invalid offsets cache file: {}", err),
+                }
+            }
+        }
+
+        let pdb = self.load(guid)?;
+        let offsets = Win32Offsets::from_pdb_slice(&pdb[..])?;
+
+        if let Some(cache_file) = &cache_file {
+            info!(
+                "writing offsets to local cache: {}",
+                cache_file.to_string_lossy()
+            );
+            if let Err(err) = write_offsets_cache(cache_file, &offsets) {
+                warn!("unable to write offsets cache file: {}", err);
+            }
+        }
+
+        Ok(offsets)
+    }
+
     fn download(&self, guid: &Win32GUID) -> Result<Vec<u8>> {
         let pdb_url = format!("{}/{}/{}", self.base_url, guid.file_name, guid.guid);
 
@@ -132,6 +228,27 @@ impl SymbolStore {
 
     fn download_file(&self, url: &str) -> Result<Vec<u8>> {
         info!("downloading pdb from {}", url);
+
+        if self.download_threads > 1 {
+            let resp = ureq::head(url).call();
+            let len = resp
+                .header("Content-Length")
+                .and_then(|s| s.parse::<usize>().ok())
+                .unwrap_or(0);
+            let ranges = resp
+                .header("Accept-Ranges")
+                .map(|s| s.eq_ignore_ascii_case("bytes"))
+                .unwrap_or(false);
+
+            if resp.ok() && ranges && len >= MIN_RANGED_DOWNLOAD_SIZE {
+                // use the url after redirects for all ranged requests
+                match self.download_ranged(resp.get_url(), len) {
+                    Ok(buffer) => return Ok(buffer),
+                    Err(err) => warn!("ranged download failed, retrying in one piece: {}", err),
+                }
+            }
+        }
+
         let resp = ureq::get(url).call();
         if !resp.ok() {
             return Err(Error::SymbolStore("unable to download pdb"));
@@ -143,13 +260,54 @@ impl SymbolStore {
             .and_then(|s| s.parse::<usize>().ok())
             .unwrap();
 
+        let progress = DownloadProgress::new(len);
         let mut reader = resp.into_reader();
-        let buffer = read_to_end(&mut reader, len)?;
+        let buffer = read_to_end(&mut reader, &progress.total)?;
 
         assert_eq!(buffer.len(), len);
         Ok(buffer)
     }
 
+    /// Downloads a file in `download_threads` parallel range requests.
+    fn download_ranged(&self, url: &str, len: usize) -> Result<Vec<u8>> {
+        let progress = DownloadProgress::new(len);
+        let chunk_size = (len + self.download_threads - 1) / self.download_threads;
+
+        let threads = (0..len)
+            .step_by(chunk_size)
+            .map(|start| {
+                let end = std::cmp::min(start + chunk_size, len);
+                let url = url.to_string();
+                let total = progress.total.clone();
+
+                std::thread::spawn(move || -> Result<Vec<u8>> {
+                    let resp = ureq::get(&url)
+                        .set("Range", &format!("bytes={}-{}", start, end - 1))
+                        .call();
+                    if resp.status() != 206 {
+                        return Err(Error::SymbolStore("server did not respond with a range"));
+                    }
+
+                    let buffer = read_to_end(&mut resp.into_reader(), &total)?;
+                    if buffer.len() != end - start {
+                        return Err(Error::SymbolStore("received range has an invalid size"));
+                    }
+                    Ok(buffer)
+                })
+            })
+            .collect::<Vec<_>>();
+
+        let mut buffer = Vec::with_capacity(len);
+        for thread in threads.into_iter() {
+            let chunk = thread
+                .join()
+                .map_err(|_| Error::SymbolStore("download thread panicked"))??;
+            buffer.extend_from_slice(&chunk);
+        }
+
+        Ok(buffer)
+    }
+
     // symbol store configurations
     pub fn base_url(mut self, base_url: &str) -> Self {
         self.base_url = base_url.to_string();
@@ -165,4 +323,77 @@ impl SymbolStore {
         self.cache_path = Some(cache_path.as_ref().to_path_buf());
         self
     }
+
+    /// Sets the amount of parallel range requests used to download large pdbs.
+    ///
+    /// A value of 1 always downloads files in a single request.
+    pub fn download_threads(mut self, download_threads: usize) -> Self {
+        self.download_threads = std::cmp::max(download_threads, 1);
+        self
+    }
+}
+
+fn read_offsets_cache(path: &Path) -> Result<Win32Offsets> {
+    let buffer = fs::read(path).map_err(|_| Error::SymbolStore("unable to read offsets cache"))?;
+    if buffer.len() != std::mem::size_of::<OffsetsCacheFile>() {
+        return Err(Error::SymbolStore("offsets cache has an invalid size"));
+    }
+
+    // the buffer is not guaranteed to be aligned
+    let file = unsafe { std::ptr::read_unaligned(buffer.as_ptr() as *const OffsetsCacheFile) };
+    if file.magic != OFFSETS_CACHE_MAGIC
+        || file.table_size as usize != std::mem::size_of::<Win32OffsetTable>()
+    {
+        return Err(Error::SymbolStore("offsets cache has an invalid header"));
+    }
+
+    Ok(Win32Offsets(file.offsets))
+}
+
+fn write_offsets_cache(path: &Path, offsets: &Win32Offsets) -> Result<()> {
+    let file = OffsetsCacheFile {
+        magic: OFFSETS_CACHE_MAGIC,
+        table_size: std::mem::size_of::<Win32OffsetTable>() as u32,
+        _reserved: 0,
+        offsets: offsets.0.clone(),
+    };
+
+    if let Some(dir) = path.parent() {
+        fs::create_dir_all(dir)
+            .map_err(|_| Error::SymbolStore("unable to create folder in local pdb cache"))?;
+    }
+
+    // write into a temporary file first so concurrent readers never see a partial file
+    let tmp_path = path.with_extension(format!("offsets.{}", std::process::id()));
+    fs::write(&tmp_path, file.as_bytes())
+        .and_then(|_| fs::rename(&tmp_path, path))
+        .map_err(|_| {
+            fs::remove_file(&tmp_path).ok();
+            Error::SymbolStore("unable to write offsets cache")
+        })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn offsets_cache_roundtrip() {
+        let dir = std::env::temp_dir().join(format!("memflow-offsets-{}", std::process::id()));
+        let path = dir.join("ntkrnlmp.pdb").join("0123456789ABCDEF.offsets");
+
+        let mut offsets: Win32OffsetTable = unsafe { std::mem::zeroed() };
+        offsets.eproc_pid = 0x2e8;
+        offsets.teb_peb_x86 = 0x30;
+
+        write_offsets_cache(&path, &Win32Offsets(offsets)).unwrap();
+        let cached = read_offsets_cache(&path).unwrap();
+        assert_eq!(cached.0.eproc_pid, 0x2e8);
+        assert_eq!(cached.0.teb_peb_x86, 0x30);
+
+        fs::write(&path, &[0u8; 16]).unwrap();
+        assert!(read_offsets_cache(&path).is_err());
+
+        fs::remove_dir_all(&dir).ok();
+    }
 }
@@ -2,18 +2,28 @@ pub mod kernel;
 pub mod kernel_builder;
 pub mod kernel_info;
 
+#[cfg(feature = "std")]
+pub mod kernel_hint;
+
 pub use kernel::Kernel;
 pub use kernel_builder::KernelBuilder;
 pub use kernel_info::KernelInfo;
 
+#[cfg(feature = "std")]
+pub use kernel_hint::KernelHint;
+
 pub mod keyboard;
 pub mod module;
+pub mod pe_index;
 pub mod process;
+pub mod process_snapshot;
 pub mod unicode_string;
 pub mod vat;
 
 pub use keyboard::*;
 pub use module::*;
+pub use pe_index::*;
 pub use process::*;
+pub use process_snapshot::*;
 pub use unicode_string::*;
 pub use vat::*;
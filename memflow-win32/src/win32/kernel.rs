@@ -2,24 +2,32 @@ use std::prelude::v1::*;
 
 use super::{
     process::EXIT_STATUS_STILL_ACTIVE, process::IMAGE_FILE_NAME_LENGTH, KernelBuilder, KernelInfo,
-    Win32ExitStatus, Win32ModuleListInfo, Win32Process, Win32ProcessInfo, Win32VirtualTranslate,
+    PeIndex, PeIndexCache, Win32ExitStatus, Win32ModuleInfo, Win32ModuleListInfo, Win32Process,
+    Win32ProcessInfo, Win32VirtualTranslate,
 };
 
 use crate::error::{Error, Result};
 use crate::offsets::Win32Offsets;
 
-use log::{info, trace};
+use log::{info, trace, warn};
 use std::fmt;
 
-use memflow::architecture::x86;
-use memflow::mem::{DirectTranslate, PhysicalMemory, VirtualDMA, VirtualMemory, VirtualTranslate};
+use memflow::architecture::{x86, ArchitectureObj};
+use memflow::mem::{
+    CacheValidator, CachedMemoryAccess, CachedVirtualTranslate, DirectTranslate, MemoryStats,
+    PhysicalMemory, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate,
+};
 use memflow::process::{OperatingSystem, OsProcessInfo, OsProcessModuleInfo, PID};
 use memflow::types::Address;
 
-use pelite::{self, pe64::exports::Export, PeView};
+use dataview::Pod;
+use smallvec::SmallVec;
 
 const MAX_ITER_COUNT: usize = 65536;
 
+/// Upper bound of the reads per node of `eprocess_walk`, the two links and all `EprocessFields`.
+const EPROCESS_WALK_READS: usize = 10;
+
 #[derive(Clone)]
 pub struct Kernel<T, V> {
     pub phys_mem: T,
@@ -28,6 +36,9 @@ pub struct Kernel<T, V> {
 
     pub kernel_info: KernelInfo,
     pub sysproc_dtb: Address,
+
+    /// Exports and sections of ntoskrnl.exe and the loaded drivers.
+    pub pe_cache: PeIndexCache,
 }
 
 impl<T: PhysicalMemory, V: VirtualTranslate> OperatingSystem for Kernel<T, V> {}
@@ -71,6 +82,8 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
 
             kernel_info,
             sysproc_dtb,
+
+            pe_cache: PeIndexCache::new(),
         }
     }
 
@@ -87,29 +100,81 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
     }
 
     pub fn eprocess_list_extend<E: Extend<Address>>(&mut self, eprocs: &mut E) -> Result<()> {
-        // TODO: create a VirtualDMA constructor for kernel_info
-        let mut reader = VirtualDMA::with_vat(
-            &mut self.phys_mem,
-            self.kernel_info.start_block.arch,
-            Win32VirtualTranslate::new(self.kernel_info.start_block.arch, self.sysproc_dtb),
-            &mut self.vat,
-        );
+        self.eprocess_walk(false, |_, eprocess, _| {
+            eprocs.extend(Some(eprocess).into_iter())
+        })
+    }
 
+    /// Walks the `ActiveProcessLinks` list and reads flink and blink of every node in one batch.
+    ///
+    /// If `with_fields` is set the eprocess fields required by `process_info_from_eprocess`
+    /// are read in the same batch as the next link, so each node only costs a single round trip.
+    /// Nodes whose fields could not be read are reported without them.
+    ///
+    /// Every node is passed to `visit` along with the kernel as soon as it has been read,
+    /// so the visitor can resolve it right away.
+    /// If the links of a node can not be read, the nodes found up to that point have already
+    /// been visited and an `Error::VirtualMemory` error is returned.
+    fn eprocess_walk<F: FnMut(&mut Self, Address, Option<EprocessFields>)>(
+        &mut self,
+        with_fields: bool,
+        mut visit: F,
+    ) -> Result<()> {
+        let arch = self.kernel_info.start_block.arch;
         let list_start = self.kernel_info.eprocess_base + self.offsets.eproc_link();
         let mut list_entry = list_start;
 
+        // the read list and its status live on the stack, the reader is only held while a node
+        // is read so the visitor can use the kernel in between
+        let mut status = [false; EPROCESS_WALK_READS];
+
         for _ in 0..MAX_ITER_COUNT {
             let eprocess = list_entry - self.offsets.eproc_link();
             trace!("eprocess={}", eprocess);
 
             // test flink + blink before adding the process
-            let flink_entry =
-                reader.virt_read_addr_arch(self.kernel_info.start_block.arch, list_entry)?;
-            trace!("flink_entry={}", flink_entry);
-            let blink_entry = reader.virt_read_addr_arch(
-                self.kernel_info.start_block.arch,
+            let mut flink = 0u64;
+            let mut blink = 0u64;
+            let mut fields = EprocessFields::default();
+
+            let mut read_list = SmallVec::<[VirtualReadData; EPROCESS_WALK_READS]>::new();
+            read_list.push(VirtualReadData(
+                list_entry,
+                &mut flink.as_bytes_mut()[..arch.size_addr()],
+            ));
+            read_list.push(VirtualReadData(
                 list_entry + self.offsets.list_blink(),
-            )?;
+                &mut blink.as_bytes_mut()[..arch.size_addr()],
+            ));
+            if with_fields {
+                fields.read_list(&self.offsets, arch, eprocess, &mut read_list);
+            }
+
+            // TODO: create a VirtualDMA constructor for kernel_info
+            let mut reader = VirtualDMA::with_vat(
+                &mut self.phys_mem,
+                self.kernel_info.start_block.arch,
+                Win32VirtualTranslate::new(self.kernel_info.start_block.arch, self.sysproc_dtb),
+                &mut self.vat,
+            );
+            let status = &mut status[..read_list.len()];
+            reader.virt_read_raw_list_status(&mut read_list, status)?;
+            std::mem::drop(read_list);
+            std::mem::drop(reader);
+
+            if !status[0] || !status[1] {
+                warn!(
+                    "unable to read the process list links of eprocess {:x}",
+                    eprocess
+                );
+                return Err(Error::Core(memflow::error::Error::VirtualMemory(
+                    "unable to read the process list links",
+                )));
+            }
+
+            let flink_entry = Address::from(flink);
+            trace!("flink_entry={}", flink_entry);
+            let blink_entry = Address::from(blink);
             trace!("blink_entry={}", blink_entry);
 
             if flink_entry.is_null()
@@ -121,7 +186,12 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
             }
 
             trace!("found eprocess {:x}", eprocess);
-            eprocs.extend(Some(eprocess).into_iter());
+            let fields = if with_fields && status[2..].iter().all(|&ok| ok) {
+                Some(fields)
+            } else {
+                None
+            };
+            visit(self, eprocess, fields);
 
             // continue
             list_entry = flink_entry;
@@ -130,6 +200,25 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         Ok(())
     }
 
+    /// Returns the exports and sections of the kernel image or driver loaded at `base`.
+    ///
+    /// The pe header and export directory are only read on the first lookup of an image,
+    /// subsequent lookups are served from `pe_cache`.
+    pub fn pe_index(&mut self, base: Address) -> Result<&PeIndex> {
+        let mut reader = VirtualDMA::with_vat(
+            &mut self.phys_mem,
+            self.kernel_info.start_block.arch,
+            Win32VirtualTranslate::new(self.kernel_info.start_block.arch, self.sysproc_dtb),
+            &mut self.vat,
+        );
+        self.pe_cache.get_or_load(&mut reader, base)
+    }
+
+    /// Returns the exports and sections of a kernel module.
+    pub fn module_pe_index(&mut self, module: &Win32ModuleInfo) -> Result<&PeIndex> {
+        self.pe_index(module.base)
+    }
+
     pub fn kernel_process_info(&mut self) -> Result<Win32ProcessInfo> {
         // TODO: create a VirtualDMA constructor for kernel_info
         let mut reader = VirtualDMA::with_vat(
@@ -139,24 +228,11 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
             &mut self.vat,
         );
 
-        // TODO: cache pe globally
         // find PsLoadedModuleList
-        let loaded_module_list = {
-            let image =
-                reader.virt_read_raw(self.kernel_info.kernel_base, self.kernel_info.kernel_size)?;
-            let pe = PeView::from_bytes(&image).map_err(Error::PE)?;
-            match pe
-                .get_export_by_name("PsLoadedModuleList")
-                .map_err(Error::PE)?
-            {
-                Export::Symbol(s) => self.kernel_info.kernel_base + *s as usize,
-                Export::Forward(_) => {
-                    return Err(Error::Other(
-                        "PsLoadedModuleList found but it was a forwarded export",
-                    ))
-                }
-            }
-        };
+        let loaded_module_list = self
+            .pe_cache
+            .get_or_load(&mut reader, self.kernel_info.kernel_base)?
+            .export("PsLoadedModuleList")?;
 
         let kernel_modules =
             reader.virt_read_addr_arch(self.kernel_info.start_block.arch, loaded_module_list)?;
@@ -198,32 +274,45 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
             &mut self.vat,
         );
 
-        let pid: PID = reader.virt_read(eprocess + self.offsets.eproc_pid())?;
+        // all fields of the eprocess itself are read in a single batch
+        let mut fields = EprocessFields::default();
+        let mut read_list = Vec::new();
+        fields.read_list(
+            &self.offsets,
+            self.kernel_info.start_block.arch,
+            eprocess,
+            &mut read_list,
+        );
+        reader.virt_read_raw_list(&mut read_list)?;
+        std::mem::drop(read_list);
+        std::mem::drop(reader);
+
+        self.process_info_from_fields(eprocess, &fields)
+    }
+
+    fn process_info_from_fields(
+        &mut self,
+        eprocess: Address,
+        fields: &EprocessFields,
+    ) -> Result<Win32ProcessInfo> {
+        // TODO: create a VirtualDMA constructor for kernel_info
+        let mut reader = VirtualDMA::with_vat(
+            &mut self.phys_mem,
+            self.kernel_info.start_block.arch,
+            Win32VirtualTranslate::new(self.kernel_info.start_block.arch, self.sysproc_dtb),
+            &mut self.vat,
+        );
+
+        let pid = fields.pid;
         trace!("pid={}", pid);
 
-        let name =
-            reader.virt_read_cstr(eprocess + self.offsets.eproc_name(), IMAGE_FILE_NAME_LENGTH)?;
+        let name = fields.name();
         trace!("name={}", name);
 
-        let dtb = reader.virt_read_addr_arch(
-            self.kernel_info.start_block.arch,
-            eprocess + self.offsets.kproc_dtb(),
-        )?;
+        let dtb = Address::from(fields.dtb);
         trace!("dtb={:x}", dtb);
 
-        let wow64 = if self.offsets.eproc_wow64() == 0 {
-            trace!("eproc_wow64=null; skipping wow64 detection");
-            Address::null()
-        } else {
-            trace!(
-                "eproc_wow64={:x}; trying to read wow64 pointer",
-                self.offsets.eproc_wow64()
-            );
-            reader.virt_read_addr_arch(
-                self.kernel_info.start_block.arch,
-                eprocess + self.offsets.eproc_wow64(),
-            )?
-        };
+        let wow64 = Address::from(fields.wow64);
         trace!("wow64={:x}", wow64);
 
         // determine process architecture
@@ -242,35 +331,18 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         };
         trace!("proc_arch={:?}", proc_arch);
 
-        // read native_peb (either the process peb or the peb containing the wow64 helpers)
-        let native_peb = reader.virt_read_addr_arch(
-            self.kernel_info.start_block.arch,
-            eprocess + self.offsets.eproc_peb(),
-        )?;
-        trace!("native_peb={:x}", native_peb);
-
-        let section_base = reader.virt_read_addr_arch(
-            self.kernel_info.start_block.arch,
-            eprocess + self.offsets.eproc_section_base(),
-        )?;
+        let section_base = Address::from(fields.section_base);
         trace!("section_base={:x}", section_base);
 
-        let exit_status: Win32ExitStatus =
-            reader.virt_read(eprocess + self.offsets.eproc_exit_status())?;
+        let exit_status = fields.exit_status;
         trace!("exit_status={}", exit_status);
 
         // find first ethread
-        let ethread = reader.virt_read_addr_arch(
-            self.kernel_info.start_block.arch,
-            eprocess + self.offsets.eproc_thread_list(),
-        )? - self.offsets.ethread_list_entry();
+        let ethread = Address::from(fields.thread_list) - self.offsets.ethread_list_entry();
         trace!("ethread={:x}", ethread);
 
-        let peb_native = reader
-            .virt_read_addr_arch(
-                self.kernel_info.start_block.arch,
-                eprocess + self.offsets.eproc_peb(),
-            )?
+        // native_peb is either the process peb or the peb containing the wow64 helpers
+        let peb_native = Address::from(fields.peb)
             .non_null()
             .ok_or(Error::Other("Could not retrieve peb_native"))?;
 
@@ -363,14 +435,32 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
         &mut self,
         list: &mut E,
     ) -> Result<()> {
-        let mut vec = Vec::new();
-        self.eprocess_list_extend(&mut vec)?;
-        for eprocess in vec.into_iter() {
-            if let Ok(prc) = self.process_info_from_eprocess(eprocess) {
-                list.extend(Some(prc).into_iter());
+        self.process_info_list_extend_max(list, usize::MAX)
+            .map(|_| ())
+    }
+
+    /// Resolves the `Win32ProcessInfo` of at most the first `max_size` processes into `list`.
+    ///
+    /// Returns the total amount of processes in the process list, which may be larger than
+    /// `max_size`. Processes beyond `max_size` are only counted, they are never resolved.
+    /// Every process is passed to `list` as soon as it has been resolved during the walk.
+    pub fn process_info_list_extend_max<E: Extend<Win32ProcessInfo>>(
+        &mut self,
+        list: &mut E,
+        max_size: usize,
+    ) -> Result<usize> {
+        let mut count = 0;
+        self.eprocess_walk(max_size > 0, |kernel, eprocess, fields| {
+            if count < max_size {
+                if let Some(Ok(prc)) =
+                    fields.map(|fields| kernel.process_info_from_fields(eprocess, &fields))
+                {
+                    list.extend(Some(prc).into_iter());
+                }
             }
-        }
-        Ok(())
+            count += 1;
+        })?;
+        Ok(count)
     }
 
     /// Retrieves a list of `Win32ProcessInfo` structs for all processes
@@ -517,12 +607,123 @@ impl<T: PhysicalMemory, V: VirtualTranslate> Kernel<T, V> {
     }
 }
 
+/// Raw eprocess fields required to construct a `Win32ProcessInfo`.
+///
+/// Pointers are stored as `u64` and only the first `size_addr` bytes are read,
+/// which yields the correct value for 32 bit pointers on little endian targets as well.
+#[derive(Default)]
+struct EprocessFields {
+    pid: PID,
+    name: [u8; IMAGE_FILE_NAME_LENGTH],
+    dtb: u64,
+    wow64: u64,
+    peb: u64,
+    section_base: u64,
+    exit_status: Win32ExitStatus,
+    thread_list: u64,
+}
+
+impl EprocessFields {
+    /// Appends the reads of all fields of `eprocess` to `list`.
+    fn read_list<'a, E: Extend<VirtualReadData<'a>>>(
+        &'a mut self,
+        offsets: &Win32Offsets,
+        arch: ArchitectureObj,
+        eprocess: Address,
+        list: &mut E,
+    ) {
+        let size_addr = arch.size_addr();
+        let Self {
+            pid,
+            name,
+            dtb,
+            wow64,
+            peb,
+            section_base,
+            exit_status,
+            thread_list,
+        } = self;
+
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_pid(),
+            pid.as_bytes_mut(),
+        )));
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_name(),
+            &mut name[..],
+        )));
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.kproc_dtb(),
+            &mut dtb.as_bytes_mut()[..size_addr],
+        )));
+        if offsets.eproc_wow64() != 0 {
+            list.extend(Some(VirtualReadData(
+                eprocess + offsets.eproc_wow64(),
+                &mut wow64.as_bytes_mut()[..size_addr],
+            )));
+        } else {
+            trace!("eproc_wow64=null; skipping wow64 detection");
+        }
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_peb(),
+            &mut peb.as_bytes_mut()[..size_addr],
+        )));
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_section_base(),
+            &mut section_base.as_bytes_mut()[..size_addr],
+        )));
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_exit_status(),
+            exit_status.as_bytes_mut(),
+        )));
+        list.extend(Some(VirtualReadData(
+            eprocess + offsets.eproc_thread_list(),
+            &mut thread_list.as_bytes_mut()[..size_addr],
+        )));
+    }
+
+    fn name(&self) -> String {
+        let len = self
+            .name
+            .iter()
+            .position(|&c| c == 0)
+            .unwrap_or_else(|| self.name.len());
+        String::from_utf8_lossy(&self.name[..len]).to_string()
+    }
+}
+
 impl<T: PhysicalMemory> Kernel<T, DirectTranslate> {
     pub fn builder(connector: T) -> KernelBuilder<T, T, DirectTranslate> {
         KernelBuilder::<T, T, DirectTranslate>::new(connector)
     }
 }
 
+impl<'a, T, Q, V, QV> Kernel<CachedMemoryAccess<'a, T, Q>, CachedVirtualTranslate<V, QV>>
+where
+    T: PhysicalMemory,
+    Q: CacheValidator,
+    V: VirtualTranslate,
+    QV: CacheValidator,
+{
+    /// Returns the statistics of the page caches, the vat cache and the connector.
+    ///
+    /// Except for the vat cache hits and misses the statistics are only recorded
+    /// when memflow is compiled with the `stats` feature.
+    pub fn stats(&self) -> MemoryStats {
+        MemoryStats {
+            page_cache: self.phys_mem.page_cache_stats(),
+            page_table_cache: self.phys_mem.page_table_cache_stats(),
+            connector: self.phys_mem.connector_stats(),
+            translate: self.vat.stats(),
+        }
+    }
+
+    pub fn reset_stats(&mut self) {
+        self.phys_mem.reset_stats();
+        self.vat.reset_stats();
+    }
+}
+
 impl<T: PhysicalMemory, V: VirtualTranslate> fmt::Debug for Kernel<T, V> {
     fn fmt(&self, f: &mut fmt::Formatter) -> fmt::Result {
         write!(f, "{:?}", self.kernel_info)
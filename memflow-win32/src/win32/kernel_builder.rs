@@ -1,9 +1,17 @@
 use std::prelude::v1::*;
 
+use super::kernel_info::KernelFinder;
 use super::{Kernel, KernelInfo};
 use crate::error::Result;
 use crate::offsets::Win32Offsets;
 
+#[cfg(feature = "std")]
+use {
+    super::KernelHint,
+    log::{debug, warn},
+    std::path::PathBuf,
+};
+
 #[cfg(feature = "symstore")]
 use crate::offsets::SymbolStore;
 
@@ -119,6 +127,10 @@ pub struct KernelBuilder<T, TK, VK> {
     #[cfg(feature = "symstore")]
     symbol_store: Option<SymbolStore>,
 
+    kernel_finder: Option<KernelFinder>,
+    #[cfg(feature = "std")]
+    hint_file: Option<PathBuf>,
+
     build_page_cache: Box<dyn FnOnce(T, ArchitectureObj) -> TK>,
     build_vat_cache: Box<dyn FnOnce(DirectTranslate, ArchitectureObj) -> VK>,
 }
@@ -138,6 +150,10 @@ where
             #[cfg(feature = "symstore")]
             symbol_store: Some(SymbolStore::default()),
 
+            kernel_finder: None,
+            #[cfg(feature = "std")]
+            hint_file: None,
+
             build_page_cache: Box::new(|connector, _| connector),
             build_vat_cache: Box::new(|vat, _| vat),
         }
@@ -152,17 +168,7 @@ where
 {
     pub fn build(mut self) -> Result<Kernel<TK, VK>> {
         // find kernel_info
-        let mut kernel_scanner = KernelInfo::scanner(&mut self.connector);
-        if let Some(arch) = self.arch {
-            kernel_scanner = kernel_scanner.arch(arch);
-        }
-        if let Some(kernel_hint) = self.kernel_hint {
-            kernel_scanner = kernel_scanner.kernel_hint(kernel_hint);
-        }
-        if let Some(dtb) = self.dtb {
-            kernel_scanner = kernel_scanner.dtb(dtb);
-        }
-        let kernel_info = kernel_scanner.scan()?;
+        let kernel_info = self.build_kernel_info()?;
 
         // acquire offsets from the symbol store
         let offsets = self.build_offsets(&kernel_info)?;
@@ -184,6 +190,50 @@ where
         ))
     }
 
+    #[cfg(feature = "std")]
+    fn build_kernel_info(&mut self) -> Result<KernelInfo> {
+        let hint_file = match self.hint_file.clone() {
+            Some(hint_file) => hint_file,
+            None => return self.scan_kernel_info(),
+        };
+
+        match KernelHint::load(&hint_file).and_then(|hint| hint.validate(&mut self.connector)) {
+            Ok(kernel_info) => Ok(kernel_info),
+            Err(err) => {
+                debug!("kernel hint rejected, scanning for the kernel: {}", err);
+                let kernel_info = self.scan_kernel_info()?;
+                if let Err(err) = KernelHint::probe(&mut self.connector, &kernel_info)
+                    .and_then(|hint| hint.save(&hint_file))
+                {
+                    warn!("unable to store kernel hint: {}", err);
+                }
+                Ok(kernel_info)
+            }
+        }
+    }
+
+    #[cfg(not(feature = "std"))]
+    fn build_kernel_info(&mut self) -> Result<KernelInfo> {
+        self.scan_kernel_info()
+    }
+
+    fn scan_kernel_info(&mut self) -> Result<KernelInfo> {
+        let mut kernel_scanner = KernelInfo::scanner(&mut self.connector);
+        if let Some(arch) = self.arch {
+            kernel_scanner = kernel_scanner.arch(arch);
+        }
+        if let Some(kernel_hint) = self.kernel_hint {
+            kernel_scanner = kernel_scanner.kernel_hint(kernel_hint);
+        }
+        if let Some(dtb) = self.dtb {
+            kernel_scanner = kernel_scanner.dtb(dtb);
+        }
+        if let Some(kernel_finder) = self.kernel_finder.take() {
+            kernel_scanner = kernel_scanner.kernel_finder(kernel_finder);
+        }
+        kernel_scanner.scan()
+    }
+
     #[cfg(feature = "symstore")]
     fn build_offsets(&self, kernel_info: &KernelInfo) -> Result<Win32Offsets> {
         let mut builder = Win32Offsets::builder();
@@ -262,6 +312,30 @@ where
         self
     }
 
+    /// Stores the result of the kernel scan in `path` and reuses it on the next initialization.
+    ///
+    /// The stored hint is validated against the target before it is used,
+    /// if validation fails the kernel is scanned again and the file is replaced.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use memflow::mem::PhysicalMemory;
+    /// use memflow_win32::win32::Kernel;
+    ///
+    /// fn test<T: PhysicalMemory>(connector: T) {
+    ///     let _kernel = Kernel::builder(connector)
+    ///         .kernel_hint_file("kernel.hint")
+    ///         .build()
+    ///         .unwrap();
+    /// }
+    /// ```
+    #[cfg(feature = "std")]
+    pub fn kernel_hint_file<P: Into<PathBuf>>(mut self, path: P) -> Self {
+        self.hint_file = Some(path.into());
+        self
+    }
+
     /// Creates the Kernel structure with default caching enabled.
     ///
     /// If this option is specified, the Kernel structure is generated
@@ -298,6 +372,10 @@ where
             #[cfg(feature = "symstore")]
             symbol_store: self.symbol_store,
 
+            kernel_finder: self.kernel_finder,
+            #[cfg(feature = "std")]
+            hint_file: self.hint_file,
+
             build_page_cache: Box::new(|connector, arch| {
                 CachedMemoryAccess::builder(connector)
                     .arch(arch)
@@ -353,6 +431,10 @@ where
             #[cfg(feature = "symstore")]
             symbol_store: self.symbol_store,
 
+            kernel_finder: self.kernel_finder,
+            #[cfg(feature = "std")]
+            hint_file: self.hint_file,
+
             build_page_cache: Box::new(func),
             build_vat_cache: self.build_vat_cache,
         }
@@ -398,6 +480,10 @@ where
             #[cfg(feature = "symstore")]
             symbol_store: self.symbol_store,
 
+            kernel_finder: self.kernel_finder,
+            #[cfg(feature = "std")]
+            hint_file: self.hint_file,
+
             build_page_cache: self.build_page_cache,
             build_vat_cache: Box::new(func),
         }
@@ -407,3 +493,37 @@ where
     // kernel_info_builder()
     // offset_builder()
 }
+
+#[cfg(feature = "std")]
+impl<T, TK, VK> KernelBuilder<T, TK, VK>
+where
+    T: PhysicalMemory + Clone + 'static,
+    TK: PhysicalMemory,
+    VK: VirtualTranslate,
+{
+    /// Scans for ntoskrnl.exe on `threads` clones of the connector.
+    ///
+    /// The candidate regions of the kernel address space are split between the threads,
+    /// the resulting kernel is the same as the one found by the serial scan.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use memflow::mem::PhysicalMemory;
+    /// use memflow_win32::win32::Kernel;
+    ///
+    /// fn test<T: PhysicalMemory + Clone + 'static>(connector: T) {
+    ///     let _kernel = Kernel::builder(connector)
+    ///         .parallel_scan(4)
+    ///         .build()
+    ///         .unwrap();
+    /// }
+    /// ```
+    pub fn parallel_scan(mut self, threads: usize) -> Self {
+        let connector = self.connector.clone();
+        self.kernel_finder = Some(Box::new(move |start_block| {
+            crate::kernel::ntos::find_parallel(&connector, start_block, threads)
+        }));
+        self
+    }
+}
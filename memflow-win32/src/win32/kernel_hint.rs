@@ -0,0 +1,270 @@
+use std::prelude::v1::*;
+
+use super::{KernelInfo, Win32VirtualTranslate};
+use crate::error::{Error, Result};
+use crate::kernel::ntos::pehelper;
+use crate::kernel::{StartBlock, Win32GUID, Win32Version};
+use crate::offsets::offset_table::BinaryString;
+
+use std::convert::TryFrom;
+use std::fs;
+use std::path::Path;
+
+use log::{debug, info};
+
+use memflow::architecture::{self, ArchitectureObj};
+use memflow::mem::{DirectTranslate, PhysicalMemory, VirtualDMA, VirtualMemory};
+use memflow::types::Address;
+
+use dataview::Pod;
+
+const KERNEL_HINT_MAGIC: [u8; 8] = *b"MFKHNT01";
+
+/// The result of a previous kernel scan which can be used to skip the scan on the next initialization.
+///
+/// A hint is only accepted after it has been validated against the target with a few small reads:
+/// the pe header of ntoskrnl.exe has to be mapped at the same address, with the same image size and
+/// timestamp, and the system eprocess has to be readable with the stored dtb.
+/// This makes it safe to keep hints around after the target has been rebooted or updated.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::mem::PhysicalMemory;
+/// use memflow_win32::win32::{KernelHint, KernelInfo};
+///
+/// fn scan<T: PhysicalMemory>(mut connector: T) {
+///     let kernel_info = match KernelHint::load("kernel.hint")
+///         .and_then(|hint| hint.validate(&mut connector))
+///     {
+///         Ok(kernel_info) => kernel_info,
+///         Err(_) => {
+///             let kernel_info = KernelInfo::scanner(&mut connector).scan().unwrap();
+///             KernelHint::probe(&mut connector, &kernel_info)
+///                 .and_then(|hint| hint.save("kernel.hint"))
+///                 .ok();
+///             kernel_info
+///         }
+///     };
+/// }
+/// ```
+#[derive(Debug, Clone)]
+pub struct KernelHint {
+    pub kernel_info: KernelInfo,
+    pub image_timestamp: u32,
+}
+
+#[repr(C)]
+#[derive(Clone)]
+struct KernelHintFile {
+    magic: [u8; 8],
+    arch: u32,
+    image_timestamp: u32,
+    dtb: u64,
+    kernel_hint: u64,
+    kernel_base: u64,
+    kernel_size: u64,
+    eprocess_base: u64,
+    winver: [u32; 3],
+    has_guid: u32,
+    pdb_file_name: BinaryString,
+    pdb_guid: BinaryString,
+}
+unsafe impl Pod for KernelHintFile {}
+
+impl KernelHint {
+    /// Creates a hint for an already scanned kernel by reading its pe header timestamp.
+    pub fn probe<T: PhysicalMemory>(mem: &mut T, kernel_info: &KernelInfo) -> Result<Self> {
+        let mut virt_mem = kernel_virt_mem(mem, &kernel_info.start_block);
+        let (_, image_timestamp) =
+            pehelper::try_get_pe_header_info(&mut virt_mem, kernel_info.kernel_base)?;
+
+        Ok(Self {
+            kernel_info: kernel_info.clone(),
+            image_timestamp,
+        })
+    }
+
+    /// Checks whether the hint still matches the target and returns the `KernelInfo` on success.
+    pub fn validate<T: PhysicalMemory>(&self, mem: &mut T) -> Result<KernelInfo> {
+        let info = &self.kernel_info;
+        let mut virt_mem = kernel_virt_mem(mem, &info.start_block);
+
+        let (size_of_image, image_timestamp) =
+            pehelper::try_get_pe_header_info(&mut virt_mem, info.kernel_base)?;
+        if size_of_image != info.kernel_size || image_timestamp != self.image_timestamp {
+            return Err(Error::Initialization(
+                "kernel hint does not match the ntoskrnl.exe image",
+            ));
+        }
+
+        let mut buf = [0u8; 8];
+        virt_mem.virt_read_raw_into(
+            info.eprocess_base,
+            &mut buf[..info.start_block.arch.size_addr()],
+        )?;
+
+        info!("kernel hint validated: kernel_base={:x}", info.kernel_base);
+        Ok(info.clone())
+    }
+
+    /// Loads a hint that was previously written with `save`.
+    pub fn load<P: AsRef<Path>>(path: P) -> Result<Self> {
+        let buffer = fs::read(path).map_err(|_| Error::Other("unable to read kernel hint file"))?;
+        if buffer.len() != std::mem::size_of::<KernelHintFile>() {
+            return Err(Error::Other("kernel hint file has an invalid size"));
+        }
+
+        // the buffer is not guaranteed to be aligned
+        let file = unsafe { std::ptr::read_unaligned(buffer.as_ptr() as *const KernelHintFile) };
+        if file.magic != KERNEL_HINT_MAGIC {
+            return Err(Error::Other("kernel hint file has an invalid header"));
+        }
+
+        let kernel_guid = if file.has_guid != 0 {
+            let file_name = <&str>::try_from(&file.pdb_file_name).map_err(|_| Error::Encoding)?;
+            let guid = <&str>::try_from(&file.pdb_guid).map_err(|_| Error::Encoding)?;
+            Some(Win32GUID::new(file_name, guid))
+        } else {
+            None
+        };
+
+        debug!("kernel hint loaded: kernel_base={:x}", file.kernel_base);
+        Ok(Self {
+            kernel_info: KernelInfo {
+                start_block: StartBlock {
+                    arch: arch_from_u32(file.arch)?,
+                    kernel_hint: file.kernel_hint.into(),
+                    dtb: file.dtb.into(),
+                },
+                kernel_base: file.kernel_base.into(),
+                kernel_size: file.kernel_size as usize,
+                kernel_guid,
+                kernel_winver: Win32Version::new(file.winver[0], file.winver[1], file.winver[2]),
+                eprocess_base: file.eprocess_base.into(),
+            },
+            image_timestamp: file.image_timestamp,
+        })
+    }
+
+    /// Writes the hint into a small binary file.
+    pub fn save<P: AsRef<Path>>(&self, path: P) -> Result<()> {
+        let info = &self.kernel_info;
+        let (pdb_file_name, pdb_guid) = match &info.kernel_guid {
+            Some(guid) => (
+                BinaryString::from(guid.file_name.as_str()),
+                BinaryString::from(guid.guid.as_str()),
+            ),
+            None => (BinaryString::default(), BinaryString::default()),
+        };
+
+        let file = KernelHintFile {
+            magic: KERNEL_HINT_MAGIC,
+            arch: arch_to_u32(info.start_block.arch)?,
+            image_timestamp: self.image_timestamp,
+            dtb: info.start_block.dtb.as_u64(),
+            kernel_hint: info.start_block.kernel_hint.as_u64(),
+            kernel_base: info.kernel_base.as_u64(),
+            kernel_size: info.kernel_size as u64,
+            eprocess_base: info.eprocess_base.as_u64(),
+            winver: [
+                info.kernel_winver.major_version(),
+                info.kernel_winver.minor_version(),
+                info.kernel_winver.build_number(),
+            ],
+            has_guid: info.kernel_guid.is_some() as u32,
+            pdb_file_name,
+            pdb_guid,
+        };
+
+        // write into a temporary file first so concurrent loads never see a partial hint
+        let path = path.as_ref();
+        let tmp_path = path.with_extension(format!("hint.{}", std::process::id()));
+        fs::write(&tmp_path, file.as_bytes())
+            .and_then(|_| fs::rename(&tmp_path, path))
+            .map_err(|_| {
+                fs::remove_file(&tmp_path).ok();
+                Error::Other("unable to write kernel hint file")
+            })
+    }
+}
+
+fn kernel_virt_mem<T: PhysicalMemory>(
+    mem: &mut T,
+    start_block: &StartBlock,
+) -> VirtualDMA<&mut T, DirectTranslate, Win32VirtualTranslate> {
+    VirtualDMA::with_vat(
+        mem,
+        start_block.arch,
+        Win32VirtualTranslate::new(start_block.arch, start_block.dtb),
+        DirectTranslate::new(),
+    )
+}
+
+fn arch_to_u32(arch: ArchitectureObj) -> Result<u32> {
+    if arch == architecture::x86::x64::ARCH {
+        Ok(0)
+    } else if arch == architecture::x86::x32::ARCH {
+        Ok(1)
+    } else if arch == architecture::x86::x32_pae::ARCH {
+        Ok(2)
+    } else {
+        Err(Error::InvalidArchitecture)
+    }
+}
+
+fn arch_from_u32(arch: u32) -> Result<ArchitectureObj> {
+    match arch {
+        0 => Ok(architecture::x86::x64::ARCH),
+        1 => Ok(architecture::x86::x32::ARCH),
+        2 => Ok(architecture::x86::x32_pae::ARCH),
+        _ => Err(Error::InvalidArchitecture),
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn kernel_hint_file_roundtrip() {
+        let path = std::env::temp_dir().join(format!("memflow-{}.hint", std::process::id()));
+
+        let hint = KernelHint {
+            kernel_info: KernelInfo {
+                start_block: StartBlock {
+                    arch: architecture::x86::x64::ARCH,
+                    kernel_hint: Address::from(0xffff_f802_1234_5678u64),
+                    dtb: Address::from(0x1ad000u64),
+                },
+                kernel_base: Address::from(0xffff_f802_1200_0000u64),
+                kernel_size: 0x104_6000,
+                kernel_guid: Some(Win32GUID::new(
+                    "ntkrnlmp.pdb",
+                    "3844DBB920174967BE7AA4A2C20430FA2",
+                )),
+                kernel_winver: Win32Version::new(10, 0, 19041),
+                eprocess_base: Address::from(0xffff_d10f_0a48_e040u64),
+            },
+            image_timestamp: 0x5f4e_1234,
+        };
+        hint.save(&path).unwrap();
+
+        let loaded = KernelHint::load(&path).unwrap();
+        fs::remove_file(&path).ok();
+
+        let (a, b) = (&hint.kernel_info, &loaded.kernel_info);
+        assert_eq!(loaded.image_timestamp, hint.image_timestamp);
+        assert!(a.start_block.arch == b.start_block.arch);
+        assert_eq!(a.start_block.dtb, b.start_block.dtb);
+        assert_eq!(a.start_block.kernel_hint, b.start_block.kernel_hint);
+        assert_eq!(a.kernel_base, b.kernel_base);
+        assert_eq!(a.kernel_size, b.kernel_size);
+        assert_eq!(a.eprocess_base, b.eprocess_base);
+        assert_eq!(a.kernel_winver, b.kernel_winver);
+        assert_eq!(
+            b.kernel_guid.as_ref().map(|g| g.guid.as_str()),
+            Some("3844DBB920174967BE7AA4A2C20430FA2")
+        );
+    }
+}
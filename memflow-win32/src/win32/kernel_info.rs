@@ -1,3 +1,5 @@
+use std::prelude::v1::*;
+
 use crate::error::Result;
 use crate::kernel::{self, StartBlock};
 use crate::kernel::{Win32GUID, Win32Version};
@@ -30,11 +32,17 @@ impl KernelInfo {
     }
 }
 
+/// A user supplied function which locates ntoskrnl.exe for a given `StartBlock`.
+///
+/// Returns the base address and the size of the kernel image.
+pub type KernelFinder = Box<dyn Fn(&StartBlock) -> Result<(Address, usize)>>;
+
 pub struct KernelInfoScanner<T> {
     mem: T,
     arch: Option<ArchitectureObj>,
     kernel_hint: Option<Address>,
     dtb: Option<Address>,
+    kernel_finder: Option<KernelFinder>,
 }
 
 impl<T: PhysicalMemory> KernelInfoScanner<T> {
@@ -44,6 +52,7 @@ impl<T: PhysicalMemory> KernelInfoScanner<T> {
             arch: None,
             kernel_hint: None,
             dtb: None,
+            kernel_finder: None,
         }
     }
 
@@ -87,7 +96,10 @@ impl<T: PhysicalMemory> KernelInfoScanner<T> {
         );
 
         // find ntoskrnl.exe base
-        let (kernel_base, kernel_size) = kernel::ntos::find(&mut virt_mem, &start_block)?;
+        let (kernel_base, kernel_size) = match &self.kernel_finder {
+            Some(finder) => finder(&start_block)?,
+            None => kernel::ntos::find(&mut virt_mem, &start_block)?,
+        };
         info!("kernel_base={} kernel_size={}", kernel_base, kernel_size);
 
         // get ntoskrnl.exe guid
@@ -140,4 +152,23 @@ impl<T: PhysicalMemory> KernelInfoScanner<T> {
         self.dtb = Some(dtb);
         self
     }
+
+    /// Replaces the default ntoskrnl.exe scan with `finder`.
+    pub fn kernel_finder(mut self, finder: KernelFinder) -> Self {
+        self.kernel_finder = Some(finder);
+        self
+    }
+}
+
+#[cfg(feature = "std")]
+impl<T: PhysicalMemory + Clone + 'static> KernelInfoScanner<T> {
+    /// Scans for ntoskrnl.exe on `threads` clones of the connector.
+    ///
+    /// This only affects x64 targets, see `kernel::ntos::find_parallel` for details.
+    pub fn parallel(self, threads: usize) -> Self {
+        let mem = self.mem.clone();
+        self.kernel_finder(Box::new(move |start_block| {
+            kernel::ntos::find_parallel(&mem, start_block, threads)
+        }))
+    }
 }
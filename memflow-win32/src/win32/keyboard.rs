@@ -138,18 +138,22 @@ impl Keyboard {
         }
     }
 
-    // TODO: replace with a custom signature scanning crate
-    #[cfg(feature = "regex")]
+    #[cfg(feature = "std")]
     fn find_gaf_sig(module_buf: &[u8]) -> Result<usize> {
-        use ::regex::bytes::*;
+        use memflow::mem::scan::{Pattern, PatternScanner};
 
         // 48 8B 05 ? ? ? ? 48 89 81 ? ? 00 00 48 8B 8F + 0x3
-        let re = Regex::new("(?-u)\\x48\\x8B\\x05(?s:.)(?s:.)(?s:.)(?s:.)\\x48\\x89\\x81(?s:.)(?s:.)\\x00\\x00\\x48\\x8B\\x8F")
-                    .map_err(|_| Error::Other("malformed gafAsyncKeyState signature"))?;
-        let buf_offs = re
-            .find(&module_buf[..])
+        let pattern = Pattern::from_ida("48 8B 05 ? ? ? ? 48 89 81 ? ? 00 00 48 8B 8F")
+            .map_err(|_| Error::Other("malformed gafAsyncKeyState signature"))?;
+        let mut matches = Vec::new();
+        PatternScanner::new()
+            .pattern(pattern)
+            .scan_buffer(Address::NULL, module_buf, &mut matches);
+        let buf_offs = matches
+            .first()
             .ok_or_else(|| Error::Other("unable to find gafAsyncKeyState signature"))?
-            .start()
+            .address
+            .as_usize()
             + 0x3;
 
         // compute rip relative addr
@@ -160,7 +164,7 @@ impl Keyboard {
         Ok(export_offs as usize)
     }
 
-    #[cfg(not(feature = "regex"))]
+    #[cfg(not(feature = "std"))]
     fn find_gaf_sig(module_buf: &[u8]) -> Result<usize> {
         Err(Error::Other("signature scanning requires std"))
     }
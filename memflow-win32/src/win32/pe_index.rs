@@ -0,0 +1,278 @@
+use std::prelude::v1::*;
+
+use crate::error::{Error, Result};
+
+use std::collections::BTreeMap;
+use std::convert::TryInto;
+
+use log::debug;
+
+use memflow::mem::VirtualMemory;
+use memflow::types::{size, Address};
+
+use pelite::{self, image::IMAGE_DIRECTORY_ENTRY_EXPORT, PeView};
+
+/// Upper bound for the size of an export directory that is read from the target.
+const MAX_EXPORT_DIRECTORY_SIZE: usize = size::mb(16);
+
+/// A section of a loaded pe image.
+#[derive(Debug, Clone)]
+pub struct PeSection {
+    pub name: String,
+    pub rva: usize,
+    pub size: usize,
+    pub characteristics: u32,
+}
+
+/// The exports and sections of a loaded pe image.
+///
+/// Constructing the index only reads the pe header and the export directory of the image
+/// instead of the entire image.
+/// Forwarded exports are not part of the index.
+#[derive(Debug, Clone)]
+pub struct PeIndex {
+    pub base: Address,
+    pub size: usize,
+    pub timestamp: u32,
+    pub dll_name: Option<String>,
+    sections: Vec<PeSection>,
+    exports: BTreeMap<String, usize>,
+}
+
+impl PeIndex {
+    pub fn new<V: VirtualMemory>(virt_mem: &mut V, base: Address) -> Result<Self> {
+        let mut header = vec![0; size::kb(4)];
+        virt_mem.virt_read_raw_into(base, &mut header)?;
+        let pe = PeView::from_bytes(&header).map_err(Error::PE)?;
+
+        let size = match pe.optional_header() {
+            pelite::Wrap::T32(opt32) => opt32.SizeOfImage,
+            pelite::Wrap::T64(opt64) => opt64.SizeOfImage,
+        } as usize;
+        if size == 0 {
+            return Err(Error::Initialization("pe size_of_image is zero"));
+        }
+
+        let sections: Vec<PeSection> = pe
+            .section_headers()
+            .iter()
+            .map(|section| PeSection {
+                name: section.name().unwrap_or_default().to_string(),
+                rva: section.VirtualAddress as usize,
+                size: section.VirtualSize as usize,
+                characteristics: section.Characteristics,
+            })
+            .collect();
+
+        let (dll_name, exports) = match pe.data_directory().get(IMAGE_DIRECTORY_ENTRY_EXPORT) {
+            Some(dir) if dir.VirtualAddress != 0 && dir.Size != 0 => {
+                let dir_rva = dir.VirtualAddress as usize;
+                let dir_size = dir.Size as usize;
+                if dir_rva + dir_size > size || dir_size > MAX_EXPORT_DIRECTORY_SIZE {
+                    return Err(Error::PE(pelite::Error::Bounds));
+                }
+
+                let mut export_dir = vec![0; dir_size];
+                virt_mem.virt_read_raw_into(base + dir_rva, &mut export_dir)?;
+                parse_export_directory(dir_rva, &export_dir)?
+            }
+            _ => (None, BTreeMap::new()),
+        };
+
+        debug!(
+            "indexed pe image at {:x}: {} sections, {} exports",
+            base,
+            sections.len(),
+            exports.len()
+        );
+
+        Ok(Self {
+            base,
+            size,
+            timestamp: pe.file_header().TimeDateStamp,
+            dll_name,
+            sections,
+            exports,
+        })
+    }
+
+    /// Returns the offset of the export `name` relative to the image base.
+    pub fn export_offset(&self, name: &str) -> Option<usize> {
+        self.exports.get(name).copied()
+    }
+
+    /// Returns the absolute address of the export `name`.
+    pub fn export(&self, name: &str) -> Result<Address> {
+        self.export_offset(name)
+            .map(|offset| self.base + offset)
+            .ok_or(Error::Other("export not found"))
+    }
+
+    /// Iterates over all exports as `(name, offset)` pairs, ordered by name.
+    pub fn exports(&self) -> impl Iterator<Item = (&str, usize)> {
+        self.exports
+            .iter()
+            .map(|(name, &offset)| (name.as_str(), offset))
+    }
+
+    pub fn section(&self, name: &str) -> Option<&PeSection> {
+        self.sections.iter().find(|section| section.name == name)
+    }
+
+    pub fn sections(&self) -> &[PeSection] {
+        &self.sections
+    }
+}
+
+/// Parses the export directory located at `dir_rva`.
+///
+/// The name, function and ordinal tables are expected to be contained in the export directory,
+/// entries pointing outside of it are skipped.
+fn parse_export_directory(
+    dir_rva: usize,
+    dir: &[u8],
+) -> Result<(Option<String>, BTreeMap<String, usize>)> {
+    let read_u32 = |rva: usize| -> Option<u32> {
+        let offset = rva.checked_sub(dir_rva)?;
+        Some(u32::from_le_bytes(
+            dir.get(offset..offset + 4)?.try_into().unwrap(),
+        ))
+    };
+    let read_u16 = |rva: usize| -> Option<u16> {
+        let offset = rva.checked_sub(dir_rva)?;
+        Some(u16::from_le_bytes(
+            dir.get(offset..offset + 2)?.try_into().unwrap(),
+        ))
+    };
+    let read_str = |rva: usize| -> Option<String> {
+        let offset = rva.checked_sub(dir_rva)?;
+        let bytes = dir.get(offset..)?;
+        let len = bytes.iter().position(|&b| b == 0)?;
+        std::str::from_utf8(&bytes[..len]).ok().map(String::from)
+    };
+
+    // IMAGE_EXPORT_DIRECTORY
+    let field = |offset: usize| read_u32(dir_rva + offset).ok_or(Error::PE(pelite::Error::Bounds));
+    let name = field(0xc)?;
+    let number_of_functions = field(0x14)? as usize;
+    let number_of_names = field(0x18)? as usize;
+    let address_of_functions = field(0x1c)? as usize;
+    let address_of_names = field(0x20)? as usize;
+    let address_of_name_ordinals = field(0x24)? as usize;
+
+    let mut exports = BTreeMap::new();
+    for i in 0..number_of_names {
+        let export = read_u32(address_of_names + i * 4)
+            .and_then(|name_rva| read_str(name_rva as usize))
+            .and_then(|name| {
+                let ordinal = read_u16(address_of_name_ordinals + i * 2)? as usize;
+                if ordinal >= number_of_functions {
+                    return None;
+                }
+                let rva = read_u32(address_of_functions + ordinal * 4)? as usize;
+                // forwarded exports point into the export directory
+                if rva >= dir_rva && rva < dir_rva + dir.len() {
+                    return None;
+                }
+                Some((name, rva))
+            });
+
+        if let Some((name, rva)) = export {
+            exports.insert(name, rva);
+        }
+    }
+
+    Ok((read_str(name as usize), exports))
+}
+
+/// Caches the `PeIndex` of images by their base address.
+#[derive(Debug, Clone, Default)]
+pub struct PeIndexCache {
+    entries: BTreeMap<Address, PeIndex>,
+}
+
+impl PeIndexCache {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Returns the index of the image at `base`, it is only read from `virt_mem` on the first lookup.
+    pub fn get_or_load<V: VirtualMemory>(
+        &mut self,
+        virt_mem: &mut V,
+        base: Address,
+    ) -> Result<&PeIndex> {
+        if !self.entries.contains_key(&base) {
+            let index = PeIndex::new(virt_mem, base)?;
+            self.entries.insert(base, index);
+        }
+        Ok(&self.entries[&base])
+    }
+
+    pub fn get(&self, base: Address) -> Option<&PeIndex> {
+        self.entries.get(&base)
+    }
+
+    /// Removes the index of the image at `base`, e.g. after the module was unloaded.
+    pub fn invalidate(&mut self, base: Address) {
+        self.entries.remove(&base);
+    }
+
+    pub fn clear(&mut self) {
+        self.entries.clear();
+    }
+
+    pub fn len(&self) -> usize {
+        self.entries.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.entries.is_empty()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn put_u32(buf: &mut [u8], offset: usize, value: u32) {
+        buf[offset..offset + 4].copy_from_slice(&value.to_le_bytes());
+    }
+
+    #[test]
+    fn parse_exports() {
+        const DIR_RVA: usize = 0x2000;
+
+        let mut dir = vec![0u8; 0x100];
+        put_u32(&mut dir, 0xc, (DIR_RVA + 0x80) as u32); // Name
+        put_u32(&mut dir, 0x14, 3); // NumberOfFunctions
+        put_u32(&mut dir, 0x18, 3); // NumberOfNames
+        put_u32(&mut dir, 0x1c, (DIR_RVA + 0x28) as u32); // AddressOfFunctions
+        put_u32(&mut dir, 0x20, (DIR_RVA + 0x34) as u32); // AddressOfNames
+        put_u32(&mut dir, 0x24, (DIR_RVA + 0x40) as u32); // AddressOfNameOrdinals
+
+        // functions, the last one is forwarded
+        put_u32(&mut dir, 0x28, 0x1010);
+        put_u32(&mut dir, 0x2c, 0x1020);
+        put_u32(&mut dir, 0x30, (DIR_RVA + 0xc0) as u32);
+
+        // names and ordinals, the second name points to the first function
+        put_u32(&mut dir, 0x34, (DIR_RVA + 0x90) as u32);
+        put_u32(&mut dir, 0x38, (DIR_RVA + 0xa0) as u32);
+        put_u32(&mut dir, 0x3c, (DIR_RVA + 0xb0) as u32);
+        dir[0x40..0x46].copy_from_slice(&[1, 0, 0, 0, 2, 0]);
+
+        dir[0x80..0x8d].copy_from_slice(b"ntoskrnl.exe\0");
+        dir[0x90..0x9f].copy_from_slice(b"NtBuildNumber\0\0");
+        dir[0xa0..0xae].copy_from_slice(b"RtlGetVersion\0");
+        dir[0xb0..0xba].copy_from_slice(b"Forwarded\0");
+        dir[0xc0..0xcf].copy_from_slice(b"hal.HalFunction");
+
+        let (dll_name, exports) = parse_export_directory(DIR_RVA, &dir).unwrap();
+        assert_eq!(dll_name.as_deref(), Some("ntoskrnl.exe"));
+        assert_eq!(exports.len(), 2);
+        assert_eq!(exports.get("NtBuildNumber"), Some(&0x1020));
+        assert_eq!(exports.get("RtlGetVersion"), Some(&0x1010));
+        assert_eq!(exports.get("Forwarded"), None);
+    }
+}
@@ -1,15 +1,20 @@
 use std::prelude::v1::*;
 
-use super::{Kernel, Win32ModuleInfo};
+use super::{Kernel, PeIndex, PeIndexCache, Win32ModuleInfo};
 use crate::error::{Error, Result};
 use crate::offsets::Win32ArchOffsets;
+use crate::win32::unicode_string::{
+    decode_unicode_string, parse_unicode_string, unicode_string_size,
+};
 use crate::win32::VirtualReadUnicodeString;
 
+use std::convert::TryInto;
+
 use log::trace;
 use std::fmt;
 
 use memflow::architecture::ArchitectureObj;
-use memflow::mem::{PhysicalMemory, VirtualDMA, VirtualMemory, VirtualTranslate};
+use memflow::mem::{PhysicalMemory, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate};
 use memflow::process::{OsProcessInfo, OsProcessModuleInfo, PID};
 use memflow::types::Address;
 
@@ -75,11 +80,23 @@ impl Win32ModuleListInfo {
         arch: ArchitectureObj,
     ) -> Result<Vec<Address>> {
         let mut list = Vec::new();
+        self.module_entry_list_extend(mem, arch, &mut list)?;
+        Ok(list)
+    }
 
+    /// Walks the module list and pushes the address of every entry into `out`.
+    ///
+    /// On error the entries that were walked so far remain in `out`.
+    pub fn module_entry_list_extend<V: VirtualMemory, E: Extend<Address>>(
+        &self,
+        mem: &mut V,
+        arch: ArchitectureObj,
+        out: &mut E,
+    ) -> Result<()> {
         let list_start = self.module_base;
         let mut list_entry = list_start;
         for _ in 0..MAX_ITER_COUNT {
-            list.push(list_entry);
+            out.extend(Some(list_entry));
             list_entry = mem.virt_read_addr_arch(arch, list_entry)?;
             // Break on misaligned entry. On NT 4.0 list end is misaligned, maybe it's a flag?
             if list_entry.is_null()
@@ -90,7 +107,7 @@ impl Win32ModuleListInfo {
             }
         }
 
-        Ok(list)
+        Ok(())
     }
 
     pub fn module_info_from_entry<V: VirtualMemory>(
@@ -125,6 +142,121 @@ impl Win32ModuleListInfo {
             name,
         })
     }
+
+    /// Reads the module information of all `entries` in two batched reads.
+    ///
+    /// The first batch reads the base, size and the name descriptors of every entry,
+    /// the second one reads the contents of all names.
+    /// Entries which can not be read completely are skipped.
+    pub fn module_info_list_from_entries<V: VirtualMemory, E: Extend<Win32ModuleInfo>>(
+        &self,
+        entries: &[Address],
+        parent_eprocess: Address,
+        mem: &mut V,
+        arch: ArchitectureObj,
+        out: &mut E,
+    ) -> Result<()> {
+        let size_addr = arch.size_addr();
+        let size_ustr = unicode_string_size(arch)?;
+        let read_addr = |raw: &[u8]| -> Address {
+            match size_addr {
+                8 => u64::from_le_bytes(raw.try_into().unwrap()).into(),
+                _ => u32::from_le_bytes(raw.try_into().unwrap()).into(),
+            }
+        };
+
+        // base, size, full name and base name
+        let stride = 2 * size_addr + 2 * size_ustr;
+        let mut fields = vec![0u8; entries.len() * stride];
+        let mut status = vec![false; entries.len() * 4];
+        {
+            let mut read_list = Vec::with_capacity(entries.len() * 4);
+            for (&entry, buf) in entries.iter().zip(fields.chunks_exact_mut(stride)) {
+                let (base, buf) = buf.split_at_mut(size_addr);
+                let (size, buf) = buf.split_at_mut(size_addr);
+                let (path, name) = buf.split_at_mut(size_ustr);
+                read_list.push(VirtualReadData(entry + self.offsets.ldr_data_base, base));
+                read_list.push(VirtualReadData(entry + self.offsets.ldr_data_size, size));
+                read_list.push(VirtualReadData(
+                    entry + self.offsets.ldr_data_full_name,
+                    path,
+                ));
+                read_list.push(VirtualReadData(
+                    entry + self.offsets.ldr_data_base_name,
+                    name,
+                ));
+            }
+            mem.virt_read_raw_list_status(&mut read_list, &mut status)?;
+        }
+
+        // (entry, base, size, path, name) of all entries with valid name descriptors
+        let pending = entries
+            .iter()
+            .zip(fields.chunks_exact(stride))
+            .zip(status.chunks_exact(4))
+            .filter(|(_, ok)| ok.iter().all(|&ok| ok))
+            .filter_map(|((&entry, buf), _)| {
+                let path = parse_unicode_string(arch, &buf[2 * size_addr..]).ok()?;
+                let name = parse_unicode_string(arch, &buf[2 * size_addr + size_ustr..]).ok()?;
+                Some((
+                    entry,
+                    read_addr(&buf[..size_addr]),
+                    read_addr(&buf[size_addr..2 * size_addr]).as_usize(),
+                    path,
+                    name,
+                ))
+            })
+            .collect::<Vec<_>>();
+
+        let names_len = pending
+            .iter()
+            .map(|(_, _, _, (path_len, _), (name_len, _))| path_len + name_len)
+            .sum();
+        let mut names = vec![0u8; names_len];
+        let mut status = vec![false; pending.len() * 2];
+        {
+            let mut read_list = Vec::with_capacity(pending.len() * 2);
+            let mut buf = &mut names[..];
+            for (_, _, _, (path_len, path_buf), (name_len, name_buf)) in pending.iter() {
+                let (path, rest) = std::mem::take(&mut buf).split_at_mut(*path_len);
+                let (name, rest) = rest.split_at_mut(*name_len);
+                read_list.push(VirtualReadData(*path_buf, path));
+                read_list.push(VirtualReadData(*name_buf, name));
+                buf = rest;
+            }
+            mem.virt_read_raw_list_status(&mut read_list, &mut status)?;
+        }
+
+        let mut offset = 0;
+        for ((entry, base, size, (path_len, _), (name_len, _)), ok) in
+            pending.into_iter().zip(status.chunks_exact(2))
+        {
+            let path = &names[offset..offset + path_len];
+            let name = &names[offset + path_len..offset + path_len + name_len];
+            offset += path_len + name_len;
+
+            if !ok[0] || !ok[1] {
+                continue;
+            }
+
+            if let (Ok(path), Ok(name)) = (
+                decode_unicode_string(arch, path),
+                decode_unicode_string(arch, name),
+            ) {
+                trace!("base={:x} size={:x} name={}", base, size, name);
+                out.extend(Some(Win32ModuleInfo {
+                    peb_entry: entry,
+                    parent_eprocess,
+                    base,
+                    size,
+                    path,
+                    name,
+                }));
+            }
+        }
+
+        Ok(())
+    }
 }
 
 #[derive(Debug, Clone)]
@@ -229,6 +361,9 @@ impl OsProcessInfo for Win32ProcessInfo {
 pub struct Win32Process<T> {
     pub virt_mem: T,
     pub proc_info: Win32ProcessInfo,
+
+    /// Exports and sections of the modules of this process.
+    pub pe_cache: PeIndexCache,
 }
 
 // TODO: can be removed i think
@@ -237,6 +372,7 @@ impl<T: Clone> Clone for Win32Process<T> {
         Self {
             virt_mem: self.virt_mem.clone(),
             proc_info: self.proc_info.clone(),
+            pe_cache: self.pe_cache.clone(),
         }
     }
 }
@@ -257,6 +393,7 @@ impl<'a, T: PhysicalMemory, V: VirtualTranslate>
         Self {
             virt_mem,
             proc_info,
+            pe_cache: PeIndexCache::new(),
         }
     }
 
@@ -289,6 +426,7 @@ impl<'a, T: PhysicalMemory, V: VirtualTranslate>
         Self {
             virt_mem,
             proc_info,
+            pe_cache: PeIndexCache::new(),
         }
     }
 }
@@ -303,31 +441,32 @@ impl<T: VirtualMemory> Win32Process<T> {
         out: &mut E,
     ) -> Result<()> {
         for (info, arch) in module_infos {
-            out.extend(
-                info.module_entry_list(&mut self.virt_mem, arch)?
-                    .iter()
-                    .filter_map(|&peb| {
-                        info.module_info_from_entry(
-                            peb,
-                            self.proc_info.address,
-                            &mut self.virt_mem,
-                            arch,
-                        )
-                        .ok()
-                    }),
-            );
+            let entries = info.module_entry_list(&mut self.virt_mem, arch)?;
+            info.module_info_list_from_entries(
+                &entries,
+                self.proc_info.address,
+                &mut self.virt_mem,
+                arch,
+                out,
+            )?;
         }
         Ok(())
     }
 
     pub fn module_entry_list(&mut self) -> Result<Vec<Address>> {
+        let mut list = Vec::new();
+        self.module_entry_list_extend(&mut list)?;
+        Ok(list)
+    }
+
+    pub fn module_entry_list_extend<E: Extend<Address>>(&mut self, out: &mut E) -> Result<()> {
         let (info, arch) = if let Some(info_wow64) = self.proc_info.module_info_wow64 {
             (info_wow64, self.proc_info.proc_arch)
         } else {
             (self.proc_info.module_info_native, self.proc_info.sys_arch)
         };
 
-        info.module_entry_list(&mut self.virt_mem, arch)
+        info.module_entry_list_extend(&mut self.virt_mem, arch, out)
     }
 
     pub fn module_entry_list_native(&mut self) -> Result<Vec<Address>> {
@@ -377,6 +516,14 @@ impl<T: VirtualMemory> Win32Process<T> {
             .ok_or_else(|| Error::ModuleInfo)
     }
 
+    /// Returns the exports and sections of `module`.
+    ///
+    /// Only the pe header and the export directory of the module are read on the first lookup,
+    /// subsequent lookups are served from `pe_cache`.
+    pub fn module_pe_index(&mut self, module: &Win32ModuleInfo) -> Result<&PeIndex> {
+        self.pe_cache.get_or_load(&mut self.virt_mem, module.base)
+    }
+
     pub fn module_info(&mut self, name: &str) -> Result<Win32ModuleInfo> {
         let module_list = self.module_list()?;
         module_list
@@ -0,0 +1,301 @@
+use std::prelude::v1::*;
+
+use super::{Kernel, Win32ProcessInfo, Win32VirtualTranslate};
+
+use crate::error::Result;
+
+use log::trace;
+
+use memflow::mem::{PhysicalMemory, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate};
+use memflow::process::PID;
+use memflow::types::Address;
+
+use dataview::Pod;
+
+/// The processes that appeared and disappeared between two snapshot updates.
+#[derive(Debug, Clone, Default)]
+pub struct Win32ProcessDiff {
+    pub added: Vec<Win32ProcessInfo>,
+    pub removed: Vec<Win32ProcessInfo>,
+}
+
+/// An incrementally updated list of all processes on the target system.
+///
+/// Every update only walks the `ActiveProcessLinks` list and reads the pid of each entry
+/// in a single batch. The full `Win32ProcessInfo` is only resolved for processes that were not
+/// part of the previous update. Processes are identified by their eprocess address and pid so
+/// a reused eprocess allocation is reported as a removed and an added process.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::mem::{PhysicalMemory, VirtualTranslate};
+/// use memflow_win32::error::Result;
+/// use memflow_win32::win32::{Kernel, Win32ProcessSnapshot};
+///
+/// fn poll<T: PhysicalMemory, V: VirtualTranslate>(kernel: &mut Kernel<T, V>) -> Result<()> {
+///     let mut snapshot = Win32ProcessSnapshot::new();
+///
+///     // every subsequent update only reports the changes
+///     let diff = snapshot.update(kernel)?;
+///     for process in diff.added.iter() {
+///         println!("started: {} {}", process.pid, process.name);
+///     }
+///     for process in diff.removed.iter() {
+///         println!("exited: {} {}", process.pid, process.name);
+///     }
+///
+///     Ok(())
+/// }
+/// ```
+#[derive(Debug, Clone, Default)]
+pub struct Win32ProcessSnapshot {
+    // sorted by (address, pid)
+    processes: Vec<Win32ProcessInfo>,
+}
+
+impl Win32ProcessSnapshot {
+    /// Creates an empty snapshot, the first update will report all processes as added.
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Returns all processes that were found during the last update.
+    pub fn processes(&self) -> &[Win32ProcessInfo] {
+        &self.processes
+    }
+
+    pub fn len(&self) -> usize {
+        self.processes.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.processes.is_empty()
+    }
+
+    /// Re-walks the process list of the given kernel and returns the changes since the last update.
+    ///
+    /// Processes whose information can not be resolved yet (e.g. because they are still starting up)
+    /// are skipped and retried on the next update.
+    pub fn update<T: PhysicalMemory, V: VirtualTranslate>(
+        &mut self,
+        kernel: &mut Kernel<T, V>,
+    ) -> Result<Win32ProcessDiff> {
+        let mut eprocs = Vec::new();
+        kernel.eprocess_list_extend(&mut eprocs)?;
+
+        let ids = eprocess_pids(kernel, &eprocs)?;
+
+        Ok(self.merge(ids, |eprocess| {
+            kernel.process_info_from_eprocess(eprocess).ok()
+        }))
+    }
+
+    /// Replaces the snapshot with the processes identified by `ids` and returns the changes.
+    ///
+    /// `resolve` is only called for processes that were not part of the previous update,
+    /// processes it can not resolve are skipped.
+    fn merge<F: FnMut(Address) -> Option<Win32ProcessInfo>>(
+        &mut self,
+        mut ids: Vec<(Address, PID)>,
+        mut resolve: F,
+    ) -> Win32ProcessDiff {
+        ids.sort_unstable();
+        ids.dedup();
+
+        let mut diff = Win32ProcessDiff::default();
+        let mut processes = Vec::with_capacity(ids.len());
+
+        let previous = std::mem::replace(&mut self.processes, Vec::new());
+        let mut previous = previous.into_iter().peekable();
+
+        for id in ids.into_iter() {
+            while previous
+                .peek()
+                .map(|prc| (prc.address, prc.pid) < id)
+                .unwrap_or(false)
+            {
+                diff.removed.extend(previous.next());
+            }
+
+            match previous.peek() {
+                Some(prc) if (prc.address, prc.pid) == id => processes.extend(previous.next()),
+                _ => {
+                    if let Some(prc) = resolve(id.0) {
+                        trace!("process added: {} {}", prc.pid, prc.name);
+                        diff.added.push(prc.clone());
+                        processes.push(prc);
+                    }
+                }
+            }
+        }
+        diff.removed.extend(previous);
+
+        self.processes = processes;
+        diff
+    }
+}
+
+/// Reads the pids of all given eprocess structures in a single batch.
+///
+/// Entries whose pid can not be read are omitted.
+fn eprocess_pids<T: PhysicalMemory, V: VirtualTranslate>(
+    kernel: &mut Kernel<T, V>,
+    eprocs: &[Address],
+) -> Result<Vec<(Address, PID)>> {
+    let mut reader = VirtualDMA::with_vat(
+        &mut kernel.phys_mem,
+        kernel.kernel_info.start_block.arch,
+        Win32VirtualTranslate::new(kernel.kernel_info.start_block.arch, kernel.sysproc_dtb),
+        &mut kernel.vat,
+    );
+
+    let mut pids = vec![0 as PID; eprocs.len()];
+    let mut status = vec![false; eprocs.len()];
+
+    let pid_offset = kernel.offsets.eproc_pid();
+    let mut read_list = eprocs
+        .iter()
+        .zip(pids.iter_mut())
+        .map(|(&eprocess, pid)| VirtualReadData(eprocess + pid_offset, pid.as_bytes_mut()))
+        .collect::<Vec<_>>();
+    reader.virt_read_raw_list_status(&mut read_list, &mut status)?;
+    std::mem::drop(read_list);
+
+    Ok(eprocs
+        .iter()
+        .copied()
+        .zip(pids.into_iter())
+        .zip(status.into_iter())
+        .filter(|(_, ok)| *ok)
+        .map(|(id, _)| id)
+        .collect())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::win32::Win32ModuleListInfo;
+
+    use memflow::architecture::x86::x64;
+
+    fn process(address: u64, pid: PID) -> Win32ProcessInfo {
+        Win32ProcessInfo {
+            address: address.into(),
+            pid,
+            name: format!("process{}.exe", pid),
+            dtb: Address::NULL,
+            section_base: Address::NULL,
+            exit_status: 0,
+            ethread: Address::NULL,
+            wow64: Address::NULL,
+            teb: None,
+            teb_wow64: None,
+            peb_native: Address::NULL,
+            peb_wow64: None,
+            module_info_native: Win32ModuleListInfo::with_base(Address::NULL, x64::ARCH).unwrap(),
+            module_info_wow64: None,
+            sys_arch: x64::ARCH,
+            proc_arch: x64::ARCH,
+        }
+    }
+
+    /// Resolves the eprocess addresses with the given list of running processes.
+    fn running(processes: &[(u64, PID)]) -> Vec<(Address, PID)> {
+        processes
+            .iter()
+            .map(|&(address, pid)| (address.into(), pid))
+            .collect()
+    }
+
+    fn resolver<'a>(
+        processes: &'a [(u64, PID)],
+        resolved: &'a mut Vec<Address>,
+    ) -> impl FnMut(Address) -> Option<Win32ProcessInfo> + 'a {
+        move |eprocess| {
+            resolved.push(eprocess);
+            processes
+                .iter()
+                .find(|&&(address, _)| Address::from(address) == eprocess)
+                .map(|&(address, pid)| process(address, pid))
+        }
+    }
+
+    fn pids(processes: &[Win32ProcessInfo]) -> Vec<PID> {
+        processes.iter().map(|prc| prc.pid).collect()
+    }
+
+    #[test]
+    fn empty_previous_snapshot() {
+        let current = [(0x3000, 12), (0x1000, 4), (0x2000, 8)];
+        let mut resolved = Vec::new();
+
+        let mut snapshot = Win32ProcessSnapshot::new();
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut resolved));
+
+        assert_eq!(pids(&diff.added), vec![4, 8, 12]);
+        assert!(diff.removed.is_empty());
+        assert_eq!(pids(snapshot.processes()), vec![4, 8, 12]);
+        assert_eq!(resolved.len(), 3);
+    }
+
+    #[test]
+    fn started_and_exited_processes() {
+        let previous = [(0x1000, 4), (0x2000, 8), (0x3000, 12)];
+        let mut snapshot = Win32ProcessSnapshot::new();
+        snapshot.merge(running(&previous), resolver(&previous, &mut Vec::new()));
+
+        let current = [(0x1000, 4), (0x3000, 12), (0x4000, 16), (0x0800, 20)];
+        let mut resolved = Vec::new();
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut resolved));
+
+        assert_eq!(pids(&diff.added), vec![20, 16]);
+        assert_eq!(pids(&diff.removed), vec![8]);
+        assert_eq!(pids(snapshot.processes()), vec![20, 4, 12, 16]);
+
+        // processes that were already known are not resolved again
+        assert_eq!(resolved, vec![Address::from(0x0800), Address::from(0x4000)]);
+
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut Vec::new()));
+        assert!(diff.added.is_empty());
+        assert!(diff.removed.is_empty());
+    }
+
+    #[test]
+    fn reused_pid() {
+        let previous = [(0x1000, 4), (0x2000, 8)];
+        let mut snapshot = Win32ProcessSnapshot::new();
+        snapshot.merge(running(&previous), resolver(&previous, &mut Vec::new()));
+
+        // the pid is reused by a process with a different eprocess
+        let current = [(0x1000, 4), (0x5000, 8)];
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut Vec::new()));
+        assert_eq!(pids(&diff.added), vec![8]);
+        assert_eq!(diff.added[0].address, Address::from(0x5000));
+        assert_eq!(pids(&diff.removed), vec![8]);
+        assert_eq!(diff.removed[0].address, Address::from(0x2000));
+
+        // the eprocess allocation is reused under a different pid
+        let current = [(0x1000, 24), (0x5000, 8)];
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut Vec::new()));
+        assert_eq!(pids(&diff.added), vec![24]);
+        assert_eq!(pids(&diff.removed), vec![4]);
+        assert_eq!(pids(snapshot.processes()), vec![24, 8]);
+    }
+
+    #[test]
+    fn unresolved_process_is_retried() {
+        let current = [(0x1000, 4), (0x2000, 8)];
+
+        // the second process is still starting up and can not be resolved
+        let mut snapshot = Win32ProcessSnapshot::new();
+        let diff = snapshot.merge(running(&current), resolver(&current[..1], &mut Vec::new()));
+        assert_eq!(pids(&diff.added), vec![4]);
+
+        let mut resolved = Vec::new();
+        let diff = snapshot.merge(running(&current), resolver(&current, &mut resolved));
+        assert_eq!(pids(&diff.added), vec![8]);
+        assert!(diff.removed.is_empty());
+        assert_eq!(resolved, vec![Address::from(0x2000)]);
+    }
+}
@@ -8,7 +8,8 @@ use memflow::architecture::{ArchitectureObj, Endianess};
 use memflow::mem::VirtualMemory;
 use memflow::types::Address;
 
-use widestring::U16CString;
+/// Size of the stack buffer short strings (e.g. module names) are read into.
+const STACK_BUFFER_SIZE: usize = 0x200;
 
 pub trait VirtualReadUnicodeString {
     fn virt_read_unicode_string(
@@ -16,6 +17,16 @@ pub trait VirtualReadUnicodeString {
         proc_arch: ArchitectureObj,
         addr: Address,
     ) -> Result<String>;
+
+    /// Reads a `UNICODE_STRING` into `out`, reusing its allocation.
+    ///
+    /// `out` is cleared before the string is written.
+    fn virt_read_unicode_string_into(
+        &mut self,
+        proc_arch: ArchitectureObj,
+        addr: Address,
+        out: &mut String,
+    ) -> Result<()>;
 }
 
 // TODO: split up cpu and proc arch in read_helper.rs
@@ -25,6 +36,17 @@ impl<'a, T: VirtualMemory> VirtualReadUnicodeString for T {
         proc_arch: ArchitectureObj,
         addr: Address,
     ) -> Result<String> {
+        let mut out = String::new();
+        self.virt_read_unicode_string_into(proc_arch, addr, &mut out)?;
+        Ok(out)
+    }
+
+    fn virt_read_unicode_string_into(
+        &mut self,
+        proc_arch: ArchitectureObj,
+        addr: Address,
+        out: &mut String,
+    ) -> Result<()> {
         /*
         typedef struct _windows_unicode_string32 {
             uint16_t length;
@@ -40,52 +62,123 @@ impl<'a, T: VirtualMemory> VirtualReadUnicodeString for T {
         } __attribute__((packed)) win64_unicode_string_t;
         */
 
-        // length is always the first entry
-        let mut length = 0u16;
-        self.virt_read_into(addr, &mut length)?;
-        if length == 0 {
-            return Err(Error::Unicode("unable to read unicode string length"));
-        }
-
-        // TODO: chek if length exceeds limit
-        // buffer is either aligned at 4 or 8
-        let buffer = match proc_arch.bits() {
-            64 => self.virt_read_addr64(addr + 8)?,
-            32 => self.virt_read_addr32(addr + 4)?,
-            _ => {
-                return Err(Error::InvalidArchitecture);
-            }
+        // length is always the first entry, the buffer is either aligned at 4 or 8
+        let mut raw = [0u8; 16];
+        let raw = &mut raw[..unicode_string_size(proc_arch)?];
+        self.virt_read_raw_into(addr, raw)?;
+        let (length, buffer) = parse_unicode_string(proc_arch, raw)?;
+
+        // read buffer
+        let mut stack_buf = [0u8; STACK_BUFFER_SIZE];
+        let mut heap_buf;
+        let content = if length <= STACK_BUFFER_SIZE {
+            &mut stack_buf[..length]
+        } else {
+            heap_buf = vec![0; length];
+            &mut heap_buf[..]
         };
-        if buffer.is_null() {
-            return Err(Error::Unicode("unable to read unicode string length"));
-        }
+        self.virt_read_raw_into(buffer, content)?;
+
+        out.clear();
+        decode_unicode_string_into(proc_arch, content, out);
+        Ok(())
+    }
+}
 
-        // check if buffer length is mod 2 (utf-16)
-        if length % 2 != 0 {
-            return Err(Error::Unicode(
-                "unicode string length is not a multiple of two",
-            ));
-        }
+/// Size of a `UNICODE_STRING` structure for the given architecture.
+pub(crate) fn unicode_string_size(proc_arch: ArchitectureObj) -> Result<usize> {
+    match proc_arch.bits() {
+        64 => Ok(16),
+        32 => Ok(8),
+        _ => Err(Error::InvalidArchitecture),
+    }
+}
 
-        // read buffer
-        let mut content = vec![0; length as usize + 2];
-        self.virt_read_raw_into(buffer, &mut content)?;
-        content[length as usize] = 0;
-        content[length as usize + 1] = 0;
-
-        // TODO: check length % 2 == 0
-
-        let content16 = content
-            .chunks_exact(2)
-            .map(|b| b[0..2].try_into().map_err(|_| Error::Bounds))
-            .filter_map(Result::ok)
-            .map(|b| match proc_arch.endianess() {
-                Endianess::LittleEndian => u16::from_le_bytes(b),
-                Endianess::BigEndian => u16::from_be_bytes(b),
-            })
-            .collect::<Vec<u16>>();
-        Ok(U16CString::from_vec_with_nul(content16)
-            .map_err(|_| Error::Encoding)?
-            .to_string_lossy())
+/// Parses a raw `UNICODE_STRING` structure and returns the length and address of its buffer.
+pub(crate) fn parse_unicode_string(
+    proc_arch: ArchitectureObj,
+    raw: &[u8],
+) -> Result<(usize, Address)> {
+    let length = u16::from_le_bytes(raw[0..2].try_into().unwrap()) as usize;
+    if length == 0 {
+        return Err(Error::Unicode("unable to read unicode string length"));
+    }
+    if length % 2 != 0 {
+        return Err(Error::Unicode(
+            "unicode string length is not a multiple of two",
+        ));
+    }
+
+    let buffer: Address = match proc_arch.bits() {
+        64 => u64::from_le_bytes(raw[8..16].try_into().unwrap()).into(),
+        32 => u32::from_le_bytes(raw[4..8].try_into().unwrap()).into(),
+        _ => return Err(Error::InvalidArchitecture),
+    };
+    if buffer.is_null() {
+        return Err(Error::Unicode("unable to read unicode string length"));
+    }
+
+    Ok((length, buffer))
+}
+
+/// Decodes the utf-16 contents of a `UNICODE_STRING` buffer.
+///
+/// The string is cut off at the first null terminator, if there is one.
+pub(crate) fn decode_unicode_string(proc_arch: ArchitectureObj, content: &[u8]) -> Result<String> {
+    let mut out = String::new();
+    decode_unicode_string_into(proc_arch, content, &mut out);
+    Ok(out)
+}
+
+/// Appends the decoded utf-16 contents of a `UNICODE_STRING` buffer to `out`.
+///
+/// Invalid code units are replaced with `U+FFFD`.
+pub(crate) fn decode_unicode_string_into(
+    proc_arch: ArchitectureObj,
+    content: &[u8],
+    out: &mut String,
+) {
+    let content16 = content
+        .chunks_exact(2)
+        .map(|b| match proc_arch.endianess() {
+            Endianess::LittleEndian => u16::from_le_bytes([b[0], b[1]]),
+            Endianess::BigEndian => u16::from_be_bytes([b[0], b[1]]),
+        })
+        .take_while(|&c| c != 0);
+
+    out.reserve(content.len() / 2);
+    out.extend(
+        std::char::decode_utf16(content16).map(|c| c.unwrap_or(std::char::REPLACEMENT_CHARACTER)),
+    );
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use memflow::architecture::x86;
+
+    #[test]
+    fn parse_and_decode() {
+        let mut raw = [0u8; 16];
+        raw[0..2].copy_from_slice(&8u16.to_le_bytes());
+        raw[2..4].copy_from_slice(&10u16.to_le_bytes());
+        raw[8..16].copy_from_slice(&0x7ff0_1234_0000u64.to_le_bytes());
+
+        let (length, buffer) = parse_unicode_string(x86::x64::ARCH, &raw).unwrap();
+        assert_eq!(length, 8);
+        assert_eq!(buffer, Address::from(0x7ff0_1234_0000u64));
+
+        let content = "ntdll\0x"
+            .encode_utf16()
+            .flat_map(|c| c.to_le_bytes().to_vec())
+            .collect::<Vec<u8>>();
+        assert_eq!(
+            decode_unicode_string(x86::x64::ARCH, &content).unwrap(),
+            "ntdll"
+        );
+
+        let mut out = String::new();
+        decode_unicode_string_into(x86::x64::ARCH, &[0x00, 0xd8, b'a', 0], &mut out);
+        assert_eq!(out, "\u{fffd}a");
     }
 }
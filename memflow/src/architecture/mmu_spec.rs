@@ -39,7 +39,7 @@ macro_rules! vtop_trace {
 /// Our virtual to physical memory ranslation code is the same for both architectures, in fact, it
 /// is also the same for the x86 (non-PAE) architecture that has different PTE and pointer sizes.
 /// All that differentiates the translation process is the data inside this structure.
-#[derive(Debug)]
+#[derive(Debug, PartialEq)]
 pub struct ArchMMUSpec {
     /// defines the way virtual addresses gets split (the last element
     /// being the final physical page offset, and thus treated a bit differently)
@@ -79,6 +79,110 @@ pub trait MMUTranslationBase {
     );
 }
 
+/// Provides the `ArchMMUSpec` that drives a page table walk.
+///
+/// The page walk is monomorphized for every provider. A zero sized provider that returns a
+/// reference to a constant spec makes the spec visible to the optimizer in that instantiation,
+/// while `&ArchMMUSpec` reads it through a pointer. In both cases the per-step values are
+/// still derived from the spec at runtime, once per step, in a `WalkStep`.
+pub trait MMUSpecProvider: Copy {
+    fn spec(&self) -> &ArchMMUSpec;
+}
+
+impl<'a> MMUSpecProvider for &'a ArchMMUSpec {
+    #[inline(always)]
+    fn spec(&self) -> &ArchMMUSpec {
+        self
+    }
+}
+
+/// Values of a single page walk step.
+///
+/// They are derived from the `ArchMMUSpec` once per step of a walk instead of once per
+/// translated entry.
+#[derive(Debug, Clone, Copy)]
+struct WalkStep {
+    step: usize,
+    last: bool,
+    /// whether a large page bit in the entry of this step is honored
+    large_page: bool,
+    pte_mask: u64,
+    pte_size: u64,
+    index_shift: u8,
+    index_mask: u64,
+    page_offset_mask: u64,
+    page_size: usize,
+    leaf_size: usize,
+    present_bit: u8,
+    writeable_bit: u8,
+    nx_bit: u8,
+    large_page_bit: u8,
+}
+
+impl WalkStep {
+    #[inline(always)]
+    fn new(mmu: &ArchMMUSpec, step: usize) -> Self {
+        let (min, max) = mmu.virt_addr_bit_range(step);
+        Self {
+            step,
+            last: step == mmu.split_count() - 1,
+            large_page: mmu.valid_final_page_steps.contains(&step),
+            pte_mask: mmu.pte_addr_mask(Address::INVALID, step),
+            pte_size: mmu.pte_size as u64,
+            index_shift: min,
+            index_mask: Address::bit_mask(0..(max - min - 1)).as_u64(),
+            page_offset_mask: Address::bit_mask(0..(max - 1)).as_u64(),
+            page_size: mmu.page_size_step_unchecked(step),
+            leaf_size: mmu.pt_leaf_size(step),
+            present_bit: mmu.present_bit,
+            writeable_bit: mmu.writeable_bit,
+            nx_bit: mmu.nx_bit,
+            large_page_bit: mmu.large_page_bit,
+        }
+    }
+
+    /// See `ArchMMUSpec::pte_addr_mask`
+    #[inline(always)]
+    fn pte_addr_mask(&self, pte_addr: Address) -> u64 {
+        pte_addr.as_u64() & self.pte_mask
+    }
+
+    /// See `ArchMMUSpec::vtop_step`
+    #[inline(always)]
+    fn vtop_step(&self, pte_addr: Address, virt_addr: Address) -> Address {
+        let offset = ((virt_addr.as_u64() >> self.index_shift) & self.index_mask) * self.pte_size;
+        Address::from(self.pte_addr_mask(pte_addr) | offset)
+    }
+
+    /// See `ArchMMUSpec::check_entry`
+    #[inline(always)]
+    fn check_entry(&self, pte_addr: Address) -> bool {
+        self.step == 0 || pte_addr.bit_at(self.present_bit)
+    }
+
+    /// See `ArchMMUSpec::is_final_mapping`
+    #[inline(always)]
+    fn is_final_mapping(&self, pte_addr: Address) -> bool {
+        self.last || (self.large_page && pte_addr.bit_at(self.large_page_bit))
+    }
+
+    /// See `ArchMMUSpec::get_phys_page`
+    #[inline(always)]
+    fn get_phys_page(&self, pte_addr: Address, virt_addr: Address) -> PhysicalAddress {
+        let phys_addr = Address::from(
+            self.pte_addr_mask(pte_addr) | (virt_addr.as_u64() & self.page_offset_mask),
+        );
+
+        PhysicalAddress::with_page(
+            phys_addr,
+            PageType::default()
+                .write(pte_addr.bit_at(self.writeable_bit))
+                .noexec(pte_addr.bit_at(self.nx_bit)),
+            self.page_size,
+        )
+    }
+}
+
 impl ArchMMUSpec {
     /// Mask a page table entry address to retrieve the next page table entry
     ///
@@ -337,190 +441,268 @@ impl ArchMMUSpec {
         VO: Extend<(PhysicalAddress, B)>,
         FO: Extend<(Error, Address, B)>,
     {
-        vtop_trace!("virt_to_phys_iter_with_mmu");
+        virt_to_phys_iter(self, mem, dtb, addrs, out, out_fail, arena)
+    }
+}
+
+/// Virtual to physical memory translation over multiple elements, specialized for the `ArchMMUSpec`
+/// returned by `spec`.
+pub(crate) fn virt_to_phys_iter<S, T, B, D, VI, VO, FO>(
+    spec: S,
+    mem: &mut T,
+    dtb: D,
+    addrs: VI,
+    out: &mut VO,
+    out_fail: &mut FO,
+    arena: &Bump,
+) where
+    S: MMUSpecProvider,
+    T: PhysicalMemory + ?Sized,
+    B: SplitAtIndex,
+    D: MMUTranslationBase,
+    VI: Iterator<Item = (Address, B)>,
+    VO: Extend<(PhysicalAddress, B)>,
+    FO: Extend<(Error, Address, B)>,
+{
+    vtop_trace!("virt_to_phys_iter_with_mmu");
+
+    let mmu = spec.spec();
+
+    let mut data_to_translate = BumpVec::new_in(arena);
+    let mut data_pt_read: BumpVec<PhysicalReadData> = BumpVec::new_in(arena);
+    let mut data_pt_buf = BumpVec::new_in(arena);
+    let mut data_to_translate_map = BTreeMap::new_in(BumpVec::new_in(arena));
+
+    //TODO: Calculate and reserve enough data in the data_to_translate vectors
+    //TODO: Improve filtering speed (vec reserve)
+    //TODO: Optimize BTreeMap
+
+    data_to_translate.extend(
+        (0..dtb.pt_count())
+            .map(|idx| TranslationChunk::new(dtb.get_pt_by_index(idx), BumpVec::new_in(arena))),
+    );
 
-        let mut data_to_translate = BumpVec::new_in(arena);
-        let mut data_pt_read: BumpVec<PhysicalReadData> = BumpVec::new_in(arena);
-        let mut data_pt_buf = BumpVec::new_in(arena);
-        let mut data_to_translate_map = BTreeMap::new_in(BumpVec::new_in(arena));
+    addrs.for_each(|data| dtb.virt_addr_filter(mmu, data, &mut data_to_translate, out_fail));
 
-        //TODO: Calculate and reserve enough data in the data_to_translate vectors
-        //TODO: precalc vtop_step bit split sum / transform the splits to a lookup table
-        //TODO: Improve filtering speed (vec reserve)
-        //TODO: Optimize BTreeMap
+    data_to_translate
+        .iter_mut()
+        .for_each(|trd| trd.recalc_minmax());
 
-        data_to_translate
-            .extend((0..dtb.pt_count()).map(|idx| {
-                TranslationChunk::new(dtb.get_pt_by_index(idx), BumpVec::new_in(arena))
-            }));
+    for pt_step in 0..mmu.split_count() {
+        vtop_trace!(
+            "pt_step = {}, data_to_translate.len() = {:x}",
+            pt_step,
+            data_to_translate.len()
+        );
 
-        addrs.for_each(|data| dtb.virt_addr_filter(self, data, &mut data_to_translate, out_fail));
+        let step = WalkStep::new(mmu, pt_step);
+        let next_page_size = mmu.page_size_step_unchecked(pt_step + 1);
 
-        data_to_translate
-            .iter_mut()
-            .for_each(|trd| trd.recalc_minmax());
+        vtop_trace!("next_page_size = {:x}", next_page_size);
 
-        for pt_step in 0..self.split_count() {
+        //Loop through the data in reverse order to allow the data buffer grow on the back when
+        //memory regions are split
+        for i in (0..data_to_translate.len()).rev() {
+            let tr_chunk = data_to_translate.swap_remove(i);
             vtop_trace!(
-                "pt_step = {}, data_to_translate.len() = {:x}",
-                pt_step,
-                data_to_translate.len()
+                "checking pt_addr={:x}, elems={:x}",
+                tr_chunk.pt_addr,
+                tr_chunk.vec.len()
             );
 
-            let next_page_size = self.page_size_step_unchecked(pt_step + 1);
-
-            vtop_trace!("next_page_size = {:x}", next_page_size);
-
-            //Loop through the data in reverse order to allow the data buffer grow on the back when
-            //memory regions are split
-            for i in (0..data_to_translate.len()).rev() {
-                let tr_chunk = data_to_translate.swap_remove(i);
-                vtop_trace!(
-                    "checking pt_addr={:x}, elems={:x}",
-                    tr_chunk.pt_addr,
-                    tr_chunk.vec.len()
+            if !step.check_entry(tr_chunk.pt_addr) {
+                //There has been an error in translation, push it to output with the associated buf
+                vtop_trace!("check_entry failed");
+                out_fail.extend(
+                    tr_chunk
+                        .vec
+                        .into_iter()
+                        .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
                 );
+            } else if step.is_final_mapping(tr_chunk.pt_addr) {
+                //We reached an actual page. The translation was successful
+                vtop_trace!("found final mapping: {:x}", tr_chunk.pt_addr);
+                let pt_addr = tr_chunk.pt_addr;
+                out.extend(
+                    tr_chunk
+                        .vec
+                        .into_iter()
+                        .map(|entry| (step.get_phys_page(pt_addr, entry.addr), entry.buf)),
+                );
+            } else {
+                //We still need to continue the page walk
 
-                if !self.check_entry(tr_chunk.pt_addr, pt_step) {
-                    //There has been an error in translation, push it to output with the associated buf
-                    vtop_trace!("check_entry failed");
-                    out_fail.extend(
-                        tr_chunk
-                            .vec
-                            .into_iter()
-                            .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
-                    );
-                } else if self.is_final_mapping(tr_chunk.pt_addr, pt_step) {
-                    //We reached an actual page. The translation was successful
-                    vtop_trace!("found final mapping: {:x}", tr_chunk.pt_addr);
-                    let pt_addr = tr_chunk.pt_addr;
-                    out.extend(tr_chunk.vec.into_iter().map(|entry| {
-                        (self.get_phys_page(pt_addr, entry.addr, pt_step), entry.buf)
-                    }));
-                } else {
-                    //We still need to continue the page walk
-
-                    let min_addr = tr_chunk.min_addr();
-
-                    //As an optimization, divide and conquer the input memory regions.
-                    //VTOP speedup is insane. Visible in large sequential or chunked reads.
-                    for (_, (_, mut chunk)) in
-                        (arena, tr_chunk).page_chunks(min_addr, next_page_size)
-                    {
-                        let pt_addr = self.vtop_step(chunk.pt_addr, chunk.min_addr(), pt_step);
-                        chunk.pt_addr = pt_addr;
-                        data_to_translate.push(chunk);
-                    }
-                }
-            }
+                let min_addr = tr_chunk.min_addr();
 
-            if data_to_translate.is_empty() {
-                break;
+                //As an optimization, divide and conquer the input memory regions.
+                //VTOP speedup is insane. Visible in large sequential or chunked reads.
+                for (_, (_, mut chunk)) in (arena, tr_chunk).page_chunks(min_addr, next_page_size) {
+                    let pt_addr = step.vtop_step(chunk.pt_addr, chunk.min_addr());
+                    chunk.pt_addr = pt_addr;
+                    data_to_translate.push(chunk);
+                }
             }
+        }
 
-            if let Err(err) = self.read_pt_address_iter(
-                mem,
-                pt_step,
-                &mut data_to_translate_map,
-                &mut data_to_translate,
-                &mut data_pt_buf,
-                &mut data_pt_read,
-                out_fail,
-            ) {
-                vtop_trace!("read_pt_address_iter failure: {}", err);
-                out_fail.extend(
-                    data_to_translate
-                        .into_iter()
-                        .flat_map(|chunk| chunk.vec.into_iter())
-                        .map(|data| (err, data.addr, data.buf)),
-                );
-                return;
-            }
+        if data_to_translate.is_empty() {
+            break;
         }
 
-        debug_assert!(data_to_translate.is_empty());
+        if let Err(err) = read_pt_address_iter(
+            mem,
+            &step,
+            &mut data_to_translate_map,
+            &mut data_to_translate,
+            &mut data_pt_buf,
+            &mut data_pt_read,
+            out_fail,
+        ) {
+            vtop_trace!("read_pt_address_iter failure: {}", err);
+            out_fail.extend(
+                data_to_translate
+                    .into_iter()
+                    .flat_map(|chunk| chunk.vec.into_iter())
+                    .map(|data| (err, data.addr, data.buf)),
+            );
+            return;
+        }
     }
 
-    //TODO: Clean this up to have less args
-    #[allow(clippy::too_many_arguments)]
-    fn read_pt_address_iter<'a, T, B, V, FO>(
-        &self,
-        mem: &mut T,
-        step: usize,
-        addr_map: &mut BTreeMap<V, Address, ()>,
-        addrs: &mut TranslateVec<'a, B>,
-        pt_buf: &mut BumpVec<u8>,
-        pt_read: &mut BumpVec<PhysicalReadData>,
-        err_out: &mut FO,
-    ) -> Result<()>
-    where
-        T: PhysicalMemory + ?Sized,
-        FO: Extend<(Error, Address, B)>,
-        V: Vector<vector_trees::btree::BVecTreeNode<Address, ()>>,
-        B: SplitAtIndex,
-    {
-        //TODO: use self.pt_leaf_size(step) (need to handle LittleEndian::read_u64)
-        let pte_size = 8;
-        let page_size = self.pt_leaf_size(step);
+    debug_assert!(data_to_translate.is_empty());
+}
 
-        //pt_buf.clear();
-        pt_buf.resize(pte_size * addrs.len(), 0);
+//TODO: Clean this up to have less args
+#[allow(clippy::too_many_arguments)]
+fn read_pt_address_iter<'a, T, B, V, FO>(
+    mem: &mut T,
+    step: &WalkStep,
+    addr_map: &mut BTreeMap<V, Address, ()>,
+    addrs: &mut TranslateVec<'a, B>,
+    pt_buf: &mut BumpVec<u8>,
+    pt_read: &mut BumpVec<PhysicalReadData>,
+    err_out: &mut FO,
+) -> Result<()>
+where
+    T: PhysicalMemory + ?Sized,
+    FO: Extend<(Error, Address, B)>,
+    V: Vector<vector_trees::btree::BVecTreeNode<Address, ()>>,
+    B: SplitAtIndex,
+{
+    //TODO: use step.leaf_size (need to handle LittleEndian::read_u64)
+    let pte_size = 8;
+    let page_size = step.leaf_size;
+
+    //pt_buf.clear();
+    pt_buf.resize(pte_size * addrs.len(), 0);
+
+    debug_assert!(pt_read.is_empty());
+
+    //This is safe, because pt_read gets cleared at the end of the function
+    let pt_read: &mut BumpVec<PhysicalReadData> = unsafe { std::mem::transmute(pt_read) };
+
+    for (chunk, tr_chunk) in pt_buf.chunks_exact_mut(pte_size).zip(addrs.iter()) {
+        pt_read.push(PhysicalReadData(
+            PhysicalAddress::with_page(tr_chunk.pt_addr, PageType::PAGE_TABLE, page_size),
+            chunk,
+        ));
+    }
 
-        debug_assert!(pt_read.is_empty());
+    mem.phys_read_raw_list(pt_read)?;
 
-        //This is safe, because pt_read gets cleared at the end of the function
-        let pt_read: &mut BumpVec<PhysicalReadData> = unsafe { std::mem::transmute(pt_read) };
+    //Filter out duplicate reads
+    //Ideally, we would want to append all duplicates to the existing list, but they would mostly
+    //only occur, in strange kernel side situations when building the page map,
+    //and having such handling may end up highly inefficient (due to having to use map, and remapping it)
+    addr_map.clear();
 
-        for (chunk, tr_chunk) in pt_buf.chunks_exact_mut(pte_size).zip(addrs.iter()) {
-            pt_read.push(PhysicalReadData(
-                PhysicalAddress::with_page(tr_chunk.pt_addr, PageType::PAGE_TABLE, page_size),
-                chunk,
-            ));
-        }
+    //Okay, so this is extremely useful in one element reads.
+    //We kind of have a local on-stack cache to check against
+    //before a) checking in the set, and b) pushing to the set
+    let mut prev_addr: Option<Address> = None;
 
-        mem.phys_read_raw_list(pt_read)?;
+    for i in (0..addrs.len()).rev() {
+        let mut chunk = addrs.swap_remove(i);
+        let PhysicalReadData(_, buf) = pt_read.swap_remove(i);
+        let pt_addr = Address::from(u64::from_le_bytes(buf[0..8].try_into().unwrap()));
 
-        //Filter out duplicate reads
-        //Ideally, we would want to append all duplicates to the existing list, but they would mostly
-        //only occur, in strange kernel side situations when building the page map,
-        //and having such handling may end up highly inefficient (due to having to use map, and remapping it)
-        addr_map.clear();
+        if step.pte_addr_mask(chunk.pt_addr) != step.pte_addr_mask(pt_addr)
+            && (prev_addr.is_none()
+                || (prev_addr.unwrap() != pt_addr && !addr_map.contains_key(&pt_addr)))
+        {
+            chunk.pt_addr = pt_addr;
 
-        //Okay, so this is extremely useful in one element reads.
-        //We kind of have a local on-stack cache to check against
-        //before a) checking in the set, and b) pushing to the set
-        let mut prev_addr: Option<Address> = None;
+            if let Some(pa) = prev_addr {
+                addr_map.insert(pa, ());
+            }
 
-        for i in (0..addrs.len()).rev() {
-            let mut chunk = addrs.swap_remove(i);
-            let PhysicalReadData(_, buf) = pt_read.swap_remove(i);
-            let pt_addr = Address::from(u64::from_le_bytes(buf[0..8].try_into().unwrap()));
+            prev_addr = Some(pt_addr);
+            addrs.push(chunk);
+            continue;
+        }
 
-            if self.pte_addr_mask(chunk.pt_addr, step) != self.pte_addr_mask(pt_addr, step)
-                && (prev_addr.is_none()
-                    || (prev_addr.unwrap() != pt_addr && !addr_map.contains_key(&pt_addr)))
-            {
-                chunk.pt_addr = pt_addr;
+        err_out.extend(
+            chunk
+                .vec
+                .into_iter()
+                .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
+        );
+    }
 
-                if let Some(pa) = prev_addr {
-                    addr_map.insert(pa, ());
-                }
+    pt_read.clear();
 
-                prev_addr = Some(pt_addr);
-                addrs.push(chunk);
-                continue;
-            }
+    Ok(())
+}
 
-            err_out.extend(
-                chunk
-                    .vec
-                    .into_iter()
-                    .map(|entry| (Error::VirtualTranslate, entry.addr, entry.buf)),
+/// Checks that every `WalkStep` of `mmu` translates exactly like the `ArchMMUSpec` it was
+/// derived from. Called by the tests of the architectures with their real specs.
+#[cfg(test)]
+pub(crate) fn check_walk_steps(mmu: &ArchMMUSpec) {
+    let pte_addrs = [
+        0x0u64,
+        0x1,
+        0x83,
+        0x8000_0012_3456_7087,
+        0x0000_7fff_ffff_f0e3,
+        !0,
+    ];
+    let virt_addrs = [
+        0x0u64,
+        0x1234,
+        0x7ff7_1234_5678,
+        0xffff_f802_1234_5678,
+        0xdead_beef,
+    ];
+
+    for step in 0..mmu.split_count() {
+        let walk = WalkStep::new(mmu, step);
+        assert_eq!(walk.leaf_size, mmu.pt_leaf_size(step));
+
+        for &pte_addr in pte_addrs.iter() {
+            let pte_addr = Address::from(pte_addr);
+            assert_eq!(walk.check_entry(pte_addr), mmu.check_entry(pte_addr, step));
+            assert_eq!(
+                walk.is_final_mapping(pte_addr),
+                mmu.is_final_mapping(pte_addr, step)
+            );
+            assert_eq!(
+                walk.pte_addr_mask(pte_addr),
+                mmu.pte_addr_mask(pte_addr, step)
             );
-        }
-
-        pt_read.clear();
 
-        Ok(())
+            for &virt_addr in virt_addrs.iter() {
+                let virt_addr = Address::from(virt_addr);
+                assert_eq!(
+                    walk.vtop_step(pte_addr, virt_addr),
+                    mmu.vtop_step(pte_addr, virt_addr, step)
+                );
+                if mmu.valid_final_page_steps.contains(&step) {
+                    let a = walk.get_phys_page(pte_addr, virt_addr);
+                    let b = mmu.get_phys_page(pte_addr, virt_addr, step);
+                    assert_eq!(a.address(), b.address());
+                    assert_eq!(a.page_type(), b.page_type());
+                    assert_eq!(a.page_size(), b.page_size());
+                }
+            }
+        }
     }
 }
@@ -3,7 +3,9 @@ pub mod x32_pae;
 pub mod x64;
 
 use super::{
-    mmu_spec::{translate_data::TranslateVec, ArchMMUSpec, MMUTranslationBase},
+    mmu_spec::{
+        self, translate_data::TranslateVec, ArchMMUSpec, MMUSpecProvider, MMUTranslationBase,
+    },
     Architecture, ArchitectureObj, Endianess, ScopedVirtualTranslate,
 };
 
@@ -44,17 +46,73 @@ impl Architecture for X86Architecture {
     }
 }
 
+/// Selects the page walk implementation of a `X86ScopedVirtualTranslate`.
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum X86PageWalk {
+    /// Walk driven by the runtime tables of the `ArchMMUSpec`.
+    Generic,
+    /// Walk specialized for the constant x64 spec.
+    X64,
+    /// Walk specialized for the constant x32_pae spec.
+    X32Pae,
+}
+
+#[derive(Clone, Copy)]
+struct X64Spec;
+
+impl MMUSpecProvider for X64Spec {
+    #[inline(always)]
+    fn spec(&self) -> &ArchMMUSpec {
+        &x64::ARCH_SPEC.mmu
+    }
+}
+
+#[derive(Clone, Copy)]
+struct X32PaeSpec;
+
+impl MMUSpecProvider for X32PaeSpec {
+    #[inline(always)]
+    fn spec(&self) -> &ArchMMUSpec {
+        &x32_pae::ARCH_SPEC.mmu
+    }
+}
+
 #[derive(Clone, Copy)]
 pub struct X86ScopedVirtualTranslate {
     arch: &'static X86Architecture,
     dtb: X86PageTableBase,
+    walk: X86PageWalk,
 }
 
 impl X86ScopedVirtualTranslate {
+    /// Creates a new translator for `arch`.
+    ///
+    /// The x64 and x32_pae specs are translated with a page walk monomorphized over their constant
+    /// spec.
     pub fn new(arch: &'static X86Architecture, dtb: Address) -> Self {
+        let walk = if arch.mmu == x64::ARCH_SPEC.mmu {
+            X86PageWalk::X64
+        } else if arch.mmu == x32_pae::ARCH_SPEC.mmu {
+            X86PageWalk::X32Pae
+        } else {
+            X86PageWalk::Generic
+        };
+
+        Self {
+            arch,
+            dtb: X86PageTableBase(dtb),
+            walk,
+        }
+    }
+
+    /// Creates a new translator for `arch` that always uses the runtime table driven page walk.
+    ///
+    /// The results are identical to the ones of `new`, this mainly exists for benchmarking.
+    pub fn new_generic(arch: &'static X86Architecture, dtb: Address) -> Self {
         Self {
             arch,
             dtb: X86PageTableBase(dtb),
+            walk: X86PageWalk::Generic,
         }
     }
 }
@@ -74,9 +132,18 @@ impl ScopedVirtualTranslate for X86ScopedVirtualTranslate {
         out_fail: &mut FO,
         arena: &Bump,
     ) {
-        self.arch
-            .mmu
-            .virt_to_phys_iter(mem, self.dtb, addrs, out, out_fail, arena)
+        match self.walk {
+            X86PageWalk::X64 => {
+                mmu_spec::virt_to_phys_iter(X64Spec, mem, self.dtb, addrs, out, out_fail, arena)
+            }
+            X86PageWalk::X32Pae => {
+                mmu_spec::virt_to_phys_iter(X32PaeSpec, mem, self.dtb, addrs, out, out_fail, arena)
+            }
+            X86PageWalk::Generic => self
+                .arch
+                .mmu
+                .virt_to_phys_iter(mem, self.dtb, addrs, out, out_fail, arena),
+        }
     }
 
     fn translation_table_id(&self, _address: Address) -> usize {
@@ -138,6 +205,17 @@ pub fn new_translator(dtb: Address, arch: ArchitectureObj) -> Result<impl Scoped
     Ok(X86ScopedVirtualTranslate::new(arch, dtb))
 }
 
+/// Creates a translator for `arch` that does not use any of the specialized page walks.
+///
+/// See `X86ScopedVirtualTranslate::new_generic`.
+pub fn new_translator_generic(
+    dtb: Address,
+    arch: ArchitectureObj,
+) -> Result<impl ScopedVirtualTranslate> {
+    let arch = underlying_arch(arch).ok_or(Error::InvalidArchitecture)?;
+    Ok(X86ScopedVirtualTranslate::new_generic(arch, dtb))
+}
+
 pub fn is_x86_arch(arch: ArchitectureObj) -> bool {
     underlying_arch(arch).is_some()
 }
@@ -37,6 +37,11 @@ mod tests {
         super::ARCH_SPEC.mmu
     }
 
+    #[test]
+    fn x86_pae_walk_steps() {
+        crate::architecture::mmu_spec::check_walk_steps(&get_mmu_spec());
+    }
+
     #[test]
     fn x86_pae_pte_bitmasks() {
         let mmu = get_mmu_spec();
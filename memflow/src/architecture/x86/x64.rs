@@ -36,6 +36,26 @@ mod tests {
         super::ARCH_SPEC.mmu
     }
 
+    #[test]
+    fn x64_walk_steps() {
+        crate::architecture::mmu_spec::check_walk_steps(&get_mmu_spec());
+    }
+
+    #[test]
+    fn x64_specialized_walk() {
+        use super::super::{x32, x32_pae, X86PageWalk, X86ScopedVirtualTranslate};
+
+        let dtb = Address::from(0x1000);
+        let walk = |arch| X86ScopedVirtualTranslate::new(arch, dtb).walk;
+        assert_eq!(walk(&super::ARCH_SPEC), X86PageWalk::X64);
+        assert_eq!(walk(&x32_pae::ARCH_SPEC), X86PageWalk::X32Pae);
+        assert_eq!(walk(&x32::ARCH_SPEC), X86PageWalk::Generic);
+        assert_eq!(
+            X86ScopedVirtualTranslate::new_generic(&super::ARCH_SPEC, dtb).walk,
+            X86PageWalk::Generic
+        );
+    }
+
     #[test]
     fn x64_pte_bitmasks() {
         let mmu = get_mmu_spec();
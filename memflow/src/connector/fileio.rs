@@ -7,7 +7,7 @@ use crate::iter::FnExtend;
 use crate::mem::{
     MemoryMap, PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData,
 };
-use crate::types::Address;
+use crate::types::{size, Address};
 
 use std::io::{Read, Seek, SeekFrom, Write};
 
@@ -83,6 +83,10 @@ impl<T: Seek + Read + Write + Send> PhysicalMemory for FileIOMemory<T> {
                 .map(|map| map.base().as_usize() + map.output().1)
                 .unwrap(),
             readonly: false,
+            // every entry is a separate seek and read
+            preferred_batch_size: 1,
+            max_in_flight: 0,
+            coalesce_size: size::mb(1),
         }
     }
 }
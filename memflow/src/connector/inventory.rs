@@ -16,7 +16,7 @@ use log::{debug, error, info, warn};
 use libloading::Library;
 
 /// Exported memflow connector version
-pub const MEMFLOW_CONNECTOR_VERSION: i32 = 5;
+pub const MEMFLOW_CONNECTOR_VERSION: i32 = 6;
 
 /// Type of a single connector instance
 pub type ConnectorType = PhysicalMemoryBox;
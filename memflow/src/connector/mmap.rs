@@ -122,6 +122,10 @@ impl<'a, F: AsRef<MemoryMap<&'a mut [u8]>> + Send> PhysicalMemory
                 .map(|map| map.base().as_usize() + map.output().len())
                 .unwrap(),
             readonly: false,
+            // memory is copied directly, the batch size makes no difference
+            preferred_batch_size: 0,
+            max_in_flight: 0,
+            coalesce_size: 0,
         }
     }
 }
@@ -155,6 +159,9 @@ impl<'a, F: AsRef<MemoryMap<&'a [u8]>> + Send> PhysicalMemory
                 .map(|map| map.base().as_usize() + map.output().len())
                 .unwrap(),
             readonly: true,
+            preferred_batch_size: 0,
+            max_in_flight: 0,
+            coalesce_size: 0,
         }
     }
 }
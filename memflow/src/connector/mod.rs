@@ -28,6 +28,12 @@ pub mod fileio;
 #[cfg(feature = "std")]
 pub use fileio::FileIOMemory;
 
+#[cfg(feature = "std")]
+pub mod shared;
+#[doc(hidden)]
+#[cfg(feature = "std")]
+pub use shared::SharedConnector;
+
 #[cfg(feature = "filemap")]
 pub mod filemap;
 #[cfg(feature = "filemap")]
@@ -35,6 +41,12 @@ pub use filemap::{
     MMAPInfo, MMAPInfoMut, ReadMappedFilePhysicalMemory, WriteMappedFilePhysicalMemory,
 };
 
+#[cfg(all(feature = "filemap", feature = "std"))]
+pub mod snapshot;
+#[doc(hidden)]
+#[cfg(all(feature = "filemap", feature = "std"))]
+pub use snapshot::{SnapshotCompression, SnapshotMemory, SnapshotWriter};
+
 pub mod mmap;
 #[doc(hidden)]
 pub use mmap::MappedPhysicalMemory;
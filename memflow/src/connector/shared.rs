@@ -0,0 +1,643 @@
+/*!
+Thread-safe connector handle that multiplexes the requests of many threads.
+
+Every clone of a [`SharedConnector`](struct.SharedConnector.html) refers to the same connector.
+Reads are put into a submission queue, the first thread that finds the connector idle becomes
+the dispatcher, drains the queue and submits the reads of all queued requests in a single
+`phys_read_raw_list` call. Entries are sorted by their physical address and adjacent or
+overlapping entries are merged into one larger read, so many threads reading small objects
+turn into a few large device requests.
+
+Threads that do not dispatch simply block until their request has been completed.
+If the connector panics while a batch is dispatched all requests of that batch fail
+and every following request returns an error.
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::{Error, Result};
+use crate::mem::{PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData};
+use crate::types::{size, PhysicalAddress};
+
+use std::slice::from_raw_parts_mut;
+use std::sync::{Arc, Condvar, Mutex, MutexGuard, PoisonError, TryLockError};
+
+/// Upper bound for the size of a read that is created by merging adjacent entries.
+const MAX_MERGE_SIZE: usize = size::kb(64);
+
+/// A thread-safe handle to a connector.
+///
+/// The handle is `Send + Sync`, it can be shared by reference or cloned cheaply.
+/// All clones share the same connector and submission queue.
+///
+/// If the merged read of a dispatch fails, every request of that dispatch is retried on its own,
+/// so an error is only reported to the requests that actually failed.
+/// Writes are not queued, they are directly forwarded to the connector once it is idle.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::connector::SharedConnector;
+/// use memflow::mem::PhysicalMemory;
+///
+/// fn read_parallel<T: PhysicalMemory + 'static>(mem: T) {
+///     let shared = SharedConnector::new(mem);
+///
+///     let threads = (0..4)
+///         .map(|i| {
+///             let mut mem = shared.clone();
+///             std::thread::spawn(move || {
+///                 let _: u64 = mem.phys_read((i * 0x1000).into()).unwrap();
+///             })
+///         })
+///         .collect::<Vec<_>>();
+///
+///     threads.into_iter().for_each(|t| t.join().unwrap());
+/// }
+/// # use memflow::mem::dummy::DummyMemory;
+/// # use memflow::types::size;
+/// # read_parallel(DummyMemory::new(size::mb(4)));
+/// ```
+pub struct SharedConnector<T> {
+    inner: Arc<SharedState<T>>,
+}
+
+struct SharedState<T> {
+    metadata: PhysicalMemoryMetadata,
+    queue: Mutex<Vec<Request>>,
+    completed: Condvar,
+    dispatcher: Mutex<Dispatcher<T>>,
+}
+
+/// A queued read of a thread that waits for its completion.
+///
+/// The pointers stay valid until `result` is set, since the submitting thread blocks until then.
+/// `result` is only accessed while the queue lock is held.
+struct Request {
+    data: *mut PhysicalReadData<'static>,
+    len: usize,
+    result: *mut Option<Result<()>>,
+}
+unsafe impl Send for Request {}
+
+#[derive(Clone, Copy)]
+struct Entry {
+    addr: PhysicalAddress,
+    buf: *mut u8,
+    len: usize,
+}
+unsafe impl Send for Entry {}
+
+/// A range of entries that is read with one merged `PhysicalReadData`.
+#[derive(Clone, Copy)]
+struct Run {
+    entries: (usize, usize),
+    addr: PhysicalAddress,
+    size: usize,
+}
+
+impl Run {
+    #[inline]
+    fn is_merged(&self) -> bool {
+        self.entries.1 - self.entries.0 > 1
+    }
+}
+
+struct Dispatcher<T> {
+    mem: T,
+    entries: Vec<Entry>,
+    runs: Vec<Run>,
+    scratch: Vec<u8>,
+    results: Vec<Result<()>>,
+}
+
+/// Holds the connector while a batch is dispatched.
+///
+/// If the connector panics the guard is dropped while unwinding, it releases (and thereby poisons)
+/// the connector, fails all requests of the batch and wakes up all waiting threads.
+struct DispatchGuard<'a, T> {
+    state: &'a SharedState<T>,
+    dispatcher: Option<MutexGuard<'a, Dispatcher<T>>>,
+    batch: Vec<Request>,
+}
+
+impl<'a, T: PhysicalMemory> DispatchGuard<'a, T> {
+    fn dispatch(&mut self) {
+        if let Some(dispatcher) = &mut self.dispatcher {
+            if !self.batch.is_empty() {
+                dispatcher.dispatch(&self.batch);
+            }
+        }
+    }
+
+    /// Hands the results to the requests of the batch and releases the connector.
+    ///
+    /// Has to be called while the queue is locked.
+    fn complete(&mut self) {
+        if let Some(dispatcher) = self.dispatcher.take() {
+            for (request, ret) in self.batch.iter().zip(dispatcher.results.iter()) {
+                unsafe { *request.result = Some(*ret) };
+            }
+        }
+    }
+}
+
+impl<'a, T> Drop for DispatchGuard<'a, T> {
+    fn drop(&mut self) {
+        // the batch has been completed regularly
+        if self.dispatcher.is_none() {
+            return;
+        }
+
+        // the connector has to be released before the queue is locked,
+        // otherwise a waiting reader could fail to lock it again after being notified.
+        std::mem::drop(self.dispatcher.take());
+
+        let _queue = self
+            .state
+            .queue
+            .lock()
+            .unwrap_or_else(PoisonError::into_inner);
+        for request in self.batch.iter() {
+            unsafe { *request.result = Some(Err(Error::Connector("shared connector panicked"))) };
+        }
+        self.state.completed.notify_all();
+    }
+}
+
+impl<T: PhysicalMemory> SharedConnector<T> {
+    pub fn new(mem: T) -> Self {
+        Self {
+            inner: Arc::new(SharedState {
+                metadata: mem.metadata(),
+                queue: Mutex::new(Vec::new()),
+                completed: Condvar::new(),
+                dispatcher: Mutex::new(Dispatcher {
+                    mem,
+                    entries: Vec::new(),
+                    runs: Vec::new(),
+                    scratch: Vec::new(),
+                    results: Vec::new(),
+                }),
+            }),
+        }
+    }
+
+    /// Queues the reads and blocks until they have been dispatched.
+    ///
+    /// If the connector is idle the calling thread dispatches all queued requests itself.
+    pub fn read_raw_list(&self, data: &mut [PhysicalReadData]) -> Result<()> {
+        if data.is_empty() {
+            return Ok(());
+        }
+
+        let mut result: Option<Result<()>> = None;
+        let result_ptr: *mut Option<Result<()>> = &mut result;
+
+        let state = &*self.inner;
+        let mut queue = state.queue.lock().unwrap();
+        queue.push(Request {
+            data: data.as_mut_ptr() as *mut PhysicalReadData<'static>,
+            len: data.len(),
+            result: result_ptr,
+        });
+
+        loop {
+            if let Some(result) = unsafe { (*result_ptr).take() } {
+                return result;
+            }
+
+            // the connector is only tried while the queue is locked, dispatchers and writers have to
+            // acquire the queue lock after they are done with the connector and notify all waiters.
+            // this guarantees that every waiting thread either becomes the dispatcher or gets notified.
+            match state.dispatcher.try_lock() {
+                Ok(dispatcher) => {
+                    let mut guard = DispatchGuard {
+                        state,
+                        dispatcher: Some(dispatcher),
+                        batch: std::mem::replace(&mut *queue, Vec::new()),
+                    };
+                    std::mem::drop(queue);
+
+                    guard.dispatch();
+
+                    queue = state.queue.lock().unwrap();
+                    guard.complete();
+                    state.completed.notify_all();
+                }
+                Err(TryLockError::WouldBlock) => {
+                    queue = state.completed.wait(queue).unwrap();
+                }
+                Err(TryLockError::Poisoned(_)) => {
+                    // nobody is going to dispatch the request anymore
+                    queue.retain(|request| request.result != result_ptr);
+                    return Err(Error::Connector("shared connector is poisoned"));
+                }
+            }
+        }
+    }
+
+    /// Forwards the writes to the connector once it is idle.
+    ///
+    /// Readers that queued their requests while the write was in progress are woken up
+    /// afterwards, so one of them takes over dispatching the queue.
+    pub fn write_raw_list(&self, data: &[PhysicalWriteData]) -> Result<()> {
+        let state = &*self.inner;
+        let ret = state
+            .dispatcher
+            .lock()
+            .map_err(|_| Error::Connector("shared connector is poisoned"))?
+            .mem
+            .phys_write_raw_list(data);
+
+        // the connector has to be released before the queue is locked,
+        // otherwise a waiting reader could fail to lock it again after being notified.
+        let _queue = state.queue.lock().unwrap();
+        state.completed.notify_all();
+
+        ret
+    }
+
+    pub fn metadata(&self) -> PhysicalMemoryMetadata {
+        self.inner.metadata
+    }
+}
+
+impl<T: PhysicalMemory> Dispatcher<T> {
+    /// Reads all requests of the batch and stores the result of every request in `results`.
+    fn dispatch(&mut self, batch: &[Request]) {
+        let ret = self.dispatch_merged(batch);
+
+        self.results.clear();
+        if ret.is_ok() || batch.len() == 1 {
+            self.results.resize(batch.len(), ret);
+        } else {
+            // a single invalid request must not fail the other requests of the batch
+            for request in batch.iter() {
+                let data = unsafe { from_raw_parts_mut(request.data, request.len) };
+                let ret = self.mem.phys_read_raw_list(data);
+                self.results.push(ret);
+            }
+        }
+    }
+
+    fn dispatch_merged(&mut self, batch: &[Request]) -> Result<()> {
+        let entries = &mut self.entries;
+        entries.clear();
+        for request in batch.iter() {
+            let data = unsafe { from_raw_parts_mut(request.data, request.len) };
+            entries.extend(
+                data.iter_mut()
+                    .filter(|PhysicalReadData(_, buf)| !buf.is_empty())
+                    .map(|PhysicalReadData(addr, buf)| Entry {
+                        addr: *addr,
+                        buf: buf.as_mut_ptr(),
+                        len: buf.len(),
+                    }),
+            );
+        }
+        entries.sort_unstable_by_key(|entry| entry.addr.address());
+
+        let runs = &mut self.runs;
+        runs.clear();
+        let mut scratch_size = 0;
+        let mut first = 0;
+        while first < entries.len() {
+            let base = entries[first].addr.address();
+            let mut end = base + entries[first].len;
+            let mut last = first + 1;
+            while let Some(next) = entries.get(last) {
+                let next_end = std::cmp::max(end, next.addr.address() + next.len);
+                if next.addr.address() > end || next_end - base > MAX_MERGE_SIZE {
+                    break;
+                }
+                end = next_end;
+                last += 1;
+            }
+
+            let run = Run {
+                entries: (first, last),
+                addr: entries[first].addr,
+                size: end - base,
+            };
+            if run.is_merged() {
+                scratch_size += run.size;
+            }
+            runs.push(run);
+            first = last;
+        }
+
+        if self.scratch.len() < scratch_size {
+            self.scratch.resize(scratch_size, 0);
+        }
+
+        let mut read_list = Vec::with_capacity(runs.len());
+        let mut scratch = &mut self.scratch[..];
+        for run in runs.iter() {
+            if run.is_merged() {
+                let (buf, rest) = scratch.split_at_mut(run.size);
+                read_list.push(PhysicalReadData(run.addr, buf));
+                scratch = rest;
+            } else {
+                let entry = entries[run.entries.0];
+                read_list.push(PhysicalReadData(entry.addr, unsafe {
+                    from_raw_parts_mut(entry.buf, entry.len)
+                }));
+            }
+        }
+
+        let ret = self.mem.phys_read_raw_list(&mut read_list);
+        std::mem::drop(read_list);
+
+        let mut offset = 0;
+        for run in runs.iter().filter(|run| run.is_merged()) {
+            let base = run.addr.address();
+            for entry in entries[run.entries.0..run.entries.1].iter() {
+                let start = offset + (entry.addr.address() - base);
+                let src = &self.scratch[start..start + entry.len];
+                unsafe { from_raw_parts_mut(entry.buf, entry.len) }.copy_from_slice(src);
+            }
+            offset += run.size;
+        }
+
+        ret
+    }
+}
+
+impl<T> Clone for SharedConnector<T> {
+    fn clone(&self) -> Self {
+        Self {
+            inner: self.inner.clone(),
+        }
+    }
+}
+
+impl<T: PhysicalMemory> PhysicalMemory for SharedConnector<T> {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.read_raw_list(data)
+    }
+
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.write_raw_list(data)
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        SharedConnector::metadata(self)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::Address;
+
+    #[test]
+    fn shared_merges_overlapping_reads() {
+        let mut mem = DummyMemory::with_seed(size::mb(1), 7);
+        let expected = mem.phys_read_raw(Address::null().into(), 0x3000).unwrap();
+
+        let shared = SharedConnector::new(mem);
+
+        let mut a = [0u8; 0x100];
+        let mut b = [0u8; 0x80];
+        let mut c = [0u8; 0x10];
+        let mut d = [0u8; 0x20];
+        let mut read_list = [
+            PhysicalReadData(Address::from(0x1100).into(), &mut b),
+            PhysicalReadData(Address::from(0x2000).into(), &mut d),
+            PhysicalReadData(Address::from(0x1000).into(), &mut a),
+            PhysicalReadData(Address::from(0x1040).into(), &mut c),
+        ];
+        shared.read_raw_list(&mut read_list).unwrap();
+
+        assert_eq!(a[..], expected[0x1000..0x1100]);
+        assert_eq!(b[..], expected[0x1100..0x1180]);
+        assert_eq!(c[..], expected[0x1040..0x1050]);
+        assert_eq!(d[..], expected[0x2000..0x2020]);
+    }
+
+    #[test]
+    fn shared_parallel_reads() {
+        let mut mem = DummyMemory::with_seed(size::mb(1), 13);
+        let expected = Arc::new(
+            mem.phys_read_raw(Address::null().into(), size::mb(1))
+                .unwrap(),
+        );
+
+        let shared = SharedConnector::new(mem);
+
+        let threads = (0..8)
+            .map(|t| {
+                let shared = shared.clone();
+                let expected = expected.clone();
+                std::thread::spawn(move || {
+                    let mut buf = [0u8; 0x18];
+                    for i in 0..0x200 {
+                        let addr = (i * 0x20 + t * 0x8) % (size::mb(1) - buf.len());
+                        shared
+                            .read_raw_list(&mut [PhysicalReadData(
+                                Address::from(addr).into(),
+                                &mut buf,
+                            )])
+                            .unwrap();
+                        assert_eq!(buf[..], expected[addr..addr + buf.len()]);
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+
+        threads.into_iter().for_each(|t| t.join().unwrap());
+    }
+
+    #[test]
+    fn shared_parallel_reads_and_writes() {
+        let mut mem = DummyMemory::with_seed(size::mb(1), 17);
+        let expected = mem
+            .phys_read_raw(Address::from(size::kb(512)).into(), size::kb(512))
+            .unwrap();
+
+        let shared = SharedConnector::new(mem);
+
+        // a single reader, so no other reader can pick up a request that is queued during a write
+        let reader = {
+            let shared = shared.clone();
+            std::thread::spawn(move || {
+                let mut buf = [0u8; 0x20];
+                for i in 0..0x1000 {
+                    let offset = (i * 0x40) % (size::kb(512) - buf.len());
+                    let addr = Address::from(size::kb(512) + offset);
+                    shared
+                        .read_raw_list(&mut [PhysicalReadData(addr.into(), &mut buf)])
+                        .unwrap();
+                    assert_eq!(buf[..], expected[offset..offset + buf.len()]);
+                }
+            })
+        };
+
+        let writer = {
+            let shared = shared.clone();
+            std::thread::spawn(move || {
+                for i in 0..0x1000usize {
+                    let addr = Address::from((i * 0x40) % size::kb(512));
+                    shared
+                        .write_raw_list(&[PhysicalWriteData(addr.into(), &i.to_le_bytes())])
+                        .unwrap();
+                }
+            })
+        };
+
+        reader.join().unwrap();
+        writer.join().unwrap();
+
+        let mut buf = [0u8; 8];
+        shared
+            .read_raw_list(&mut [PhysicalReadData(
+                Address::from(0xfff * 0x40).into(),
+                &mut buf,
+            )])
+            .unwrap();
+        assert_eq!(usize::from_le_bytes(buf), 0xfff);
+    }
+
+    /// Fails every read list that contains an entry above `limit`.
+    struct LimitedMemory {
+        mem: DummyMemory,
+        limit: Address,
+    }
+
+    impl PhysicalMemory for LimitedMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            if data
+                .iter()
+                .any(|PhysicalReadData(addr, _)| addr.address() >= self.limit)
+            {
+                return Err(Error::Bounds);
+            }
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    /// Blocks inside of the first read until it is released and panics on every following read.
+    struct PanickingMemory {
+        mem: DummyMemory,
+        reads: usize,
+        entered: std::sync::mpsc::Sender<()>,
+        release: std::sync::mpsc::Receiver<()>,
+    }
+
+    impl PhysicalMemory for PanickingMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            self.reads += 1;
+            if self.reads > 1 {
+                panic!("connector panicked");
+            }
+            self.entered.send(()).unwrap();
+            self.release.recv().unwrap();
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    #[test]
+    fn shared_dispatcher_panic() {
+        let (entered, entered_rx) = std::sync::mpsc::channel();
+        let (release_tx, release) = std::sync::mpsc::channel();
+        let shared = SharedConnector::new(PanickingMemory {
+            mem: DummyMemory::new(size::mb(1)),
+            reads: 0,
+            entered,
+            release,
+        });
+
+        let spawn_read = || {
+            let shared = shared.clone();
+            std::thread::spawn(move || {
+                let mut buf = [0u8; 8];
+                shared
+                    .read_raw_list(&mut [PhysicalReadData(Address::from(0x1000).into(), &mut buf)])
+            })
+        };
+
+        // the first reader dispatches and blocks inside of the connector
+        let first = spawn_read();
+        entered_rx.recv().unwrap();
+
+        // both requests are dispatched in the same batch, the connector panics on it
+        let waiting = (0..2).map(|_| spawn_read()).collect::<Vec<_>>();
+        while shared.inner.queue.lock().unwrap().len() < 2 {
+            std::thread::yield_now();
+        }
+        release_tx.send(()).unwrap();
+
+        assert_eq!(first.join().unwrap(), Ok(()));
+
+        // one of the readers panicked as the dispatcher, the other one must not hang
+        let results = waiting.into_iter().map(|t| t.join()).collect::<Vec<_>>();
+        assert_eq!(results.iter().filter(|ret| ret.is_err()).count(), 1);
+        assert!(results
+            .iter()
+            .filter_map(|ret| ret.as_ref().ok())
+            .all(|ret| *ret == Err(Error::Connector("shared connector panicked"))));
+
+        let mut buf = [0u8; 8];
+        assert_eq!(
+            shared.read_raw_list(&mut [PhysicalReadData(Address::from(0x1000).into(), &mut buf)]),
+            Err(Error::Connector("shared connector is poisoned"))
+        );
+    }
+
+    #[test]
+    fn shared_error_isolated() {
+        let mem = LimitedMemory {
+            mem: DummyMemory::with_seed(size::mb(1), 19),
+            limit: Address::from(size::kb(512)),
+        };
+        let mut dispatcher = Dispatcher {
+            mem,
+            entries: Vec::new(),
+            runs: Vec::new(),
+            scratch: Vec::new(),
+            results: Vec::new(),
+        };
+
+        let mut valid = [0u8; 0x10];
+        let mut invalid = [0u8; 0x10];
+        let mut valid_list = [PhysicalReadData(Address::from(0x1000).into(), &mut valid)];
+        let mut invalid_list = [PhysicalReadData(
+            Address::from(size::kb(768)).into(),
+            &mut invalid,
+        )];
+        let batch = [
+            Request {
+                data: valid_list.as_mut_ptr() as *mut PhysicalReadData<'static>,
+                len: valid_list.len(),
+                result: std::ptr::null_mut(),
+            },
+            Request {
+                data: invalid_list.as_mut_ptr() as *mut PhysicalReadData<'static>,
+                len: invalid_list.len(),
+                result: std::ptr::null_mut(),
+            },
+        ];
+        dispatcher.dispatch(&batch);
+
+        assert!(dispatcher.results[0].is_ok());
+        assert!(dispatcher.results[1].is_err());
+    }
+}
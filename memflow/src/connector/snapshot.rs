@@ -0,0 +1,699 @@
+/*!
+Sparse memory snapshot files.
+
+A snapshot file consists of a small header, the non-zero chunks of memory
+(optionally compressed) and an index of all stored chunks followed by a footer:
+
+```text
++--------+---------+---------+-----+-------+--------+
+| header | chunk 0 | chunk 1 | ... | index | footer |
++--------+---------+---------+-----+-------+--------+
+```
+
+Chunks that only contain zeroes are not stored at all. Since the index is placed at the end
+of the file the [`SnapshotWriter`](struct.SnapshotWriter.html) can stream a snapshot while it is being dumped.
+The [`SnapshotMemory`](struct.SnapshotMemory.html) connector maps the file, only parses the index
+on open and decompresses chunks lazily when they are accessed.
+
+All values are stored in little endian.
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::{Error, Result};
+use crate::mem::dump::DumpSink;
+use crate::mem::{PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData};
+use crate::types::{size, Address};
+
+use std::fs::File;
+use std::io::Write;
+use std::path::Path;
+use std::sync::Arc;
+
+use dataview::Pod;
+use memmap::{Mmap, MmapOptions};
+
+const SNAPSHOT_MAGIC: [u8; 8] = *b"MFSNAP01";
+
+/// Amount of decompressed chunks each reader keeps around.
+const CHUNK_CACHE_SIZE: usize = 8;
+
+/// Compression that is applied to every stored chunk.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SnapshotCompression {
+    None = 0,
+    /// Requires the `snapshot_lz4` feature
+    Lz4 = 1,
+    /// Requires the `snapshot_zstd` feature
+    Zstd = 2,
+}
+
+impl SnapshotCompression {
+    fn from_u32(value: u32) -> Result<Self> {
+        match value {
+            0 => Ok(SnapshotCompression::None),
+            1 => Ok(SnapshotCompression::Lz4),
+            2 => Ok(SnapshotCompression::Zstd),
+            _ => Err(Error::Connector("unknown snapshot chunk compression")),
+        }
+    }
+
+    fn is_supported(self) -> bool {
+        match self {
+            SnapshotCompression::None => true,
+            SnapshotCompression::Lz4 => cfg!(feature = "snapshot_lz4"),
+            SnapshotCompression::Zstd => cfg!(feature = "snapshot_zstd"),
+        }
+    }
+
+    #[allow(unused_variables)]
+    fn compress(self, data: &[u8]) -> Result<Vec<u8>> {
+        match self {
+            #[cfg(feature = "snapshot_lz4")]
+            SnapshotCompression::Lz4 => Ok(lz4_flex::compress(data)),
+            #[cfg(feature = "snapshot_zstd")]
+            SnapshotCompression::Zstd => zstd::block::compress(data, 0)
+                .map_err(|_| Error::Connector("unable to compress snapshot chunk")),
+            SnapshotCompression::None => Ok(data.to_vec()),
+            #[allow(unreachable_patterns)]
+            _ => Err(Error::Connector("snapshot compression is not enabled")),
+        }
+    }
+
+    #[allow(unused_variables)]
+    fn decompress(self, data: &[u8], size: usize) -> Result<Vec<u8>> {
+        let out = match self {
+            #[cfg(feature = "snapshot_lz4")]
+            SnapshotCompression::Lz4 => lz4_flex::decompress(data, size)
+                .map_err(|_| Error::Connector("unable to decompress snapshot chunk"))?,
+            #[cfg(feature = "snapshot_zstd")]
+            SnapshotCompression::Zstd => zstd::block::decompress(data, size)
+                .map_err(|_| Error::Connector("unable to decompress snapshot chunk"))?,
+            SnapshotCompression::None => data.to_vec(),
+            #[allow(unreachable_patterns)]
+            _ => return Err(Error::Connector("snapshot compression is not enabled")),
+        };
+
+        if out.len() != size {
+            return Err(Error::Connector("snapshot chunk has an invalid size"));
+        }
+
+        Ok(out)
+    }
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct SnapshotHeader {
+    magic: [u8; 8],
+    chunk_size: u64,
+}
+unsafe impl Pod for SnapshotHeader {}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct SnapshotIndexEntry {
+    address: u64,
+    file_offset: u64,
+    size: u32,
+    stored_size: u32,
+    compression: u32,
+    _reserved: u32,
+}
+unsafe impl Pod for SnapshotIndexEntry {}
+
+impl SnapshotIndexEntry {
+    /// Checks that the entry describes a chunk within `data_start..data_end` of the file
+    /// and returns the end address of the chunk.
+    fn validate(&self, chunk_size: usize, data_start: u64, data_end: u64) -> Result<u64> {
+        const CORRUPTED: Error = Error::Connector("snapshot index is corrupted");
+
+        // chunks that only contain zeroes are not stored at all
+        if self.size == 0
+            || self.size as usize > chunk_size
+            || self.address % chunk_size as u64 != 0
+        {
+            return Err(CORRUPTED);
+        }
+
+        let stored_size_valid = match SnapshotCompression::from_u32(self.compression)? {
+            SnapshotCompression::None => self.stored_size == self.size,
+            // chunks are only stored compressed if they shrink
+            SnapshotCompression::Lz4 | SnapshotCompression::Zstd => {
+                self.stored_size > 0 && self.stored_size < self.size
+            }
+        };
+
+        let file_end = self
+            .file_offset
+            .checked_add(self.stored_size as u64)
+            .ok_or(CORRUPTED)?;
+        if !stored_size_valid || self.file_offset < data_start || file_end > data_end {
+            return Err(CORRUPTED);
+        }
+
+        self.address.checked_add(self.size as u64).ok_or(CORRUPTED)
+    }
+}
+
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+struct SnapshotFooter {
+    index_offset: u64,
+    chunk_count: u64,
+    mem_size: u64,
+    magic: [u8; 8],
+}
+unsafe impl Pod for SnapshotFooter {}
+
+fn read_pod<T: Pod + Copy>(buf: &[u8], offset: usize) -> Result<T> {
+    let bytes = buf
+        .get(offset..offset + std::mem::size_of::<T>())
+        .ok_or(Error::Connector("snapshot file is truncated"))?;
+    // the file buffer does not guarantee any alignment
+    Ok(unsafe { std::ptr::read_unaligned(bytes.as_ptr() as *const T) })
+}
+
+/// Streams memory into a sparse snapshot file.
+///
+/// Data has to be written in ascending address order, which is exactly what
+/// the [`MemoryDumper`](../../mem/dump/struct.MemoryDumper.html) provides, so the writer can be used as its sink directly.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::connector::snapshot::{SnapshotCompression, SnapshotMemory, SnapshotWriter};
+/// use memflow::mem::PhysicalMemory;
+/// use memflow::types::{size, Address};
+///
+/// let mut writer = SnapshotWriter::new(Vec::new(), size::kb(64), SnapshotCompression::None).unwrap();
+/// writer.write(Address::from(0x10000u64), &[0xff; 0x100]).unwrap();
+/// writer.write(Address::from(size::mb(1)), &[0; 0x1000]).unwrap();
+/// let file = writer.finish().unwrap();
+///
+/// let mut mem = SnapshotMemory::with_buffer(file).unwrap();
+/// assert_eq!(mem.metadata().size, size::mb(1) + 0x1000);
+///
+/// let mut buf = [0u8; 0x200];
+/// mem.phys_read_raw_into(Address::from(0x10000u64).into(), &mut buf).unwrap();
+/// assert_eq!(&buf[..0x100], &[0xff; 0x100][..]);
+/// assert_eq!(&buf[0x100..], &[0; 0x100][..]);
+/// ```
+pub struct SnapshotWriter<W: Write> {
+    out: W,
+    offset: u64,
+    chunk_size: usize,
+    compression: SnapshotCompression,
+
+    chunk_base: Address,
+    chunk: Vec<u8>,
+    index: Vec<SnapshotIndexEntry>,
+    mem_size: u64,
+}
+
+impl<W: Write> SnapshotWriter<W> {
+    /// Creates a new writer and writes the snapshot header.
+    ///
+    /// `chunk_size` has to be a power of two and a multiple of 4kb.
+    pub fn new(mut out: W, chunk_size: usize, compression: SnapshotCompression) -> Result<Self> {
+        if !chunk_size.is_power_of_two()
+            || chunk_size < size::kb(4)
+            || chunk_size > u32::MAX as usize
+        {
+            return Err(Error::Bounds);
+        }
+
+        if !compression.is_supported() {
+            return Err(Error::Connector("snapshot compression is not enabled"));
+        }
+
+        let header = SnapshotHeader {
+            magic: SNAPSHOT_MAGIC,
+            chunk_size: chunk_size as u64,
+        };
+        write_all(&mut out, header.as_bytes())?;
+
+        Ok(Self {
+            out,
+            offset: std::mem::size_of::<SnapshotHeader>() as u64,
+            chunk_size,
+            compression,
+
+            chunk_base: Address::NULL,
+            chunk: Vec::with_capacity(chunk_size),
+            index: Vec::new(),
+            mem_size: 0,
+        })
+    }
+
+    /// Appends `data` at `address` to the snapshot.
+    ///
+    /// Gaps between writes are treated as zeroes. Writing to an address below
+    /// the end of a previous write returns `Error::Bounds`.
+    pub fn write(&mut self, mut address: Address, mut data: &[u8]) -> Result<()> {
+        if address.as_u64() < self.mem_size {
+            return Err(Error::Bounds);
+        }
+
+        while !data.is_empty() {
+            let base = address.as_page_aligned(self.chunk_size);
+            if !self.chunk.is_empty() && base != self.chunk_base {
+                self.flush_chunk()?;
+            }
+            if self.chunk.is_empty() {
+                self.chunk_base = base;
+            }
+
+            // the gap since the previous write is zero filled
+            let offset = address - base;
+            self.chunk.resize(offset, 0);
+
+            let len = std::cmp::min(data.len(), self.chunk_size - offset);
+            self.chunk.extend_from_slice(&data[..len]);
+
+            address += len;
+            data = &data[len..];
+            self.mem_size = address.as_u64();
+
+            if self.chunk.len() == self.chunk_size {
+                self.flush_chunk()?;
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Writes the remaining data, the index and the footer and returns the underlying writer.
+    pub fn finish(mut self) -> Result<W> {
+        self.flush_chunk()?;
+
+        // keep the index 8 byte aligned
+        let padding = (8 - self.offset % 8) % 8;
+        write_all(&mut self.out, &[0u8; 8][..padding as usize])?;
+        self.offset += padding;
+
+        let index_offset = self.offset;
+        for entry in self.index.iter() {
+            write_all(&mut self.out, entry.as_bytes())?;
+        }
+
+        let footer = SnapshotFooter {
+            index_offset,
+            chunk_count: self.index.len() as u64,
+            mem_size: self.mem_size,
+            magic: SNAPSHOT_MAGIC,
+        };
+        write_all(&mut self.out, footer.as_bytes())?;
+
+        self.out
+            .flush()
+            .map_err(|_| Error::IO("unable to write snapshot"))?;
+        Ok(self.out)
+    }
+
+    fn flush_chunk(&mut self) -> Result<()> {
+        if self.chunk.is_empty() {
+            return Ok(());
+        }
+
+        // zero chunks are elided
+        if self.chunk.iter().any(|&b| b != 0) {
+            let compressed = match self.compression {
+                SnapshotCompression::None => None,
+                compression => Some(compression.compress(&self.chunk)?),
+            };
+
+            // chunks that do not shrink are stored uncompressed
+            let (compression, stored) = match compressed {
+                Some(ref buf) if buf.len() < self.chunk.len() => (self.compression, &buf[..]),
+                _ => (SnapshotCompression::None, &self.chunk[..]),
+            };
+
+            write_all(&mut self.out, stored)?;
+
+            self.index.push(SnapshotIndexEntry {
+                address: self.chunk_base.as_u64(),
+                file_offset: self.offset,
+                size: self.chunk.len() as u32,
+                stored_size: stored.len() as u32,
+                compression: compression as u32,
+                _reserved: 0,
+            });
+            self.offset += stored.len() as u64;
+        }
+
+        self.chunk.clear();
+        Ok(())
+    }
+}
+
+impl<W: Write> DumpSink for SnapshotWriter<W> {
+    fn write_range(&mut self, address: Address, data: &[u8]) -> Result<()> {
+        self.write(address, data)
+    }
+}
+
+fn write_all<W: Write>(out: &mut W, data: &[u8]) -> Result<()> {
+    out.write_all(data)
+        .map_err(|_| Error::IO("unable to write snapshot"))
+}
+
+/// Read-only connector for snapshot files created by the `SnapshotWriter`.
+///
+/// Opening a snapshot only validates the index, stored chunks are read directly from the
+/// mapped file and compressed chunks are decompressed on first access. Every clone of the connector
+/// shares the mapped file but keeps its own cache of decompressed chunks.
+pub struct SnapshotMemory<B = Mmap> {
+    buf: Arc<B>,
+    chunk_size: usize,
+    index_offset: usize,
+    chunk_count: usize,
+    mem_size: usize,
+    cache: Vec<(usize, Box<[u8]>)>,
+}
+
+impl<B> Clone for SnapshotMemory<B> {
+    fn clone(&self) -> Self {
+        Self {
+            buf: self.buf.clone(),
+            chunk_size: self.chunk_size,
+            index_offset: self.index_offset,
+            chunk_count: self.chunk_count,
+            mem_size: self.mem_size,
+            cache: Vec::with_capacity(CHUNK_CACHE_SIZE),
+        }
+    }
+}
+
+impl SnapshotMemory<Mmap> {
+    /// Maps the snapshot file at the given path.
+    pub fn open<P: AsRef<Path>>(path: P) -> Result<Self> {
+        let file = File::open(path).map_err(|_| Error::Connector("unable to open snapshot"))?;
+        let buf = unsafe {
+            MmapOptions::new()
+                .map(&file)
+                .map_err(|_| Error::Connector("unable to map file"))?
+        };
+        Self::with_buffer(buf)
+    }
+}
+
+impl<B: AsRef<[u8]>> SnapshotMemory<B> {
+    /// Creates a connector from an in-memory or mapped snapshot.
+    pub fn with_buffer(buf: B) -> Result<Self> {
+        let bytes = buf.as_ref();
+
+        let header: SnapshotHeader = read_pod(bytes, 0)?;
+        if header.magic != SNAPSHOT_MAGIC {
+            return Err(Error::Connector("invalid snapshot header"));
+        }
+
+        let footer_offset = bytes
+            .len()
+            .checked_sub(std::mem::size_of::<SnapshotFooter>())
+            .ok_or(Error::Connector("snapshot file is truncated"))?;
+        let footer: SnapshotFooter = read_pod(bytes, footer_offset)?;
+        if footer.magic != SNAPSHOT_MAGIC {
+            return Err(Error::Connector("invalid snapshot footer"));
+        }
+
+        let chunk_size = header.chunk_size as usize;
+        if !chunk_size.is_power_of_two() || chunk_size < size::kb(4) {
+            return Err(Error::Connector("invalid snapshot chunk size"));
+        }
+
+        let index_offset = footer.index_offset as usize;
+        let chunk_count = footer.chunk_count as usize;
+        let index_end = chunk_count
+            .checked_mul(std::mem::size_of::<SnapshotIndexEntry>())
+            .and_then(|len| len.checked_add(index_offset))
+            .ok_or(Error::Connector("snapshot index is out of range"))?;
+        if index_end > footer_offset {
+            return Err(Error::Connector("snapshot index is out of range"));
+        }
+
+        let snapshot = Self {
+            buf: Arc::new(buf),
+            chunk_size,
+            index_offset,
+            chunk_count,
+            mem_size: footer.mem_size as usize,
+            cache: Vec::with_capacity(CHUNK_CACHE_SIZE),
+        };
+
+        // validate the index once so reads can rely on it
+        let data_start = std::mem::size_of::<SnapshotHeader>() as u64;
+        let mut prev_end = 0;
+        for i in 0..chunk_count {
+            let entry = snapshot.entry(i);
+            let end = entry.validate(chunk_size, data_start, index_offset as u64)?;
+            if entry.address < prev_end || end > footer.mem_size {
+                return Err(Error::Connector("snapshot index is corrupted"));
+            }
+            prev_end = end;
+        }
+
+        Ok(snapshot)
+    }
+
+    fn entry(&self, idx: usize) -> SnapshotIndexEntry {
+        read_pod(
+            (*self.buf).as_ref(),
+            self.index_offset + idx * std::mem::size_of::<SnapshotIndexEntry>(),
+        )
+        .unwrap()
+    }
+
+    /// Binary searches the index for the chunk starting at `base`.
+    fn find_entry(&self, base: u64) -> Option<(usize, SnapshotIndexEntry)> {
+        let (mut lo, mut hi) = (0, self.chunk_count);
+        while lo < hi {
+            let mid = (lo + hi) / 2;
+            let entry = self.entry(mid);
+            if entry.address == base {
+                return Some((mid, entry));
+            } else if entry.address < base {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        None
+    }
+
+    fn read_chunk(&mut self, base: Address, offset: usize, out: &mut [u8]) -> Result<()> {
+        let (idx, entry) = match self.find_entry(base.as_u64()) {
+            Some(entry) => entry,
+            None => {
+                for b in out.iter_mut() {
+                    *b = 0;
+                }
+                return Ok(());
+            }
+        };
+
+        let size = entry.size as usize;
+        let stored = (*self.buf)
+            .as_ref()
+            .get(entry.file_offset as usize..)
+            .and_then(|buf| buf.get(..entry.stored_size as usize))
+            .ok_or(Error::Connector("snapshot chunk is out of range"))?;
+
+        let copy_len = std::cmp::min(out.len(), size.saturating_sub(offset));
+        let (copy_out, zero_out) = out.split_at_mut(copy_len);
+        for b in zero_out.iter_mut() {
+            *b = 0;
+        }
+
+        if copy_len == 0 {
+            return Ok(());
+        }
+
+        match SnapshotCompression::from_u32(entry.compression)? {
+            SnapshotCompression::None => {
+                let src = stored
+                    .get(offset..offset + copy_len)
+                    .ok_or(Error::Connector("snapshot chunk has an invalid size"))?;
+                copy_out.copy_from_slice(src);
+            }
+            compression => {
+                let pos = match self.cache.iter().position(|(i, _)| *i == idx) {
+                    Some(pos) => pos,
+                    None => {
+                        let chunk = compression.decompress(stored, size)?.into_boxed_slice();
+                        if self.cache.len() >= CHUNK_CACHE_SIZE {
+                            self.cache.pop();
+                        }
+                        self.cache.insert(0, (idx, chunk));
+                        0
+                    }
+                };
+
+                // keep the most recently used chunk in front
+                if pos != 0 {
+                    let cached = self.cache.remove(pos);
+                    self.cache.insert(0, cached);
+                }
+
+                copy_out.copy_from_slice(&self.cache[0].1[offset..offset + copy_len]);
+            }
+        }
+
+        Ok(())
+    }
+}
+
+impl<B: AsRef<[u8]> + Send + Sync> PhysicalMemory for SnapshotMemory<B> {
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        for PhysicalReadData(addr, out) in data.iter_mut() {
+            let mut address = addr.address();
+            let mut out = &mut out[..];
+
+            while !out.is_empty() {
+                let base = address.as_page_aligned(self.chunk_size);
+                let offset = (address - base) as usize;
+                let len = std::cmp::min(out.len(), self.chunk_size - offset);
+
+                let (chunk_out, rest) = out.split_at_mut(len);
+                self.read_chunk(base, offset, chunk_out)?;
+
+                out = rest;
+                address += len;
+            }
+        }
+
+        Ok(())
+    }
+
+    fn phys_write_raw_list(&mut self, _data: &[PhysicalWriteData]) -> Result<()> {
+        Err(Error::Connector("snapshot is not writeable"))
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        PhysicalMemoryMetadata {
+            size: self.mem_size,
+            readonly: true,
+            // chunks are read from the mapped file directly, the batch size makes no difference
+            preferred_batch_size: 0,
+            max_in_flight: 0,
+            coalesce_size: 0,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::mem::dump::{DumpRange, MemoryDumper};
+
+    fn snapshot_roundtrip(compression: SnapshotCompression) {
+        let mut mem = DummyMemory::new(size::mb(4));
+        mem.phys_write_raw(Address::from(size::kb(68)).into(), &[0xab; 0x3000])
+            .unwrap();
+        mem.phys_write_raw(Address::from(size::mb(3) - 8).into(), &[0xcd; 16])
+            .unwrap();
+
+        let mut writer = SnapshotWriter::new(Vec::new(), size::kb(64), compression).unwrap();
+        MemoryDumper::new()
+            .chunk_size(size::kb(256))
+            .dump(
+                &mem,
+                &[DumpRange::physical(Address::NULL, size::mb(4))],
+                &mut writer,
+            )
+            .unwrap();
+        let file = writer.finish().unwrap();
+
+        // only the 3 chunks containing data are stored
+        assert!(file.len() < size::kb(64) * 4);
+
+        let mut snapshot = SnapshotMemory::with_buffer(file).unwrap();
+        assert_eq!(snapshot.metadata().size, size::mb(4));
+
+        let mut expected = vec![0u8; size::mb(4)];
+        mem.phys_read_raw_into(Address::NULL.into(), &mut expected)
+            .unwrap();
+        let mut actual = vec![0xffu8; size::mb(4)];
+        snapshot
+            .phys_read_raw_into(Address::NULL.into(), &mut actual)
+            .unwrap();
+        assert!(expected == actual);
+    }
+
+    #[test]
+    fn snapshot_sparse_roundtrip() {
+        snapshot_roundtrip(SnapshotCompression::None);
+    }
+
+    #[cfg(feature = "snapshot_lz4")]
+    #[test]
+    fn snapshot_lz4_roundtrip() {
+        snapshot_roundtrip(SnapshotCompression::Lz4);
+    }
+
+    #[cfg(feature = "snapshot_zstd")]
+    #[test]
+    fn snapshot_zstd_roundtrip() {
+        snapshot_roundtrip(SnapshotCompression::Zstd);
+    }
+
+    /// Writes a snapshot with a single uncompressed chunk and applies `corrupt` to its index entry.
+    fn corrupted_snapshot<F: FnOnce(&mut SnapshotIndexEntry)>(corrupt: F) -> Result<()> {
+        let mut writer =
+            SnapshotWriter::new(Vec::new(), size::kb(4), SnapshotCompression::None).unwrap();
+        writer
+            .write(Address::from(0x1000u64), &[1; 0x1000])
+            .unwrap();
+        let mut file = writer.finish().unwrap();
+
+        let footer: SnapshotFooter =
+            read_pod(&file, file.len() - std::mem::size_of::<SnapshotFooter>()).unwrap();
+        let entry_offset = footer.index_offset as usize;
+        let mut entry: SnapshotIndexEntry = read_pod(&file, entry_offset).unwrap();
+        corrupt(&mut entry);
+        file[entry_offset..(entry_offset + std::mem::size_of::<SnapshotIndexEntry>())]
+            .copy_from_slice(entry.as_bytes());
+
+        SnapshotMemory::with_buffer(file).map(|_| ())
+    }
+
+    #[test]
+    fn snapshot_corrupted_index() {
+        let corrupted = Err(Error::Connector("snapshot index is corrupted"));
+
+        assert_eq!(corrupted_snapshot(|_| {}), Ok(()));
+        assert_eq!(corrupted_snapshot(|e| e.stored_size = 0x800), corrupted);
+        assert_eq!(corrupted_snapshot(|e| e.size = 0x2000), corrupted);
+        assert_eq!(corrupted_snapshot(|e| e.file_offset = u64::MAX), corrupted);
+        assert_eq!(corrupted_snapshot(|e| e.file_offset = 0), corrupted);
+        assert_eq!(
+            corrupted_snapshot(|e| e.address = u64::MAX - 0xfff),
+            corrupted
+        );
+        assert_eq!(corrupted_snapshot(|e| e.address = 0x1800), corrupted);
+        assert_eq!(
+            corrupted_snapshot(|e| {
+                e.compression = SnapshotCompression::Lz4 as u32;
+                e.stored_size = 0x1000;
+            }),
+            corrupted
+        );
+        assert_eq!(
+            corrupted_snapshot(|e| e.compression = 7),
+            Err(Error::Connector("unknown snapshot chunk compression"))
+        );
+    }
+
+    #[test]
+    fn snapshot_unordered_write() {
+        let mut writer =
+            SnapshotWriter::new(Vec::new(), size::kb(4), SnapshotCompression::None).unwrap();
+        writer.write(Address::from(0x2000u64), &[1; 0x10]).unwrap();
+        assert_eq!(
+            writer.write(Address::from(0x1000u64), &[1; 0x10]),
+            Err(Error::Bounds)
+        );
+    }
+}
@@ -11,6 +11,24 @@ The cache validator has to implement the [`CacheValidator`](../trait.CacheValida
 
 To make it easier and quicker to construct and work with caches this module also contains a cache builder.
 
+By default every clone of a cache holds its own copy of the cached pages.
+When multiple threads work on clones of the same cache the builder can be put into shared mode via
+the `shared()` function, in this case all clones reference the same sharded page store.
+
+Pages can also be loaded into the cache ahead of time via `PhysicalMemory::phys_prefetch_list`
+(or `VirtualMemory::virt_prefetch` when accessing memory through a `VirtualDMA` object).
+Optionally the cache detects sequential reads and prefetches the following memory on its own,
+see the `read_ahead()` function of the builder.
+
+Page table entries are held in the same cache as all other pages by default.
+Large scans over data pages can therefore evict the page tables and every following translation
+has to go back to the connector. Via the `page_table_cache()` function of the builder the page tables
+can be moved into a separate, usually much smaller, cache with its own validator.
+
+Writes are passed through to the connector immediately by default. With the `write_combining()`
+function of the builder they are buffered instead, adjacent and overlapping writes are merged and
+only written out once the buffer is full, a page containing buffered data is read or `commit()` is called.
+
 More examples can be found in the documentations for each of the structs in this module.
 
 # Examples
@@ -30,7 +48,8 @@ fn build<T: PhysicalMemory>(mem: T) {
 */
 
 use super::{
-    page_cache::PageCache, page_cache::PageValidity, CacheValidator, DefaultCacheValidator,
+    page_cache::PageCache, page_cache::PageValidity, write_combiner::WriteCombiner, CacheValidator,
+    DefaultCacheValidator,
 };
 use crate::architecture::ArchitectureObj;
 use crate::error::Result;
@@ -38,30 +57,89 @@ use crate::iter::PageChunks;
 use crate::mem::phys_mem::{
     PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalWriteData,
 };
-use crate::types::{size, PageType};
+use crate::mem::stats::{ConnectorStats, PageCacheStats, StatsRecorder};
+use crate::types::{size, Address, PageType, PhysicalAddress};
+
+#[cfg(feature = "std")]
+use super::shared_page_cache::{SharedPageCache, DEFAULT_SHARD_COUNT};
+#[cfg(feature = "std")]
+use coarsetime::Duration;
+#[cfg(feature = "std")]
+use std::sync::Arc;
 
-use bumpalo::Bump;
+use bumpalo::{collections::Vec as BumpVec, Bump};
+use log::{debug, warn};
 
 /// The cache object that can use as a drop-in replacement for any Connector.
 ///
 /// Since this cache implements `PhysicalMemory` it can be used as a replacement
 /// in all structs and functions that require a `PhysicalMemory` object.
-pub struct CachedMemoryAccess<'a, T, Q> {
-    mem: T,
-    cache: PageCache<'a, Q>,
+pub struct CachedMemoryAccess<'a, T: PhysicalMemory, Q> {
+    // only `None` after `destroy()` moved the memory object out of the cache
+    mem: Option<T>,
+    cache: CacheStore<'a, Q>,
+    pt_cache: Option<PageCache<'a, Q>>,
     arena: Bump,
+    read_ahead: ReadAhead,
+    write_buffer: Option<WriteCombiner>,
+    connector_stats: StatsRecorder<ConnectorStats>,
+}
+
+/// State of the sequential read detection.
+#[derive(Clone, Copy)]
+struct ReadAhead {
+    size: usize,
+    last_end: Address,
+    prefetched_end: Address,
+}
+
+impl ReadAhead {
+    const fn disabled() -> Self {
+        Self {
+            size: 0,
+            last_end: Address::INVALID,
+            prefetched_end: Address::INVALID,
+        }
+    }
+}
+
+enum CacheStore<'a, Q> {
+    Local(PageCache<'a, Q>),
+    // the statistics are recorded per handle, clones start out with empty statistics
+    #[cfg(feature = "std")]
+    Shared(Arc<SharedPageCache>, StatsRecorder<PageCacheStats>),
+}
+
+impl<'a, Q> Clone for CacheStore<'a, Q>
+where
+    Q: CacheValidator + Clone,
+{
+    fn clone(&self) -> Self {
+        match self {
+            CacheStore::Local(cache) => CacheStore::Local(cache.clone()),
+            #[cfg(feature = "std")]
+            CacheStore::Shared(cache, _) => {
+                CacheStore::Shared(cache.clone(), StatsRecorder::default())
+            }
+        }
+    }
 }
 
 impl<'a, T, Q> Clone for CachedMemoryAccess<'a, T, Q>
 where
-    T: Clone,
+    T: PhysicalMemory + Clone,
     Q: CacheValidator + Clone,
 {
     fn clone(&self) -> Self {
         Self {
             mem: self.mem.clone(),
             cache: self.cache.clone(),
+            pt_cache: self.pt_cache.clone(),
             arena: Bump::new(),
+            read_ahead: self.read_ahead,
+            // buffered writes stay with the original cache
+            write_buffer: self.write_buffer.as_ref().map(WriteCombiner::detached),
+            connector_stats: StatsRecorder::default(),
         }
     }
 }
@@ -73,12 +151,142 @@ impl<'a, T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccess<'a, T, Q> {
     ///
     /// For general usage it is advised to just use the [builder](struct.CachedMemoryAccessBuilder.html)
     /// to construct the cache.
-    pub fn new(mem: T, cache: PageCache<'a, Q>) -> Self {
+    pub fn new(mem: T, mut cache: PageCache<'a, Q>) -> Self {
+        cache.set_metadata(&mem.metadata());
         Self {
-            mem,
-            cache,
+            mem: Some(mem),
+            cache: CacheStore::Local(cache),
+            pt_cache: None,
+            arena: Bump::new(),
+            read_ahead: ReadAhead::disabled(),
+            write_buffer: None,
+            connector_stats: StatsRecorder::default(),
+        }
+    }
+
+    /// Constructs a new cache based on the given `SharedPageCache`.
+    ///
+    /// All caches constructed from the same `SharedPageCache` (as well as all of their clones)
+    /// will share the cached pages with each other.
+    ///
+    /// For general usage it is advised to just use the [builder](struct.CachedMemoryAccessBuilder.html)
+    /// and enable the shared mode via the `shared()` function.
+    #[cfg(feature = "std")]
+    pub fn with_shared(mem: T, cache: Arc<SharedPageCache>) -> Self {
+        Self {
+            mem: Some(mem),
+            cache: CacheStore::Shared(cache, StatsRecorder::default()),
+            pt_cache: None,
             arena: Bump::new(),
+            read_ahead: ReadAhead::disabled(),
+            write_buffer: None,
+            connector_stats: StatsRecorder::default(),
+        }
+    }
+
+    /// Moves all page table entries into the given `PageCache`.
+    ///
+    /// Physical reads of pages with the `PageType::PAGE_TABLE` type are exclusively served by
+    /// this cache afterwards, so they can not be evicted by reads of data pages.
+    ///
+    /// For general usage it is advised to just use the [builder](struct.CachedMemoryAccessBuilder.html)
+    /// and enable the page table cache via the `page_table_cache()` function.
+    pub fn with_page_table_cache(mut self, mut cache: PageCache<'a, Q>) -> Self {
+        cache.set_metadata(&self.metadata());
+        self.pt_cache = Some(cache);
+        self
+    }
+
+    /// Buffers writes and merges adjacent and overlapping ones before they reach the connector.
+    ///
+    /// Buffered writes are flushed once they exceed `limit` bytes, when a page containing buffered
+    /// data is read or prefetched, when `commit()` or `destroy()` is called and when the cache is dropped.
+    ///
+    /// For general usage it is advised to just use the [builder](struct.CachedMemoryAccessBuilder.html)
+    /// and enable write combining via the `write_combining()` function.
+    pub fn with_write_combining(mut self, limit: usize, page_size: usize) -> Self {
+        self.write_buffer = Some(WriteCombiner::new(limit, page_size));
+        self
+    }
+
+    /// Writes all buffered writes to the underlying memory object.
+    ///
+    /// This function does nothing if write combining is disabled.
+    pub fn commit(&mut self) -> Result<()> {
+        match (&mut self.write_buffer, &mut self.mem) {
+            (Some(write_buffer), Some(mem)) => {
+                let mut mem = TrackedMemory::new(mem, &mut self.connector_stats);
+                match &self.cache {
+                    CacheStore::Local(_) => write_buffer.flush(&mut mem),
+                    #[cfg(feature = "std")]
+                    CacheStore::Shared(cache, _) => write_buffer.flush(&mut SharedWriteBack {
+                        mem: &mut mem,
+                        cache,
+                    }),
+                }
+            }
+            _ => Ok(()),
+        }
+    }
+
+    /// Flushes the write buffer in case any of the accessed pages contains buffered data.
+    fn commit_overlapping<I: Iterator<Item = (Address, usize)>>(
+        &mut self,
+        mut ranges: I,
+    ) -> Result<()> {
+        let dirty = match &self.write_buffer {
+            Some(write_buffer) => {
+                !write_buffer.is_empty()
+                    && ranges.any(|(addr, len)| write_buffer.overlaps_pages(addr, len))
+            }
+            None => false,
+        };
+
+        if dirty {
+            self.commit()
+        } else {
+            Ok(())
+        }
+    }
+
+    /// Returns the statistics of the regular page cache.
+    ///
+    /// Statistics are only recorded with the `stats` feature.
+    /// In shared mode only the accesses of this cache object are counted, not the ones of its clones.
+    pub fn page_cache_stats(&self) -> PageCacheStats {
+        match &self.cache {
+            CacheStore::Local(cache) => cache.stats(),
+            #[cfg(feature = "std")]
+            CacheStore::Shared(_, stats) => stats.get(),
+        }
+    }
+
+    /// Returns the statistics of the page table cache, if it is enabled.
+    pub fn page_table_cache_stats(&self) -> PageCacheStats {
+        self.pt_cache
+            .as_ref()
+            .map(PageCache::stats)
+            .unwrap_or_default()
+    }
+
+    /// Returns the statistics of all accesses that were forwarded to the underlying memory object.
+    ///
+    /// Statistics are only recorded with the `stats` feature.
+    pub fn connector_stats(&self) -> ConnectorStats {
+        self.connector_stats.get()
+    }
+
+    /// Resets the statistics of the caches and the connector.
+    pub fn reset_stats(&mut self) {
+        match &mut self.cache {
+            CacheStore::Local(cache) => cache.reset_stats(),
+            #[cfg(feature = "std")]
+            CacheStore::Shared(_, stats) => stats.reset(),
         }
+        if let Some(pt_cache) = &mut self.pt_cache {
+            pt_cache.reset_stats();
+        }
+        self.connector_stats.reset();
     }
 
     /// Consumes self and returns the containing memory object.
@@ -87,6 +295,8 @@ impl<'a, T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccess<'a, T, Q> {
     /// when it was being constructed.
     /// It will destroy the `self` and return back the ownership of the underlying memory object.
     ///
+    /// Buffered writes are committed before the memory object is returned.
+    ///
     /// # Examples
     /// ```
     /// # const MAGIC_VALUE: u64 = 0x23bd_318f_f3a3_5821;
@@ -112,8 +322,64 @@ impl<'a, T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccess<'a, T, Q> {
     /// # mem.phys_write(0.into(), &MAGIC_VALUE).unwrap();
     /// # build(mem);
     /// ```
-    pub fn destroy(self) -> T {
-        self.mem
+    pub fn destroy(mut self) -> T {
+        if let Err(err) = self.commit() {
+            warn!("unable to commit buffered writes: {}", err);
+        }
+        self.mem.take().unwrap()
+    }
+
+    /// Prefetches the memory following `data` in case it continues the previous read.
+    ///
+    /// A new prefetch is only issued once at least half of the read-ahead window has been consumed.
+    /// The prefetch is best effort, it may run past the end of the physical memory or into
+    /// unmapped ranges, so its errors never fail the read that triggered it.
+    fn detect_read_ahead(&mut self, data: &[PhysicalReadData]) {
+        if self.read_ahead.size == 0 {
+            return;
+        }
+
+        let (first, last) = match (data.first(), data.last()) {
+            (Some(first), Some(last)) => (first.0, last),
+            _ => return,
+        };
+
+        let ra = &mut self.read_ahead;
+        let sequential = first.address() == ra.last_end;
+        let end = last.0.address() + last.1.len();
+        ra.last_end = end;
+
+        let target = end + ra.size;
+        let start = if ra.prefetched_end > end && ra.prefetched_end <= target {
+            ra.prefetched_end
+        } else {
+            end
+        };
+
+        if !sequential || target - start < ra.size / 2 {
+            return;
+        }
+
+        ra.prefetched_end = target;
+
+        let start = if last.0.has_page() {
+            PhysicalAddress::with_page(start, last.0.page_type(), last.0.page_size())
+        } else {
+            PhysicalAddress::from(start)
+        };
+
+        if let Err(err) = self.phys_prefetch_list(&[(start, target - start.address())]) {
+            debug!("read-ahead of {:x} failed: {}", start.address(), err);
+        }
+    }
+}
+
+/// Buffered writes are committed when the cache is dropped.
+impl<'a, T: PhysicalMemory, Q> Drop for CachedMemoryAccess<'a, T, Q> {
+    fn drop(&mut self) {
+        if let Err(err) = self.commit() {
+            warn!("unable to commit buffered writes: {}", err);
+        }
     }
 }
 
@@ -127,38 +393,253 @@ impl<'a, T: PhysicalMemory> CachedMemoryAccess<'a, T, DefaultCacheValidator> {
 // forward PhysicalMemory trait fncs
 impl<'a, T: PhysicalMemory, Q: CacheValidator> PhysicalMemory for CachedMemoryAccess<'a, T, Q> {
     fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
-        self.cache.validator.update_validity();
+        self.commit_overlapping(
+            data.iter()
+                .map(|PhysicalReadData(addr, buf)| (addr.address(), buf.len())),
+        )?;
+
         self.arena.reset();
-        self.cache.cached_read(&mut self.mem, data, &self.arena)
+
+        let mut mem = TrackedMemory::new(self.mem.as_mut().unwrap(), &mut self.connector_stats);
+
+        let pt_cache = match &mut self.pt_cache {
+            Some(pt_cache) => pt_cache,
+            None => {
+                read_store(&mut self.cache, &mut mem, data, &self.arena)?;
+                self.detect_read_ahead(data);
+                return Ok(());
+            }
+        };
+
+        pt_cache.validator.update_validity();
+
+        let pt_count = data
+            .iter()
+            .filter(|PhysicalReadData(addr, _)| is_page_table(*addr))
+            .count();
+
+        if pt_count == data.len() {
+            // page walks only consist of page table reads
+            pt_cache.cached_read(&mut mem, data, &self.arena)
+        } else if pt_count == 0 {
+            read_store(&mut self.cache, &mut mem, data, &self.arena)?;
+            self.detect_read_ahead(data);
+            Ok(())
+        } else {
+            let mut pt_list = BumpVec::with_capacity_in(pt_count, &self.arena);
+            let mut data_list = BumpVec::with_capacity_in(data.len() - pt_count, &self.arena);
+            for PhysicalReadData(addr, buf) in data.iter_mut() {
+                if is_page_table(*addr) {
+                    pt_list.push(PhysicalReadData(*addr, &mut **buf));
+                } else {
+                    data_list.push(PhysicalReadData(*addr, &mut **buf));
+                }
+            }
+
+            pt_cache.cached_read(&mut mem, &mut pt_list, &self.arena)?;
+            read_store(&mut self.cache, &mut mem, &mut data_list, &self.arena)?;
+
+            self.detect_read_ahead(data);
+            Ok(())
+        }
     }
 
     fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
-        self.cache.validator.update_validity();
-
-        let cache = &mut self.cache;
-        let mem = &mut self.mem;
-
-        data.iter().for_each(move |PhysicalWriteData(addr, data)| {
-            if cache.is_cached_page_type(addr.page_type()) {
-                for (paddr, data_chunk) in data.page_chunks(addr.address(), cache.page_size()) {
-                    let mut cached_page = cache.cached_page_mut(paddr, false);
-                    if let PageValidity::Valid(buf) = &mut cached_page.validity {
-                        // write-back into still valid cache pages
-                        let start = paddr - cached_page.address;
-                        buf[start..(start + data_chunk.len())].copy_from_slice(data_chunk);
-                    }
+        if let Some(pt_cache) = &mut self.pt_cache {
+            pt_cache.validator.update_validity();
+            write_back(pt_cache, data);
+        }
+
+        match &mut self.cache {
+            CacheStore::Local(cache) => {
+                cache.validator.update_validity();
+                write_back(cache, data);
+            }
+            // the shared cache is only updated once the write reached the memory,
+            // otherwise a concurrent read from another clone could put outdated pages back into it.
+            #[cfg(feature = "std")]
+            CacheStore::Shared(_, _) => {}
+        }
+
+        if let Some(write_buffer) = &mut self.write_buffer {
+            for PhysicalWriteData(addr, buf) in data.iter() {
+                write_buffer.push(*addr, buf);
+            }
+            return if write_buffer.is_full() {
+                self.commit()
+            } else {
+                Ok(())
+            };
+        }
 
-                    cache.put_entry(cached_page);
+        self.connector_stats.record_write(data);
+        self.mem.as_mut().unwrap().phys_write_raw_list(data)?;
+
+        #[cfg(feature = "std")]
+        {
+            if let CacheStore::Shared(cache, _) = &self.cache {
+                cache.cached_write(data);
+            }
+        }
+
+        Ok(())
+    }
+
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        self.mem.as_ref().unwrap().metadata()
+    }
+
+    fn phys_prefetch_list(&mut self, data: &[(PhysicalAddress, usize)]) -> Result<()> {
+        self.commit_overlapping(data.iter().map(|(addr, len)| (addr.address(), *len)))?;
+
+        self.arena.reset();
+
+        let mut mem = TrackedMemory::new(self.mem.as_mut().unwrap(), &mut self.connector_stats);
+
+        if let Some(pt_cache) = &mut self.pt_cache {
+            if data.iter().any(|(addr, _)| is_page_table(*addr)) {
+                pt_cache.validator.update_validity();
+
+                let mut pt_list = BumpVec::new_in(&self.arena);
+                let mut data_list = BumpVec::new_in(&self.arena);
+                for &(addr, size) in data.iter() {
+                    if is_page_table(addr) {
+                        pt_list.push((addr, size));
+                    } else {
+                        data_list.push((addr, size));
+                    }
                 }
+
+                pt_cache.prefetch(&mut mem, &pt_list, &self.arena)?;
+                return prefetch_store(&mut self.cache, &mut mem, &data_list, &self.arena);
             }
-        });
+        }
 
-        mem.phys_write_raw_list(data)
+        prefetch_store(&mut self.cache, &mut mem, data, &self.arena)
     }
+}
 
+/// Forwards all accesses to the underlying memory object and records them in the connector statistics.
+struct TrackedMemory<'b, T> {
+    mem: &'b mut T,
+    stats: &'b mut StatsRecorder<ConnectorStats>,
+}
+
+impl<'b, T> TrackedMemory<'b, T> {
+    #[inline(always)]
+    fn new(mem: &'b mut T, stats: &'b mut StatsRecorder<ConnectorStats>) -> Self {
+        Self { mem, stats }
+    }
+}
+
+impl<'b, T: PhysicalMemory> PhysicalMemory for TrackedMemory<'b, T> {
+    #[inline(always)]
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.stats.record_read(data);
+        self.mem.phys_read_raw_list(data)
+    }
+
+    #[inline(always)]
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.stats.record_write(data);
+        self.mem.phys_write_raw_list(data)
+    }
+
+    #[inline(always)]
     fn metadata(&self) -> PhysicalMemoryMetadata {
         self.mem.metadata()
     }
+
+    #[inline(always)]
+    fn phys_prefetch_list(&mut self, data: &[(PhysicalAddress, usize)]) -> Result<()> {
+        self.mem.phys_prefetch_list(data)
+    }
+}
+
+/// Updates the shared cache after each write reached the underlying memory object.
+#[cfg(feature = "std")]
+struct SharedWriteBack<'b, T> {
+    mem: &'b mut T,
+    cache: &'b SharedPageCache,
+}
+
+#[cfg(feature = "std")]
+impl<'b, T: PhysicalMemory> PhysicalMemory for SharedWriteBack<'b, T> {
+    #[inline(always)]
+    fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+        self.mem.phys_read_raw_list(data)
+    }
+
+    #[inline(always)]
+    fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+        self.mem.phys_write_raw_list(data)?;
+        self.cache.cached_write(data);
+        Ok(())
+    }
+
+    #[inline(always)]
+    fn metadata(&self) -> PhysicalMemoryMetadata {
+        self.mem.metadata()
+    }
+
+    #[inline(always)]
+    fn phys_prefetch_list(&mut self, data: &[(PhysicalAddress, usize)]) -> Result<()> {
+        self.mem.phys_prefetch_list(data)
+    }
+}
+
+#[inline]
+fn is_page_table(addr: PhysicalAddress) -> bool {
+    addr.page_type().contains(PageType::PAGE_TABLE)
+}
+
+fn read_store<T: PhysicalMemory, Q: CacheValidator>(
+    store: &mut CacheStore<Q>,
+    mem: &mut T,
+    data: &mut [PhysicalReadData],
+    arena: &Bump,
+) -> Result<()> {
+    match store {
+        CacheStore::Local(cache) => {
+            cache.validator.update_validity();
+            cache.cached_read(mem, data, arena)
+        }
+        #[cfg(feature = "std")]
+        CacheStore::Shared(cache, stats) => cache.cached_read(mem, data, arena, stats),
+    }
+}
+
+fn prefetch_store<T: PhysicalMemory, Q: CacheValidator>(
+    store: &mut CacheStore<Q>,
+    mem: &mut T,
+    data: &[(PhysicalAddress, usize)],
+    arena: &Bump,
+) -> Result<()> {
+    match store {
+        CacheStore::Local(cache) => {
+            cache.validator.update_validity();
+            cache.prefetch(mem, data, arena)
+        }
+        #[cfg(feature = "std")]
+        CacheStore::Shared(cache, stats) => cache.prefetch(mem, data, arena, stats),
+    }
+}
+
+fn write_back<Q: CacheValidator>(cache: &mut PageCache<Q>, data: &[PhysicalWriteData]) {
+    data.iter().for_each(|PhysicalWriteData(addr, data)| {
+        if cache.is_cached_page_type(addr.page_type()) {
+            for (paddr, data_chunk) in data.page_chunks(addr.address(), cache.page_size()) {
+                let mut cached_page = cache.cached_page_mut(paddr, false);
+                if let PageValidity::Valid(buf) = &mut cached_page.validity {
+                    // write-back into still valid cache pages
+                    let start = paddr - cached_page.address;
+                    buf[start..(start + data_chunk.len())].copy_from_slice(data_chunk);
+                }
+
+                cache.put_entry(cached_page);
+            }
+        }
+    });
 }
 
 /// The builder interface for constructing a `CachedMemoryAccess` object.
@@ -168,6 +649,11 @@ pub struct CachedMemoryAccessBuilder<T, Q> {
     page_size: Option<usize>,
     cache_size: usize,
     page_type_mask: PageType,
+    page_table_cache: Option<(usize, Q)>,
+    read_ahead: usize,
+    write_combining: usize,
+    #[cfg(feature = "std")]
+    shared: Option<Duration>,
 }
 
 impl<T: PhysicalMemory> CachedMemoryAccessBuilder<T, DefaultCacheValidator> {
@@ -248,6 +734,11 @@ impl<T: PhysicalMemory> CachedMemoryAccessBuilder<T, DefaultCacheValidator> {
             page_size: None,
             cache_size: size::mb(2),
             page_type_mask: PageType::PAGE_TABLE | PageType::READ_ONLY,
+            page_table_cache: None,
+            read_ahead: 0,
+            write_combining: 0,
+            #[cfg(feature = "std")]
+            shared: None,
         }
     }
 }
@@ -255,15 +746,62 @@ impl<T: PhysicalMemory> CachedMemoryAccessBuilder<T, DefaultCacheValidator> {
 impl<T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccessBuilder<T, Q> {
     /// Builds the `CachedMemoryAccess` object or returns an error if the page size is not set.
     pub fn build<'a>(self) -> Result<CachedMemoryAccess<'a, T, Q>> {
-        Ok(CachedMemoryAccess::new(
-            self.mem,
-            PageCache::with_page_size(
-                self.page_size.ok_or("page_size must be initialized")?,
-                self.cache_size,
-                self.page_type_mask,
-                self.validator,
+        let page_size = self.page_size.ok_or("page_size must be initialized")?;
+        let read_ahead = ReadAhead {
+            size: self.read_ahead,
+            ..ReadAhead::disabled()
+        };
+
+        // page tables are exclusively held by the page table cache when it is enabled
+        let (page_type_mask, mut pt_cache) = match self.page_table_cache {
+            Some((cache_size, validator)) if cache_size >= page_size => (
+                self.page_type_mask - PageType::PAGE_TABLE,
+                Some(PageCache::with_page_size(
+                    page_size,
+                    cache_size,
+                    PageType::PAGE_TABLE,
+                    validator,
+                )),
             ),
-        ))
+            _ => (self.page_type_mask, None),
+        };
+        if let Some(pt_cache) = &mut pt_cache {
+            pt_cache.set_metadata(&self.mem.metadata());
+        }
+        let write_buffer = if self.write_combining > 0 {
+            Some(WriteCombiner::new(self.write_combining, page_size))
+        } else {
+            None
+        };
+
+        #[cfg(feature = "std")]
+        {
+            if let Some(valid_time) = self.shared {
+                let mut cache = CachedMemoryAccess::with_shared(
+                    self.mem,
+                    Arc::new(SharedPageCache::new(
+                        page_size,
+                        self.cache_size,
+                        page_type_mask,
+                        valid_time,
+                        DEFAULT_SHARD_COUNT,
+                    )),
+                );
+                cache.pt_cache = pt_cache;
+                cache.read_ahead = read_ahead;
+                cache.write_buffer = write_buffer;
+                return Ok(cache);
+            }
+        }
+
+        let mut cache = CachedMemoryAccess::new(
+            self.mem,
+            PageCache::with_page_size(page_size, self.cache_size, page_type_mask, self.validator),
+        );
+        cache.pt_cache = pt_cache;
+        cache.read_ahead = read_ahead;
+        cache.write_buffer = write_buffer;
+        Ok(cache)
     }
 
     /// Sets a custom validator for the cache.
@@ -273,6 +811,9 @@ impl<T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccessBuilder<T, Q> {
     ///
     /// The default setting is `DefaultCacheValidator::default()`.
     ///
+    /// Since the validator determines the type of the cache a previously configured
+    /// `page_table_cache()` is discarded by this function, it has to be set up afterwards.
+    ///
     /// # Examples:
     ///
     /// ```
@@ -300,6 +841,11 @@ impl<T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccessBuilder<T, Q> {
             page_size: self.page_size,
             cache_size: self.cache_size,
             page_type_mask: self.page_type_mask,
+            page_table_cache: None,
+            read_ahead: self.read_ahead,
+            write_combining: self.write_combining,
+            #[cfg(feature = "std")]
+            shared: self.shared,
         }
     }
 
@@ -427,4 +973,166 @@ impl<T: PhysicalMemory, Q: CacheValidator> CachedMemoryAccessBuilder<T, Q> {
         self.page_type_mask = page_type_mask;
         self
     }
+
+    /// Moves page table entries into a separate cache.
+    ///
+    /// The page table cache holds `cache_size` bytes of pages with the `PageType::PAGE_TABLE` type
+    /// and uses its own `validator`. Since page tables are no longer part of the regular cache
+    /// they can not be evicted by large data reads anymore and page walks keep being served from memory.
+    ///
+    /// Page tables usually make up a small fraction of the accessed memory, a few hundred kilobytes
+    /// are sufficient in most cases. A `cache_size` smaller than a single page disables the page table cache.
+    ///
+    /// In shared mode every clone still holds its own page table cache.
+    ///
+    /// By default the page table cache is disabled and page tables are held in the regular cache
+    /// in case the `page_type_mask` contains `PageType::PAGE_TABLE`.
+    ///
+    /// # Examples:
+    ///
+    /// ```
+    /// use std::time::Duration;
+    ///
+    /// use memflow::types::size;
+    /// use memflow::architecture::x86::x64;
+    /// use memflow::mem::{PhysicalMemory, CachedMemoryAccess, DefaultCacheValidator};
+    ///
+    /// fn build<T: PhysicalMemory>(mem: T) {
+    ///     let cache = CachedMemoryAccess::builder(mem)
+    ///         .arch(x64::ARCH)
+    ///         .cache_size(size::mb(2))
+    ///         .page_table_cache(
+    ///             size::kb(256),
+    ///             DefaultCacheValidator::new(Duration::from_millis(5000).into()),
+    ///         )
+    ///         .build()
+    ///         .unwrap();
+    /// }
+    /// # use memflow::mem::dummy::DummyMemory;
+    /// # let mut mem = DummyMemory::new(size::mb(4));
+    /// # build(mem);
+    /// ```
+    pub fn page_table_cache(mut self, cache_size: usize, validator: Q) -> Self {
+        self.page_table_cache = Some((cache_size, validator));
+        self
+    }
+
+    /// Enables sequential read-ahead.
+    ///
+    /// When a read continues exactly where the previous one ended the cache
+    /// prefetches the following `read_ahead` bytes in a single batch,
+    /// so that further sequential reads are served from warm pages.
+    /// Only pages matching the `page_type_mask` are prefetched.
+    ///
+    /// The window should be a fraction of the `cache_size`, otherwise prefetched pages evict each other.
+    ///
+    /// The default setting is 0 which disables read-ahead.
+    ///
+    /// # Examples:
+    ///
+    /// ```
+    /// use memflow::types::size;
+    /// use memflow::architecture::x86::x64;
+    /// use memflow::mem::{PhysicalMemory, CachedMemoryAccess};
+    ///
+    /// fn build<T: PhysicalMemory>(mem: T) {
+    ///     let cache = CachedMemoryAccess::builder(mem)
+    ///         .arch(x64::ARCH)
+    ///         .cache_size(size::mb(2))
+    ///         .read_ahead(size::kb(256))
+    ///         .build()
+    ///         .unwrap();
+    /// }
+    /// # use memflow::mem::dummy::DummyMemory;
+    /// # let mut mem = DummyMemory::new(size::mb(4));
+    /// # build(mem);
+    /// ```
+    pub fn read_ahead(mut self, read_ahead: usize) -> Self {
+        self.read_ahead = read_ahead;
+        self
+    }
+
+    /// Enables write combining.
+    ///
+    /// Writes are buffered instead of being passed through to the connector,
+    /// adjacent and overlapping writes are merged into a single write.
+    /// Cached pages are still updated in place right away.
+    ///
+    /// The buffer is written out once it holds `limit` bytes, when a page containing buffered data
+    /// is read or prefetched, when `commit()` or `destroy()` is called and when the cache is dropped.
+    ///
+    /// This is useful for connectors with expensive writes and workloads that issue
+    /// many small writes to neighbouring memory, like updating the fields of a structure.
+    ///
+    /// The default setting is 0 which disables write combining.
+    ///
+    /// # Examples:
+    ///
+    /// ```
+    /// use memflow::types::size;
+    /// use memflow::architecture::x86::x64;
+    /// use memflow::mem::{PhysicalMemory, CachedMemoryAccess};
+    ///
+    /// fn build<T: PhysicalMemory>(mem: T) {
+    ///     let mut cache = CachedMemoryAccess::builder(mem)
+    ///         .arch(x64::ARCH)
+    ///         .write_combining(size::kb(64))
+    ///         .build()
+    ///         .unwrap();
+    ///
+    ///     cache.phys_write(0x1000.into(), &1u32).unwrap();
+    ///     cache.phys_write(0x1004.into(), &2u32).unwrap();
+    ///
+    ///     // both values are written in a single write
+    ///     cache.commit().unwrap();
+    /// }
+    /// # use memflow::mem::dummy::DummyMemory;
+    /// # let mut mem = DummyMemory::new(size::mb(4));
+    /// # build(mem);
+    /// ```
+    pub fn write_combining(mut self, limit: usize) -> Self {
+        self.write_combining = limit;
+        self
+    }
+
+    /// Enables the shared cache mode.
+    ///
+    /// In shared mode all clones of the resulting cache reference a single sharded page store
+    /// instead of copying the cached pages on every clone.
+    /// This is useful when a cache (or a `Kernel` containing it) is cloned for multiple worker threads
+    /// so pages that have been read by one thread are available for all others.
+    ///
+    /// Reading from the shared store is lock-free. Each cached page carries its own timestamp
+    /// and stays valid for `valid_time`, the validator set via `validator()` is not used in this mode.
+    ///
+    /// This function is only available when being compiled with `std`.
+    ///
+    /// # Examples:
+    ///
+    /// ```
+    /// use std::time::Duration;
+    ///
+    /// use memflow::architecture::x86::x64;
+    /// use memflow::mem::{PhysicalMemory, CachedMemoryAccess};
+    ///
+    /// fn build<T: PhysicalMemory + Clone>(mem: T) {
+    ///     let cache = CachedMemoryAccess::builder(mem)
+    ///         .arch(x64::ARCH)
+    ///         .shared(Duration::from_millis(1000).into())
+    ///         .build()
+    ///         .unwrap();
+    ///
+    ///     // both caches read from and write to the same cached pages
+    ///     let _cloned_cache = cache.clone();
+    /// }
+    /// # use memflow::mem::dummy::DummyMemory;
+    /// # use memflow::types::size;
+    /// # let mut mem = DummyMemory::new(size::mb(4));
+    /// # build(mem);
+    /// ```
+    #[cfg(feature = "std")]
+    pub fn shared(mut self, valid_time: Duration) -> Self {
+        self.shared = Some(valid_time);
+        self
+    }
 }
@@ -4,6 +4,7 @@ use super::tlb_cache::TLBCache;
 use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::iter::{PageChunks, SplitAtIndex};
 use crate::mem::cache::{CacheValidator, DefaultCacheValidator};
+use crate::mem::stats::{StatsRecorder, TranslateStats, LATENCY_BUCKETS};
 use crate::mem::virt_translate::VirtualTranslate;
 use crate::mem::PhysicalMemory;
 use crate::types::{Address, PhysicalAddress};
@@ -93,6 +94,7 @@ pub struct CachedVirtualTranslate<V, Q> {
     arena: Bump,
     pub hitc: usize,
     pub misc: usize,
+    latency: StatsRecorder<[u64; LATENCY_BUCKETS]>,
 }
 
 impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslate<V, Q> {
@@ -104,8 +106,29 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslate<V, Q> {
             arena: Bump::new(),
             hitc: 0,
             misc: 0,
+            latency: StatsRecorder::default(),
         }
     }
+
+    /// Returns the statistics of this cache.
+    ///
+    /// Hits and misses are always counted, evictions and the latency of the page walks
+    /// are only recorded with the `stats` feature.
+    pub fn stats(&self) -> TranslateStats {
+        TranslateStats {
+            tlb_hits: self.hitc as u64,
+            tlb_misses: self.misc as u64,
+            tlb_evictions: self.tlb.evictions(),
+            latency_ns_histogram: self.latency.get(),
+        }
+    }
+
+    pub fn reset_stats(&mut self) {
+        self.hitc = 0;
+        self.misc = 0;
+        self.latency.reset();
+        self.tlb.reset_stats();
+    }
 }
 
 impl<V: VirtualTranslate> CachedVirtualTranslate<V, DefaultCacheValidator> {
@@ -125,6 +148,7 @@ impl<V: VirtualTranslate + Clone, Q: CacheValidator + Clone> Clone
             arena: Bump::new(),
             hitc: self.hitc,
             misc: self.misc,
+            latency: self.latency,
         }
     }
 }
@@ -191,6 +215,9 @@ impl<V: VirtualTranslate, Q: CacheValidator> VirtualTranslate for CachedVirtualT
             .peekable();
 
         if addrs.peek().is_some() {
+            #[cfg(all(feature = "stats", feature = "std"))]
+            let start = std::time::Instant::now();
+
             vat.virt_to_phys_iter(
                 phys_mem,
                 translator,
@@ -198,12 +225,25 @@ impl<V: VirtualTranslate, Q: CacheValidator> VirtualTranslate for CachedVirtualT
                 &mut uncached_out,
                 &mut uncached_out_fail,
             );
+
+            #[cfg(all(feature = "stats", feature = "std"))]
+            self.latency.record(|latency| {
+                crate::mem::stats::record_histogram(latency, start.elapsed().as_nanos() as u64)
+            });
         }
 
         let mut uncached_iter = uncached_in.into_iter().peekable();
 
         if uncached_iter.peek().is_some() {
+            #[cfg(all(feature = "stats", feature = "std"))]
+            let start = std::time::Instant::now();
+
             vat.virt_to_phys_iter(phys_mem, translator, uncached_iter, out, out_fail);
+
+            #[cfg(all(feature = "stats", feature = "std"))]
+            self.latency.record(|latency| {
+                crate::mem::stats::record_histogram(latency, start.elapsed().as_nanos() as u64)
+            });
         }
 
         out.extend(uncached_out.into_iter().map(|(paddr, (addr, buf))| {
@@ -225,6 +265,7 @@ pub struct CachedVirtualTranslateBuilder<V, Q> {
     vat: V,
     validator: Q,
     entries: Option<usize>,
+    ways: usize,
     arch: Option<ArchitectureObj>,
 }
 
@@ -234,6 +275,7 @@ impl<V: VirtualTranslate> CachedVirtualTranslateBuilder<V, DefaultCacheValidator
             vat,
             validator: DefaultCacheValidator::default(),
             entries: Some(2048),
+            ways: 1,
             arch: None,
         }
     }
@@ -243,8 +285,9 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslateBuilder<V, Q>
     pub fn build(self) -> Result<CachedVirtualTranslate<V, Q>> {
         Ok(CachedVirtualTranslate::new(
             self.vat,
-            TLBCache::new(
+            TLBCache::with_ways(
                 self.entries.ok_or("entries must be initialized")?,
+                self.ways,
                 self.validator,
             ),
             self.arch.ok_or("arch must be initialized")?,
@@ -259,6 +302,7 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslateBuilder<V, Q>
             vat: self.vat,
             validator,
             entries: self.entries,
+            ways: self.ways,
             arch: self.arch,
         }
     }
@@ -268,6 +312,33 @@ impl<V: VirtualTranslate, Q: CacheValidator> CachedVirtualTranslateBuilder<V, Q>
         self
     }
 
+    /// Sets the associativity of the translation cache.
+    ///
+    /// With more than one way entries are grouped into sets of `ways` entries,
+    /// a translation can be placed in any entry of its set which reduces conflicts
+    /// between addresses that map to the same set (e.g. equally aligned allocations in different processes).
+    /// Replacement within a set is done with a pseudo-LRU policy.
+    ///
+    /// The default setting is 1, which results in a direct-mapped cache.
+    ///
+    /// # Examples:
+    ///
+    /// ```
+    /// use memflow::architecture::x86::x64;
+    /// use memflow::mem::{CachedVirtualTranslate, DirectTranslate};
+    ///
+    /// let vat = CachedVirtualTranslate::builder(DirectTranslate::new())
+    ///     .arch(x64::ARCH)
+    ///     .entries(2048)
+    ///     .ways(4)
+    ///     .build()
+    ///     .unwrap();
+    /// ```
+    pub fn ways(mut self, ways: usize) -> Self {
+        self.ways = ways;
+        self
+    }
+
     pub fn arch(mut self, arch: ArchitectureObj) -> Self {
         self.arch = Some(arch);
         self
@@ -293,6 +364,18 @@ mod tests {
         impl VirtualMemory + Clone,
         Address,
         Address,
+    ) {
+        build_mem_with_ways(buf, 1)
+    }
+
+    fn build_mem_with_ways(
+        buf: &[u8],
+        ways: usize,
+    ) -> (
+        impl PhysicalMemory,
+        impl VirtualMemory + Clone,
+        Address,
+        Address,
     ) {
         let (mem, dtb, virt_base) =
             DummyMemory::new_and_dtb(buf.len() + size::mb(2), buf.len(), buf);
@@ -302,6 +385,7 @@ mod tests {
             .arch(x86::x64::ARCH)
             .validator(TimedCacheValidator::new(Duration::from_secs(100)))
             .entries(2048)
+            .ways(ways)
             .build()
             .unwrap();
         let vmem = VirtualDMA::with_vat(mem.clone(), x86::x64::ARCH, translator, vat);
@@ -353,4 +437,25 @@ mod tests {
             .unwrap();
         assert!(read_into == buffer);
     }
+
+    #[test]
+    fn valid_after_pt_destruction_associative() {
+        let buffer = standard_buffer(size::mb(2));
+        let (mut mem, mut vmem, virt_base, dtb) = build_mem_with_ways(&buffer, 4);
+
+        let mut read_into = vec![0; size::mb(2)];
+        vmem.virt_read_raw_into(virt_base, &mut read_into)
+            .data()
+            .unwrap();
+        assert!(read_into == buffer);
+
+        // Destroy the page tables
+        mem.phys_write_raw(dtb.into(), &vec![0; size::kb(4)])
+            .unwrap();
+
+        vmem.virt_read_raw_into(virt_base, &mut read_into)
+            .data()
+            .unwrap();
+        assert!(read_into == buffer);
+    }
 }
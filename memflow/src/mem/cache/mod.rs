@@ -7,17 +7,27 @@ pub mod timed_validator;
 pub mod count_validator;
 
 mod page_cache;
+pub mod page_tracker;
+#[cfg(feature = "std")]
+mod shared_page_cache;
 mod tlb_cache;
+mod write_combiner;
 
 #[doc(hidden)]
 pub use cached_memory_access::*;
 #[doc(hidden)]
 pub use cached_vat::*;
 
+#[doc(hidden)]
+pub use page_tracker::{DirtyRange, PageTracker};
+
 #[cfg(feature = "std")]
 #[doc(hidden)]
 pub use timed_validator::*;
 
+#[cfg(feature = "std")]
+pub use shared_page_cache::SharedPageCache;
+
 #[doc(hidden)]
 pub use count_validator::*;
 
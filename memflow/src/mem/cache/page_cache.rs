@@ -4,11 +4,18 @@ use super::{CacheValidator, PageType};
 use crate::architecture::ArchitectureObj;
 use crate::error::Result;
 use crate::iter::PageChunks;
-use crate::mem::phys_mem::{PhysicalMemory, PhysicalReadData, PhysicalReadIterator};
+use crate::mem::phys_mem::{
+    PhysicalMemory, PhysicalMemoryMetadata, PhysicalReadData, PhysicalReadIterator,
+};
+use crate::mem::stats::{PageCacheStats, StatsRecorder};
 use crate::types::{Address, PhysicalAddress};
 use bumpalo::{collections::Vec as BumpVec, Bump};
 use std::alloc::{alloc, alloc_zeroed, dealloc, Layout};
 
+/// Amount of queued entries after which the cache flushes its reads
+/// when the connector does not advertise a preferred batch size.
+const DEFAULT_BATCH_SIZE: usize = 64;
+
 pub enum PageValidity<'a> {
     Invalid,
     Validatable(&'a mut [u8]),
@@ -33,9 +40,11 @@ pub struct PageCache<'a, T> {
     address_once_validated: Box<[Address]>,
     page_size: usize,
     page_type_mask: PageType,
+    batch_size: usize,
     pub validator: T,
     cache_ptr: *mut u8,
     cache_layout: Layout,
+    stats: StatsRecorder<PageCacheStats>,
 }
 
 unsafe impl<'a, T> Send for PageCache<'a, T> {}
@@ -75,12 +84,19 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
             address_once_validated: vec![Address::INVALID; cache_entries].into_boxed_slice(),
             page_size,
             page_type_mask,
+            batch_size: DEFAULT_BATCH_SIZE,
             validator,
             cache_ptr,
             cache_layout: layout,
+            stats: StatsRecorder::default(),
         }
     }
 
+    /// Sizes the batches of cache misses from the metadata of the connector the cache is used with.
+    pub fn set_metadata(&mut self, metadata: &PhysicalMemoryMetadata) {
+        self.batch_size = metadata.batch_size(DEFAULT_BATCH_SIZE);
+    }
+
     fn page_index(&self, addr: Address) -> usize {
         (addr.as_page_aligned(self.page_size).as_usize() / self.page_size) % self.address.len()
     }
@@ -120,6 +136,15 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
         self.page_size
     }
 
+    /// Returns the statistics of this cache, they are only recorded with the `stats` feature.
+    pub fn stats(&self) -> PageCacheStats {
+        self.stats.get()
+    }
+
+    pub fn reset_stats(&mut self) {
+        self.stats.reset();
+    }
+
     pub fn is_cached_page_type(&self, page_type: PageType) -> bool {
         self.page_type_mask.contains(page_type)
     }
@@ -153,6 +178,7 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
         self.address[idx] = addr;
         self.address_once_validated[idx] = Address::INVALID;
         self.validator.validate_slot(idx);
+        self.stats.record_validation();
         self.put_page(addr, page_buf);
     }
 
@@ -178,6 +204,63 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
             })
     }
 
+    /// Fills the cache with all pages of the given ranges that are not cached yet.
+    ///
+    /// All pages are read in a single batch. The amount of pages is limited
+    /// by the size of the cache, pages that would evict a page read by the same call are skipped.
+    pub fn prefetch<F: PhysicalMemory>(
+        &mut self,
+        mem: &mut F,
+        data: &[(PhysicalAddress, usize)],
+        arena: &Bump,
+    ) -> Result<()> {
+        let page_size = self.page_size;
+        let mut wlistcache = BumpVec::new_in(arena);
+
+        for &(addr, len) in data.iter() {
+            if !self.is_cached_page_type(addr.page_type()) {
+                continue;
+            }
+
+            for (paddr, _) in len.page_chunks(addr.address(), page_size) {
+                if wlistcache.len() >= self.address.len() {
+                    break;
+                }
+
+                let cached_page = self.cached_page_mut(paddr, false);
+                match cached_page.validity {
+                    PageValidity::Validatable(buf) => {
+                        wlistcache.push(PhysicalReadData(
+                            PhysicalAddress::from(cached_page.address),
+                            buf,
+                        ));
+                        self.mark_page_for_validation(cached_page.address);
+                    }
+                    _ => self.put_entry(cached_page),
+                }
+            }
+        }
+
+        if wlistcache.is_empty() {
+            return Ok(());
+        }
+
+        let ret = mem.phys_read_raw_list(&mut wlistcache);
+
+        wlistcache
+            .into_iter()
+            .for_each(|PhysicalReadData(addr, buf)| {
+                if ret.is_ok() {
+                    self.validate_page(addr.address(), buf)
+                } else {
+                    // the page stays validatable and will be re-read on the next access
+                    self.put_page(addr.address(), buf)
+                }
+            });
+
+        ret
+    }
+
     pub fn cached_read<F: PhysicalMemory>(
         &mut self,
         mem: &mut F,
@@ -185,6 +268,7 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
         arena: &Bump,
     ) -> Result<()> {
         let page_size = self.page_size;
+        let batch_size = self.batch_size;
 
         let mut iter = data.iter_mut();
 
@@ -211,6 +295,7 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
 
                             match cached_page.validity {
                                 PageValidity::Valid(buf) => {
+                                    self.stats.record_hit();
                                     let aligned_addr = paddr.as_page_aligned(self.page_size);
                                     let start = paddr - aligned_addr;
                                     let cached_buf =
@@ -219,6 +304,7 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
                                     self.put_page(cached_page.address, buf);
                                 }
                                 PageValidity::Validatable(buf) => {
+                                    self.stats.record_miss();
                                     clist.push(prd);
                                     wlistcache.push(PhysicalReadData(
                                         PhysicalAddress::from(cached_page.address),
@@ -227,9 +313,11 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
                                     self.mark_page_for_validation(cached_page.address);
                                 }
                                 PageValidity::ToBeValidated => {
+                                    self.stats.record_miss();
                                     clist.push(prd);
                                 }
                                 PageValidity::Invalid => {
+                                    self.stats.record_miss();
                                     wlist.push(prd);
                                 }
                             }
@@ -241,9 +329,9 @@ impl<'a, T: CacheValidator> PageCache<'a, T> {
                 next = iter.next();
 
                 if next.is_none()
-                    || wlist.len() >= 64
-                    || wlistcache.len() >= 64
-                    || clist.len() >= 64
+                    || wlist.len() >= batch_size
+                    || wlistcache.len() >= batch_size
+                    || clist.len() >= batch_size
                 {
                     if !wlist.is_empty() {
                         mem.phys_read_raw_list(&mut wlist)?;
@@ -289,6 +377,7 @@ where
     fn clone(&self) -> Self {
         let page_size = self.page_size;
         let page_type_mask = self.page_type_mask;
+        let batch_size = self.batch_size;
         let validator = self.validator.clone();
 
         let cache_entries = self.address.len();
@@ -317,9 +406,11 @@ where
             address_once_validated: vec![Address::INVALID; cache_entries].into_boxed_slice(),
             page_size,
             page_type_mask,
+            batch_size,
             validator,
             cache_ptr,
             cache_layout: layout,
+            stats: StatsRecorder::default(),
         }
     }
 }
@@ -401,6 +492,76 @@ mod tests {
         assert_eq!(cloned_read_buf, cmp_buf);
     }
 
+    #[cfg(feature = "stats")]
+    #[test]
+    fn cache_stats() {
+        let mut mem = CachedMemoryAccess::builder(DummyMemory::new(size::mb(4)))
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::UNKNOWN)
+            .arch(x86::x64::ARCH)
+            .build()
+            .unwrap();
+
+        let mut buf = [0u8; 0x2000];
+        mem.phys_read_raw_into(0x800.into(), &mut buf).unwrap();
+        mem.phys_read_raw_into(0x800.into(), &mut buf).unwrap();
+
+        // the unaligned read touches 3 pages
+        let stats = mem.page_cache_stats();
+        assert_eq!(stats.misses, 3);
+        assert_eq!(stats.validations, 3);
+        assert_eq!(stats.hits, 3);
+
+        let connector = mem.connector_stats();
+        assert_eq!(connector.read_calls, 1);
+        assert_eq!(connector.read_bytes, 0x3000);
+
+        mem.reset_stats();
+        assert_eq!(mem.page_cache_stats(), Default::default());
+    }
+
+    #[test]
+    fn page_table_cache() {
+        let mut dummy_mem = DummyMemory::with_seed(size::mb(64), 0);
+
+        let virt_size = size::mb(8);
+        let test_buf = vec![0xa5u8; virt_size];
+        let (dtb, virt_base) = dummy_mem.alloc_dtb(virt_size, &test_buf);
+        let arch = x86::x64::ARCH;
+        let translator = x86::x64::new_translator(dtb);
+
+        // shares the underlying buffer with `dummy_mem`
+        let mut raw_mem = dummy_mem.clone();
+
+        let mut mem_cache = CachedMemoryAccess::builder(dummy_mem)
+            .arch(arch)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::PAGE_TABLE | PageType::READ_ONLY | PageType::WRITEABLE)
+            .cache_size(size::kb(64))
+            .page_table_cache(
+                size::mb(2),
+                TimedCacheValidator::new(Duration::from_secs(100)),
+            )
+            .build()
+            .unwrap();
+
+        let mut buf = vec![0u8; virt_size];
+        VirtualDMA::new(&mut mem_cache, arch, translator)
+            .virt_read_raw_into(virt_base, &mut buf)
+            .unwrap();
+        assert!(buf == test_buf);
+
+        // the data reads above exceed the regular cache by far,
+        // clearing the pml4 only goes unnoticed when it is still held by the page table cache
+        raw_mem
+            .phys_write_raw(dtb.into(), &[0u8; size::kb(4)])
+            .unwrap();
+
+        let mut virt_mem = VirtualDMA::new(&mut mem_cache, arch, translator);
+        let value: u64 = virt_mem.virt_read(virt_base + size::mb(4)).unwrap();
+        assert_eq!(value, 0xa5a5_a5a5_a5a5_a5a5);
+    }
+
     /// Test cached memory read both with a random seed and a predetermined one.
     ///
     /// The predetermined seed was found to be problematic when it comes to memory overlap
@@ -768,4 +929,184 @@ mod tests {
             .unwrap();
         assert_eq!(buf_2, buf_3);
     }
+
+    #[test]
+    fn prefetch_fills_cache() {
+        let mut dummy_mem = DummyMemory::new(size::mb(16));
+        let mem_ptr = &mut dummy_mem as *mut DummyMemory;
+
+        let prefetch_addr = Address::from(size::mb(1));
+        let read_addr = PhysicalAddress::from(prefetch_addr + size::kb(8));
+        let cmp_buf = [0xab_u8; 0x100];
+        dummy_mem.phys_write_raw(read_addr, &cmp_buf).unwrap();
+
+        let mut mem_cache = CachedMemoryAccess::builder(&mut dummy_mem)
+            .arch(x86::x64::ARCH)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::UNKNOWN)
+            .build()
+            .unwrap();
+
+        mem_cache
+            .phys_prefetch(prefetch_addr.into(), size::kb(16))
+            .unwrap();
+
+        // Modifying the memory from other channels should leave the prefetched page unchanged
+        unsafe { mem_ptr.as_mut().unwrap() }
+            .phys_write_raw(read_addr, &[0_u8; 0x100])
+            .unwrap();
+
+        let mut read_buf = [0_u8; 0x100];
+        mem_cache
+            .phys_read_raw_into(read_addr, &mut read_buf)
+            .unwrap();
+        assert_eq!(read_buf[..], cmp_buf[..]);
+    }
+
+    #[test]
+    fn read_ahead_sequential() {
+        let mut dummy_mem = DummyMemory::new(size::mb(16));
+        let mem_ptr = &mut dummy_mem as *mut DummyMemory;
+
+        let base = Address::from(size::mb(1));
+        let ahead_addr = PhysicalAddress::from(base + size::kb(12));
+        let cmp_buf = [0xcd_u8; 0x100];
+        dummy_mem.phys_write_raw(ahead_addr, &cmp_buf).unwrap();
+
+        let mut mem_cache = CachedMemoryAccess::builder(&mut dummy_mem)
+            .arch(x86::x64::ARCH)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::UNKNOWN)
+            .read_ahead(size::kb(64))
+            .build()
+            .unwrap();
+
+        let mut read_buf = [0_u8; 0x1000];
+        mem_cache
+            .phys_read_raw_into(base.into(), &mut read_buf)
+            .unwrap();
+        mem_cache
+            .phys_read_raw_into((base + size::kb(4)).into(), &mut read_buf)
+            .unwrap();
+
+        unsafe { mem_ptr.as_mut().unwrap() }
+            .phys_write_raw(ahead_addr, &[0_u8; 0x100])
+            .unwrap();
+
+        // The second read was sequential, so the following pages have to be cached already
+        let mut ahead_buf = [0_u8; 0x100];
+        mem_cache
+            .phys_read_raw_into(ahead_addr, &mut ahead_buf)
+            .unwrap();
+        assert_eq!(ahead_buf[..], cmp_buf[..]);
+    }
+
+    /// Fails reads that run past the end of the memory, unlike `DummyMemory` itself.
+    struct BoundedMemory {
+        mem: DummyMemory,
+    }
+
+    impl PhysicalMemory for BoundedMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            let size = self.mem.metadata().size;
+            if data
+                .iter()
+                .any(|PhysicalReadData(addr, buf)| addr.as_usize() + buf.len() > size)
+            {
+                return Err(crate::error::Error::Bounds);
+            }
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[crate::mem::PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> crate::mem::PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    #[test]
+    fn read_ahead_end_of_memory() {
+        let mut bounded_mem = BoundedMemory {
+            mem: DummyMemory::new(size::mb(1)),
+        };
+
+        let mut mem_cache = CachedMemoryAccess::builder(&mut bounded_mem)
+            .arch(x86::x64::ARCH)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::UNKNOWN)
+            .read_ahead(size::kb(64))
+            .build()
+            .unwrap();
+
+        // the second read is sequential, its read-ahead runs past the end of the memory
+        let mut read_buf = [0_u8; 0x1000];
+        mem_cache
+            .phys_read_raw_into(
+                Address::from(size::mb(1) - size::kb(8)).into(),
+                &mut read_buf,
+            )
+            .unwrap();
+        mem_cache
+            .phys_read_raw_into(
+                Address::from(size::mb(1) - size::kb(4)).into(),
+                &mut read_buf,
+            )
+            .unwrap();
+    }
+
+    struct BatchedMemory {
+        mem: DummyMemory,
+        preferred_batch_size: usize,
+        max_list_len: usize,
+    }
+
+    impl PhysicalMemory for BatchedMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            self.max_list_len = core::cmp::max(self.max_list_len, data.len());
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[crate::mem::PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> crate::mem::PhysicalMemoryMetadata {
+            crate::mem::PhysicalMemoryMetadata {
+                preferred_batch_size: self.preferred_batch_size,
+                ..self.mem.metadata()
+            }
+        }
+    }
+
+    #[test]
+    fn batch_size_from_metadata() {
+        let mut batched_mem = BatchedMemory {
+            mem: DummyMemory::new(size::mb(16)),
+            preferred_batch_size: 8,
+            max_list_len: 0,
+        };
+
+        let mut mem_cache = CachedMemoryAccess::builder(&mut batched_mem)
+            .arch(x86::x64::ARCH)
+            .validator(TimedCacheValidator::new(Duration::from_secs(100)))
+            .page_type_mask(PageType::UNKNOWN)
+            .build()
+            .unwrap();
+
+        let mut bufs = vec![[0_u8; 0x10]; 256];
+        let mut read_list = bufs
+            .iter_mut()
+            .enumerate()
+            .map(|(i, buf)| PhysicalReadData(Address::from(i * size::kb(4)).into(), &mut buf[..]))
+            .collect::<Vec<_>>();
+        mem_cache.phys_read_raw_list(&mut read_list).unwrap();
+
+        std::mem::drop(mem_cache);
+
+        assert!(batched_mem.max_list_len > 0);
+        assert!(batched_mem.max_list_len <= 8);
+    }
 }
@@ -0,0 +1,326 @@
+/*!
+Change detection for regions of virtual memory.
+
+The `PageTracker` keeps a compact hash for every block of the tracked pages instead of a copy
+of their contents. On every update the pages are reread in batches, hashed and compared against
+the previous state, only the pages that changed are handed back together with the byte ranges
+that differ (at the granularity of the configured block size).
+
+Since the tracker only holds hashes it can be layered on top of any `VirtualMemory` without
+duplicating the buffers of a `PageCache` that might sit below it. Keep in mind that a cache
+below the tracker delays the detection of changes until the cached page becomes invalid.
+
+# Examples
+
+```
+use memflow::mem::{PageTracker, VirtualMemory};
+use memflow::types::Address;
+
+fn poll<T: VirtualMemory>(virt_mem: &mut T, tracker: &mut PageTracker) {
+    tracker.update_with(virt_mem, |page, data, ranges| {
+        for range in ranges.iter() {
+            let offset = range.address - page;
+            println!("{:x} changed: {:?}", range.address, &data[offset..offset + range.size]);
+        }
+    });
+}
+# use memflow::mem::dummy::DummyMemory;
+# use memflow::types::size;
+# let (mut mem, virt_base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0u8; 0x2000]);
+# let mut tracker = PageTracker::new(&[(virt_base, 0x2000)]);
+# poll(&mut mem, &mut tracker);
+```
+*/
+
+use std::prelude::v1::*;
+
+use crate::mem::{VirtualMemory, VirtualReadData};
+use crate::types::{size, Address};
+
+use std::convert::TryInto;
+
+/// A range of bytes that changed since the previous update.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct DirtyRange {
+    pub address: Address,
+    pub size: usize,
+}
+
+#[derive(Debug, Clone, Copy)]
+struct TrackedPage {
+    address: Address,
+    // false until the page has been read successfully
+    known: bool,
+}
+
+/// Tracks changes in a set of virtual memory regions.
+#[derive(Debug, Clone)]
+pub struct PageTracker {
+    page_size: usize,
+    block_size: usize,
+    batch_size: usize,
+    pages: Vec<TrackedPage>,
+    hashes: Vec<u64>,
+    buf: Vec<u8>,
+}
+
+impl PageTracker {
+    /// Creates a tracker for all pages overlapping the given `(address, size)` regions.
+    ///
+    /// The first update reports every readable page as changed.
+    pub fn new(regions: &[(Address, usize)]) -> Self {
+        Self::with_page_size(size::kb(4), regions)
+    }
+
+    pub fn with_page_size(page_size: usize, regions: &[(Address, usize)]) -> Self {
+        let mut pages = regions
+            .iter()
+            .filter(|(_, size)| *size > 0)
+            .flat_map(|&(address, size)| {
+                let first = address.as_page_aligned(page_size);
+                let last = (address + (size - 1)).as_page_aligned(page_size);
+                (0..=(last - first) / page_size).map(move |i| first + i * page_size)
+            })
+            .collect::<Vec<_>>();
+        pages.sort_unstable();
+        pages.dedup();
+
+        let mut tracker = Self {
+            page_size,
+            block_size: 0,
+            batch_size: 64,
+            pages: pages
+                .into_iter()
+                .map(|address| TrackedPage {
+                    address,
+                    known: false,
+                })
+                .collect(),
+            hashes: Vec::new(),
+            buf: Vec::new(),
+        };
+        tracker.set_block_size(std::cmp::min(256, page_size));
+        tracker
+    }
+
+    /// Sets the granularity at which changed byte ranges are reported.
+    ///
+    /// The block size is clamped to a power of two between 8 bytes and the page size.
+    /// Every block occupies 8 bytes of hash storage. Changing the block size resets the tracker.
+    pub fn block_size(mut self, block_size: usize) -> Self {
+        self.set_block_size(block_size);
+        self
+    }
+
+    /// Sets the amount of pages that are reread in a single batch.
+    pub fn batch_size(mut self, batch_size: usize) -> Self {
+        self.batch_size = std::cmp::max(batch_size, 1);
+        self.buf = Vec::new();
+        self
+    }
+
+    fn set_block_size(&mut self, block_size: usize) {
+        self.block_size = std::cmp::min(
+            std::cmp::max(block_size, 8).next_power_of_two(),
+            self.page_size,
+        );
+        self.hashes = vec![0; self.pages.len() * self.blocks_per_page()];
+        self.reset();
+    }
+
+    /// Forgets the state of all pages, they will all be reported as changed on the next update.
+    pub fn reset(&mut self) {
+        self.pages.iter_mut().for_each(|p| p.known = false);
+    }
+
+    /// Amount of tracked pages.
+    pub fn len(&self) -> usize {
+        self.pages.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.pages.is_empty()
+    }
+
+    #[inline]
+    fn blocks_per_page(&self) -> usize {
+        self.page_size / self.block_size
+    }
+
+    /// Rereads all pages and pushes the changed byte ranges into `out`.
+    pub fn update<V: VirtualMemory + ?Sized, E: Extend<DirtyRange>>(
+        &mut self,
+        virt_mem: &mut V,
+        out: &mut E,
+    ) {
+        self.update_with(virt_mem, |_, _, ranges| out.extend(ranges.iter().copied()))
+    }
+
+    /// Rereads all pages and calls `f(page, data, ranges)` for every page that changed.
+    ///
+    /// `data` holds the current contents of the page, `ranges` the changed byte ranges in ascending order.
+    /// Pages that can not be read are skipped and reported completely once they are readable again.
+    pub fn update_with<V: VirtualMemory + ?Sized, F: FnMut(Address, &[u8], &[DirtyRange])>(
+        &mut self,
+        virt_mem: &mut V,
+        mut f: F,
+    ) {
+        let page_size = self.page_size;
+        let block_size = self.block_size;
+        let blocks_per_page = self.blocks_per_page();
+
+        self.buf.resize(self.batch_size * page_size, 0);
+        let mut status = vec![false; self.batch_size];
+        let mut ranges = Vec::new();
+
+        for (batch_idx, pages) in self.pages.chunks_mut(self.batch_size).enumerate() {
+            let mut read_list = pages
+                .iter()
+                .zip(self.buf.chunks_mut(page_size))
+                .map(|(page, buf)| VirtualReadData(page.address, buf))
+                .collect::<Vec<_>>();
+            if virt_mem
+                .virt_read_raw_list_status(&mut read_list, &mut status)
+                .is_err()
+            {
+                continue;
+            }
+            std::mem::drop(read_list);
+
+            let hashes = self.hashes[batch_idx * self.batch_size * blocks_per_page..]
+                .chunks_mut(blocks_per_page);
+            for (((page, data), hashes), ok) in pages
+                .iter_mut()
+                .zip(self.buf.chunks(page_size))
+                .zip(hashes)
+                .zip(status.iter())
+            {
+                if !*ok {
+                    continue;
+                }
+
+                ranges.clear();
+                for (idx, (block, hash)) in data
+                    .chunks_exact(block_size)
+                    .zip(hashes.iter_mut())
+                    .enumerate()
+                {
+                    let new_hash = hash_block(block);
+                    if !page.known || *hash != new_hash {
+                        *hash = new_hash;
+                        let address = page.address + idx * block_size;
+                        match ranges.last_mut() {
+                            Some(DirtyRange {
+                                address: prev,
+                                size,
+                            }) if *prev + *size == address => *size += block_size,
+                            _ => ranges.push(DirtyRange {
+                                address,
+                                size: block_size,
+                            }),
+                        }
+                    }
+                }
+                page.known = true;
+
+                if !ranges.is_empty() {
+                    f(page.address, data, &ranges);
+                }
+            }
+        }
+    }
+}
+
+/// Hashes a block of memory whose size is a multiple of 8 bytes.
+///
+/// Every step of the word loop is a bijection of both the state and the word,
+/// therefore changing a single word in a block always changes the hash.
+#[inline]
+fn hash_block(data: &[u8]) -> u64 {
+    const K: u64 = 0x9e37_79b9_7f4a_7c15;
+
+    let mut h = K ^ data.len() as u64;
+    for word in data.chunks_exact(8) {
+        let w = u64::from_le_bytes(word.try_into().unwrap());
+        h = (h.rotate_left(5) ^ w).wrapping_mul(K);
+    }
+
+    // final avalanche
+    h ^= h >> 33;
+    h = h.wrapping_mul(0xff51_afd7_ed55_8ccd);
+    h ^ (h >> 33)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+
+    #[test]
+    fn tracker_reports_changes() {
+        let (mut mem, virt_base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[0u8; 0x4000]);
+
+        let mut tracker = PageTracker::new(&[(virt_base + 0x10, 0x2000)])
+            .block_size(64)
+            .batch_size(2);
+        assert_eq!(tracker.len(), 3);
+
+        let mut dirty = Vec::new();
+        tracker.update(&mut mem, &mut dirty);
+        assert_eq!(
+            dirty,
+            (0..3)
+                .map(|i| DirtyRange {
+                    address: virt_base + i * 0x1000,
+                    size: 0x1000
+                })
+                .collect::<Vec<_>>()
+        );
+
+        dirty.clear();
+        tracker.update(&mut mem, &mut dirty);
+        assert!(dirty.is_empty());
+
+        mem.virt_write_raw(virt_base + 0x1040, &[1; 0x50]).unwrap();
+        mem.virt_write_raw(virt_base + 0x2200, &[1]).unwrap();
+
+        let mut pages = Vec::new();
+        tracker.update_with(&mut mem, |page, data, ranges| {
+            if page == virt_base + 0x1000 {
+                assert_eq!(data[0x40..0x90], [1; 0x50][..]);
+            }
+            pages.push((page, ranges.to_vec()));
+        });
+        assert_eq!(
+            pages,
+            vec![
+                (
+                    virt_base + 0x1000,
+                    vec![DirtyRange {
+                        address: virt_base + 0x1040,
+                        size: 0x80
+                    }]
+                ),
+                (
+                    virt_base + 0x2000,
+                    vec![DirtyRange {
+                        address: virt_base + 0x2200,
+                        size: 0x40
+                    }]
+                ),
+            ]
+        );
+    }
+
+    #[test]
+    fn hash_single_word_change() {
+        let mut block = [0u8; 256];
+        let base = hash_block(&block);
+        for i in 0..block.len() {
+            block[i] = 1;
+            assert_ne!(hash_block(&block), base);
+            block[i] = 0;
+        }
+    }
+}
@@ -0,0 +1,653 @@
+/*!
+A page cache that can be shared between multiple `CachedMemoryAccess` objects.
+
+Unlike the regular `PageCache` which is owned by a single cache instance and deep-copied on clone,
+the `SharedPageCache` is reference counted and all clones of a `CachedMemoryAccess`
+built in shared mode reference the same page store.
+
+The store is split into multiple independently allocated shards.
+Every slot inside of a shard is guarded by a sequence counter (seqlock),
+readers never block and simply fall back to reading from the underlying memory
+if a slot is currently being written to by another thread.
+The page contents are only ever accessed via atomic word sized loads and stores
+so readers racing with a writer observe a torn page at worst, which is then
+detected and discarded by re-checking the sequence counter.
+
+The sequence counter also serves as the generation of a slot. Pages that are read
+from the underlying memory are only put into the cache if the generation of their slot
+did not change in the meantime, a write that lands during the read therefore can not
+be overwritten by the outdated page contents.
+
+Validation is based on timestamps that are stored along each slot in the shard
+and compared against the shared cache time.
+*/
+
+use std::prelude::v1::*;
+
+use super::PageType;
+use crate::error::Result;
+use crate::iter::PageChunks;
+use crate::mem::phys_mem::{PhysicalMemory, PhysicalReadData, PhysicalWriteData};
+use crate::mem::stats::{PageCacheStats, StatsRecorder};
+use crate::types::{Address, PhysicalAddress};
+
+use bumpalo::{collections::Vec as BumpVec, Bump};
+use coarsetime::{Duration, Instant};
+use std::alloc::{alloc_zeroed, dealloc, handle_alloc_error, Layout};
+use std::sync::atomic::{fence, AtomicU64, AtomicUsize, Ordering};
+
+/// The default amount of shards a `SharedPageCache` is split into.
+pub const DEFAULT_SHARD_COUNT: usize = 16;
+
+const WORD_SIZE: usize = std::mem::size_of::<usize>();
+
+struct SharedSlot {
+    seq: AtomicUsize,
+    address: AtomicU64,
+    time: AtomicU64,
+}
+
+impl SharedSlot {
+    fn new() -> Self {
+        Self {
+            seq: AtomicUsize::new(0),
+            address: AtomicU64::new(Address::INVALID.as_u64()),
+            time: AtomicU64::new(0),
+        }
+    }
+
+    /// Tries to take exclusive write access to this slot.
+    ///
+    /// Returns the sequence number that has to be passed to `unlock` or `None`
+    /// in case another thread is currently writing to the slot.
+    #[inline]
+    fn try_lock(&self) -> Option<usize> {
+        self.try_lock_at(self.seq.load(Ordering::Relaxed))
+    }
+
+    /// Tries to take exclusive write access to this slot if it is still at the given generation.
+    ///
+    /// Fails if the slot has been locked (and therefore modified) since `seq` was read.
+    #[inline]
+    fn try_lock_at(&self, seq: usize) -> Option<usize> {
+        if seq & 1 != 0 {
+            return None;
+        }
+        self.seq
+            .compare_exchange(seq, seq + 1, Ordering::Acquire, Ordering::Relaxed)
+            .ok()?;
+        fence(Ordering::Release);
+        Some(seq)
+    }
+
+    /// Returns the current generation of this slot.
+    #[inline]
+    fn generation(&self) -> usize {
+        self.seq.load(Ordering::Acquire)
+    }
+
+    #[inline]
+    fn unlock(&self, seq: usize) {
+        self.seq.store(seq + 2, Ordering::Release);
+    }
+}
+
+struct SharedShard {
+    slots: Box<[SharedSlot]>,
+    buf_ptr: *mut u8,
+    buf_layout: Layout,
+}
+
+impl SharedShard {
+    fn new(slot_count: usize, page_size: usize) -> Self {
+        let buf_layout = Layout::from_size_align(slot_count * page_size, page_size).unwrap();
+        let buf_ptr = unsafe { alloc_zeroed(buf_layout) };
+        if buf_ptr.is_null() {
+            handle_alloc_error(buf_layout);
+        }
+
+        Self {
+            slots: (0..slot_count)
+                .map(|_| SharedSlot::new())
+                .collect::<Vec<_>>()
+                .into_boxed_slice(),
+            buf_ptr,
+            buf_layout,
+        }
+    }
+
+    /// Returns the words of the page in the given slot.
+    #[inline]
+    fn page(&self, idx: usize, page_size: usize) -> &[AtomicUsize] {
+        // the buffer is aligned to the page size and never handed out as anything but atomics
+        unsafe {
+            std::slice::from_raw_parts(
+                self.buf_ptr.add(idx * page_size) as *const AtomicUsize,
+                page_size / WORD_SIZE,
+            )
+        }
+    }
+}
+
+impl Drop for SharedShard {
+    fn drop(&mut self) {
+        unsafe {
+            dealloc(self.buf_ptr, self.buf_layout);
+        }
+    }
+}
+
+/// Copies `out.len()` bytes starting at byte `offset` of `words` into `out`.
+fn load_bytes(words: &[AtomicUsize], offset: usize, out: &mut [u8]) {
+    let mut pos = 0;
+    while pos < out.len() {
+        let start = (offset + pos) % WORD_SIZE;
+        let len = std::cmp::min(WORD_SIZE - start, out.len() - pos);
+        let word = words[(offset + pos) / WORD_SIZE]
+            .load(Ordering::Relaxed)
+            .to_ne_bytes();
+        out[pos..(pos + len)].copy_from_slice(&word[start..(start + len)]);
+        pos += len;
+    }
+}
+
+/// Copies `data` into `words` starting at byte `offset`.
+///
+/// Partially overwritten words are read back first, which requires the slot to be locked.
+fn store_bytes(words: &[AtomicUsize], offset: usize, data: &[u8]) {
+    let mut pos = 0;
+    while pos < data.len() {
+        let start = (offset + pos) % WORD_SIZE;
+        let len = std::cmp::min(WORD_SIZE - start, data.len() - pos);
+        let word = &words[(offset + pos) / WORD_SIZE];
+        let mut bytes = if len == WORD_SIZE {
+            [0u8; WORD_SIZE]
+        } else {
+            word.load(Ordering::Relaxed).to_ne_bytes()
+        };
+        bytes[start..(start + len)].copy_from_slice(&data[pos..(pos + len)]);
+        word.store(usize::from_ne_bytes(bytes), Ordering::Relaxed);
+        pos += len;
+    }
+}
+
+/// A sharded page store which can be accessed concurrently from multiple threads.
+///
+/// This cache is usually not constructed directly but via the `shared()` function of the
+/// [`CachedMemoryAccessBuilder`](struct.CachedMemoryAccessBuilder.html).
+pub struct SharedPageCache {
+    shards: Box<[SharedShard]>,
+    slots_per_shard: usize,
+    page_size: usize,
+    page_type_mask: PageType,
+    base_time: Instant,
+    valid_time: u64,
+}
+
+unsafe impl Send for SharedPageCache {}
+unsafe impl Sync for SharedPageCache {}
+
+impl SharedPageCache {
+    /// Constructs a new `SharedPageCache`.
+    ///
+    /// `size` is the total size of the cache in bytes which is split evenly across `shard_count` shards.
+    /// Pages stay valid for `valid_time` after they have been read.
+    pub fn new(
+        page_size: usize,
+        size: usize,
+        page_type_mask: PageType,
+        valid_time: Duration,
+        shard_count: usize,
+    ) -> Self {
+        assert!(
+            page_size % WORD_SIZE == 0,
+            "the page size has to be a multiple of the word size"
+        );
+        let shard_count = std::cmp::max(shard_count, 1);
+        let slots_per_shard = std::cmp::max(size / page_size / shard_count, 1);
+
+        Self {
+            shards: (0..shard_count)
+                .map(|_| SharedShard::new(slots_per_shard, page_size))
+                .collect::<Vec<_>>()
+                .into_boxed_slice(),
+            slots_per_shard,
+            page_size,
+            page_type_mask,
+            base_time: Instant::now(),
+            valid_time: valid_time.as_millis(),
+        }
+    }
+
+    pub fn page_size(&self) -> usize {
+        self.page_size
+    }
+
+    pub fn is_cached_page_type(&self, page_type: PageType) -> bool {
+        self.page_type_mask.contains(page_type)
+    }
+
+    /// Returns the current timestamp relative to the creation of the cache.
+    #[inline]
+    fn now(&self) -> u64 {
+        Instant::now().duration_since(self.base_time).as_millis()
+    }
+
+    /// Neighbouring pages are spread across different shards.
+    #[inline]
+    fn slot(&self, aligned_addr: Address) -> (&SharedShard, usize) {
+        let page_num = aligned_addr.as_usize() / self.page_size;
+        let shard = &self.shards[page_num % self.shards.len()];
+        (shard, (page_num / self.shards.len()) % self.slots_per_shard)
+    }
+
+    /// Returns true if the page is cached and still valid.
+    #[inline]
+    fn is_page_cached(&self, aligned_addr: Address, now: u64) -> bool {
+        let (shard, idx) = self.slot(aligned_addr);
+        let slot = &shard.slots[idx];
+
+        slot.address.load(Ordering::Relaxed) == aligned_addr.as_u64()
+            && now.saturating_sub(slot.time.load(Ordering::Relaxed)) <= self.valid_time
+    }
+
+    /// Copies the cached contents at `addr` into `out` without taking any locks.
+    ///
+    /// `out` must not cross a page boundary.
+    /// Returns false if the page is not cached, expired or currently being modified,
+    /// in which case the contents of `out` are undefined.
+    fn try_read(&self, addr: Address, out: &mut [u8], now: u64) -> bool {
+        let aligned_addr = addr.as_page_aligned(self.page_size);
+        let (shard, idx) = self.slot(aligned_addr);
+        let slot = &shard.slots[idx];
+
+        let seq = slot.seq.load(Ordering::Acquire);
+        if seq & 1 != 0
+            || slot.address.load(Ordering::Relaxed) != aligned_addr.as_u64()
+            || now.saturating_sub(slot.time.load(Ordering::Relaxed)) > self.valid_time
+        {
+            return false;
+        }
+
+        load_bytes(shard.page(idx, self.page_size), addr - aligned_addr, out);
+
+        // the contents have to be loaded before the sequence counter is re-checked
+        fence(Ordering::Acquire);
+        slot.seq.load(Ordering::Relaxed) == seq
+    }
+
+    /// Returns the generation of the slot the page at `aligned_addr` is stored in.
+    ///
+    /// The generation has to be taken before the page is read from the underlying memory.
+    #[inline]
+    fn generation(&self, aligned_addr: Address) -> usize {
+        let (shard, idx) = self.slot(aligned_addr);
+        shard.slots[idx].generation()
+    }
+
+    /// Stores a full page in the cache.
+    ///
+    /// If the slot has been modified since `generation` was taken or is currently written to
+    /// by another thread the page is silently dropped. Returns true if the page was stored.
+    fn store(&self, aligned_addr: Address, page: &[u8], generation: usize, now: u64) -> bool {
+        let (shard, idx) = self.slot(aligned_addr);
+        let slot = &shard.slots[idx];
+
+        if let Some(seq) = slot.try_lock_at(generation) {
+            store_bytes(shard.page(idx, self.page_size), 0, page);
+            slot.address.store(aligned_addr.as_u64(), Ordering::Relaxed);
+            slot.time.store(now, Ordering::Relaxed);
+            slot.unlock(seq);
+            true
+        } else {
+            false
+        }
+    }
+
+    /// Updates the still valid cache pages with the given write.
+    ///
+    /// This function has to be called after the write reached the underlying memory.
+    /// Every touched slot is locked and therefore moves to a new generation,
+    /// so pages that were read before the write landed are not put into the cache anymore.
+    pub fn cached_write(&self, data: &[PhysicalWriteData]) {
+        // the write to the underlying memory has to be visible before the generations change
+        fence(Ordering::SeqCst);
+
+        for PhysicalWriteData(addr, data) in data.iter() {
+            if !self.is_cached_page_type(addr.page_type()) {
+                continue;
+            }
+
+            for (paddr, data_chunk) in data.page_chunks(addr.address(), self.page_size) {
+                let aligned_addr = paddr.as_page_aligned(self.page_size);
+                let (shard, idx) = self.slot(aligned_addr);
+                let slot = &shard.slots[idx];
+
+                // the address is only checked while the slot is locked, a concurrent store
+                // might be refilling the slot with the page that is written to.
+                loop {
+                    if let Some(seq) = slot.try_lock() {
+                        if slot.address.load(Ordering::Relaxed) == aligned_addr.as_u64() {
+                            // write-back into the cached page
+                            store_bytes(
+                                shard.page(idx, self.page_size),
+                                paddr - aligned_addr,
+                                data_chunk,
+                            );
+                        }
+                        slot.unlock(seq);
+                        break;
+                    }
+                    // another thread is storing into this slot, we have to wait for it
+                    // to finish as it might be storing the page we are writing to.
+                    std::hint::spin_loop();
+                }
+            }
+        }
+    }
+
+    /// Fills the cache with all pages of the given ranges that are not cached yet.
+    ///
+    /// All pages are read in a single batch. The amount of pages is limited by the size of the cache.
+    pub(crate) fn prefetch<F: PhysicalMemory>(
+        &self,
+        mem: &mut F,
+        data: &[(PhysicalAddress, usize)],
+        arena: &Bump,
+        stats: &mut StatsRecorder<PageCacheStats>,
+    ) -> Result<()> {
+        let page_size = self.page_size;
+        let now = self.now();
+        let capacity = self.shards.len() * self.slots_per_shard;
+
+        let mut wlist = BumpVec::new_in(arena);
+        let mut generations = BumpVec::new_in(arena);
+
+        for &(addr, len) in data.iter() {
+            if !self.is_cached_page_type(addr.page_type()) {
+                continue;
+            }
+
+            for (paddr, _) in len.page_chunks(addr.address(), page_size) {
+                if wlist.len() >= capacity {
+                    break;
+                }
+
+                let aligned_addr = paddr.as_page_aligned(page_size);
+                if !self.is_page_cached(aligned_addr, now) {
+                    generations.push(self.generation(aligned_addr));
+                    wlist.push(PhysicalReadData(
+                        PhysicalAddress::with_page(
+                            aligned_addr,
+                            addr.page_type(),
+                            addr.page_size(),
+                        ),
+                        arena.alloc_slice_fill_copy(page_size, 0u8),
+                    ));
+                }
+            }
+        }
+
+        if wlist.is_empty() {
+            return Ok(());
+        }
+
+        mem.phys_read_raw_list(&mut wlist)?;
+
+        for (PhysicalReadData(page_addr, buf), generation) in wlist.iter().zip(generations) {
+            if self.store(page_addr.address(), buf, generation, now) {
+                stats.record_validation();
+            }
+        }
+
+        Ok(())
+    }
+
+    /// Reads the given list with the help of the cache.
+    ///
+    /// All cache misses are issued as a single read to `mem`.
+    /// Cached pages that were missed are read in full and put into the cache afterwards.
+    ///
+    /// Hits, misses and validations are recorded in `stats`.
+    pub(crate) fn cached_read<F: PhysicalMemory>(
+        &self,
+        mem: &mut F,
+        data: &mut [PhysicalReadData],
+        arena: &Bump,
+        stats: &mut StatsRecorder<PageCacheStats>,
+    ) -> Result<()> {
+        let page_size = self.page_size;
+        let now = self.now();
+
+        let mut wlist = BumpVec::new_in(arena);
+        let mut misses = BumpVec::new_in(arena);
+
+        for PhysicalReadData(addr, out) in data.iter_mut() {
+            if self.is_cached_page_type(addr.page_type()) {
+                for (paddr, chunk) in out.page_chunks(addr.address(), page_size) {
+                    if self.try_read(paddr, chunk, now) {
+                        stats.record_hit();
+                    } else {
+                        stats.record_miss();
+                        misses.push((paddr.as_page_aligned(page_size), *addr, paddr, chunk));
+                    }
+                }
+            } else {
+                wlist.push(PhysicalReadData(*addr, out));
+            }
+        }
+
+        if misses.is_empty() {
+            return if wlist.is_empty() {
+                Ok(())
+            } else {
+                mem.phys_read_raw_list(&mut wlist)
+            };
+        }
+
+        // read every missed page exactly once
+        misses.sort_by_key(|(aligned_addr, _, _, _)| *aligned_addr);
+
+        let page_start = wlist.len();
+        let mut generations = BumpVec::new_in(arena);
+        let mut last_page = Address::INVALID;
+        for (aligned_addr, addr, _, _) in misses.iter() {
+            if *aligned_addr != last_page {
+                last_page = *aligned_addr;
+                generations.push(self.generation(*aligned_addr));
+                wlist.push(PhysicalReadData(
+                    PhysicalAddress::with_page(*aligned_addr, addr.page_type(), addr.page_size()),
+                    arena.alloc_slice_fill_copy(page_size, 0u8),
+                ));
+            }
+        }
+
+        mem.phys_read_raw_list(&mut wlist)?;
+
+        let mut pages = wlist[page_start..].iter();
+        let mut page = pages.next();
+        for (aligned_addr, _, paddr, chunk) in misses.into_iter() {
+            while let Some(PhysicalReadData(page_addr, _)) = page {
+                if page_addr.address() == aligned_addr {
+                    break;
+                }
+                page = pages.next();
+            }
+
+            if let Some(PhysicalReadData(_, buf)) = page {
+                let start = paddr - aligned_addr;
+                chunk.copy_from_slice(&buf[start..(start + chunk.len())]);
+            }
+        }
+
+        for (PhysicalReadData(page_addr, buf), generation) in
+            wlist[page_start..].iter().zip(generations)
+        {
+            if self.store(page_addr.address(), buf, generation, now) {
+                stats.record_validation();
+            }
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86;
+    use crate::mem::{dummy::DummyMemory, CachedMemoryAccess};
+    use crate::types::size;
+
+    use std::sync::Arc;
+    use std::thread;
+
+    #[test]
+    fn shared_between_clones() {
+        let mut mem = DummyMemory::with_seed(size::mb(32), 0);
+
+        let cmp_buf = [143u8; 16];
+        let write_addr = 0x1000.into();
+        mem.phys_write_raw(write_addr, &cmp_buf).unwrap();
+
+        let mut mem = CachedMemoryAccess::builder(mem)
+            .arch(x86::x64::ARCH)
+            .page_type_mask(PageType::UNKNOWN)
+            .shared(Duration::from_secs(100))
+            .build()
+            .unwrap();
+
+        let mut read_buf = [0u8; 16];
+        mem.phys_read_raw_into(write_addr, &mut read_buf).unwrap();
+        assert_eq!(read_buf, cmp_buf);
+
+        let mut cloned_mem = mem.clone();
+
+        // writes through one clone are visible through the other clone
+        let new_buf = [27u8; 16];
+        mem.phys_write_raw(write_addr, &new_buf).unwrap();
+
+        let mut cloned_read_buf = [0u8; 16];
+        cloned_mem
+            .phys_read_raw_into(write_addr, &mut cloned_read_buf)
+            .unwrap();
+        assert_eq!(cloned_read_buf, new_buf);
+    }
+
+    #[test]
+    fn unaligned_word_copies() {
+        let words = (0..4).map(|_| AtomicUsize::new(0)).collect::<Vec<_>>();
+
+        let data = (1..=(WORD_SIZE * 2 + 3) as u8).collect::<Vec<_>>();
+        store_bytes(&words, 3, &data);
+
+        let mut out = vec![0u8; WORD_SIZE * 4];
+        load_bytes(&words, 0, &mut out);
+        assert_eq!(&out[..3], &[0, 0, 0]);
+        assert_eq!(&out[3..(3 + data.len())], &data[..]);
+        assert!(out[(3 + data.len())..].iter().all(|&b| b == 0));
+
+        let mut out = vec![0u8; data.len()];
+        load_bytes(&words, 3, &mut out);
+        assert_eq!(out, data);
+    }
+
+    #[test]
+    fn stale_fill_is_dropped() {
+        let cache = SharedPageCache::new(
+            size::kb(4),
+            size::kb(64),
+            PageType::UNKNOWN,
+            Duration::from_secs(100),
+            4,
+        );
+        let page_addr = Address::from(0x1000);
+        let now = cache.now();
+
+        // a write lands while the page is being read from the memory
+        let generation = cache.generation(page_addr);
+        cache.cached_write(&[PhysicalWriteData(
+            PhysicalAddress::from(page_addr),
+            &[1u8; 8],
+        )]);
+        assert!(!cache.store(page_addr, &[0u8; 0x1000], generation, now));
+        assert!(!cache.is_page_cached(page_addr, now));
+
+        let generation = cache.generation(page_addr);
+        assert!(cache.store(page_addr, &[2u8; 0x1000], generation, now));
+
+        let mut buf = [0u8; 8];
+        assert!(cache.try_read(page_addr + 0x10, &mut buf, now));
+        assert_eq!(buf, [2u8; 8]);
+    }
+
+    #[cfg(feature = "stats")]
+    #[test]
+    fn shared_cache_stats() {
+        let mut mem = CachedMemoryAccess::builder(DummyMemory::new(size::mb(4)))
+            .arch(x86::x64::ARCH)
+            .page_type_mask(PageType::UNKNOWN)
+            .shared(Duration::from_secs(100))
+            .build()
+            .unwrap();
+
+        let mut buf = [0u8; 0x2000];
+        mem.phys_read_raw_into(0x800.into(), &mut buf).unwrap();
+
+        // the clone is served by the pages the first read put into the cache
+        let mut cloned_mem = mem.clone();
+        cloned_mem
+            .phys_read_raw_into(0x800.into(), &mut buf)
+            .unwrap();
+
+        let stats = mem.page_cache_stats();
+        assert_eq!(stats.misses, 3);
+        assert_eq!(stats.validations, 3);
+        assert_eq!(stats.hits, 0);
+
+        let stats = cloned_mem.page_cache_stats();
+        assert_eq!(stats.misses, 0);
+        assert_eq!(stats.hits, 3);
+
+        mem.reset_stats();
+        assert_eq!(mem.page_cache_stats(), Default::default());
+    }
+
+    #[test]
+    fn parallel_reads() {
+        let mut mem = DummyMemory::with_seed(size::mb(32), 1);
+
+        let mut cmp_buf = vec![0u8; size::kb(64)];
+        for (i, v) in cmp_buf.iter_mut().enumerate() {
+            *v = i as u8;
+        }
+        mem.phys_write_raw(0.into(), &cmp_buf).unwrap();
+
+        let mem = CachedMemoryAccess::builder(mem)
+            .arch(x86::x64::ARCH)
+            .page_type_mask(PageType::UNKNOWN)
+            .cache_size(size::kb(32))
+            .shared(Duration::from_secs(100))
+            .build()
+            .unwrap();
+
+        let cmp_buf = Arc::new(cmp_buf);
+
+        (0..4)
+            .map(|i| {
+                let mut mem = mem.clone();
+                let cmp_buf = cmp_buf.clone();
+                thread::spawn(move || {
+                    for j in 0..64 {
+                        let off = ((i * 64 + j) * 333) % (cmp_buf.len() - 0x100);
+                        let mut read_buf = [0u8; 0x100];
+                        mem.phys_read_raw_into(off.into(), &mut read_buf).unwrap();
+                        assert_eq!(read_buf[..], cmp_buf[off..(off + 0x100)]);
+                    }
+                })
+            })
+            .collect::<Vec<_>>()
+            .into_iter()
+            .for_each(|t| t.join().unwrap());
+    }
+}
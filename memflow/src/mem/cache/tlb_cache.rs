@@ -3,8 +3,11 @@ use std::prelude::v1::*;
 use super::CacheValidator;
 use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::error::{Error, Result};
+use crate::mem::stats::StatsRecorder;
 use crate::types::{Address, PhysicalAddress};
 
+use std::cell::Cell;
+
 #[derive(Clone, Copy)]
 pub struct TLBEntry {
     pub pt_index: usize,
@@ -37,30 +40,132 @@ impl CachedEntry {
     };
 }
 
+/// The amount of entries reserved for translations of large pages.
+pub const LARGE_PAGE_ENTRIES: usize = 16;
+
+/// Translation cache with a N-way set-associative layout.
+///
+/// The entries of a single set are stored next to each other,
+/// with a single way this is equal to a direct-mapped cache.
+/// When all ways of a set are occupied the victim is chosen by a bit based pseudo-LRU.
+///
+/// Translations of large pages (e.g. 2M or 1G pages on x64) are not split up into
+/// regular sized pages but kept in a separate, fully associative array of `LARGE_PAGE_ENTRIES` entries
+/// where a single entry covers the entire large page.
 #[derive(Clone)]
 pub struct TLBCache<T> {
+    // sets of regular page entries followed by the large page entries
     entries: Box<[CachedEntry]>,
+    ways: usize,
+    large_start: usize,
+    // one bit per way, set for recently used entries. The last one belongs to the large pages.
+    lru: Box<[Cell<u64>]>,
     pub validator: T,
+    evictions: StatsRecorder<u64>,
 }
 
 impl<T: CacheValidator> TLBCache<T> {
-    pub fn new(size: usize, mut validator: T) -> Self {
-        validator.allocate_slots(size);
+    pub fn new(size: usize, validator: T) -> Self {
+        Self::with_ways(size, 1, validator)
+    }
+
+    /// Creates a new cache with `size` entries split into sets of `ways` entries.
+    ///
+    /// `ways` is clamped between 1 and 64 and `size` is rounded down to a multiple of it.
+    pub fn with_ways(size: usize, ways: usize, mut validator: T) -> Self {
+        let ways = core::cmp::min(core::cmp::max(ways, 1), 64);
+        let sets = core::cmp::max(size / ways, 1);
+        let size = sets * ways;
+
+        validator.allocate_slots(size + LARGE_PAGE_ENTRIES);
 
         Self {
-            entries: vec![CachedEntry::INVALID; size].into_boxed_slice(),
+            entries: vec![CachedEntry::INVALID; size + LARGE_PAGE_ENTRIES].into_boxed_slice(),
+            ways,
+            large_start: size,
+            lru: vec![Cell::new(0); sets + 1].into_boxed_slice(),
             validator,
+            evictions: StatsRecorder::default(),
         }
     }
 
+    /// Returns the amount of valid entries that were replaced by another translation.
+    ///
+    /// Evictions are only counted with the `stats` feature.
+    pub fn evictions(&self) -> u64 {
+        self.evictions.get()
+    }
+
+    pub fn reset_stats(&mut self) {
+        self.evictions.reset();
+    }
+
+    #[inline(always)]
+    fn record_eviction(&mut self, _idx: usize) {
+        #[cfg(feature = "stats")]
+        {
+            if self.entries[_idx].pt_index != !0 && self.validator.is_slot_valid(_idx) {
+                self.evictions.record(|evictions| *evictions += 1);
+            }
+        }
+    }
+
+    #[inline]
+    fn get_set_index(&self, page_addr: Address, page_size: usize) -> usize {
+        ((page_addr.as_u64() / (page_size as u64)) % ((self.lru.len() - 1) as u64)) as usize
+    }
+
+    /// Returns the slot index of the matching entry in the given set.
     #[inline]
-    fn get_cache_index(&self, page_addr: Address, page_size: usize) -> usize {
-        ((page_addr.as_u64() / (page_size as u64)) % (self.entries.len() as u64)) as usize
+    fn find_entry(&self, set: usize, pt_index: usize, page_addr: Address) -> Option<usize> {
+        (set * self.ways..(set + 1) * self.ways).find(|&idx| {
+            let entry = &self.entries[idx];
+            entry.pt_index == pt_index && entry.virt_page == page_addr
+        })
+    }
+
+    /// Returns the slot index of the large page entry containing the address.
+    #[inline]
+    fn find_large_entry(&self, pt_index: usize, addr: Address) -> Option<usize> {
+        (self.large_start..self.entries.len()).find(|&idx| {
+            let entry = &self.entries[idx];
+            entry.pt_index == pt_index
+                && entry.virt_page.is_valid()
+                && entry.virt_page == addr.as_page_aligned(entry.phys_page.page_size())
+        })
+    }
+
+    /// Marks the slot as recently used.
+    #[inline]
+    fn touch(&self, set: usize, start: usize, ways: usize, idx: usize) {
+        if ways > 1 {
+            let lru = &self.lru[set];
+            let all = !0u64 >> (64 - ways);
+            let bits = lru.get() | (1 << (idx - start));
+            // once all ways have been used only keep the most recent one marked
+            lru.set(if bits == all {
+                1 << (idx - start)
+            } else {
+                bits
+            });
+        }
+    }
+
+    /// Returns the slot in the set which should be replaced next.
+    ///
+    /// Empty and expired entries are preferred over the least recently used ones.
+    #[inline]
+    fn victim_entry(&self, set: usize, start: usize, ways: usize) -> usize {
+        (start..start + ways)
+            .find(|&idx| self.entries[idx].pt_index == !0 || !self.validator.is_slot_valid(idx))
+            .unwrap_or_else(|| {
+                start + core::cmp::min((!self.lru[set].get()).trailing_zeros() as usize, ways - 1)
+            })
     }
 
     #[inline]
     pub fn is_read_too_long(&self, arch: ArchitectureObj, size: usize) -> bool {
-        size / arch.page_size() > self.entries.len()
+        size / arch.page_size() > self.large_start
     }
 
     #[inline]
@@ -73,17 +178,18 @@ impl<T: CacheValidator> TLBCache<T> {
         let pt_index = translator.translation_table_id(addr);
         let page_size = arch.page_size();
         let page_address = addr.as_page_aligned(page_size);
-        let idx = self.get_cache_index(page_address, page_size);
-        let entry = self.entries[idx];
-        if entry.pt_index == pt_index
-            && entry.virt_page == page_address
-            && self.validator.is_slot_valid(idx)
+        let set = self.get_set_index(page_address, page_size);
+
+        if let Some(idx) = self
+            .find_entry(set, pt_index, page_address)
+            .filter(|&idx| self.validator.is_slot_valid(idx))
         {
+            let entry = self.entries[idx];
+            self.touch(set, set * self.ways, self.ways, idx);
             if entry.phys_page.is_valid() && entry.phys_page.has_page() {
                 Some(Ok(TLBEntry {
                     pt_index,
                     virt_addr: addr,
-                    // TODO: this should be aware of huge pages
                     phys_addr: PhysicalAddress::with_page(
                         entry.phys_page.address().as_page_aligned(page_size)
                             + (addr - page_address),
@@ -95,7 +201,27 @@ impl<T: CacheValidator> TLBCache<T> {
                 Some(Err(Error::VirtualTranslate))
             }
         } else {
-            None
+            let idx = self
+                .find_large_entry(pt_index, addr)
+                .filter(|&idx| self.validator.is_slot_valid(idx))?;
+            let entry = self.entries[idx];
+            self.touch(
+                self.lru.len() - 1,
+                self.large_start,
+                LARGE_PAGE_ENTRIES,
+                idx,
+            );
+            let large_page_size = entry.phys_page.page_size();
+            Some(Ok(TLBEntry {
+                pt_index,
+                virt_addr: addr,
+                phys_addr: PhysicalAddress::with_page(
+                    entry.phys_page.address().as_page_aligned(large_page_size)
+                        + (addr - entry.virt_page),
+                    entry.phys_page.page_type(),
+                    large_page_size,
+                ),
+            }))
         }
     }
 
@@ -109,13 +235,46 @@ impl<T: CacheValidator> TLBCache<T> {
     ) {
         let pt_index = translator.translation_table_id(in_addr);
         let page_size = arch.page_size();
-        let idx = self.get_cache_index(in_addr.as_page_aligned(page_size), page_size);
+
+        // the leaf size found by the page walk is stored in the physical address
+        if out_page.has_page() && out_page.page_size() > page_size {
+            let large_page_size = out_page.page_size();
+            let set = self.lru.len() - 1;
+            let idx = match self.find_large_entry(pt_index, in_addr) {
+                Some(idx) => idx,
+                None => {
+                    let idx = self.victim_entry(set, self.large_start, LARGE_PAGE_ENTRIES);
+                    self.record_eviction(idx);
+                    idx
+                }
+            };
+            self.entries[idx] = CachedEntry {
+                pt_index,
+                virt_page: in_addr.as_page_aligned(large_page_size),
+                phys_page: out_page,
+            };
+            self.validator.validate_slot(idx);
+            self.touch(set, self.large_start, LARGE_PAGE_ENTRIES, idx);
+            return;
+        }
+
+        let page_address = in_addr.as_page_aligned(page_size);
+        let set = self.get_set_index(page_address, page_size);
+        let idx = match self.find_entry(set, pt_index, page_address) {
+            Some(idx) => idx,
+            None => {
+                let idx = self.victim_entry(set, set * self.ways, self.ways);
+                self.record_eviction(idx);
+                idx
+            }
+        };
         self.entries[idx] = CachedEntry {
             pt_index,
-            virt_page: in_addr.as_page_aligned(page_size),
+            virt_page: page_address,
             phys_page: out_page,
         };
         self.validator.validate_slot(idx);
+        self.touch(set, set * self.ways, self.ways, idx);
     }
 
     #[inline]
@@ -133,11 +292,16 @@ impl<T: CacheValidator> TLBCache<T> {
 
         for i in (page_addr.as_u64()..end_addr.as_u64())
             .step_by(page_size)
-            .take(self.entries.len())
+            .take(self.large_start)
         {
             let cur_page = Address::from(i);
-            let idx = self.get_cache_index(cur_page, page_size);
+            let set = self.get_set_index(cur_page, page_size);
 
+            let idx = self
+                .find_entry(set, pt_index, cur_page)
+                .unwrap_or_else(|| self.victim_entry(set, set * self.ways, self.ways));
+
+            // never evict a valid translation in favor of an invalid one
             let entry = &mut self.entries[idx];
             if entry.pt_index == !0
                 || !entry.phys_page.is_valid()
@@ -147,7 +311,53 @@ impl<T: CacheValidator> TLBCache<T> {
                 entry.virt_page = cur_page;
                 entry.phys_page = PhysicalAddress::INVALID;
                 self.validator.validate_slot(idx);
+                self.touch(set, set * self.ways, self.ways, idx);
             }
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::x64;
+    use crate::mem::cache::timed_validator::TimedCacheValidator;
+    use crate::types::{size, PageType};
+
+    use coarsetime::Duration;
+
+    #[test]
+    fn large_page_single_entry() {
+        let translator = x64::new_translator(Address::from(0x1000u64));
+        let arch = x64::ARCH;
+        let mut tlb = TLBCache::new(64, TimedCacheValidator::new(Duration::from_secs(100)));
+        tlb.validator.update_validity();
+
+        let virt_base = Address::from(0x7fff_0000_0000u64);
+        let phys_base = Address::from(size::gb(1));
+
+        tlb.cache_entry(
+            &translator,
+            virt_base + 0x1234,
+            PhysicalAddress::with_page(phys_base + 0x1234, PageType::default(), size::mb(2)),
+            arch,
+        );
+
+        // a single entry covers all the regular pages of the large page
+        for i in (0..size::mb(2)).step_by(size::kb(4)) {
+            let entry = tlb
+                .try_entry(&translator, virt_base + i + 0x10, arch)
+                .unwrap()
+                .unwrap();
+            assert_eq!(entry.phys_addr.address(), phys_base + i + 0x10);
+            assert_eq!(entry.phys_addr.page_size(), size::mb(2));
+        }
+
+        assert!(tlb
+            .try_entry(&translator, virt_base + size::mb(2), arch)
+            .is_none());
+        assert!(tlb
+            .try_entry(&translator, virt_base - size::kb(4), arch)
+            .is_none());
+    }
+}
@@ -0,0 +1,358 @@
+/*!
+Write combining buffer used by the `CachedMemoryAccess`.
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::Result;
+use crate::mem::phys_mem::{PhysicalMemory, PhysicalWriteData};
+use crate::types::{Address, PhysicalAddress};
+
+use std::collections::BTreeMap;
+
+/// Buffers physical writes and merges adjacent and overlapping ones.
+///
+/// Buffered ranges never overlap or touch each other, a write that overlaps or touches
+/// existing ranges is merged with them into a single range. Newer data always takes precedence.
+pub(crate) struct WriteCombiner {
+    limit: usize,
+    page_size: usize,
+    size: usize,
+    ranges: BTreeMap<Address, (PhysicalAddress, Vec<u8>)>,
+}
+
+impl WriteCombiner {
+    pub fn new(limit: usize, page_size: usize) -> Self {
+        Self {
+            limit,
+            page_size,
+            size: 0,
+            ranges: BTreeMap::new(),
+        }
+    }
+
+    /// Returns an empty buffer with the same configuration.
+    pub fn detached(&self) -> Self {
+        Self::new(self.limit, self.page_size)
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.ranges.is_empty()
+    }
+
+    /// Returns true once the buffered writes reached the size limit.
+    pub fn is_full(&self) -> bool {
+        self.size >= self.limit
+    }
+
+    pub fn push(&mut self, addr: PhysicalAddress, data: &[u8]) {
+        if data.is_empty() {
+            return;
+        }
+
+        let start = addr.address();
+        let end = start + data.len();
+
+        // the range right before `start` is merged if it reaches up to the write
+        let lower = self
+            .ranges
+            .range(..start)
+            .next_back()
+            .filter(|(&range_start, (_, buf))| range_start + buf.len() >= start)
+            .map(|(&range_start, _)| range_start)
+            .unwrap_or(start);
+        let mut merged = self
+            .ranges
+            .range(lower..=end)
+            .map(|(&range_start, _)| range_start);
+
+        let first = match merged.next() {
+            Some(first) => first,
+            None => {
+                self.size += data.len();
+                self.ranges.insert(start, (addr, data.to_vec()));
+                return;
+            }
+        };
+        let last = merged.last().unwrap_or(first);
+
+        // writes that only touch a single range update it in place, so appending to a range
+        // does not copy the whole range again
+        if first == last {
+            if first <= start {
+                let (_, buf) = self.ranges.get_mut(&first).unwrap();
+                let offset = start - first;
+                if end <= first + buf.len() {
+                    buf[offset..offset + data.len()].copy_from_slice(data);
+                } else {
+                    self.size += end - (first + buf.len());
+                    buf.truncate(offset);
+                    buf.extend_from_slice(data);
+                }
+            } else {
+                let (_, range_buf) = self.ranges.remove(&first).unwrap();
+                let range_end = first + range_buf.len();
+                let mut buf = Vec::with_capacity(std::cmp::max(end, range_end) - start);
+                buf.extend_from_slice(data);
+                if range_end > end {
+                    buf.extend_from_slice(&range_buf[end - first..]);
+                }
+                self.size = self.size - range_buf.len() + buf.len();
+                self.ranges.insert(start, (addr, buf));
+            }
+            return;
+        }
+
+        let (_, last_buf) = &self.ranges[&last];
+        let merged_start = std::cmp::min(start, first);
+        let merged_end = std::cmp::max(end, last + last_buf.len());
+
+        let mut buf = vec![0; merged_end - merged_start];
+        let mut merged_addr = addr;
+        let keys = self
+            .ranges
+            .range(first..=last)
+            .map(|(&range_start, _)| range_start)
+            .collect::<Vec<_>>();
+        for range_start in keys {
+            let (range_addr, range_buf) = self.ranges.remove(&range_start).unwrap();
+            let offset = range_start - merged_start;
+            buf[offset..offset + range_buf.len()].copy_from_slice(&range_buf);
+            self.size -= range_buf.len();
+            if range_start == merged_start {
+                merged_addr = range_addr;
+            }
+        }
+
+        let offset = start - merged_start;
+        buf[offset..offset + data.len()].copy_from_slice(data);
+
+        self.size += buf.len();
+        self.ranges.insert(merged_start, (merged_addr, buf));
+    }
+
+    /// Checks whether any of the pages touched by `[addr, addr + len)` contains buffered data.
+    pub fn overlaps_pages(&self, addr: Address, len: usize) -> bool {
+        let start = addr.as_page_aligned(self.page_size);
+        let end = (addr + len + self.page_size - 1).as_page_aligned(self.page_size);
+        self.ranges
+            .range(..end)
+            .next_back()
+            .map(|(&range_start, (_, buf))| range_start + buf.len() > start)
+            .unwrap_or(false)
+    }
+
+    /// Writes all buffered ranges to `mem`.
+    ///
+    /// The buffer is only emptied if all writes succeeded.
+    pub fn flush<T: PhysicalMemory>(&mut self, mem: &mut T) -> Result<()> {
+        if self.ranges.is_empty() {
+            return Ok(());
+        }
+
+        let write_list = self
+            .ranges
+            .values()
+            .map(|(addr, buf)| PhysicalWriteData(*addr, buf))
+            .collect::<Vec<_>>();
+
+        let batch_size = mem.metadata().batch_size(usize::MAX);
+        for chunk in write_list.chunks(batch_size) {
+            mem.phys_write_raw_list(chunk)?;
+        }
+        std::mem::drop(write_list);
+
+        self.ranges.clear();
+        self.size = 0;
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use std::sync::Arc;
+
+    fn ranges(combiner: &WriteCombiner) -> Vec<(u64, Vec<u8>)> {
+        combiner
+            .ranges
+            .iter()
+            .map(|(addr, (_, buf))| (addr.as_u64(), buf.clone()))
+            .collect()
+    }
+
+    #[test]
+    fn merge_writes() {
+        let mut combiner = WriteCombiner::new(size::kb(4), size::kb(4));
+
+        combiner.push(Address::from(0x10).into(), &[1, 1, 1, 1]);
+        combiner.push(Address::from(0x18).into(), &[2, 2]);
+        combiner.push(Address::from(0x14).into(), &[3, 3, 3, 3]);
+        assert_eq!(
+            ranges(&combiner),
+            vec![(0x10, vec![1, 1, 1, 1, 3, 3, 3, 3, 2, 2])]
+        );
+
+        // contained and overlapping writes overwrite older data
+        combiner.push(Address::from(0x12).into(), &[4, 4]);
+        combiner.push(Address::from(0xe).into(), &[5, 5, 5]);
+        assert_eq!(
+            ranges(&combiner),
+            vec![(0xe, vec![5, 5, 5, 1, 4, 4, 3, 3, 3, 3, 2, 2])]
+        );
+
+        combiner.push(Address::from(0x100).into(), &[6]);
+        assert_eq!(combiner.size, 13);
+        assert_eq!(ranges(&combiner).len(), 2);
+
+        // a write bridging both ranges merges them
+        combiner.push(Address::from(0x1a).into(), &[7; 0xe6]);
+        let merged = ranges(&combiner);
+        assert_eq!(merged.len(), 1);
+        assert_eq!(merged[0].0, 0xe);
+        assert_eq!(merged[0].1.len(), 0xf3);
+        assert_eq!(combiner.size, 0xf3);
+    }
+
+    #[test]
+    fn append_writes() {
+        let mut combiner = WriteCombiner::new(size::kb(64), size::kb(4));
+
+        for i in 0..0x100u32 {
+            combiner.push(
+                Address::from(0x1000 + i as u64 * 4).into(),
+                &i.to_le_bytes(),
+            );
+        }
+        // a write that overlaps the start of the range
+        combiner.push(Address::from(0xffe).into(), &[9, 9, 9, 9]);
+
+        let merged = ranges(&combiner);
+        assert_eq!(merged.len(), 1);
+        assert_eq!(merged[0].0, 0xffe);
+        assert_eq!(merged[0].1.len(), 0x402);
+        assert_eq!(merged[0].1[..6], [9, 9, 9, 9, 0, 0]);
+        assert_eq!(merged[0].1[0x3fe..], 0xffu32.to_le_bytes());
+        assert_eq!(combiner.size, 0x402);
+    }
+
+    #[test]
+    fn overlapping_pages() {
+        let mut combiner = WriteCombiner::new(size::kb(4), size::kb(4));
+        combiner.push(Address::from(0x1ff0).into(), &[0; 8]);
+
+        assert!(combiner.overlaps_pages(Address::from(0x1000), 8));
+        assert!(combiner.overlaps_pages(Address::from(0xff0), 0x20));
+        assert!(!combiner.overlaps_pages(Address::from(0x2000), 0x1000));
+        assert!(!combiner.overlaps_pages(Address::from(0xff0), 0x10));
+    }
+
+    #[test]
+    fn flush_writes() {
+        let mut mem = DummyMemory::new(size::mb(1));
+        let mut combiner = WriteCombiner::new(size::kb(4), size::kb(4));
+
+        combiner.push(Address::from(0x100).into(), &[1, 2, 3, 4]);
+        combiner.push(Address::from(0x104).into(), &[5, 6, 7, 8]);
+        combiner.push(Address::from(0x2000).into(), &[9]);
+        combiner.flush(&mut mem).unwrap();
+        assert!(combiner.is_empty());
+
+        assert_eq!(
+            mem.phys_read_raw(Address::from(0x100).into(), 8).unwrap(),
+            vec![1, 2, 3, 4, 5, 6, 7, 8]
+        );
+        assert_eq!(
+            mem.phys_read_raw(Address::from(0x2000).into(), 1).unwrap(),
+            vec![9]
+        );
+    }
+
+    struct CountingMemory {
+        mem: DummyMemory,
+        writes: Arc<AtomicUsize>,
+    }
+
+    impl PhysicalMemory for CountingMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [crate::mem::PhysicalReadData]) -> Result<()> {
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[PhysicalWriteData]) -> Result<()> {
+            self.writes.fetch_add(data.len(), Ordering::SeqCst);
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> crate::mem::PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    #[test]
+    fn cached_write_combining() {
+        let writes = Arc::new(AtomicUsize::new(0));
+        let mem = CountingMemory {
+            mem: DummyMemory::new(size::mb(1)),
+            writes: writes.clone(),
+        };
+        let mut cache = crate::mem::CachedMemoryAccess::builder(mem)
+            .page_size(size::kb(4))
+            .write_combining(size::kb(64))
+            .build()
+            .unwrap();
+
+        cache
+            .phys_write(Address::from(0x1000).into(), &1u32)
+            .unwrap();
+        cache
+            .phys_write(Address::from(0x1004).into(), &2u32)
+            .unwrap();
+        cache
+            .phys_write(Address::from(0x3000).into(), &3u8)
+            .unwrap();
+
+        // reading an unrelated page does not flush
+        let _: u8 = cache.phys_read(Address::from(0x5000).into()).unwrap();
+        assert_eq!(writes.load(Ordering::SeqCst), 0);
+
+        // reading a dirty page flushes all writes
+        let value: u64 = cache.phys_read(Address::from(0x1000).into()).unwrap();
+        assert_eq!(value, 0x2_0000_0001);
+        assert_eq!(writes.load(Ordering::SeqCst), 2);
+
+        cache
+            .phys_write(Address::from(0x3001).into(), &4u8)
+            .unwrap();
+        cache.destroy();
+        assert_eq!(writes.load(Ordering::SeqCst), 3);
+    }
+
+    #[test]
+    fn cached_write_combining_drop() {
+        let writes = Arc::new(AtomicUsize::new(0));
+        let mut dummy_mem = DummyMemory::new(size::mb(1));
+        let mem = CountingMemory {
+            mem: dummy_mem.clone(),
+            writes: writes.clone(),
+        };
+        let mut cache = crate::mem::CachedMemoryAccess::builder(mem)
+            .page_size(size::kb(4))
+            .write_combining(size::kb(64))
+            .build()
+            .unwrap();
+
+        cache
+            .phys_write(Address::from(0x2000).into(), &0x1234u32)
+            .unwrap();
+        std::mem::drop(cache);
+
+        // dropping the cache flushes the buffered writes
+        assert_eq!(writes.load(Ordering::SeqCst), 1);
+        let value: u32 = dummy_mem.phys_read(Address::from(0x2000).into()).unwrap();
+        assert_eq!(value, 0x1234);
+    }
+}
@@ -1,4 +1,4 @@
-use crate::architecture::x86::x64;
+use crate::architecture::x86::{self, x64};
 use crate::architecture::{ArchitectureObj, ScopedVirtualTranslate};
 use crate::connector::MappedPhysicalMemory;
 use crate::error::Result;
@@ -129,6 +129,11 @@ impl DummyProcess {
     pub fn translator(&self) -> impl ScopedVirtualTranslate {
         x64::new_translator(self.dtb)
     }
+
+    /// Returns a translator that uses the runtime table driven page walk instead of the specialized one.
+    pub fn translator_generic(&self) -> impl ScopedVirtualTranslate {
+        x86::new_translator_generic(self.dtb, x64::ARCH).unwrap()
+    }
 }
 
 impl OsProcessInfo for DummyProcess {
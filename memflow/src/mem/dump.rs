@@ -0,0 +1,657 @@
+/*!
+Parallel bulk dumping of memory ranges.
+
+The [`MemoryDumper`](struct.MemoryDumper.html) splits a list of ranges into chunks and reads them
+on a pool of worker threads, each using its own clone of the connector. The chunks are handed
+to a [`DumpSink`](trait.DumpSink.html) on the calling thread in the original order,
+while at most `max_in_flight` chunks are buffered at any time.
+*/
+
+use std::prelude::v1::*;
+
+use std::collections::BTreeMap;
+use std::sync::atomic::{AtomicBool, AtomicUsize, Ordering};
+use std::sync::{mpsc, Arc, Condvar, Mutex, PoisonError};
+use std::thread;
+use std::time::{Duration, Instant};
+
+use crate::error::{Error, Result};
+use crate::mem::{CloneablePhysicalMemory, PhysicalMemory, PhysicalReadData};
+use crate::types::{size, Address, PhysicalAddress};
+
+use log::{info, warn};
+
+/// Granularity at which failed chunks are read again.
+const RETRY_PAGE_SIZE: usize = size::kb(4);
+
+/// A single range that should be dumped.
+///
+/// `address` is the address the data is reported at to the sink
+/// (e.g. the virtual address for process dumps), `phys_address` is where the data is read from.
+#[repr(C)]
+#[derive(Debug, Clone, Copy)]
+pub struct DumpRange {
+    pub address: Address,
+    pub phys_address: PhysicalAddress,
+    pub size: usize,
+}
+
+impl DumpRange {
+    /// Creates a range that dumps physical memory at its own address.
+    pub fn physical(address: Address, size: usize) -> Self {
+        Self {
+            address,
+            phys_address: address.into(),
+            size,
+        }
+    }
+
+    /// Converts the output of `VirtualMemory::virt_translation_map` into ranges
+    /// that are reported at their virtual addresses.
+    pub fn from_translation_map(map: &[(Address, usize, PhysicalAddress)]) -> Vec<Self> {
+        map.iter()
+            .map(|&(address, size, phys_address)| Self {
+                address,
+                phys_address,
+                size,
+            })
+            .collect()
+    }
+
+    fn split_at(&self, offset: usize) -> (Self, Self) {
+        let phys_address = if self.phys_address.has_page() {
+            PhysicalAddress::with_page(
+                self.phys_address.address() + offset,
+                self.phys_address.page_type(),
+                self.phys_address.page_size(),
+            )
+        } else {
+            PhysicalAddress::from(self.phys_address.address() + offset)
+        };
+
+        (
+            Self {
+                size: offset,
+                ..*self
+            },
+            Self {
+                address: self.address + offset,
+                phys_address,
+                size: self.size - offset,
+            },
+        )
+    }
+}
+
+/// Statistics of a finished dump.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default)]
+pub struct DumpStats {
+    /// Total amount of bytes handed to the sink
+    pub bytes: usize,
+    /// Amount of bytes that could not be read and were zero filled
+    pub failed_bytes: usize,
+    /// Wall clock time of the dump in nanoseconds
+    pub elapsed_ns: u64,
+}
+
+impl DumpStats {
+    pub fn elapsed(&self) -> Duration {
+        Duration::from_nanos(self.elapsed_ns)
+    }
+
+    /// Returns the throughput of the dump in bytes per second.
+    pub fn bytes_per_sec(&self) -> f64 {
+        let secs = self.elapsed().as_secs_f64();
+        if secs > 0.0 {
+            self.bytes as f64 / secs
+        } else {
+            0.0
+        }
+    }
+}
+
+/// Receives the dumped memory.
+///
+/// All ranges are passed to the sink in the order they were given to the dumper.
+/// Large ranges are split into multiple consecutive calls.
+pub trait DumpSink {
+    fn write_range(&mut self, address: Address, data: &[u8]) -> Result<()>;
+}
+
+impl<F: FnMut(Address, &[u8]) -> Result<()>> DumpSink for F {
+    fn write_range(&mut self, address: Address, data: &[u8]) -> Result<()> {
+        (*self)(address, data)
+    }
+}
+
+/// A sink that writes all ranges back to back into a `std::io::Write` implementation.
+pub struct WriteSink<W>(pub W);
+
+impl<W: std::io::Write> DumpSink for WriteSink<W> {
+    fn write_range(&mut self, _address: Address, data: &[u8]) -> Result<()> {
+        self.0
+            .write_all(data)
+            .map_err(|_| Error::IO("unable to write dump"))
+    }
+}
+
+#[derive(Default)]
+struct DumpChunk {
+    ranges: Vec<DumpRange>,
+    size: usize,
+}
+
+/// State shared between the sink and the workers to bound the amount of buffered chunks.
+struct DumpWindow {
+    written: Mutex<usize>,
+    cond: Condvar,
+    aborted: AtomicBool,
+}
+
+impl DumpWindow {
+    /// Stops all workers, including the ones that wait for the sink to catch up.
+    fn abort(&self) {
+        self.aborted.store(true, Ordering::SeqCst);
+        // take the lock so no worker misses the notification between its check and wait
+        let _written = self.written.lock().unwrap_or_else(PoisonError::into_inner);
+        self.cond.notify_all();
+    }
+}
+
+/// Aborts the dump if its worker panics.
+///
+/// Otherwise the chunk of the worker would never arrive and the remaining workers
+/// would wait for the sink forever. The sender is dropped along with the guard,
+/// so the sink stops receiving once all workers are gone.
+struct WorkerGuard<T> {
+    window: Arc<DumpWindow>,
+    tx: mpsc::Sender<T>,
+}
+
+impl<T> Drop for WorkerGuard<T> {
+    fn drop(&mut self) {
+        if thread::panicking() {
+            self.window.abort();
+        }
+    }
+}
+
+/// Reads memory ranges in parallel and streams them in order to a `DumpSink`.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::mem::dump::{DumpRange, MemoryDumper, WriteSink};
+/// use memflow::mem::PhysicalMemory;
+/// use memflow::types::{size, Address};
+/// # use memflow::mem::dummy::DummyMemory;
+///
+/// # let mem = DummyMemory::new(size::mb(4));
+/// let mut out = Vec::new();
+///
+/// let stats = MemoryDumper::new()
+///     .threads(2)
+///     .chunk_size(size::kb(64))
+///     .dump(
+///         &mem,
+///         &[DumpRange::physical(Address::NULL, mem.metadata().size)],
+///         &mut WriteSink(&mut out),
+///     )
+///     .unwrap();
+///
+/// assert_eq!(stats.bytes, size::mb(4));
+/// assert_eq!(out.len(), size::mb(4));
+/// ```
+#[derive(Debug, Clone, Copy)]
+pub struct MemoryDumper {
+    threads: usize,
+    chunk_size: usize,
+    max_in_flight: usize,
+}
+
+impl Default for MemoryDumper {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl MemoryDumper {
+    /// Creates a new dumper with 4 worker threads reading chunks of 2mb.
+    pub fn new() -> Self {
+        Self {
+            threads: 4,
+            chunk_size: size::mb(2),
+            max_in_flight: 16,
+        }
+    }
+
+    /// Changes the amount of worker threads, each of them uses its own connector clone.
+    pub fn threads(mut self, threads: usize) -> Self {
+        self.threads = std::cmp::max(threads, 1);
+        self
+    }
+
+    /// Changes the amount of bytes each worker reads in a single batch.
+    pub fn chunk_size(mut self, chunk_size: usize) -> Self {
+        self.chunk_size = std::cmp::max(chunk_size, 1);
+        self
+    }
+
+    /// Changes the maximum amount of chunks that can be buffered before they are written to the sink.
+    ///
+    /// This bounds the memory usage of a dump to roughly `max_in_flight * chunk_size` bytes.
+    pub fn max_in_flight(mut self, max_in_flight: usize) -> Self {
+        self.max_in_flight = std::cmp::max(max_in_flight, 1);
+        self
+    }
+
+    /// Dumps all `ranges` from `mem` into `sink`.
+    ///
+    /// If a chunk can not be read, its pages are read again one by one. Pages that can not be read
+    /// are zero filled and accounted for in `DumpStats::failed_bytes`.
+    /// If the sink returns an error the dump is aborted and the error is returned.
+    /// If a worker panics the dump is aborted as well and `Error::Other` is returned.
+    pub fn dump<M: CloneablePhysicalMemory + ?Sized, S: DumpSink + ?Sized>(
+        &self,
+        mem: &M,
+        ranges: &[DumpRange],
+        sink: &mut S,
+    ) -> Result<DumpStats> {
+        let start = Instant::now();
+
+        let chunks = Arc::new(self.split_chunks(ranges));
+        let next_chunk = Arc::new(AtomicUsize::new(0));
+        let buffers = Arc::new(Mutex::new(Vec::<Vec<u8>>::new()));
+        let window = Arc::new(DumpWindow {
+            written: Mutex::new(0),
+            cond: Condvar::new(),
+            aborted: AtomicBool::new(false),
+        });
+
+        let (tx, rx) = mpsc::channel();
+
+        let workers = (0..std::cmp::min(self.threads, chunks.len()))
+            .map(|_| {
+                let mut mem = mem.clone_box();
+                let chunks = chunks.clone();
+                let next_chunk = next_chunk.clone();
+                let buffers = buffers.clone();
+                let guard = WorkerGuard {
+                    window: window.clone(),
+                    tx: tx.clone(),
+                };
+                let max_in_flight = self.max_in_flight;
+
+                thread::spawn(move || loop {
+                    let window = &guard.window;
+                    let idx = next_chunk.fetch_add(1, Ordering::SeqCst);
+                    let chunk = match chunks.get(idx) {
+                        Some(chunk) => chunk,
+                        None => break,
+                    };
+
+                    // wait until the sink caught up to keep the amount of buffered chunks bounded
+                    {
+                        let mut written = window.written.lock().unwrap();
+                        while idx >= *written + max_in_flight
+                            && !window.aborted.load(Ordering::SeqCst)
+                        {
+                            written = window.cond.wait(written).unwrap();
+                        }
+                    }
+                    if window.aborted.load(Ordering::SeqCst) {
+                        break;
+                    }
+
+                    let mut buf = buffers.lock().unwrap().pop().unwrap_or_default();
+                    buf.resize(chunk.size, 0);
+
+                    // a failed chunk is retried page by page, so only the unreadable pages are lost
+                    let failed = if read_chunk(&mut *mem, chunk, &mut buf).is_err() {
+                        read_chunk_pages(&mut *mem, chunk, &mut buf)
+                    } else {
+                        0
+                    };
+
+                    if guard.tx.send((idx, buf, failed)).is_err() {
+                        break;
+                    }
+                })
+            })
+            .collect::<Vec<_>>();
+        std::mem::drop(tx);
+
+        let mut stats = DumpStats::default();
+        let mut pending = BTreeMap::new();
+        let mut next_write = 0;
+        let mut result = Ok(());
+
+        'recv: for (idx, buf, failed) in rx.iter() {
+            pending.insert(idx, (buf, failed));
+
+            while let Some((buf, failed)) = pending.remove(&next_write) {
+                let chunk = &chunks[next_write];
+
+                let mut data = &buf[..];
+                for range in chunk.ranges.iter() {
+                    let (range_data, rest) = data.split_at(range.size);
+                    if let Err(err) = sink.write_range(range.address, range_data) {
+                        result = Err(err);
+                        break 'recv;
+                    }
+                    data = rest;
+                }
+
+                stats.bytes += chunk.size;
+                if failed > 0 {
+                    warn!(
+                        "unable to read {:x} bytes of dump chunk at {:x}",
+                        failed, chunk.ranges[0].address
+                    );
+                    stats.failed_bytes += failed;
+                }
+
+                buffers.lock().unwrap().push(buf);
+
+                next_write += 1;
+                *window.written.lock().unwrap() = next_write;
+                window.cond.notify_all();
+            }
+        }
+
+        if result.is_err() {
+            window.abort();
+        }
+        std::mem::drop(rx);
+
+        let panicked = workers
+            .into_iter()
+            .map(|worker| worker.join().is_err())
+            .fold(false, |acc, panicked| acc || panicked);
+
+        result?;
+        if panicked || next_write != chunks.len() {
+            return Err(Error::Other("dump worker terminated unexpectedly"));
+        }
+
+        stats.elapsed_ns = start.elapsed().as_nanos() as u64;
+        info!(
+            "dumped {} bytes in {:?} ({:.2} mb/s)",
+            stats.bytes,
+            stats.elapsed(),
+            stats.bytes_per_sec() / size::mb(1) as f64
+        );
+
+        Ok(stats)
+    }
+
+    /// Groups the ranges into chunks of at most `chunk_size` bytes, splitting large ranges.
+    fn split_chunks(&self, ranges: &[DumpRange]) -> Vec<DumpChunk> {
+        let mut chunks = Vec::new();
+        let mut chunk = DumpChunk::default();
+
+        for &range in ranges.iter().filter(|r| r.size > 0) {
+            let mut range = range;
+
+            while range.size > 0 {
+                let len = std::cmp::min(range.size, self.chunk_size - chunk.size);
+                let (head, tail) = range.split_at(len);
+
+                chunk.ranges.push(head);
+                chunk.size += len;
+                range = tail;
+
+                if chunk.size == self.chunk_size {
+                    chunks.push(std::mem::replace(&mut chunk, DumpChunk::default()));
+                }
+            }
+        }
+
+        if chunk.size > 0 {
+            chunks.push(chunk);
+        }
+
+        chunks
+    }
+}
+
+fn read_chunk<M: PhysicalMemory + ?Sized>(
+    mem: &mut M,
+    chunk: &DumpChunk,
+    buf: &mut [u8],
+) -> Result<()> {
+    let mut read_list = Vec::with_capacity(chunk.ranges.len());
+
+    let mut rest = buf;
+    for range in chunk.ranges.iter() {
+        let (out, tail) = rest.split_at_mut(range.size);
+        read_list.push(PhysicalReadData(range.phys_address, out));
+        rest = tail;
+    }
+
+    mem.phys_read_raw_list(&mut read_list)
+}
+
+/// Reads every page of the chunk on its own and zero fills the pages that can not be read.
+///
+/// Returns the amount of bytes that could not be read.
+fn read_chunk_pages<M: PhysicalMemory + ?Sized>(
+    mem: &mut M,
+    chunk: &DumpChunk,
+    buf: &mut [u8],
+) -> usize {
+    let mut failed = 0;
+
+    let mut rest = buf;
+    for range in chunk.ranges.iter() {
+        let (out, tail) = rest.split_at_mut(range.size);
+        rest = tail;
+
+        let mut range = *range;
+        let mut out = out;
+        while range.size > 0 {
+            let page_end =
+                (range.phys_address.address() + RETRY_PAGE_SIZE).as_page_aligned(RETRY_PAGE_SIZE);
+            let len = std::cmp::min(range.size, page_end - range.phys_address.address());
+            let (page, next) = range.split_at(len);
+            let (page_out, next_out) = out.split_at_mut(len);
+
+            if mem
+                .phys_read_raw_list(&mut [PhysicalReadData(page.phys_address, page_out)])
+                .is_err()
+            {
+                page_out.iter_mut().for_each(|b| *b = 0);
+                failed += len;
+            }
+
+            range = next;
+            out = next_out;
+        }
+    }
+
+    failed
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::mem::{VirtualDMA, VirtualMemory};
+
+    #[test]
+    fn dump_phys_in_order() {
+        let mut mem = DummyMemory::new(size::mb(4));
+        for i in 0..size::mb(4) / size::kb(4) {
+            mem.phys_write(Address::from(i * size::kb(4)).into(), &(i as u64))
+                .unwrap();
+        }
+
+        let mut out = Vec::new();
+        let stats = MemoryDumper::new()
+            .threads(4)
+            .chunk_size(size::kb(12))
+            .max_in_flight(2)
+            .dump(
+                &mem,
+                &[DumpRange::physical(Address::NULL, size::mb(4))],
+                &mut WriteSink(&mut out),
+            )
+            .unwrap();
+
+        assert_eq!(stats.bytes, size::mb(4));
+        assert_eq!(stats.failed_bytes, 0);
+
+        let mut cmp = vec![0_u8; size::mb(4)];
+        mem.phys_read_raw_into(Address::NULL.into(), &mut cmp)
+            .unwrap();
+        assert_eq!(out, cmp);
+    }
+
+    #[test]
+    fn dump_virt_translation_map() {
+        let (mut mem, dtb, virt_base) = {
+            let buf = (0..size::kb(64)).map(|i| i as u8).collect::<Vec<_>>();
+            let mut mem = DummyMemory::new(size::mb(8));
+            let (dtb, virt_base) = mem.alloc_dtb(size::kb(64), &buf);
+            (mem, dtb, virt_base)
+        };
+
+        let translator = crate::architecture::x86::x64::new_translator(dtb);
+        let map = VirtualDMA::new(&mut mem, crate::architecture::x86::x64::ARCH, translator)
+            .virt_translation_map();
+
+        let mut ranges = Vec::new();
+        MemoryDumper::new()
+            .chunk_size(size::kb(6))
+            .dump(
+                &mem,
+                &DumpRange::from_translation_map(&map),
+                &mut |address: Address, data: &[u8]| {
+                    ranges.push((address, data.to_vec()));
+                    Ok(())
+                },
+            )
+            .unwrap();
+
+        let data = ranges
+            .iter()
+            .filter(|(address, _)| *address >= virt_base)
+            .flat_map(|(_, data)| data.iter().copied())
+            .take(size::kb(64))
+            .collect::<Vec<_>>();
+        assert_eq!(data, (0..size::kb(64)).map(|i| i as u8).collect::<Vec<_>>());
+        assert!(ranges.windows(2).all(|w| w[0].0 < w[1].0));
+    }
+
+    #[test]
+    fn dump_sink_error_aborts() {
+        let mem = DummyMemory::new(size::mb(4));
+
+        let mut calls = 0;
+        let ret = MemoryDumper::new()
+            .threads(4)
+            .chunk_size(size::kb(4))
+            .max_in_flight(4)
+            .dump(
+                &mem,
+                &[DumpRange::physical(Address::NULL, size::mb(4))],
+                &mut |_: Address, _: &[u8]| {
+                    calls += 1;
+                    if calls == 3 {
+                        Err(Error::IO("full"))
+                    } else {
+                        Ok(())
+                    }
+                },
+            );
+
+        assert_eq!(ret.unwrap_err(), Error::IO("full"));
+        assert_eq!(calls, 3);
+    }
+
+    /// Fails every read list that touches the page at `hole`, or panics if `panic` is set.
+    #[derive(Clone)]
+    struct HoleMemory {
+        mem: DummyMemory,
+        hole: Address,
+        panic: bool,
+    }
+
+    impl PhysicalMemory for HoleMemory {
+        fn phys_read_raw_list(&mut self, data: &mut [PhysicalReadData]) -> Result<()> {
+            let hole = self.hole;
+            if data.iter().any(|PhysicalReadData(addr, buf)| {
+                addr.address() < hole + size::kb(4) && addr.address() + buf.len() > hole
+            }) {
+                if self.panic {
+                    panic!("unmapped page");
+                }
+                return Err(Error::Connector("unmapped page"));
+            }
+            self.mem.phys_read_raw_list(data)
+        }
+
+        fn phys_write_raw_list(&mut self, data: &[crate::mem::PhysicalWriteData]) -> Result<()> {
+            self.mem.phys_write_raw_list(data)
+        }
+
+        fn metadata(&self) -> crate::mem::PhysicalMemoryMetadata {
+            self.mem.metadata()
+        }
+    }
+
+    #[test]
+    fn dump_failed_page_only() {
+        let mut mem = DummyMemory::new(size::mb(1));
+        mem.phys_write_raw(Address::NULL.into(), &[0xff; size::kb(64)])
+            .unwrap();
+        let mem = HoleMemory {
+            mem,
+            hole: Address::from(size::kb(8)),
+            panic: false,
+        };
+
+        let mut out = Vec::new();
+        let stats = MemoryDumper::new()
+            .threads(2)
+            .chunk_size(size::kb(32))
+            .dump(
+                &mem,
+                &[DumpRange::physical(Address::NULL, size::kb(64))],
+                &mut WriteSink(&mut out),
+            )
+            .unwrap();
+
+        // only the unreadable page is zero filled, the rest of its chunk is still dumped
+        assert_eq!(stats.failed_bytes, size::kb(4));
+        assert!(out[..size::kb(8)].iter().all(|&b| b == 0xff));
+        assert!(out[size::kb(8)..size::kb(12)].iter().all(|&b| b == 0));
+        assert!(out[size::kb(12)..].iter().all(|&b| b == 0xff));
+    }
+
+    #[test]
+    fn dump_worker_panic_aborts() {
+        let mem = HoleMemory {
+            mem: DummyMemory::new(size::mb(1)),
+            hole: Address::from(size::kb(8)),
+            panic: true,
+        };
+
+        // the other workers would wait for the chunk of the panicked worker forever
+        let ret = MemoryDumper::new()
+            .threads(4)
+            .chunk_size(size::kb(4))
+            .max_in_flight(2)
+            .dump(
+                &mem,
+                &[DumpRange::physical(Address::NULL, size::mb(1))],
+                &mut |_: Address, _: &[u8]| Ok(()),
+            );
+
+        assert_eq!(
+            ret.unwrap_err(),
+            Error::Other("dump worker terminated unexpectedly")
+        );
+    }
+}
@@ -2,6 +2,7 @@ use crate::error::{Error, Result};
 use crate::iter::{SplitAtIndex, SplitAtIndexNoMutation};
 use crate::types::{Address, PhysicalAddress};
 
+use std::cell::Cell;
 use std::cmp::Ordering;
 use std::default::Default;
 use std::fmt;
@@ -12,6 +13,10 @@ use std::prelude::v1::*;
 ///
 /// All memory addresses will be bounds checked.
 ///
+/// Lookups binary search a sorted index of the mapped ranges, which is kept up to date by `push`.
+/// The mapping that served the previous lookup is checked first, so sequential accesses
+/// usually do not search at all, even for maps consisting of hundreds of ranges.
+///
 /// # Examples
 ///
 /// ```
@@ -32,6 +37,10 @@ use std::prelude::v1::*;
 #[derive(Clone)]
 pub struct MemoryMap<M> {
     mappings: Vec<MemoryMapping<M>>,
+    // (base, end) of every mapping, in the same order as `mappings`
+    ranges: Vec<(Address, Address)>,
+    // index of the mapping that served the last lookup
+    last_hit: Cell<usize>,
 }
 
 impl<M> std::convert::AsRef<MemoryMap<M>> for MemoryMap<M> {
@@ -60,6 +69,8 @@ impl<M: SplitAtIndexNoMutation> Default for MemoryMap<M> {
     fn default() -> Self {
         Self {
             mappings: Vec::new(),
+            ranges: Vec::new(),
+            last_hit: Cell::new(0),
         }
     }
 }
@@ -103,7 +114,7 @@ impl<M: SplitAtIndexNoMutation> MemoryMap<M> {
         buf: T,
         out_fail: &'a mut V,
     ) -> impl Iterator<Item = (M, T)> + 'a {
-        MemoryMapIterator::new(&self.mappings, Some((addr, buf)).into_iter(), out_fail)
+        MemoryMapIterator::new(self, Some((addr, buf)).into_iter(), out_fail)
     }
 
     /// Maps a address range iterator to a hardware address range.
@@ -123,48 +134,90 @@ impl<M: SplitAtIndexNoMutation> MemoryMap<M> {
         out_fail: &'a mut V,
     ) -> impl Iterator<Item = (M, T)> + 'a {
         MemoryMapIterator::new(
-            &self.mappings,
+            self,
             iter.map(|(addr, buf)| (addr.address(), buf)),
             out_fail,
         )
     }
 
+    /// Returns the index of the first mapping that ends after `addr`.
+    ///
+    /// This is the mapping containing `addr`, or the next one in case `addr` is not mapped.
+    /// Returns the amount of mappings if there is no mapping past `addr`.
+    #[inline]
+    fn find_mapping(&self, addr: Address) -> usize {
+        // fast path for sequential accesses, check the mapping of the last lookup and its successor
+        let last_hit = self.last_hit.get();
+        for idx in last_hit..std::cmp::min(last_hit + 2, self.ranges.len()) {
+            let (base, end) = self.ranges[idx];
+            if base <= addr && addr < end {
+                self.last_hit.set(idx);
+                return idx;
+            }
+        }
+
+        let idx = match self.ranges.binary_search_by(|&(_, end)| {
+            if end <= addr {
+                Ordering::Less
+            } else {
+                Ordering::Greater
+            }
+        }) {
+            Ok(idx) | Err(idx) => idx,
+        };
+
+        if idx < self.ranges.len() {
+            self.last_hit.set(idx);
+        }
+        idx
+    }
+
     /// Adds a new memory mapping to this memory map.
     ///
     /// When adding overlapping memory regions this function will panic!
     pub fn push(&mut self, base: Address, output: M) -> &mut Self {
+        let end = base + output.length();
         let mapping = MemoryMapping {
             base,
             output: output.into(),
         };
 
-        let mut shift_idx = self.mappings.len();
-
-        // bounds check. In reverse order, because most likely
-        // all mappings will be inserted in increasing order
-        for (i, m) in self.mappings.iter().enumerate().rev() {
-            let start = base;
-            let end = base + mapping.output.borrow().length();
-            if m.base <= start && start < m.base + m.output.borrow().length()
-                || m.base <= end && end < m.base + m.output.borrow().length()
+        // most likely all mappings will be inserted in increasing order
+        let shift_idx = match self.ranges.last() {
+            Some(&(_, last_end)) if last_end <= base => self.ranges.len(),
+            _ => match self
+                .ranges
+                .binary_search_by(|&(m_base, _)| m_base.cmp(&base))
             {
-                // overlapping memory regions should not be possible
-                panic!(
-                    "MemoryMap::push overlapping regions: {:x}-{:x} ({:x}) | {:x}-{:x} ({:x})",
-                    base,
-                    end,
-                    mapping.output.borrow().length(),
-                    m.base,
-                    m.base + m.output.borrow().length(),
-                    m.output.borrow().length()
-                );
-            } else if m.base + m.output.borrow().length() <= start {
-                shift_idx = i + 1;
-                break;
-            }
+                Ok(idx) | Err(idx) => idx,
+            },
+        };
+
+        // bounds check against the neighbouring mappings
+        let overlapping = if shift_idx > 0 && self.ranges[shift_idx - 1].1 > base {
+            Some(self.ranges[shift_idx - 1])
+        } else if shift_idx < self.ranges.len() && self.ranges[shift_idx].0 < end {
+            Some(self.ranges[shift_idx])
+        } else {
+            None
+        };
+
+        if let Some((m_base, m_end)) = overlapping {
+            // overlapping memory regions should not be possible
+            panic!(
+                "MemoryMap::push overlapping regions: {:x}-{:x} ({:x}) | {:x}-{:x} ({:x})",
+                base,
+                end,
+                end - base,
+                m_base,
+                m_end,
+                m_end - m_base
+            );
         }
 
         self.mappings.insert(shift_idx, mapping);
+        self.ranges.insert(shift_idx, (base, end));
+        self.last_hit.set(0);
 
         self
     }
@@ -295,10 +348,8 @@ impl MemoryMap<(Address, usize)> {
     }
 }
 
-const MIN_BSEARCH_THRESH: usize = 32;
-
 pub struct MemoryMapIterator<'a, I, M, T, F> {
-    map: &'a [MemoryMapping<M>],
+    map: &'a MemoryMap<M>,
     in_iter: I,
     fail_out: &'a mut F,
     cur_elem: Option<(Address, T)>,
@@ -313,7 +364,7 @@ impl<
         F: Extend<(Address, T)>,
     > MemoryMapIterator<'a, I, M, T, F>
 {
-    fn new(map: &'a [MemoryMapping<M>], in_iter: I, fail_out: &'a mut F) -> Self {
+    fn new(map: &'a MemoryMap<M>, in_iter: I, fail_out: &'a mut F) -> Self {
         Self {
             map,
             in_iter,
@@ -325,21 +376,11 @@ impl<
 
     fn get_next(&mut self) -> Option<(M, T)> {
         if let Some((mut addr, mut buf)) = self.cur_elem.take() {
-            if self.map.len() >= MIN_BSEARCH_THRESH && self.cur_map_pos == 0 {
-                self.cur_map_pos = match self.map.binary_search_by(|map_elem| {
-                    if map_elem.base > addr {
-                        Ordering::Greater
-                    } else if map_elem.base + map_elem.output.borrow().length() <= addr {
-                        Ordering::Less
-                    } else {
-                        Ordering::Equal
-                    }
-                }) {
-                    Ok(idx) | Err(idx) => idx,
-                };
+            if self.cur_map_pos == 0 {
+                self.cur_map_pos = self.map.find_mapping(addr);
             }
 
-            for (i, map_elem) in self.map.iter().enumerate().skip(self.cur_map_pos) {
+            for (i, map_elem) in self.map.mappings.iter().enumerate().skip(self.cur_map_pos) {
                 let output = &mut *map_elem.output.borrow_mut();
                 if map_elem.base + output.length() > addr {
                     let offset = map_elem.base.as_usize().saturating_sub(addr.as_usize());
@@ -574,6 +615,55 @@ mod tests {
         assert_eq!(map.map(0x3000.into(), 1, &mut void).next(), None);
     }
 
+    #[test]
+    fn test_mapping_fragmented() {
+        // 0x1000 sized mappings with 0x1000 sized holes, pushed in reverse order
+        let mut map = MemoryMap::new();
+        for i in (0..1000u64).rev() {
+            map.push_remap((i * 0x2000).into(), 0x1000, (i * 0x1000).into());
+        }
+
+        let mut void_panic = FnExtend::new(|x| panic!("Should not have mapped {:?}", x));
+        let mut void = FnExtend::void();
+
+        // sequential and backwards lookups
+        for &i in [0u64, 1, 2, 3, 500, 501, 999, 998, 10].iter() {
+            assert_eq!(
+                (map.map((i * 0x2000 + 0x10).into(), 1, &mut void_panic)
+                    .next()
+                    .unwrap()
+                    .0)
+                    .0,
+                Address::from(i * 0x1000 + 0x10)
+            );
+            assert_eq!(
+                map.map((i * 0x2000 + 0x1000).into(), 1, &mut void).next(),
+                None
+            );
+        }
+
+        // a buffer spanning multiple mappings is split at the holes
+        let mut failed = vec![];
+        let mapped = map
+            .map(0x1800.into(), 0x3000, &mut failed)
+            .map(|(out, buf)| (out.0, out.1, buf))
+            .collect::<Vec<_>>();
+        assert_eq!(
+            mapped,
+            vec![
+                (Address::from(0x1000), 0x1000, 0x1000),
+                (Address::from(0x2000), 0x800, 0x800)
+            ]
+        );
+        assert_eq!(
+            failed,
+            vec![
+                (Address::from(0x1800), 0x800),
+                (Address::from(0x3000), 0x1000)
+            ]
+        );
+    }
+
     #[test]
     #[should_panic]
     fn test_overlapping_regions_base() {
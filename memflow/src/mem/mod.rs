@@ -10,9 +10,14 @@ TODO: more documentation
 */
 
 pub mod cache;
+#[cfg(feature = "std")]
+pub mod dump;
 pub mod mem_map;
 pub mod phys_mem;
 pub mod phys_mem_batcher;
+#[cfg(feature = "std")]
+pub mod scan;
+pub mod stats;
 pub mod virt_mem;
 pub mod virt_mem_batcher;
 pub mod virt_translate;
@@ -32,7 +37,9 @@ pub use phys_mem::{
 #[doc(hidden)]
 pub use phys_mem_batcher::PhysicalMemoryBatcher;
 #[doc(hidden)]
-pub use virt_mem::{VirtualDMA, VirtualMemory, VirtualReadData, VirtualWriteData};
+pub use stats::{ConnectorStats, MemoryStats, PageCacheStats, TranslateStats};
+#[doc(hidden)]
+pub use virt_mem::{PointerChain, VirtualDMA, VirtualMemory, VirtualReadData, VirtualWriteData};
 #[doc(hidden)]
 pub use virt_mem_batcher::VirtualMemoryBatcher;
 #[doc(hidden)]
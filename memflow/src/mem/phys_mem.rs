@@ -69,7 +69,10 @@ use dataview::Pod;
 ///     fn metadata(&self) -> PhysicalMemoryMetadata {
 ///         PhysicalMemoryMetadata {
 ///             size: self.mem.len(),
-///             readonly: false
+///             readonly: false,
+///             preferred_batch_size: 0,
+///             max_in_flight: 0,
+///             coalesce_size: 0,
 ///         }
 ///     }
 /// }
@@ -100,7 +103,7 @@ where
     /// Retrieve metadata about the physical memory
     ///
     /// This function will return metadata about the underlying physical memory object, currently
-    /// including address space size and read-only status.
+    /// including address space size, read-only status and the preferred request batching.
     ///
     /// # Examples
     ///
@@ -116,6 +119,15 @@ where
     /// ```
     fn metadata(&self) -> PhysicalMemoryMetadata;
 
+    /// Hints that the given physical ranges are going to be read soon.
+    ///
+    /// Caching layers like `CachedMemoryAccess` use this hint to fill their caches
+    /// for the entire list in a single batched read so that consecutive reads hit warm pages.
+    /// All other implementations simply ignore the hint.
+    fn phys_prefetch_list(&mut self, _data: &[(PhysicalAddress, usize)]) -> Result<()> {
+        Ok(())
+    }
+
     // read helpers
     fn phys_read_raw_into(&mut self, addr: PhysicalAddress, out: &mut [u8]) -> Result<()> {
         self.phys_read_raw_list(&mut [PhysicalReadData(addr, out)])
@@ -160,6 +172,11 @@ where
         self.phys_write_raw(addr, data.as_bytes())
     }
 
+    // prefetch helpers
+    fn phys_prefetch(&mut self, addr: PhysicalAddress, len: usize) -> Result<()> {
+        self.phys_prefetch_list(&[(addr, len)])
+    }
+
     fn phys_batcher(&mut self) -> PhysicalMemoryBatcher<Self>
     where
         Self: Sized,
@@ -184,6 +201,11 @@ impl<T: PhysicalMemory + ?Sized, P: std::ops::DerefMut<Target = T> + Send> Physi
     fn metadata(&self) -> PhysicalMemoryMetadata {
         (**self).metadata()
     }
+
+    #[inline]
+    fn phys_prefetch_list(&mut self, data: &[(PhysicalAddress, usize)]) -> Result<()> {
+        (**self).phys_prefetch_list(data)
+    }
 }
 
 /// Wrapper trait around physical memory which implements a boxed clone
@@ -222,6 +244,57 @@ impl Clone for PhysicalMemoryBox {
 pub struct PhysicalMemoryMetadata {
     pub size: usize,
     pub readonly: bool,
+    /// The amount of entries the connector prefers to receive in a single `phys_read_raw_list` call.
+    ///
+    /// A value of 0 means the connector has no preference.
+    pub preferred_batch_size: usize,
+    /// The maximum amount of requests the connector can have in flight at once.
+    ///
+    /// A value of 0 means the amount of requests is unlimited.
+    pub max_in_flight: usize,
+    /// The maximum size of a read that physically contiguous entries may be merged into.
+    ///
+    /// Connectors with a high cost per request can set this to have `VirtualDMA`
+    /// sort the translated reads by their physical address and merge adjacent ones.
+    /// A value of 0 means the connector does not benefit from merged reads.
+    pub coalesce_size: usize,
+}
+
+impl PhysicalMemoryMetadata {
+    /// Returns the amount of entries that should be submitted in a single `phys_read_raw_list` call.
+    ///
+    /// Falls back to `default` if the connector has no preference
+    /// and never exceeds `max_in_flight` if the connector limits it.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use memflow::mem::PhysicalMemoryMetadata;
+    ///
+    /// let metadata = PhysicalMemoryMetadata {
+    ///     size: 0x1000,
+    ///     readonly: false,
+    ///     preferred_batch_size: 0,
+    ///     max_in_flight: 16,
+    ///     coalesce_size: 0,
+    /// };
+    ///
+    /// assert_eq!(metadata.batch_size(64), 16);
+    /// assert_eq!(metadata.batch_size(8), 8);
+    /// ```
+    pub fn batch_size(&self, default: usize) -> usize {
+        let batch_size = if self.preferred_batch_size == 0 {
+            default
+        } else {
+            self.preferred_batch_size
+        };
+
+        if self.max_in_flight == 0 {
+            std::cmp::max(batch_size, 1)
+        } else {
+            std::cmp::max(std::cmp::min(batch_size, self.max_in_flight), 1)
+        }
+    }
 }
 
 // iterator helpers
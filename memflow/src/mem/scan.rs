@@ -0,0 +1,545 @@
+/*!
+Byte signature scanning over virtual memory.
+
+The [`PatternScanner`](struct.PatternScanner.html) walks all mapped pages of a virtual address space
+in page aligned chunks and matches any number of masked byte patterns against them in a single pass.
+
+Candidate positions are located with SSE2 or AVX2 (whatever the cpu supports) by searching for
+one fixed byte of each pattern, only those candidates are then verified against the full pattern.
+On other architectures a scalar fallback is used.
+*/
+
+use std::prelude::v1::*;
+
+use crate::error::{Error, Result};
+use crate::iter::FlowIters;
+use crate::mem::{VirtualMemory, VirtualReadData};
+use crate::types::{size, Address};
+
+use std::collections::VecDeque;
+
+/// A byte pattern in which every byte is compared under a mask.
+///
+/// A mask of `0xff` compares the entire byte, a mask of `0x00` marks a wildcard.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Pattern {
+    // bytes are stored pre-masked
+    bytes: Vec<u8>,
+    mask: Vec<u8>,
+    anchor: Option<usize>,
+}
+
+impl Pattern {
+    /// Creates a pattern from a list of bytes and their masks.
+    ///
+    /// Returns `Error::Bounds` if the pattern is empty or `bytes` and `mask` have different lengths.
+    pub fn new(bytes: &[u8], mask: &[u8]) -> Result<Self> {
+        if bytes.is_empty() || bytes.len() != mask.len() {
+            return Err(Error::Bounds);
+        }
+
+        let bytes = bytes.iter().zip(mask.iter()).map(|(b, m)| b & m).collect();
+        // the search is anchored on the first fully defined byte
+        let anchor = mask.iter().position(|&m| m == 0xff);
+
+        Ok(Self {
+            bytes,
+            mask: mask.to_vec(),
+            anchor,
+        })
+    }
+
+    /// Parses a pattern in the common `"48 8B 05 ? ? ? ? 48 89"` notation.
+    ///
+    /// Bytes are separated by whitespace, `?` or `??` denote a wildcard byte.
+    ///
+    /// # Examples
+    ///
+    /// ```
+    /// use memflow::mem::scan::Pattern;
+    ///
+    /// let pattern = Pattern::from_ida("48 8B 05 ? ? ? ? 48").unwrap();
+    /// assert_eq!(pattern.len(), 8);
+    /// assert!(Pattern::from_ida("48 8G").is_err());
+    /// ```
+    pub fn from_ida(pattern: &str) -> Result<Self> {
+        let mut bytes = Vec::new();
+        let mut mask = Vec::new();
+
+        for token in pattern.split_whitespace() {
+            if token == "?" || token == "??" {
+                bytes.push(0);
+                mask.push(0);
+            } else if token.len() == 2 {
+                let byte = u8::from_str_radix(token, 16)
+                    .map_err(|_| Error::Other("malformed pattern byte"))?;
+                bytes.push(byte);
+                mask.push(0xff);
+            } else {
+                return Err(Error::Other("malformed pattern byte"));
+            }
+        }
+
+        Self::new(&bytes, &mask)
+    }
+
+    pub fn len(&self) -> usize {
+        self.bytes.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.bytes.is_empty()
+    }
+
+    #[inline]
+    fn matches(&self, window: &[u8]) -> bool {
+        window
+            .iter()
+            .zip(self.mask.iter())
+            .zip(self.bytes.iter())
+            .all(|((w, m), b)| w & m == *b)
+    }
+
+    /// Calls `f` with every offset in `buf[..limit]` at which the pattern matches.
+    ///
+    /// Matches may extend past `limit` but not past the end of the buffer.
+    fn find_all<F: FnMut(usize) -> bool>(&self, isa: Isa, buf: &[u8], limit: usize, f: &mut F) {
+        if buf.len() < self.len() {
+            return;
+        }
+
+        let count = std::cmp::min(limit, buf.len() - self.len() + 1);
+        let mut stop = false;
+
+        match self.anchor {
+            Some(anchor) => {
+                let hay = &buf[anchor..anchor + count];
+                find_byte(isa, hay, self.bytes[anchor], &mut |pos| {
+                    if !stop && self.matches(&buf[pos..pos + self.len()]) {
+                        stop = !f(pos);
+                    }
+                    !stop
+                });
+            }
+            None => {
+                for pos in 0..count {
+                    if self.matches(&buf[pos..pos + self.len()]) && !f(pos) {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// A match reported by the scanner.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct ScanMatch {
+    /// Index of the matching pattern in the order they were added to the scanner
+    pub pattern: usize,
+    /// Address of the first byte of the match
+    pub address: Address,
+}
+
+/// Scans virtual memory for multiple byte patterns at once.
+///
+/// # Examples
+///
+/// ```
+/// use memflow::mem::scan::{Pattern, PatternScanner};
+/// use memflow::mem::VirtualMemory;
+/// use memflow::types::Address;
+///
+/// fn find_code<T: VirtualMemory>(virt_mem: &mut T, base: Address, size: usize) -> Option<Address> {
+///     let scanner = PatternScanner::new()
+///         .pattern(Pattern::from_ida("48 8B 05 ? ? ? ? 48 89 81").unwrap());
+///
+///     let mut matches = Vec::new();
+///     scanner.scan(virt_mem, base, base + size, &mut matches);
+///     matches.first().map(|m| m.address)
+/// }
+/// # use memflow::mem::dummy::DummyMemory;
+/// # use memflow::types::size;
+/// # let mut buf = vec![0u8; size::kb(64)];
+/// # buf[0x1234..0x123e].copy_from_slice(&[0x48, 0x8b, 0x05, 1, 2, 3, 4, 0x48, 0x89, 0x81]);
+/// # let (mut mem, virt_base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &buf);
+/// # assert_eq!(find_code(&mut mem, virt_base, size::kb(64)), Some(virt_base + 0x1234));
+/// ```
+#[derive(Debug, Clone)]
+pub struct PatternScanner {
+    patterns: Vec<Pattern>,
+    chunk_size: usize,
+    batch_size: usize,
+    isa: Isa,
+}
+
+impl Default for PatternScanner {
+    fn default() -> Self {
+        Self {
+            patterns: Vec::new(),
+            chunk_size: size::kb(64),
+            batch_size: 16,
+            isa: Isa::detect(),
+        }
+    }
+}
+
+impl PatternScanner {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Adds a pattern to the scanner.
+    pub fn pattern(mut self, pattern: Pattern) -> Self {
+        self.patterns.push(pattern);
+        self
+    }
+
+    /// Adds a pattern to an existing scanner.
+    pub fn add_pattern(&mut self, pattern: Pattern) {
+        self.patterns.push(pattern);
+    }
+
+    /// Size of a single chunk of memory that is scanned at once.
+    ///
+    /// The chunk size is rounded up to the next power of two and is at least 4kb.
+    pub fn chunk_size(mut self, chunk_size: usize) -> Self {
+        self.chunk_size = std::cmp::max(chunk_size, size::kb(4)).next_power_of_two();
+        self
+    }
+
+    /// Amount of chunks that are read in a single batched read.
+    ///
+    /// Each batch is fetched with a single `virt_read_raw_list_status` call and buffered
+    /// while it is being scanned, so the translation of a batch is done in one pass.
+    pub fn batch_size(mut self, batch_size: usize) -> Self {
+        self.batch_size = std::cmp::max(batch_size, 1);
+        self
+    }
+
+    pub fn patterns(&self) -> &[Pattern] {
+        &self.patterns
+    }
+
+    /// Scans all mapped pages between `start` and `end` and pushes all matches into `out`.
+    ///
+    /// Matches are reported in ascending address order. Pages that fail to read are skipped.
+    pub fn scan<V: VirtualMemory + ?Sized, E: Extend<ScanMatch>>(
+        &self,
+        virt_mem: &mut V,
+        start: Address,
+        end: Address,
+        out: &mut E,
+    ) {
+        self.scan_with(virt_mem, start, end, |m| {
+            out.extend(Some(m));
+            true
+        })
+    }
+
+    /// Scans all mapped pages between `start` and `end` and calls `f` for every match.
+    ///
+    /// Returning `false` from the callback stops the scan.
+    pub fn scan_with<V: VirtualMemory + ?Sized, F: FnMut(ScanMatch) -> bool>(
+        &self,
+        virt_mem: &mut V,
+        start: Address,
+        end: Address,
+        mut f: F,
+    ) {
+        let max_len = match self.patterns.iter().map(Pattern::len).max() {
+            Some(len) => len,
+            None => return,
+        };
+
+        // every chunk is extended by the length of the longest pattern
+        // so matches that cross chunk boundaries are found as well
+        let chunks = virt_mem
+            .virt_page_map_range(0, start, end)
+            .into_iter()
+            .flat_map(|(base, size)| {
+                let chunk_size = self.chunk_size;
+                let range_end = base + size;
+                let first = base.as_page_aligned(chunk_size);
+                (0..)
+                    .map(move |i| first + i * chunk_size)
+                    .take_while(move |&chunk| chunk < range_end)
+                    .map(move |chunk| {
+                        let chunk_start = std::cmp::max(chunk, base);
+                        let chunk_end = std::cmp::min(chunk + chunk_size, range_end);
+                        let read_end = std::cmp::min(chunk_end + (max_len - 1), range_end);
+                        (chunk_start, chunk_end - chunk_start, read_end - chunk_start)
+                    })
+            })
+            .collect::<Vec<_>>();
+
+        let batch_size = self.batch_size;
+        let mut batched = 0;
+        let mut buffers = chunks.into_iter().double_buffered_map(
+            move |chunk| {
+                batched += 1;
+                if batched == batch_size {
+                    batched = 0;
+                    (false, chunk)
+                } else {
+                    (true, chunk)
+                }
+            },
+            |chunks: &mut VecDeque<(Address, usize, usize)>,
+             out: &mut VecDeque<(Address, usize, Vec<u8>)>| {
+                let mut bufs = chunks
+                    .iter()
+                    .map(|&(_, _, read_len)| vec![0u8; read_len])
+                    .collect::<Vec<_>>();
+                let mut status = vec![false; bufs.len()];
+
+                let mut read_list = chunks
+                    .iter()
+                    .zip(bufs.iter_mut())
+                    .map(|(&(addr, _, _), buf)| VirtualReadData(addr, buf))
+                    .collect::<Vec<_>>();
+                let res = virt_mem.virt_read_raw_list_status(&mut read_list, &mut status);
+                std::mem::drop(read_list);
+
+                if res.is_ok() {
+                    out.extend(
+                        chunks
+                            .iter()
+                            .zip(bufs.into_iter())
+                            .zip(status.into_iter())
+                            .filter(|(_, ok)| *ok)
+                            .map(|((&(addr, len, _), buf), _)| (addr, len, buf)),
+                    );
+                }
+                chunks.clear();
+            },
+        );
+
+        let mut matches = Vec::new();
+        while let Some((addr, len, buf)) = buffers.next() {
+            matches.clear();
+            for (idx, pattern) in self.patterns.iter().enumerate() {
+                pattern.find_all(self.isa, &buf, len, &mut |pos| {
+                    matches.push(ScanMatch {
+                        pattern: idx,
+                        address: addr + pos,
+                    });
+                    true
+                });
+            }
+
+            matches.sort_unstable_by_key(|m| (m.address, m.pattern));
+            for m in matches.iter() {
+                if !f(*m) {
+                    return;
+                }
+            }
+        }
+    }
+
+    /// Scans a local buffer which is located at `base` in the target.
+    pub fn scan_buffer<E: Extend<ScanMatch>>(&self, base: Address, buf: &[u8], out: &mut E) {
+        let mut matches = Vec::new();
+        for (idx, pattern) in self.patterns.iter().enumerate() {
+            pattern.find_all(self.isa, buf, buf.len(), &mut |pos| {
+                matches.push(ScanMatch {
+                    pattern: idx,
+                    address: base + pos,
+                });
+                true
+            });
+        }
+        matches.sort_unstable_by_key(|m| (m.address, m.pattern));
+        out.extend(matches);
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Isa {
+    Scalar,
+    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+    Sse2,
+    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+    Avx2,
+}
+
+impl Isa {
+    #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+    fn detect() -> Self {
+        if is_x86_feature_detected!("avx2") {
+            Isa::Avx2
+        } else if is_x86_feature_detected!("sse2") {
+            Isa::Sse2
+        } else {
+            Isa::Scalar
+        }
+    }
+
+    #[cfg(not(any(target_arch = "x86", target_arch = "x86_64")))]
+    fn detect() -> Self {
+        Isa::Scalar
+    }
+}
+
+/// Calls `f` with the position of every occurence of `byte` in `hay` until it returns `false`.
+fn find_byte<F: FnMut(usize) -> bool>(isa: Isa, hay: &[u8], byte: u8, f: &mut F) {
+    match isa {
+        #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+        Isa::Avx2 => unsafe { simd::find_byte_avx2(hay, byte, f) },
+        #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+        Isa::Sse2 => unsafe { simd::find_byte_sse2(hay, byte, f) },
+        Isa::Scalar => find_byte_scalar(hay, 0, byte, f),
+    }
+}
+
+#[inline]
+fn find_byte_scalar<F: FnMut(usize) -> bool>(hay: &[u8], offset: usize, byte: u8, f: &mut F) {
+    for (pos, _) in hay
+        .iter()
+        .enumerate()
+        .skip(offset)
+        .filter(|(_, &b)| b == byte)
+    {
+        if !f(pos) {
+            return;
+        }
+    }
+}
+
+#[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+mod simd {
+    use super::find_byte_scalar;
+
+    #[cfg(target_arch = "x86")]
+    use std::arch::x86::*;
+    #[cfg(target_arch = "x86_64")]
+    use std::arch::x86_64::*;
+
+    #[target_feature(enable = "sse2")]
+    pub unsafe fn find_byte_sse2<F: FnMut(usize) -> bool>(hay: &[u8], byte: u8, f: &mut F) {
+        let needle = _mm_set1_epi8(byte as i8);
+        let mut pos = 0;
+        while pos + 16 <= hay.len() {
+            let block = _mm_loadu_si128(hay.as_ptr().add(pos) as *const __m128i);
+            let mut mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)) as u32;
+            while mask != 0 {
+                if !f(pos + mask.trailing_zeros() as usize) {
+                    return;
+                }
+                mask &= mask - 1;
+            }
+            pos += 16;
+        }
+        find_byte_scalar(hay, pos, byte, f)
+    }
+
+    #[target_feature(enable = "avx2")]
+    pub unsafe fn find_byte_avx2<F: FnMut(usize) -> bool>(hay: &[u8], byte: u8, f: &mut F) {
+        let needle = _mm256_set1_epi8(byte as i8);
+        let mut pos = 0;
+        while pos + 32 <= hay.len() {
+            let block = _mm256_loadu_si256(hay.as_ptr().add(pos) as *const __m256i);
+            let mut mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)) as u32;
+            while mask != 0 {
+                if !f(pos + mask.trailing_zeros() as usize) {
+                    return;
+                }
+                mask &= mask - 1;
+            }
+            pos += 32;
+        }
+        find_byte_scalar(hay, pos, byte, f)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+
+    fn all_isas() -> Vec<Isa> {
+        let mut isas = vec![Isa::Scalar];
+        #[cfg(any(target_arch = "x86", target_arch = "x86_64"))]
+        {
+            if is_x86_feature_detected!("sse2") {
+                isas.push(Isa::Sse2);
+            }
+            if is_x86_feature_detected!("avx2") {
+                isas.push(Isa::Avx2);
+            }
+        }
+        isas
+    }
+
+    #[test]
+    fn pattern_find_all_isas() {
+        let mut buf = vec![0x48u8; 1000];
+        let pattern = Pattern::from_ida("48 8B ? 05").unwrap();
+        let expected = vec![3, 64, 65 + 31, 995];
+        for &pos in expected.iter() {
+            buf[pos + 1] = 0x8b;
+            buf[pos + 2] = pos as u8;
+            buf[pos + 3] = 0x05;
+        }
+
+        for isa in all_isas() {
+            let mut found = Vec::new();
+            pattern.find_all(isa, &buf, buf.len(), &mut |pos| {
+                found.push(pos);
+                true
+            });
+            assert_eq!(found, expected, "{:?}", isa);
+        }
+    }
+
+    #[test]
+    fn pattern_wildcards_only() {
+        let pattern = Pattern::from_ida("? ??").unwrap();
+        let mut found = 0;
+        pattern.find_all(Isa::detect(), &[0u8; 16], 16, &mut |_| {
+            found += 1;
+            true
+        });
+        assert_eq!(found, 15);
+    }
+
+    #[test]
+    fn scan_across_chunks() {
+        let mut buf = vec![0u8; size::kb(64)];
+        let first = [0xde, 0xad, 0xbe, 0xef];
+        let second = [0xca, 0xfe];
+        // crosses the first 4kb chunk boundary
+        buf[0xffe..0x1002].copy_from_slice(&first);
+        buf[0x8000..0x8002].copy_from_slice(&second);
+        buf[0x9000..0x9004].copy_from_slice(&first);
+
+        let (mut mem, virt_base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &buf);
+
+        let scanner = PatternScanner::new()
+            .chunk_size(size::kb(4))
+            .batch_size(3)
+            .pattern(Pattern::from_ida("DE AD ? EF").unwrap())
+            .pattern(Pattern::new(&second, &[0xff, 0xf0]).unwrap());
+
+        let mut matches = Vec::new();
+        scanner.scan(&mut mem, virt_base, virt_base + buf.len(), &mut matches);
+        assert_eq!(
+            matches,
+            vec![
+                ScanMatch {
+                    pattern: 0,
+                    address: virt_base + 0xffe
+                },
+                ScanMatch {
+                    pattern: 1,
+                    address: virt_base + 0x8000
+                },
+                ScanMatch {
+                    pattern: 0,
+                    address: virt_base + 0x9000
+                },
+            ]
+        );
+    }
+}
@@ -0,0 +1,207 @@
+/*!
+Statistics of the caching layers and connectors.
+
+The counters are only stored and updated when memflow is compiled with the `stats` feature.
+Without it the caching layers do not contain any counters, all recording functions are empty
+and get optimized out entirely, only the accessors remain and report zeroed statistics.
+
+The translation latency histogram additionally requires the `std` feature.
+
+All statistics are plain `repr(C)` structs so they can be passed through the FFI as is.
+Histograms use base 2 logarithmic buckets, bucket `i` counts the values in the range `[2^(i-1), 2^i)`,
+bucket 0 counts zeroes and the last bucket all values that exceed the histogram.
+
+# Examples
+
+```
+use memflow::architecture::x86::x64;
+use memflow::mem::{CachedMemoryAccess, PhysicalMemory};
+
+fn print_stats<T: PhysicalMemory>(mem: T) {
+    let mut cache = CachedMemoryAccess::builder(mem)
+        .arch(x64::ARCH)
+        .build()
+        .unwrap();
+
+    let _: u64 = cache.phys_read(0.into()).unwrap();
+
+    let stats = cache.page_cache_stats();
+    println!("hits={} misses={}", stats.hits, stats.misses);
+}
+# use memflow::mem::dummy::DummyMemory;
+# use memflow::types::size;
+# print_stats(DummyMemory::new(size::mb(4)));
+```
+*/
+
+use crate::mem::{PhysicalReadData, PhysicalWriteData};
+
+/// The amount of buckets of the batch size histogram of a connector.
+pub const BATCH_SIZE_BUCKETS: usize = 16;
+
+/// The amount of buckets of the translation latency histogram.
+pub const LATENCY_BUCKETS: usize = 32;
+
+/// Statistics of a single page cache.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct PageCacheStats {
+    /// Page chunks that were served from the cache.
+    pub hits: u64,
+    /// Page chunks that had to be read from the underlying memory.
+    pub misses: u64,
+    /// Pages that were (re)validated and stored in the cache.
+    pub validations: u64,
+}
+
+/// Statistics of the accesses that reached a connector.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ConnectorStats {
+    pub read_calls: u64,
+    pub read_entries: u64,
+    pub read_bytes: u64,
+    pub write_calls: u64,
+    pub write_entries: u64,
+    pub write_bytes: u64,
+    /// Histogram of the amount of entries per read and write call.
+    pub batch_size_histogram: [u64; BATCH_SIZE_BUCKETS],
+}
+
+/// Statistics of a virtual address translation cache.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct TranslateStats {
+    /// Page translations that were served from the TLB.
+    pub tlb_hits: u64,
+    /// Page translations that required a page walk.
+    pub tlb_misses: u64,
+    /// Valid TLB entries that were replaced by another translation.
+    pub tlb_evictions: u64,
+    /// Histogram of the duration of page walk batches in nanoseconds.
+    pub latency_ns_histogram: [u64; LATENCY_BUCKETS],
+}
+
+/// Statistics of an entire memory stack, from the translation down to the connector.
+#[repr(C)]
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct MemoryStats {
+    pub page_cache: PageCacheStats,
+    pub page_table_cache: PageCacheStats,
+    pub connector: ConnectorStats,
+    pub translate: TranslateStats,
+}
+
+/// Storage of the statistics `S` inside of a caching layer.
+///
+/// Without the `stats` feature this is zero sized, recording is a no-op and `get` returns zeroed statistics.
+#[derive(Debug, Clone, Copy, Default)]
+pub(crate) struct StatsRecorder<S> {
+    #[cfg(feature = "stats")]
+    stats: S,
+    #[cfg(not(feature = "stats"))]
+    _stats: core::marker::PhantomData<S>,
+}
+
+impl<S: Copy + Default> StatsRecorder<S> {
+    #[inline(always)]
+    pub(crate) fn get(&self) -> S {
+        #[cfg(feature = "stats")]
+        {
+            self.stats
+        }
+        #[cfg(not(feature = "stats"))]
+        {
+            S::default()
+        }
+    }
+
+    #[inline(always)]
+    pub(crate) fn reset(&mut self) {
+        *self = Self::default();
+    }
+
+    #[inline(always)]
+    pub(crate) fn record<F: FnOnce(&mut S)>(&mut self, _record: F) {
+        #[cfg(feature = "stats")]
+        _record(&mut self.stats);
+    }
+}
+
+impl StatsRecorder<PageCacheStats> {
+    #[inline(always)]
+    pub(crate) fn record_hit(&mut self) {
+        self.record(|stats| stats.hits += 1);
+    }
+
+    #[inline(always)]
+    pub(crate) fn record_miss(&mut self) {
+        self.record(|stats| stats.misses += 1);
+    }
+
+    #[inline(always)]
+    pub(crate) fn record_validation(&mut self) {
+        self.record(|stats| stats.validations += 1);
+    }
+}
+
+impl StatsRecorder<ConnectorStats> {
+    #[inline(always)]
+    pub(crate) fn record_read(&mut self, data: &[PhysicalReadData]) {
+        self.record(|stats| {
+            stats.read_calls += 1;
+            stats.read_entries += data.len() as u64;
+            stats.read_bytes += data.iter().map(|d| d.1.len() as u64).sum::<u64>();
+            stats.batch_size_histogram[log2_bucket(data.len() as u64, BATCH_SIZE_BUCKETS)] += 1;
+        });
+    }
+
+    #[inline(always)]
+    pub(crate) fn record_write(&mut self, data: &[PhysicalWriteData]) {
+        self.record(|stats| {
+            stats.write_calls += 1;
+            stats.write_entries += data.len() as u64;
+            stats.write_bytes += data.iter().map(|d| d.1.len() as u64).sum::<u64>();
+            stats.batch_size_histogram[log2_bucket(data.len() as u64, BATCH_SIZE_BUCKETS)] += 1;
+        });
+    }
+}
+
+/// Records a value in a logarithmic histogram.
+#[inline(always)]
+#[allow(unused)]
+pub(crate) fn record_histogram(histogram: &mut [u64], value: u64) {
+    histogram[log2_bucket(value, histogram.len())] += 1;
+}
+
+#[inline(always)]
+#[allow(unused)]
+fn log2_bucket(value: u64, buckets: usize) -> usize {
+    core::cmp::min(64 - value.leading_zeros() as usize, buckets - 1)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn histogram_buckets() {
+        assert_eq!(log2_bucket(0, 16), 0);
+        assert_eq!(log2_bucket(1, 16), 1);
+        assert_eq!(log2_bucket(2, 16), 2);
+        assert_eq!(log2_bucket(3, 16), 2);
+        assert_eq!(log2_bucket(4, 16), 3);
+        assert_eq!(log2_bucket(1 << 20, 16), 15);
+        assert_eq!(log2_bucket(!0, 16), 15);
+    }
+
+    #[test]
+    fn recorder_size() {
+        let size = core::mem::size_of::<StatsRecorder<ConnectorStats>>();
+        if cfg!(feature = "stats") {
+            assert_eq!(size, core::mem::size_of::<ConnectorStats>());
+        } else {
+            assert_eq!(size, 0);
+        }
+    }
+}
@@ -1,5 +1,8 @@
 use std::prelude::v1::*;
 
+pub mod pointer_chain;
+pub use pointer_chain::PointerChain;
+
 pub mod virtual_dma;
 pub use virtual_dma::VirtualDMA;
 
@@ -63,6 +66,53 @@ where
         end: Address,
     ) -> Vec<(Address, usize)>;
 
+    /// Reads a list of values and reports the outcome of every entry separately.
+    ///
+    /// After the call `status[i]` is `true` if `data[i]` was fully read and `false` if
+    /// any part of it could not be translated. Failed regions are zeroed out, the
+    /// remainder of the batch is still read.
+    ///
+    /// `status` has to be at least as long as `data`, otherwise `Error::Bounds` is returned.
+    ///
+    /// The default implementation falls back to reading entries one by one
+    /// whenever the batched read reports a partial failure.
+    fn virt_read_raw_list_status(
+        &mut self,
+        data: &mut [VirtualReadData],
+        status: &mut [bool],
+    ) -> Result<()> {
+        if status.len() < data.len() {
+            return Err(Error::Bounds);
+        }
+
+        match self.virt_read_raw_list(data) {
+            Ok(_) => {
+                status.iter_mut().for_each(|s| *s = true);
+                Ok(())
+            }
+            Err(PartialError::PartialVirtualRead(_)) => {
+                for (VirtualReadData(addr, out), s) in data.iter_mut().zip(status.iter_mut()) {
+                    *s = match self.virt_read_raw_into(*addr, out) {
+                        Ok(_) => true,
+                        Err(PartialError::PartialVirtualRead(_)) => false,
+                        Err(err) => return Err(err.into()),
+                    };
+                }
+                Ok(())
+            }
+            Err(err) => Err(err.into()),
+        }
+    }
+
+    /// Hints that the given virtual range is going to be read soon.
+    ///
+    /// Implementations translate the range and forward it to `PhysicalMemory::phys_prefetch_list`,
+    /// which allows a page cache to be filled in one large batch before e.g. scanning a module.
+    /// The default implementation ignores the hint.
+    fn virt_prefetch(&mut self, _addr: Address, _len: usize) -> Result<()> {
+        Ok(())
+    }
+
     // read helpers
     fn virt_read_raw_into(&mut self, addr: Address, out: &mut [u8]) -> PartialResult<()> {
         self.virt_read_raw_list(&mut [VirtualReadData(addr, out)])
@@ -144,6 +194,24 @@ where
         }
     }
 
+    /// Resolves a list of pointer chains with the pointer width of `arch`.
+    ///
+    /// All chains are resolved level by level, the pointers of one depth are read
+    /// with a single `virt_read_raw_list_status` call for all chains.
+    ///
+    /// After the call `out[i]` contains the final address of `chains[i]`,
+    /// or `Address::invalid()` if one of its pointers could not be read or was null.
+    ///
+    /// `out` has to be at least as long as `chains`, otherwise `Error::Bounds` is returned.
+    fn virt_read_ptr_chains(
+        &mut self,
+        arch: ArchitectureObj,
+        chains: &[PointerChain],
+        out: &mut [Address],
+    ) -> Result<()> {
+        pointer_chain::read_ptr_chains(self, arch, chains, out)
+    }
+
     // read pointer wrappers
     fn virt_read_ptr32_into<U: Pod + ?Sized>(
         &mut self,
@@ -181,15 +249,23 @@ where
         self.virt_read(ptr.address.into())
     }
 
-    // TODO: read into slice?
+    /// Reads a null terminated string of at most `out.len()` bytes into `out`.
+    ///
+    /// Returns the length of the string without the terminator,
+    /// or `out.len()` if the string is not terminated within the buffer.
+    fn virt_read_cstr_into(&mut self, addr: Address, out: &mut [u8]) -> PartialResult<usize> {
+        self.virt_read_raw_into(addr, out).data_part()?;
+        Ok(out
+            .iter()
+            .position(|c| *c == 0)
+            .unwrap_or_else(|| out.len()))
+    }
+
     // TODO: if len is shorter than string -> dynamically double length up to an upper bound
     fn virt_read_cstr(&mut self, addr: Address, len: usize) -> PartialResult<String> {
         let mut buf = vec![0; len];
-        self.virt_read_raw_into(addr, &mut buf).data_part()?;
-        if let Some((n, _)) = buf.iter().enumerate().find(|(_, c)| **c == 0_u8) {
-            buf.truncate(n);
-        }
-        Ok(String::from_utf8_lossy(&buf).to_string())
+        let len = self.virt_read_cstr_into(addr, &mut buf)?;
+        Ok(String::from_utf8_lossy(&buf[..len]).into_owned())
     }
 
     fn virt_batcher(&mut self) -> VirtualMemoryBatcher<Self>
@@ -212,6 +288,30 @@ impl<T: VirtualMemory + ?Sized, P: std::ops::DerefMut<Target = T> + Send> Virtua
         (**self).virt_write_raw_list(data)
     }
 
+    #[inline]
+    fn virt_read_raw_list_status(
+        &mut self,
+        data: &mut [VirtualReadData],
+        status: &mut [bool],
+    ) -> Result<()> {
+        (**self).virt_read_raw_list_status(data, status)
+    }
+
+    #[inline]
+    fn virt_read_raw_into(&mut self, addr: Address, out: &mut [u8]) -> PartialResult<()> {
+        (**self).virt_read_raw_into(addr, out)
+    }
+
+    #[inline]
+    fn virt_write_raw(&mut self, addr: Address, data: &[u8]) -> PartialResult<()> {
+        (**self).virt_write_raw(addr, data)
+    }
+
+    #[inline]
+    fn virt_prefetch(&mut self, addr: Address, len: usize) -> Result<()> {
+        (**self).virt_prefetch(addr, len)
+    }
+
     #[inline]
     fn virt_page_info(&mut self, addr: Address) -> Result<Page> {
         (**self).virt_page_info(addr)
@@ -0,0 +1,172 @@
+/*!
+Batched resolution of pointer chains.
+
+Resolving a chain like `[[[base + o1] + o2] + o3]` requires one dependent read per level.
+Resolving many chains one after another multiplies those round trips by the amount of chains.
+The resolver in this module instead walks all chains in lockstep and reads the pointers of
+every chain of the same depth with a single `virt_read_raw_list_status` call,
+so resolving thousands of chains of depth 3 only takes 3 batched reads.
+*/
+
+use std::prelude::v1::*;
+
+use super::{VirtualMemory, VirtualReadData};
+use crate::architecture::ArchitectureObj;
+use crate::error::{Error, Result};
+use crate::types::{Address, Pointer32, Pointer64};
+
+use dataview::Pod;
+
+/// A chain of pointers that is resolved starting from `base`.
+///
+/// Every offset is added to the current address before the pointer at that location is read,
+/// the chain `base, [o1, o2]` resolves to `[[base + o1] + o2]`.
+/// A chain without any offsets resolves to `base` itself.
+#[derive(Debug, Clone, Copy)]
+pub struct PointerChain<'a> {
+    pub base: Address,
+    pub offsets: &'a [usize],
+}
+
+impl<'a> PointerChain<'a> {
+    pub fn new(base: Address, offsets: &'a [usize]) -> Self {
+        Self { base, offsets }
+    }
+}
+
+/// Resolves `chains` with the pointer width of `arch`, see `VirtualMemory::virt_read_ptr_chains`.
+pub(crate) fn read_ptr_chains<V: VirtualMemory + ?Sized>(
+    virt_mem: &mut V,
+    arch: ArchitectureObj,
+    chains: &[PointerChain],
+    out: &mut [Address],
+) -> Result<()> {
+    match arch.bits() {
+        64 => read_ptr_chains_with::<V, Pointer64>(virt_mem, chains, out),
+        32 => read_ptr_chains_with::<V, Pointer32>(virt_mem, chains, out),
+        _ => Err(Error::InvalidArchitecture),
+    }
+}
+
+fn read_ptr_chains_with<V, P>(
+    virt_mem: &mut V,
+    chains: &[PointerChain],
+    out: &mut [Address],
+) -> Result<()>
+where
+    V: VirtualMemory + ?Sized,
+    P: Pod + Default + Copy + Into<Address>,
+{
+    if out.len() < chains.len() {
+        return Err(Error::Bounds);
+    }
+
+    for (out, chain) in out.iter_mut().zip(chains.iter()) {
+        *out = chain.base;
+    }
+
+    // indices of the chains that still have levels left to resolve
+    let mut pending = (0..chains.len())
+        .filter(|&i| !chains[i].offsets.is_empty())
+        .collect::<Vec<_>>();
+    let mut ptrs = vec![P::default(); pending.len()];
+    let mut status = vec![false; pending.len()];
+
+    let mut depth = 0;
+    while !pending.is_empty() {
+        let ptrs = &mut ptrs[..pending.len()];
+        let status = &mut status[..pending.len()];
+
+        let mut read_list = pending
+            .iter()
+            .zip(ptrs.iter_mut())
+            .map(|(&i, ptr)| {
+                let addr = out[i] + chains[i].offsets[depth];
+                VirtualReadData(addr, ptr.as_bytes_mut())
+            })
+            .collect::<Vec<_>>();
+        virt_mem.virt_read_raw_list_status(&mut read_list, status)?;
+        std::mem::drop(read_list);
+
+        depth += 1;
+
+        // a chain stops on the first pointer that could not be read or is null
+        let mut remaining = 0;
+        for j in 0..pending.len() {
+            let i = pending[j];
+            let addr: Address = ptrs[j].into();
+            if !status[j] || addr.is_null() {
+                out[i] = Address::invalid();
+                continue;
+            }
+
+            out[i] = addr;
+            if depth < chains[i].offsets.len() {
+                pending[remaining] = i;
+                remaining += 1;
+            }
+        }
+        pending.truncate(remaining);
+    }
+
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::architecture::x86::{x32, x64};
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    #[test]
+    fn resolve_chains() {
+        let (mut virt_mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[]);
+
+        // base + 0x10 -> a, a + 0x8 -> b, b + 0x20 -> c
+        let (a, b, c) = (base + 0x1000, base + 0x2000, base + 0x3000);
+        virt_mem.virt_write(base + 0x10, &a.as_u64()).unwrap();
+        virt_mem.virt_write(a + 0x8, &b.as_u64()).unwrap();
+        virt_mem.virt_write(b + 0x20, &c.as_u64()).unwrap();
+        virt_mem.virt_write(base + 0x40, &0u64).unwrap();
+
+        let chains = [
+            PointerChain::new(base, &[0x10, 0x8, 0x20]),
+            PointerChain::new(base, &[0x10]),
+            PointerChain::new(base, &[]),
+            PointerChain::new(base, &[0x40, 0x8]),
+            PointerChain::new(base + size::mb(2), &[0x10]),
+        ];
+        let mut out = [Address::null(); 5];
+        virt_mem
+            .virt_read_ptr_chains(x64::ARCH, &chains, &mut out)
+            .unwrap();
+
+        assert_eq!(out[0], c);
+        assert_eq!(out[1], a);
+        assert_eq!(out[2], base);
+        assert_eq!(out[3], Address::invalid());
+        assert_eq!(out[4], Address::invalid());
+    }
+
+    #[test]
+    fn resolve_chains_x32() {
+        let (mut virt_mem, base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &[]);
+
+        virt_mem.virt_write(base, &0x1234_5678u32).unwrap();
+
+        let chains = [PointerChain::new(base, &[0]), PointerChain::new(base, &[])];
+        let mut out = [Address::null(); 1];
+        assert_eq!(
+            virt_mem.virt_read_ptr_chains(x32::ARCH, &chains, &mut out),
+            Err(Error::Bounds)
+        );
+
+        let mut out = [Address::null(); 2];
+        virt_mem
+            .virt_read_ptr_chains(x32::ARCH, &chains, &mut out)
+            .unwrap();
+        assert_eq!(out[0], Address::from(0x1234_5678u64));
+        assert_eq!(out[1], base);
+    }
+}
@@ -139,6 +139,129 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualD
     }
 }
 
+/// Submits the translated reads in batches sized by the connector's metadata.
+///
+/// If the connector benefits from merged reads the entries are coalesced first.
+fn phys_read_chunked<T: PhysicalMemory>(
+    phys_mem: &mut T,
+    arena: &Bump,
+    data: &mut [PhysicalReadData],
+) -> Result<()> {
+    let metadata = phys_mem.metadata();
+    if metadata.coalesce_size > 0 && data.len() > 1 {
+        return phys_read_coalesced(phys_mem, arena, data, metadata.coalesce_size);
+    }
+
+    let batch_size = metadata.batch_size(usize::MAX);
+    for chunk in data.chunks_mut(batch_size) {
+        phys_mem.phys_read_raw_list(chunk)?;
+    }
+    Ok(())
+}
+
+/// A range of sorted entries that is read with a single merged `PhysicalReadData`.
+#[derive(Clone, Copy)]
+struct CoalescedRun {
+    entries: (usize, usize),
+    addr: PhysicalAddress,
+    size: usize,
+}
+
+impl CoalescedRun {
+    #[inline]
+    fn is_merged(&self) -> bool {
+        self.entries.1 - self.entries.0 > 1
+    }
+}
+
+/// Sorts the reads by their physical address and merges adjacent or overlapping entries
+/// of the same page type into reads of at most `coalesce_size` bytes.
+///
+/// Merged reads go through a bounce buffer in `arena` and are scattered back
+/// into the original buffers afterwards, single entries are read in place.
+fn phys_read_coalesced<T: PhysicalMemory>(
+    phys_mem: &mut T,
+    arena: &Bump,
+    data: &mut [PhysicalReadData],
+    coalesce_size: usize,
+) -> Result<()> {
+    data.sort_unstable_by_key(|PhysicalReadData(addr, _)| addr.address());
+
+    let mut runs = BumpVec::new_in(arena);
+    let mut scratch_size = 0;
+    let mut first = 0;
+    while first < data.len() {
+        let addr = data[first].0;
+        let base = addr.address();
+        let mut end = base + data[first].1.len();
+        let mut last = first + 1;
+        while let Some(PhysicalReadData(next, buf)) = data.get(last) {
+            let next_end = std::cmp::max(end, next.address() + buf.len());
+            if next.address() > end
+                || next.page_type() != addr.page_type()
+                || next_end - base > coalesce_size
+            {
+                break;
+            }
+            end = next_end;
+            last += 1;
+        }
+
+        let run = CoalescedRun {
+            entries: (first, last),
+            addr,
+            size: end - base,
+        };
+        if run.is_merged() {
+            scratch_size += run.size;
+        }
+        runs.push(run);
+        first = last;
+    }
+
+    let scratch = arena.alloc_slice_fill_copy(scratch_size, 0u8);
+    let mut read_list = BumpVec::with_capacity_in(runs.len(), arena);
+    let mut rest = &mut scratch[..];
+    let mut entries = data.iter_mut();
+    for run in runs.iter() {
+        if run.is_merged() {
+            entries.nth(run.entries.1 - run.entries.0 - 1);
+            let (buf, tail) = rest.split_at_mut(run.size);
+            read_list.push(PhysicalReadData(run.addr, buf));
+            rest = tail;
+        } else if let Some(PhysicalReadData(addr, buf)) = entries.next() {
+            read_list.push(PhysicalReadData(*addr, &mut buf[..]));
+        }
+    }
+
+    let batch_size = phys_mem.metadata().batch_size(usize::MAX);
+    for chunk in read_list.chunks_mut(batch_size) {
+        phys_mem.phys_read_raw_list(chunk)?;
+    }
+    std::mem::drop(read_list);
+
+    let mut offset = 0;
+    for run in runs.iter().filter(|run| run.is_merged()) {
+        let base = run.addr.address();
+        for PhysicalReadData(addr, buf) in data[run.entries.0..run.entries.1].iter_mut() {
+            let start = offset + (addr.address() - base);
+            buf.copy_from_slice(&scratch[start..start + buf.len()]);
+        }
+        offset += run.size;
+    }
+
+    Ok(())
+}
+
+/// Checks whether a non-empty access is contained in a single page of the smallest page size.
+///
+/// Such an access can never be split up by the translation, regardless of the size of the mapped page.
+#[inline]
+fn fits_in_page(arch: ArchitectureObj, addr: Address, len: usize) -> bool {
+    let page_size = arch.page_size();
+    len != 0 && (addr.as_usize() & (page_size - 1)) + len <= page_size
+}
+
 impl<T, V, D> Clone for VirtualDMA<T, V, D>
 where
     T: Clone,
@@ -178,7 +301,7 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
             }),
         );
 
-        self.phys_mem.phys_read_raw_list(&mut translation)?;
+        phys_read_chunked(&mut self.phys_mem, &self.arena, &mut translation)?;
         if !partial_read {
             Ok(())
         } else {
@@ -186,6 +309,93 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
         }
     }
 
+    /// Reads that do not cross a page boundary are translated and read directly,
+    /// without going through the batched translation machinery.
+    fn virt_read_raw_into(&mut self, addr: Address, out: &mut [u8]) -> PartialResult<()> {
+        if !fits_in_page(self.translator.arch(), addr, out.len()) {
+            return self.virt_read_raw_list(&mut [VirtualReadData(addr, out)]);
+        }
+
+        match self
+            .vat
+            .virt_to_phys(&mut self.phys_mem, &self.translator, addr)
+        {
+            Ok(paddr) => Ok(self.phys_mem.phys_read_raw_into(paddr, out)?),
+            Err(_) => {
+                out.iter_mut().for_each(|v| *v = 0);
+                Err(PartialError::PartialVirtualRead(()))
+            }
+        }
+    }
+
+    /// Writes that do not cross a page boundary are translated and written directly,
+    /// without going through the batched translation machinery.
+    fn virt_write_raw(&mut self, addr: Address, data: &[u8]) -> PartialResult<()> {
+        if !fits_in_page(self.translator.arch(), addr, data.len()) {
+            return self.virt_write_raw_list(&[VirtualWriteData(addr, data)]);
+        }
+
+        match self
+            .vat
+            .virt_to_phys(&mut self.phys_mem, &self.translator, addr)
+        {
+            Ok(paddr) => Ok(self.phys_mem.phys_write_raw(paddr, data)?),
+            Err(_) => Err(PartialError::PartialVirtualRead(())),
+        }
+    }
+
+    fn virt_read_raw_list_status(
+        &mut self,
+        data: &mut [VirtualReadData],
+        status: &mut [bool],
+    ) -> Result<()> {
+        if status.len() < data.len() {
+            return Err(Error::Bounds);
+        }
+
+        self.arena.reset();
+        let mut translation = BumpVec::with_capacity_in(data.len(), &self.arena);
+
+        // failed chunks only carry their output buffer,
+        // so map them back to their entry by the buffer's memory range
+        let mut ranges = BumpVec::with_capacity_in(data.len(), &self.arena);
+        ranges.extend(
+            data.iter()
+                .enumerate()
+                .filter(|(_, VirtualReadData(_, b))| !b.is_empty())
+                .map(|(i, VirtualReadData(_, b))| (b.as_ptr() as usize, b.len(), i)),
+        );
+        ranges.sort_unstable_by_key(|&(start, _, _)| start);
+
+        status.iter_mut().for_each(|s| *s = true);
+
+        self.vat.virt_to_phys_iter(
+            &mut self.phys_mem,
+            &self.translator,
+            data.iter_mut()
+                .map(|VirtualReadData(a, b)| (*a, &mut b[..])),
+            &mut FnExtend::new(|(a, b)| translation.push(PhysicalReadData(a, b))),
+            &mut FnExtend::new(|(_, _, out): (_, _, &mut [u8])| {
+                let ptr = out.as_ptr() as usize;
+                let idx = match ranges.binary_search_by_key(&ptr, |&(start, _, _)| start) {
+                    Ok(idx) => Some(idx),
+                    Err(0) => None,
+                    Err(idx) => Some(idx - 1),
+                };
+                if let Some(&(start, len, i)) = idx.and_then(|idx| ranges.get(idx)) {
+                    if ptr < start + len {
+                        status[i] = false;
+                    }
+                }
+                for v in out.iter_mut() {
+                    *v = 0;
+                }
+            }),
+        );
+
+        phys_read_chunked(&mut self.phys_mem, &self.arena, &mut translation)
+    }
+
     fn virt_write_raw_list(&mut self, data: &[VirtualWriteData]) -> PartialResult<()> {
         self.arena.reset();
         let mut translation = BumpVec::with_capacity_in(data.len(), &self.arena);
@@ -201,7 +411,10 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
             }),
         );
 
-        self.phys_mem.phys_write_raw_list(&translation)?;
+        let batch_size = self.phys_mem.metadata().batch_size(usize::MAX);
+        for chunk in translation.chunks(batch_size) {
+            self.phys_mem.phys_write_raw_list(chunk)?;
+        }
         if !partial_read {
             Ok(())
         } else {
@@ -209,6 +422,21 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
         }
     }
 
+    fn virt_prefetch(&mut self, addr: Address, len: usize) -> Result<()> {
+        self.arena.reset();
+        let mut translation = BumpVec::new_in(&self.arena);
+
+        self.vat.virt_to_phys_iter(
+            &mut self.phys_mem,
+            &self.translator,
+            Some((addr, len)).into_iter(),
+            &mut translation,
+            &mut FnExtend::void(),
+        );
+
+        self.phys_mem.phys_prefetch_list(&translation)
+    }
+
     fn virt_page_info(&mut self, addr: Address) -> Result<Page> {
         let paddr = self
             .vat
@@ -277,3 +505,75 @@ impl<T: PhysicalMemory, V: VirtualTranslate, D: ScopedVirtualTranslate> VirtualM
             .collect()
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::mem::dummy::DummyMemory;
+    use crate::types::size;
+
+    #[test]
+    fn single_page_fast_path() {
+        let buf = (0..0x3000).map(|i| i as u8).collect::<Vec<u8>>();
+        let (mut virt_mem, virt_base) = DummyMemory::new_virt(size::mb(4), size::mb(2), &buf);
+
+        for &(offset, len) in [
+            (0x10, 8),
+            (0xff8, 8),
+            (0xffc, 8),
+            (0x1000, 0x1000),
+            (0x800, 0x1800),
+        ]
+        .iter()
+        {
+            let mut out = vec![0u8; len];
+            virt_mem
+                .virt_read_raw_into(virt_base + offset, &mut out)
+                .unwrap();
+            assert_eq!(out[..], buf[offset..offset + len]);
+        }
+
+        virt_mem
+            .virt_write_raw(virt_base + 0x1ffc, &[1, 2, 3, 4])
+            .unwrap();
+        let mut out = [0u8; 4];
+        virt_mem
+            .virt_read_raw_list(&mut [VirtualReadData(virt_base + 0x1ffc, &mut out)])
+            .unwrap();
+        assert_eq!(out, [1, 2, 3, 4]);
+
+        let mut out = [0xffu8; 8];
+        assert!(virt_mem
+            .virt_read_raw_into(Address::null() + 0x10, &mut out)
+            .is_err());
+        assert_eq!(out, [0; 8]);
+    }
+
+    #[test]
+    fn coalesced_reads() {
+        let mut mem = DummyMemory::with_seed(size::mb(1), 3);
+        let expected = mem.phys_read_raw(Address::null().into(), 0x6000).unwrap();
+
+        let mut a = [0u8; 0x1000];
+        let mut b = [0u8; 0x1000];
+        let mut c = [0u8; 0x80];
+        let mut d = [0u8; 0x100];
+        let mut e = [0u8; 0x10];
+        let mut read_list = [
+            PhysicalReadData(Address::from(0x5000).into(), &mut d[..]),
+            PhysicalReadData(Address::from(0x2000).into(), &mut b[..]),
+            PhysicalReadData(Address::from(0x1f80).into(), &mut c[..]),
+            PhysicalReadData(Address::from(0x1000).into(), &mut a[..]),
+            PhysicalReadData(Address::from(0x5040).into(), &mut e[..]),
+        ];
+
+        let arena = Bump::new();
+        phys_read_coalesced(&mut mem, &arena, &mut read_list, size::kb(8)).unwrap();
+
+        assert_eq!(a[..], expected[0x1000..0x2000]);
+        assert_eq!(b[..], expected[0x2000..0x3000]);
+        assert_eq!(c[..], expected[0x1f80..0x2000]);
+        assert_eq!(d[..], expected[0x5000..0x5100]);
+        assert_eq!(e[..], expected[0x5040..0x5050]);
+    }
+}
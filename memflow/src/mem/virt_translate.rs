@@ -1,7 +1,7 @@
 use std::prelude::v1::*;
 
 pub mod direct_translate;
-use crate::iter::SplitAtIndex;
+use crate::iter::{FnExtend, SplitAtIndex};
 pub use direct_translate::DirectTranslate;
 
 #[cfg(test)]
@@ -95,19 +95,20 @@ where
         translator: &D,
         vaddr: Address,
     ) -> Result<PhysicalAddress> {
-        let mut vec = vec![]; //Vec::new_in(&arena);
-        let mut vec_fail = vec![]; //BumpVec::new_in(&arena);
+        // a single translation can be collected without allocating any buffers
+        let mut ret = None;
+        let mut fail = None;
         self.virt_to_phys_iter(
             phys_mem,
             translator,
             Some((vaddr, 1)).into_iter(),
-            &mut vec,
-            &mut vec_fail,
+            &mut FnExtend::new(|(paddr, _): (PhysicalAddress, usize)| ret = Some(paddr)),
+            &mut FnExtend::new(|(err, _, _): (Error, Address, usize)| fail = Some(err)),
         );
-        if let Some(ret) = vec.pop() {
-            Ok(ret.0)
-        } else {
-            Err(vec_fail.pop().unwrap().0)
+        match (ret, fail) {
+            (Some(paddr), _) => Ok(paddr),
+            (None, Some(err)) => Err(err),
+            (None, None) => Err(Error::VirtualTranslate),
         }
     }
 }
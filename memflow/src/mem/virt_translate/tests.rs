@@ -1,7 +1,7 @@
 use crate::architecture::x86::x64;
 
 use crate::mem::dummy::DummyMemory;
-use crate::mem::{DirectTranslate, VirtualDMA, VirtualMemory, VirtualTranslate};
+use crate::mem::{DirectTranslate, VirtualDMA, VirtualMemory, VirtualReadData, VirtualTranslate};
 use crate::types::size;
 
 #[test]
@@ -302,3 +302,40 @@ fn test_virt_write_big_shifted() {
     assert_eq!(buf.to_vec().len(), input.len());
     assert_eq!(buf.to_vec(), input);
 }
+
+#[test]
+fn test_virt_read_list_status() {
+    let mut dummy_mem = DummyMemory::new(size::mb(2));
+    let mut buf = vec![0u8; 0x1000 * 4];
+    for (i, item) in buf.iter_mut().enumerate() {
+        *item = i as u8;
+    }
+    let (dtb, virt_base) = dummy_mem.alloc_dtb(buf.len(), &buf);
+    let translator = x64::new_translator(dtb);
+    let arch = x64::ARCH;
+    let mut virt_mem = VirtualDMA::new(&mut dummy_mem, arch, translator);
+
+    let mut out1 = [0xffu8; 0x10];
+    let mut out2 = [0xffu8; 0x10];
+    let mut out3 = [0xffu8; 0x10];
+    let mut out4 = [0xffu8; 0x20];
+    let mut status = [false; 4];
+    virt_mem
+        .virt_read_raw_list_status(
+            &mut [
+                VirtualReadData(virt_base, &mut out1),
+                VirtualReadData(virt_base + buf.len(), &mut out2),
+                VirtualReadData(virt_base + 0x1000, &mut out3),
+                VirtualReadData(virt_base + buf.len() - 0x10, &mut out4),
+            ],
+            &mut status,
+        )
+        .unwrap();
+
+    assert_eq!(status, [true, false, true, false]);
+    assert_eq!(out1[..], buf[..0x10]);
+    assert_eq!(out2, [0u8; 0x10]);
+    assert_eq!(out3[..], buf[0x1000..0x1010]);
+    assert_eq!(out4[..0x10], buf[buf.len() - 0x10..]);
+    assert_eq!(out4[0x10..], [0u8; 0x10]);
+}